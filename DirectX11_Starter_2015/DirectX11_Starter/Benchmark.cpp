@@ -0,0 +1,314 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "EntitySystem.h"
+#include "Entity.h"
+#include "DrawnMesh.h"
+#include "Resources.h"
+#include "Logger.h"
+
+//60hz, so the fixed timestep matches what the frame budget is measured against
+const static float DEFAULT_TIMESTEP = 1.0f / 60.0f;
+//The orbit circles the middle of the map, looking at it
+const static float ORBIT_RADIUS = 20.0f;
+const static float ORBIT_HEIGHT = 6.0f;
+const static float ORBIT_SECONDS = 30.0f;//For one full turn
+const static float SPAWN_SPACING = 2.5f;//Between neighbours in the spawn grid
+const static float SPAWN_JITTER = 0.8f;//How far off their grid point they can be, as a fraction of the spacing
+
+//Splits on spaces, a quoted argument can have spaces in it
+static std::vector<std::string> SplitCommandLine(const char* cmdLine)
+{
+	std::vector<std::string> args;
+	const char* p = cmdLine;
+	while (p != nullptr && *p != 0) {
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == 0) break;
+		std::string arg;
+		if (*p == '"') {
+			p++;
+			while (*p != 0 && *p != '"') arg += *p++;
+			if (*p == '"') p++;
+		}
+		else {
+			while (*p != 0 && *p != ' ' && *p != '\t') arg += *p++;
+		}
+		args.push_back(arg);
+	}
+	return args;
+}
+
+//The same numbers every run, so spawned layouts are repeatable
+static unsigned int NextRandom(unsigned int& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static float RandomRange(unsigned int& state, float low, float high)
+{
+	return low + (high - low) * (NextRandom(state) & 0xFFFF) / 65535.0f;
+}
+
+//Nearest rank, sorted has to be sorted already
+static float GetPercentile(const std::vector<float>& sorted, float percentile)
+{
+	if (sorted.empty()) return 0.0f;
+	int rank = (int)std::ceil(percentile * sorted.size()) - 1;
+	if (rank < 0) rank = 0;
+	if (rank >= (int)sorted.size()) rank = (int)sorted.size() - 1;
+	return sorted[rank];
+}
+
+static void WriteStatistics(std::ofstream& out, std::vector<float>& values)
+{
+	std::sort(values.begin(), values.end());
+	double total = 0;
+	for (unsigned int v = 0; v < values.size(); v++) total += values[v];
+	out << "{\"frames\":" << values.size();
+	if (!values.empty()) {
+		out << ",\"mean\":" << total / values.size() << ",\"min\":" << values.front() << ",\"p50\":" << GetPercentile(values, 0.5f) <<
+			",\"p95\":" << GetPercentile(values, 0.95f) << ",\"p99\":" << GetPercentile(values, 0.99f) << ",\"max\":" << values.back();
+	}
+	out << "}";
+}
+
+bool Benchmark::ParseCommandLine(const char* cmdLine, BenchmarkSettings& settings)
+{
+	settings.mapPath = "";
+	settings.cameraPath = "";
+	settings.outputPath = "benchmark";
+	settings.numFrames = DEFAULT_NUM_FRAMES;
+	settings.numWarmupFrames = DEFAULT_NUM_WARMUP_FRAMES;
+	settings.numSpawnedEntities = 0;
+	settings.timestep = DEFAULT_TIMESTEP;
+	settings.useGPUCulling = false;
+
+	std::vector<std::string> args = SplitCommandLine(cmdLine);
+	bool isBenchmark = false;
+	for (unsigned int a = 0; a < args.size(); a++) {
+		const std::string& arg = args[a];
+		bool hasValue = a + 1 < args.size();
+		if (arg == "-benchmark") isBenchmark = true;
+		else if (arg == "-map" && hasValue) settings.mapPath = args[++a];
+		else if (arg == "-camera" && hasValue) settings.cameraPath = args[++a];
+		else if (arg == "-out" && hasValue) settings.outputPath = args[++a];
+		else if (arg == "-frames" && hasValue) settings.numFrames = atoi(args[++a].c_str());
+		else if (arg == "-warmup" && hasValue) settings.numWarmupFrames = atoi(args[++a].c_str());
+		else if (arg == "-entities" && hasValue) settings.numSpawnedEntities = atoi(args[++a].c_str());
+		else if (arg == "-gpuculling") settings.useGPUCulling = true;
+		else LogText("--ERROR--//Unknown command line argument " + arg + ", it will be ignored.");
+	}
+	if (settings.numFrames < 1) settings.numFrames = 1;
+	if (settings.numWarmupFrames < 0) settings.numWarmupFrames = 0;
+	if (settings.numSpawnedEntities < 0) settings.numSpawnedEntities = 0;
+	return isBenchmark;
+}
+
+Benchmark::Benchmark(const BenchmarkSettings& newSettings)
+{
+	settings = newSettings;
+	samples.reserve(settings.numFrames);
+	numRecordedFrames = 0;
+	firstProfilerFrame = 0;
+	numDrainFrames = 0;
+	isFinished = false;
+}
+
+void Benchmark::LoadCameraPath()
+{
+	keyframes.clear();
+	if (settings.cameraPath.empty()) return;
+	std::ifstream file(settings.cameraPath);
+	if (!file.is_open()) {
+		LogText("--ERROR--//Cant find the camera path, the benchmark will orbit instead.");
+		return;
+	}
+	Keyframe keyframe;
+	while (file >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >>
+		keyframe.rotation.x >> keyframe.rotation.y >> keyframe.rotation.z) {
+		//Out of order keyframes would make the blend go backwards
+		if (!keyframes.empty() && keyframe.time <= keyframes.back().time) continue;
+		keyframes.push_back(keyframe);
+	}
+	if (keyframes.empty()) LogText("--ERROR--//Camera path has no keyframes, the benchmark will orbit instead.");
+}
+
+void Benchmark::GetCameraPose(DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& rotation) const
+{
+	float time = GetTime();
+	if (keyframes.empty()) {
+		float angle = time / ORBIT_SECONDS * DirectX::XM_2PI;
+		position = DirectX::XMFLOAT3(std::sin(angle) * ORBIT_RADIUS, ORBIT_HEIGHT, -std::cos(angle) * ORBIT_RADIUS);
+		//Rotations are pitch, yaw and roll, and a camera with none looks down +z
+		float horizontal = std::sqrt(position.x * position.x + position.z * position.z);
+		rotation = DirectX::XMFLOAT3(std::atan2(position.y, horizontal), std::atan2(-position.x, -position.z), 0.0f);
+		return;
+	}
+	unsigned int next = 0;
+	while (next < keyframes.size() && keyframes[next].time <= time) next++;
+	if (next == 0 || next == keyframes.size()) {
+		const Keyframe& held = keyframes[next == 0 ? 0 : next - 1];
+		position = held.position;
+		rotation = held.rotation;
+		return;
+	}
+	const Keyframe& from = keyframes[next - 1];
+	const Keyframe& to = keyframes[next];
+	float t = (time - from.time) / (to.time - from.time);
+	DirectX::XMStoreFloat3(&position, DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&from.position), DirectX::XMLoadFloat3(&to.position), t));
+	DirectX::XMStoreFloat3(&rotation, DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&from.rotation), DirectX::XMLoadFloat3(&to.rotation), t));
+}
+
+int Benchmark::SpawnEntities(EntitySystem* entSys, Render* render, Resources* res, const ResourceHandle* meshes, int numMeshes, Material* material)
+{
+	int count = settings.numSpawnedEntities;
+	if (count <= 0 || numMeshes <= 0) return 0;
+	int side = (int)std::ceil(std::pow((double)count, 1.0 / 3.0));
+	float halfExtent = (side - 1) * SPAWN_SPACING * 0.5f;
+	unsigned int randomState = 0x9E3779B9;
+	int numSpawned = 0;
+	for (int s = 0; s < count; s++) {
+		EntityHandle entity = entSys->AddEntity();
+		if (!entSys->IsHandleValid(entity)) {
+			LogText("--ERROR--//Entity system is full, the benchmark has fewer entities than asked for.");
+			break;
+		}
+		float jitter = SPAWN_SPACING * SPAWN_JITTER * 0.5f;
+		DirectX::XMFLOAT3 position(
+			(s % side) * SPAWN_SPACING - halfExtent + RandomRange(randomState, -jitter, jitter),
+			((s / side) % side) * SPAWN_SPACING - halfExtent + RandomRange(randomState, -jitter, jitter),
+			(s / (side * side)) * SPAWN_SPACING - halfExtent + RandomRange(randomState, -jitter, jitter));
+		Transform& transform = entSys->GetEntity(entity)->GetTransform();
+		transform.SetPosition(position);
+		transform.SetRotation(DirectX::XMFLOAT3(RandomRange(randomState, 0.0f, DirectX::XM_2PI),
+			RandomRange(randomState, 0.0f, DirectX::XM_2PI), 0.0f));
+		ResourceHandle mesh = meshes[s % numMeshes];
+		res->AddMeshReference(mesh);
+		entSys->AddDrawnMesh(entity, DrawnMesh(render, res->GetMesh(mesh), material, mesh));
+		entSys->SetStatic(entity, s % SPAWN_DYNAMIC_INTERVAL != 0);
+		numSpawned++;
+	}
+	return numSpawned;
+}
+
+bool Benchmark::RecordFrame(const Profiler& profiler)
+{
+	if (isFinished) return false;
+	int numMeasuredFrames = numRecordedFrames - settings.numWarmupFrames;
+	const Profiler::Frame* frame = profiler.GetLastFrame();
+	if (frame != nullptr && numMeasuredFrames >= 0 && numMeasuredFrames < settings.numFrames) {
+		if (samples.empty()) firstProfilerFrame = frame->number;
+		FrameSample sample;
+		sample.cpuMilliseconds = (frame->end - frame->start) / 1000.0f;
+		sample.gpuMilliseconds = -1.0f;
+		for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) sample.counters[c] = frame->counters[c];
+		samples.push_back(sample);
+		AddScopeTimes(frame->cpuEvents, false);
+	}
+
+	//GPU timings show up a few frames late, for a frame that's already a sample
+	const Profiler::Frame* gpuFrame = profiler.GetLastGPUFrame();
+	if (gpuFrame != nullptr && !samples.empty() && gpuFrame->number >= firstProfilerFrame) {
+		unsigned int s = gpuFrame->number - firstProfilerFrame;
+		if (s < samples.size() && samples[s].gpuMilliseconds < 0.0f) {
+			samples[s].gpuMilliseconds = Profiler::GetGPUDuration(*gpuFrame) / 1000.0f;
+			AddScopeTimes(gpuFrame->gpuEvents, true);
+		}
+	}
+
+	if (numMeasuredFrames < settings.numFrames) {
+		numRecordedFrames++;
+		return false;
+	}
+	//Whatever still hasn't come in by now never will
+	numDrainFrames++;
+	if (numDrainFrames <= Profiler::NUM_QUERY_FRAMES) return false;
+	isFinished = true;
+	return true;
+}
+
+void Benchmark::AddScopeTimes(const std::vector<Profiler::Event>& events, bool isGPU)
+{
+	for (unsigned int e = 0; e < events.size(); e++) {
+		const Profiler::Event& event = events[e];
+		unsigned int t = 0;
+		while (t < scopeTotals.size() && (scopeTotals[t].isGPU != isGPU || strcmp(scopeTotals[t].name, event.name) != 0)) t++;
+		if (t == scopeTotals.size()) {
+			ScopeTotal total;
+			total.name = event.name;
+			total.isGPU = isGPU;
+			total.milliseconds = 0;
+			scopeTotals.push_back(total);
+		}
+		scopeTotals[t].milliseconds += (event.end - event.start) / 1000.0;
+	}
+}
+
+bool Benchmark::WriteResults() const
+{
+	bool wroteCSV = WriteCSV(settings.outputPath + ".csv");
+	bool wroteJSON = WriteJSON(settings.outputPath + ".json");
+	return wroteCSV && wroteJSON;
+}
+
+//One row per measured frame, a GPU time of -1 means it never came in
+bool Benchmark::WriteCSV(const std::string& path) const
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out.is_open()) {
+		LogText("--ERROR--//Couldn't write the benchmark's frames.");
+		return false;
+	}
+	out << "frame,cpu_ms,gpu_ms";
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) out << "," << Profiler::GetCounterName(c);
+	out << "\n";
+	for (unsigned int s = 0; s < samples.size(); s++) {
+		out << s << "," << samples[s].cpuMilliseconds << "," << samples[s].gpuMilliseconds;
+		for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) out << "," << samples[s].counters[c];
+		out << "\n";
+	}
+	return out.good();
+}
+
+bool Benchmark::WriteJSON(const std::string& path) const
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out.is_open()) {
+		LogText("--ERROR--//Couldn't write the benchmark's summary.");
+		return false;
+	}
+	std::vector<float> cpuTimes;
+	std::vector<float> gpuTimes;
+	for (unsigned int s = 0; s < samples.size(); s++) {
+		cpuTimes.push_back(samples[s].cpuMilliseconds);
+		if (samples[s].gpuMilliseconds >= 0.0f) gpuTimes.push_back(samples[s].gpuMilliseconds);
+	}
+	out << "{\n\"map\":\"" << Profiler::EscapeJSON(settings.mapPath) << "\",\n\"cameraPath\":\"" << Profiler::EscapeJSON(settings.cameraPath) << "\",\n\"frames\":" << samples.size() <<
+		",\n\"warmupFrames\":" << settings.numWarmupFrames << ",\n\"spawnedEntities\":" << settings.numSpawnedEntities <<
+		",\n\"timestep\":" << settings.timestep << ",\n\"gpuCulling\":" << (settings.useGPUCulling ? "true" : "false") << ",\n\"cpuMilliseconds\":";
+	WriteStatistics(out, cpuTimes);
+	out << ",\n\"gpuMilliseconds\":";
+	WriteStatistics(out, gpuTimes);
+
+	//Averaged over the frames that had them, GPU scopes only count frames whose timings came in
+	out << ",\n\"scopes\":[";
+	for (unsigned int t = 0; t < scopeTotals.size(); t++) {
+		size_t numFrames = scopeTotals[t].isGPU ? gpuTimes.size() : samples.size();
+		out << (t > 0 ? "," : "") << "\n{\"name\":\"" << Profiler::EscapeJSON(scopeTotals[t].name) << "\",\"gpu\":" << (scopeTotals[t].isGPU ? "true" : "false") <<
+			",\"meanMilliseconds\":" << (numFrames > 0 ? scopeTotals[t].milliseconds / numFrames : 0.0) << "}";
+	}
+	out << "\n],\n\"counters\":{";
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+		double total = 0;
+		for (unsigned int s = 0; s < samples.size(); s++) total += (double)samples[s].counters[c];
+		out << (c > 0 ? "," : "") << "\n\"" << Profiler::GetCounterName(c) << "\":" << (samples.empty() ? 0.0 : total / samples.size());
+	}
+	out << "\n}\n}\n";
+	return out.good();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "Profiler.h"
+
+class EntitySystem;
+class Render;
+class Resources;
+class Material;
+struct ResourceHandle;
+
+struct BenchmarkSettings {
+	std::string mapPath;//Empty for the game's own map
+	std::string cameraPath;//Keyframe file, empty for the built in orbit
+	std::string outputPath;//Gets .csv and .json added
+	int numFrames;
+	int numWarmupFrames;//Run first and left out of the results
+	int numSpawnedEntities;
+	float timestep;
+	bool useGPUCulling;
+};
+
+//Plays the same frames every run: a fixed timestep, the camera on a path instead of the keyboard and mouse,
+//and a set number of frames. Every frame's times and counters go to a CSV, percentiles and per scope averages to a JSON.
+//Camera path files have a keyframe per line, a time in seconds then a position and a rotation, three numbers each.
+//Positions and rotations are blended linearly between keyframes and hold still past the last one
+class Benchmark
+{
+public:
+	const static int DEFAULT_NUM_FRAMES = 1000;
+	const static int DEFAULT_NUM_WARMUP_FRAMES = 60;
+
+	//False without -benchmark. Everything else is optional:
+	//-map <path> -camera <path> -frames <count> -warmup <count> -entities <count> -out <path without extension> -gpuculling
+	static bool ParseCommandLine(const char* cmdLine, BenchmarkSettings& settings);
+
+	Benchmark(const BenchmarkSettings& newSettings);
+
+	const BenchmarkSettings& GetSettings() const { return settings; }
+	//Falls back to the orbit if the file isn't there or has no keyframes
+	void LoadCameraPath();
+	void GetCameraPose(DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& rotation) const;
+	float GetTime() const { return numRecordedFrames * settings.timestep; }
+	//Static entities spread evenly through a cube, with every SPAWN_DYNAMIC_INTERVAL one left dynamic.
+	//Always the same layout for the same count. Each entity takes a reference on its mesh, the caller keeps its own.
+	//Returns how many fit in the entity system
+	int SpawnEntities(EntitySystem* entSys, Render* render, Resources* res, const ResourceHandle* meshes, int numMeshes, Material* material);
+
+	//After every EndFrame. True once, when every frame is in and the GPU has had time to catch up
+	bool RecordFrame(const Profiler& profiler);
+	bool IsFinished() const { return isFinished; }
+	bool WriteResults() const;
+private:
+	const static int SPAWN_DYNAMIC_INTERVAL = 8;
+
+	struct Keyframe {
+		float time;
+		DirectX::XMFLOAT3 position;
+		DirectX::XMFLOAT3 rotation;
+	};
+	struct FrameSample {
+		float cpuMilliseconds;
+		float gpuMilliseconds;//Negative if the GPU timings never came in
+		long long counters[NUM_PROFILE_COUNTERS];
+	};
+	//Inclusive time summed over every measured frame, for each scope name
+	struct ScopeTotal {
+		const char* name;
+		bool isGPU;
+		double milliseconds;
+	};
+
+	BenchmarkSettings settings;
+	std::vector<Keyframe> keyframes;
+	std::vector<FrameSample> samples;
+	std::vector<ScopeTotal> scopeTotals;
+	int numRecordedFrames;//Warmup included
+	unsigned int firstProfilerFrame;//The profiler's number for samples[0]
+	int numDrainFrames;
+	bool isFinished;
+
+	void AddScopeTimes(const std::vector<Profiler::Event>& events, bool isGPU);
+	bool WriteCSV(const std::string& path) const;
+	bool WriteJSON(const std::string& path) const;
+};
@@ -0,0 +1,51 @@
+#include "BlockPool.h"
+#include <cstdint>
+
+BlockPool::BlockPool(size_t newBlockSize, int newBlocksPerChunk)
+{
+	if (newBlockSize < sizeof(FreeBlock)) newBlockSize = sizeof(FreeBlock);
+	blockSize = (newBlockSize + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+	blocksPerChunk = newBlocksPerChunk > 0 ? newBlocksPerChunk : 1;
+	freeList = nullptr;
+	numAllocated = 0;
+}
+
+BlockPool::~BlockPool()
+{
+	for (unsigned int c = 0; c < chunks.size(); c++) {
+		delete[] chunks[c];
+	}
+}
+
+void* BlockPool::Allocate()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (freeList == nullptr) AddChunk();
+	FreeBlock* block = freeList;
+	freeList = block->next;
+	numAllocated++;
+	return block;
+}
+
+void BlockPool::Free(void* block)
+{
+	if (block == nullptr) return;
+	std::lock_guard<std::mutex> lock(mutex);
+	FreeBlock* freeBlock = (FreeBlock*)block;
+	freeBlock->next = freeList;
+	freeList = freeBlock;
+	numAllocated--;
+}
+
+//Every block of the new chunk goes on the free list, in order so the first ones handed out are next to each other
+void BlockPool::AddChunk()
+{
+	unsigned char* chunk = new unsigned char[blockSize * blocksPerChunk + BLOCK_ALIGNMENT];
+	chunks.push_back(chunk);
+	uintptr_t first = ((uintptr_t)chunk + BLOCK_ALIGNMENT - 1) & ~(uintptr_t)(BLOCK_ALIGNMENT - 1);
+	for (int b = blocksPerChunk - 1; b >= 0; b--) {
+		FreeBlock* block = (FreeBlock*)(first + b * blockSize);
+		block->next = freeList;
+		freeList = block;
+	}
+}
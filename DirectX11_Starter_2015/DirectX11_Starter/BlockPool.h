@@ -0,0 +1,40 @@
+#pragma once
+#include <mutex>
+#include <vector>
+
+//Blocks that are all the same size, cut out of big chunks. Freed blocks go on a list and are the first ones handed
+//out again, so making and deleting the same kind of object over and over stops going to the heap.
+//Chunks are only given back when the pool goes. Thread safe
+class BlockPool
+{
+public:
+	const static size_t BLOCK_ALIGNMENT = 16;
+
+	BlockPool(size_t newBlockSize, int newBlocksPerChunk);
+	~BlockPool();
+
+	void* Allocate();
+	void Free(void* block);//Has to have come from this pool
+
+	size_t GetBlockSize() const { return blockSize; }
+	int GetNumAllocated() const { return numAllocated; }
+	int GetNumChunks() const { return (int)chunks.size(); }
+private:
+	//Free blocks hold the pointer to the next one in the space they aren't using
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	size_t blockSize;//Rounded up to BLOCK_ALIGNMENT
+	int blocksPerChunk;
+	std::vector<unsigned char*> chunks;
+	FreeBlock* freeList;
+	int numAllocated;
+	std::mutex mutex;
+
+	void AddChunk();
+
+	//Copying would delete the chunks twice
+	BlockPool(const BlockPool&);
+	BlockPool& operator=(const BlockPool&);
+};
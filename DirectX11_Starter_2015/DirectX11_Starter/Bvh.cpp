@@ -0,0 +1,227 @@
+#include "Bvh.h"
+#include "Frustum.h"
+#include "LinearArena.h"
+#include <algorithm>
+#include <math.h>
+
+static void GrowBounds(BvhBounds& bounds, const BvhBounds& other)
+{
+	if (other.min.x < bounds.min.x) bounds.min.x = other.min.x;
+	if (other.min.y < bounds.min.y) bounds.min.y = other.min.y;
+	if (other.min.z < bounds.min.z) bounds.min.z = other.min.z;
+	if (other.max.x > bounds.max.x) bounds.max.x = other.max.x;
+	if (other.max.y > bounds.max.y) bounds.max.y = other.max.y;
+	if (other.max.z > bounds.max.z) bounds.max.z = other.max.z;
+}
+
+static float GetBoundsCenter(const BvhBounds& bounds, int axis)
+{
+	return 0.5f * ((&bounds.min.x)[axis] + (&bounds.max.x)[axis]);
+}
+
+Bvh::Bvh()
+{
+}
+
+void Bvh::Build(const int* ids, const BvhBounds* bounds, int count, LinearArena& scratch)
+{
+	Clear();
+	if (count <= 0) return;
+	items.resize(count);
+	itemBounds.resize(count);
+	for (int i = 0; i < count; i++) {
+		items[i].id = ids[i];
+		items[i].buildIndex = i;
+		itemBounds[i] = bounds[i];
+	}
+	//A binary tree with at least one item per leaf never has more than this
+	nodes.reserve(2 * count);
+	BuildNode(0, count, scratch);
+}
+
+void Bvh::Refit(const BvhBounds* bounds)
+{
+	for (unsigned int i = 0; i < items.size(); i++) {
+		itemBounds[i] = bounds[items[i].buildIndex];
+	}
+	for (int n = (int)nodes.size() - 1; n >= 0; n--) {
+		UpdateNodeBounds(n);
+	}
+}
+
+void Bvh::Clear()
+{
+	nodes.clear();
+	items.clear();
+	itemBounds.clear();
+}
+
+int Bvh::BuildNode(int first, int count, LinearArena& scratch)
+{
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(Node());
+	if (count <= MAX_ITEMS_PER_LEAF) {
+		nodes[nodeIndex].rightChildOrFirstItem = first;
+		nodes[nodeIndex].numItems = count;
+		UpdateNodeBounds(nodeIndex);
+		return nodeIndex;
+	}
+
+	//Split where the centers are spread out the most
+	BvhBounds centers;
+	centers.min = centers.max = DirectX::XMFLOAT3(GetBoundsCenter(itemBounds[first], 0), GetBoundsCenter(itemBounds[first], 1), GetBoundsCenter(itemBounds[first], 2));
+	for (int i = first + 1; i < first + count; i++) {
+		BvhBounds center;
+		center.min = center.max = DirectX::XMFLOAT3(GetBoundsCenter(itemBounds[i], 0), GetBoundsCenter(itemBounds[i], 1), GetBoundsCenter(itemBounds[i], 2));
+		GrowBounds(centers, center);
+	}
+	int axis = 0;
+	float longest = centers.max.x - centers.min.x;
+	if (centers.max.y - centers.min.y > longest) { axis = 1; longest = centers.max.y - centers.min.y; }
+	if (centers.max.z - centers.min.z > longest) { axis = 2; }
+
+	//Half the items on each side, items and their bounds have to move together.
+	//The scratch space is given back before the children need theirs, so it never holds more than one node's worth
+	size_t mark = scratch.GetMark();
+	int* order = scratch.Allocate<int>(count);
+	for (int i = 0; i < count; i++) {
+		order[i] = first + i;
+	}
+	int half = count / 2;
+	std::nth_element(order, order + half, order + count, [this, axis](int a, int b) {
+		return GetBoundsCenter(itemBounds[a], axis) < GetBoundsCenter(itemBounds[b], axis);
+	});
+	Item* sortedItems = scratch.Allocate<Item>(count);
+	BvhBounds* sortedBounds = scratch.Allocate<BvhBounds>(count);
+	for (int i = 0; i < count; i++) {
+		sortedItems[i] = items[order[i]];
+		sortedBounds[i] = itemBounds[order[i]];
+	}
+	for (int i = 0; i < count; i++) {
+		items[first + i] = sortedItems[i];
+		itemBounds[first + i] = sortedBounds[i];
+	}
+	scratch.Rewind(mark);
+
+	BuildNode(first, half, scratch);
+	int rightChild = BuildNode(first + half, count - half, scratch);
+	nodes[nodeIndex].rightChildOrFirstItem = rightChild;
+	nodes[nodeIndex].numItems = 0;
+	UpdateNodeBounds(nodeIndex);
+	return nodeIndex;
+}
+
+//Children have to be up to date first
+void Bvh::UpdateNodeBounds(int nodeIndex)
+{
+	Node& node = nodes[nodeIndex];
+	if (node.numItems > 0) {
+		node.bounds = itemBounds[node.rightChildOrFirstItem];
+		for (int i = 1; i < node.numItems; i++) {
+			GrowBounds(node.bounds, itemBounds[node.rightChildOrFirstItem + i]);
+		}
+	}
+	else {
+		node.bounds = nodes[nodeIndex + 1].bounds;
+		GrowBounds(node.bounds, nodes[node.rightChildOrFirstItem].bounds);
+	}
+}
+
+int Bvh::Cull(const Frustum& frustum, int* visibleIds) const
+{
+	int numVisible = 0;
+	if (nodes.empty()) return numVisible;
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		DirectX::XMFLOAT3 center((node.bounds.min.x + node.bounds.max.x) * 0.5f, (node.bounds.min.y + node.bounds.max.y) * 0.5f, (node.bounds.min.z + node.bounds.max.z) * 0.5f);
+		DirectX::XMFLOAT3 extents(node.bounds.max.x - center.x, node.bounds.max.y - center.y, node.bounds.max.z - center.z);
+		if (!frustum.IsBoxVisible(center, extents)) continue;
+		if (node.numItems == 0) {
+			//Median splits keep the depth around log2 of the item count, so this never fills up
+			int nodeIndex = (int)(&node - &nodes[0]);
+			stack[stackSize++] = node.rightChildOrFirstItem;
+			stack[stackSize++] = nodeIndex + 1;
+			continue;
+		}
+		for (int i = node.rightChildOrFirstItem; i < node.rightChildOrFirstItem + node.numItems; i++) {
+			const BvhBounds& bounds = itemBounds[i];
+			DirectX::XMFLOAT3 itemCenter((bounds.min.x + bounds.max.x) * 0.5f, (bounds.min.y + bounds.max.y) * 0.5f, (bounds.min.z + bounds.max.z) * 0.5f);
+			DirectX::XMFLOAT3 itemExtents(bounds.max.x - itemCenter.x, bounds.max.y - itemCenter.y, bounds.max.z - itemCenter.z);
+			if (frustum.IsBoxVisible(itemCenter, itemExtents)) visibleIds[numVisible++] = items[i].id;
+		}
+	}
+	return numVisible;
+}
+
+bool Bvh::Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, int& hitId, float& hitDistance) const
+{
+	if (nodes.empty()) return false;
+	//Stand in for infinity on axes the ray doesn't move along
+	const float bigNumber = 1e30f;
+	DirectX::XMFLOAT3 inverseDirection(
+		fabsf(direction.x) > 1e-20f ? 1.0f / direction.x : bigNumber,
+		fabsf(direction.y) > 1e-20f ? 1.0f / direction.y : bigNumber,
+		fabsf(direction.z) > 1e-20f ? 1.0f / direction.z : bigNumber);
+
+	bool hit = false;
+	float closest = maxDistance;
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		int nodeIndex = stack[--stackSize];
+		const Node& node = nodes[nodeIndex];
+		float entryDistance;
+		if (!RayHitsBounds(node.bounds, origin, inverseDirection, closest, entryDistance)) continue;
+		if (node.numItems == 0) {
+			stack[stackSize++] = node.rightChildOrFirstItem;
+			stack[stackSize++] = nodeIndex + 1;
+			continue;
+		}
+		for (int i = node.rightChildOrFirstItem; i < node.rightChildOrFirstItem + node.numItems; i++) {
+			if (RayHitsBounds(itemBounds[i], origin, inverseDirection, closest, entryDistance)) {
+				//Shrinking closest means farther boxes get skipped from here on
+				closest = entryDistance;
+				hitId = items[i].id;
+				hit = true;
+			}
+		}
+	}
+	if (hit) hitDistance = closest;
+	return hit;
+}
+
+//Slab test, entryDistance is 0 when the ray starts inside
+bool Bvh::RayHitsBounds(const BvhBounds& bounds, const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& inverseDirection, float maxDistance, float& entryDistance)
+{
+	float nearest = 0;
+	float farthest = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		float o = (&origin.x)[axis];
+		float inverse = (&inverseDirection.x)[axis];
+		float t0 = ((&bounds.min.x)[axis] - o) * inverse;
+		float t1 = ((&bounds.max.x)[axis] - o) * inverse;
+		if (t0 > t1) { float temp = t0; t0 = t1; t1 = temp; }
+		if (t0 > nearest) nearest = t0;
+		if (t1 < farthest) farthest = t1;
+		if (nearest > farthest) return false;
+	}
+	entryDistance = nearest;
+	return true;
+}
+
+//The center moves like a point, each world extent is how far the rotated and scaled local extents reach along that axis
+BvhBounds Bvh::TransformBounds(const DirectX::XMFLOAT3& localCenter, const DirectX::XMFLOAT3& localExtents, const DirectX::XMFLOAT4X4& worldMatrix)
+{
+	BvhBounds bounds;
+	for (int row = 0; row < 3; row++) {
+		float center = worldMatrix.m[row][0] * localCenter.x + worldMatrix.m[row][1] * localCenter.y + worldMatrix.m[row][2] * localCenter.z + worldMatrix.m[row][3];
+		float extent = fabsf(worldMatrix.m[row][0]) * localExtents.x + fabsf(worldMatrix.m[row][1]) * localExtents.y + fabsf(worldMatrix.m[row][2]) * localExtents.z;
+		(&bounds.min.x)[row] = center - extent;
+		(&bounds.max.x)[row] = center + extent;
+	}
+	return bounds;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+class Frustum;
+class LinearArena;
+
+//World space axis aligned box
+struct BvhBounds {
+	DirectX::XMFLOAT3 min;
+	DirectX::XMFLOAT3 max;
+};
+
+//Bounding volume hierarchy over a set of boxes, each with an id that queries hand back.
+//Nodes are stored depth first, so a node's left child is right after it and every child comes after
+//its parent, which lets Refit go through them backwards.
+class Bvh
+{
+public:
+	const static int MAX_ITEMS_PER_LEAF = 4;
+
+	Bvh();
+
+	//Splits at the median item along the axis its centers are most spread out on, until the leaves are small enough.
+	//What it needs along the way comes out of scratch and is given back before it returns
+	void Build(const int* ids, const BvhBounds* bounds, int count, LinearArena& scratch);
+	//Keeps the tree and only grows or shrinks the boxes, bounds has to be in the same order as the ids given to Build.
+	//Cheaper than a rebuild but the tree gets looser the further things move from where they started.
+	void Refit(const BvhBounds* bounds);
+	void Clear();
+
+	//Writes the id of everything that might be visible and returns how many, visibleIds needs room for GetNumItems
+	int Cull(const Frustum& frustum, int* visibleIds) const;
+	//Closest box the ray hits within maxDistance, direction doesn't have to be normalized (distance is in its lengths)
+	bool Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, int& hitId, float& hitDistance) const;
+
+	int GetNumItems() const { return (int)items.size(); }
+	int GetItemID(int item) const { return items[item].id; }//In no particular order
+	int GetNumNodes() const { return (int)nodes.size(); }
+
+	//Box around a local space box once it's moved by a world matrix, worldMatrix is stored transposed
+	static BvhBounds TransformBounds(const DirectX::XMFLOAT3& localCenter, const DirectX::XMFLOAT3& localExtents, const DirectX::XMFLOAT4X4& worldMatrix);
+private:
+	struct Node {
+		BvhBounds bounds;
+		int rightChildOrFirstItem;//Leaves point into items, other nodes at their right child
+		int numItems;//0 for a node that isn't a leaf
+	};
+	struct Item {
+		int id;
+		int buildIndex;//Where its bounds were in the arrays given to Build
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Item> items;
+	std::vector<BvhBounds> itemBounds;//Same order as items
+
+	int BuildNode(int first, int count, LinearArena& scratch);
+	void UpdateNodeBounds(int nodeIndex);
+	static bool RayHitsBounds(const BvhBounds& bounds, const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& inverseDirection, float maxDistance, float& entryDistance);
+};
@@ -3,11 +3,19 @@
 
 Camera::Camera()
 {
+	viewMatrixVersion = 0;
+	nearPlane = 0.1f;
+	farPlane = 100.0f;
+	isFrustumValid = false;
 	RecalculateViewMatrix();
 }
 
 Camera::Camera(float xPos, float yPos, float zPos)
 {
+	viewMatrixVersion = 0;
+	nearPlane = 0.1f;
+	farPlane = 100.0f;
+	isFrustumValid = false;
 	transform.SetPosition(DirectX::XMFLOAT3(xPos, yPos, zPos));
 	RecalculateViewMatrix();
 }
@@ -54,14 +62,26 @@ void Camera::Update(float dt, LONG x, LONG y)
 //Note: does not check to see if the transform actually updated
 DirectX::XMFLOAT4X4 Camera::RecalculateViewMatrix()
 {
-	if (!transform.GetIsDirty()) return viewMatrix;
+	if (viewMatrixVersion == transform.GetVersion()) return viewMatrix;
 	DirectX::XMMATRIX lookToMatrix = DirectX::XMMatrixLookToLH(DirectX::XMLoadFloat3(&transform.GetPosition()),
 		DirectX::XMLoadFloat3(&transform.GetForwardVector()),
 		DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
 	DirectX::XMStoreFloat4x4(&viewMatrix, DirectX::XMMatrixTranspose(lookToMatrix));
+	viewMatrixVersion = transform.GetVersion();
+	isFrustumValid = false;
 	return viewMatrix;
 }
 
+const Frustum& Camera::GetFrustum()
+{
+	RecalculateViewMatrix();
+	if (!isFrustumValid) {
+		frustum.SetFromViewProjection(viewMatrix, projectionMatrix);
+		isFrustumValid = true;
+	}
+	return frustum;
+}
+
 void Camera::CreatePerspectiveProjectionMatrix(float aspectRatio, float nearClippingPlane, float farClippingPlane)
 {
 	DirectX::XMMATRIX P = DirectX::XMMatrixPerspectiveFovLH(
@@ -70,4 +90,7 @@ void Camera::CreatePerspectiveProjectionMatrix(float aspectRatio, float nearClip
 		nearClippingPlane,				  	// Near clip plane distance
 		farClippingPlane);			  	// Far clip plane distance
 	XMStoreFloat4x4(&projectionMatrix, DirectX::XMMatrixTranspose(P)); // Transpose for HLSL!
+	nearPlane = nearClippingPlane;
+	farPlane = farClippingPlane;
+	isFrustumValid = false;
 }
@@ -2,6 +2,7 @@
 #include "Component.h"
 #include <DirectXMath.h>
 #include "Transform.h"
+#include "Frustum.h"
 //Temp
 #include <Windows.h>
 
@@ -19,10 +20,18 @@ public:
 
 	DirectX::XMFLOAT4X4 GetViewMatrix() { return RecalculateViewMatrix(); }
 	DirectX::XMFLOAT4X4 GetProjectionMatrix() { return projectionMatrix; }
+	float GetNearPlane() const { return nearPlane; }
+	float GetFarPlane() const { return farPlane; }
+	const Frustum& GetFrustum();//Rebuilt only when the view or projection changed
 	Transform& GetTransform() { return transform; }
 private:
 	Transform transform;
 	DirectX::XMFLOAT4X4 viewMatrix;
+	unsigned int viewMatrixVersion;//The transform version the view matrix was built from
 	DirectX::XMFLOAT4X4 projectionMatrix;
+	float nearPlane;
+	float farPlane;
+	Frustum frustum;
+	bool isFrustumValid;
 };
 
@@ -0,0 +1,64 @@
+#pragma once
+
+//Keeps every component of one type packed together so systems can update them in one tight loop.
+//Removing swaps the last component into the hole, so the packed order isn't stable.
+template <typename T>
+class ComponentPool
+{
+public:
+	ComponentPool(int newMaxNumberOfEnts)
+	{
+		maxNumberOfEnts = newMaxNumberOfEnts;
+		count = 0;
+		components = new T[maxNumberOfEnts];
+		owners = new int[maxNumberOfEnts];
+		packedIndices = new int[maxNumberOfEnts];
+		for (int e = 0; e < maxNumberOfEnts; e++) {
+			packedIndices[e] = -1;
+		}
+	}
+
+	~ComponentPool()
+	{
+		delete[] components;
+		delete[] owners;
+		delete[] packedIndices;
+	}
+
+	//Returns nullptr if the entity already has one
+	T* Add(int entityIndex, const T& component)
+	{
+		if (entityIndex < 0 || entityIndex >= maxNumberOfEnts || packedIndices[entityIndex] >= 0) return nullptr;
+		components[count] = component;
+		owners[count] = entityIndex;
+		packedIndices[entityIndex] = count;
+		count++;
+		return &components[count - 1];
+	}
+
+	void Remove(int entityIndex)
+	{
+		if (!Has(entityIndex)) return;
+		int packedIndex = packedIndices[entityIndex];
+		int last = count - 1;
+		components[packedIndex] = components[last];
+		owners[packedIndex] = owners[last];
+		packedIndices[owners[packedIndex]] = packedIndex;
+		packedIndices[entityIndex] = -1;
+		count--;
+	}
+
+	bool Has(int entityIndex) const { return entityIndex >= 0 && entityIndex < maxNumberOfEnts && packedIndices[entityIndex] >= 0; }
+	T* Get(int entityIndex) { return Has(entityIndex) ? &components[packedIndices[entityIndex]] : nullptr; }
+
+	//For iterating over the packed components
+	int GetCount() const { return count; }
+	T& operator[](int packedIndex) { return components[packedIndex]; }
+	int GetOwner(int packedIndex) const { return owners[packedIndex]; }
+private:
+	T* components;
+	int* owners;//Entity index of each packed component
+	int* packedIndices;//Where each entity's component is, -1 if it doesn't have one
+	int maxNumberOfEnts;
+	int count;
+};
@@ -0,0 +1,96 @@
+#include "ConstantBufferRing.h"
+#include "DirectXGameCore.h"
+#include <DirectXMath.h>
+#include "Logger.h"
+#include "Profiler.h"
+#include <cstring>
+
+ConstantBufferRing::ConstantBufferRing(ID3D11Device* newDevice, ID3D11DeviceContext* newContext, unsigned int size)
+{
+	device = newDevice;
+	context = nullptr;
+	buffer = nullptr;
+	capacity = size;
+	offset = 0;
+	generation = 1;//0 is left for ranges that were never written
+	needsDiscard = true;
+	wasFull = false;
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer) {
+		LogText("--Constant buffer ring off--//No D3D11.1 constant buffer offsets, constants go through UpdateSubresource.");
+		return;
+	}
+	if (FAILED(newContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&context))) {
+		context = nullptr;
+		return;
+	}
+
+	CreateBuffer();
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	ReleaseMacro(buffer);
+	ReleaseMacro(context);
+}
+
+void ConstantBufferRing::Reset()
+{
+	//Everything written before this is gone once the next write discards, so no earlier range can be bound again
+	needsDiscard = true;
+	offset = 0;
+	generation++;
+	if (wasFull && buffer != nullptr) {
+		ReleaseMacro(buffer);
+		capacity *= 2;
+		LogText("Constant buffer ring grew to " + std::to_string(capacity) + " bytes");
+		CreateBuffer();
+	}
+	wasFull = false;
+}
+
+bool ConstantBufferRing::CreateBuffer()
+{
+	D3D11_BUFFER_DESC desc;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = capacity;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+	if (FAILED(device->CreateBuffer(&desc, nullptr, &buffer))) {
+		LogText("--ERROR--//Couldn't create the constant buffer ring.");
+		buffer = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool ConstantBufferRing::Write(const void* data, unsigned int size, UINT& firstConstant, UINT& numConstants)
+{
+	if (buffer == nullptr) return false;
+	unsigned int alignedSize = (size + RANGE_ALIGNMENT - 1) & ~(RANGE_ALIGNMENT - 1);
+	if (alignedSize > capacity) return false;
+
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (needsDiscard) {
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		needsDiscard = false;
+	}
+	else if (offset + alignedSize > capacity) {
+		wasFull = true;
+		return false;
+	}
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(context->Map(buffer, 0, mapType, 0, &mapped))) return false;
+	memcpy((unsigned char*)mapped.pData + offset, data, size);
+	context->Unmap(buffer, 0);
+	Profiler::Count(PROFILE_COUNTER_CONSTANT_BYTES, size);
+
+	firstConstant = offset / CONSTANT_SIZE;
+	numConstants = alignedSize / CONSTANT_SIZE;
+	offset += alignedSize;
+	return true;
+}
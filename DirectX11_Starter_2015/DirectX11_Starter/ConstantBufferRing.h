@@ -0,0 +1,47 @@
+#pragma once
+#include <d3d11_1.h>
+
+//One big dynamic constant buffer that small blocks of constants get appended to, each draw binds its own range of it
+//with *SetConstantBuffers1. Appending maps with NO_OVERWRITE, so the driver doesn't have to copy or rename anything,
+//only the first write after Reset discards. Running out of room fails the write instead of wrapping around,
+//since discarding mid frame would pull the data out from under ranges that are still bound, and Reset grows it.
+//Belongs to one context, deferred contexts each need their own.
+//Needs D3D11.1 with constant buffer offsetting, IsSupported is false otherwise and nothing should be written
+class ConstantBufferRing
+{
+public:
+	const static unsigned int DEFAULT_SIZE = 4 * 1024 * 1024;
+	//Ranges have to start on a multiple of 16 constants of 16 bytes and be a multiple of 16 constants long
+	const static unsigned int CONSTANT_SIZE = 16;
+	const static unsigned int RANGE_ALIGNMENT = 256;
+
+	ConstantBufferRing(ID3D11Device* device, ID3D11DeviceContext* context, unsigned int size = DEFAULT_SIZE);
+	~ConstantBufferRing();
+
+	bool IsSupported() const { return buffer != nullptr; }
+	//Once per frame or command list, before anything is written. A deferred context's first map has to discard
+	void Reset();
+
+	//firstConstant and numConstants are what *SetConstantBuffers1 takes
+	bool Write(const void* data, unsigned int size, UINT& firstConstant, UINT& numConstants);
+
+	ID3D11Buffer* GetBuffer() { return buffer; }
+	ID3D11DeviceContext1* GetContext() { return context; }
+	//Changes on every Reset, after which earlier ranges no longer hold anything
+	unsigned int GetGeneration() const { return generation; }
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext1* context;
+	ID3D11Buffer* buffer;
+	unsigned int capacity;
+	unsigned int offset;//Where the next range goes
+	unsigned int generation;
+	bool needsDiscard;
+	bool wasFull;//Since the last Reset
+
+	bool CreateBuffer();
+
+	//Copying would release the buffer twice
+	ConstantBufferRing(const ConstantBufferRing&);
+	ConstantBufferRing& operator=(const ConstantBufferRing&);
+};
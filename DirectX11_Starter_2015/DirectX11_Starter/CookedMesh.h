@@ -0,0 +1,21 @@
+#pragma once
+#include "Vertex.h"
+
+//Layout of a cooked mesh file, written next to the OBJ the first time it's loaded:
+//the header, then numVerts Vertex structs, then numIndices indices of indexSize bytes, exactly as they go to the GPU
+struct CookedMeshHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int vertexSize;//sizeof(Vertex) when it was cooked, a different size means recook
+	unsigned int numVerts;
+	unsigned int numIndices;
+	unsigned int indexSize;//2 when every vertex fits in a 16 bit index, otherwise 4
+	DirectX::XMFLOAT3 boundsCenter;
+	DirectX::XMFLOAT3 boundsExtents;
+	float boundingRadius;
+	unsigned int numLODs;//Levels past the mesh itself, each cooked to its own name_lodN file
+};
+
+const char COOKED_MESH_MAGIC[4] = { 'C', 'M', 'S', 'H' };
+const unsigned int COOKED_MESH_VERSION = 4;//Bump whenever the layout or the cooking changes
+const char* const COOKED_MESH_EXTENSION = ".cmesh";
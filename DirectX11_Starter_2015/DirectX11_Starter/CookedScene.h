@@ -0,0 +1,26 @@
+#pragma once
+#include <DirectXMath.h>
+
+const static int COOKED_SCENE_NAME_LENGTH = 64;//Mesh names are stored null padded to this, longer ones can't be cooked
+
+//One model placed in the level
+struct CookedScenePlacement {
+	unsigned int meshIndex;//Into the scene's mesh name table
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT3 rotation;
+	DirectX::XMFLOAT3 scale;
+};
+
+//Layout of a cooked scene file, written next to the map the first time it's loaded:
+//the header, then numMeshNames names of COOKED_SCENE_NAME_LENGTH chars, then numPlacements CookedScenePlacements.
+//Every mesh is looked up once for the whole level, placements only carry an index
+struct CookedSceneHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int numMeshNames;
+	unsigned int numPlacements;
+};
+
+const char COOKED_SCENE_MAGIC[4] = { 'C', 'S', 'C', 'N' };
+const unsigned int COOKED_SCENE_VERSION = 1;//Bump whenever the layout changes
+const char* const COOKED_SCENE_EXTENSION = ".cscene";
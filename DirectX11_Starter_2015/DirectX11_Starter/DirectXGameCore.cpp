@@ -13,6 +13,9 @@
 #include <WindowsX.h>
 #include <sstream>
 
+// timeBeginPeriod, so PRESENT_MODE_CAPPED can sleep for less than a scheduler tick
+#pragma comment(lib, "winmm.lib")
+
 #pragma region Global Window Callback
 
 // We need a global reference to the DirectX Game so that we can
@@ -43,6 +46,9 @@ DirectXGameCore::DirectXGameCore(HINSTANCE hInstance)
 	windowCaption(L"DirectX Game"),
 	windowWidth(800),
 	windowHeight(600),
+	presentMode(PRESENT_MODE_UNCAPPED),
+	frameRateCap(60.0f),
+	maximumFrameLatency(1),
 	hMainWnd(0),
 	hasFocus(false),
 	minimized(false),
@@ -51,6 +57,24 @@ DirectXGameCore::DirectXGameCore(HINSTANCE hInstance)
 	device(0),
 	deviceContext(0),
 	swapChain(0),
+	swapChain2(0),
+	frameLatencyWaitableObject(0),
+	isFlipModel(false),
+	isTearingSupported(false),
+	isTimerPeriodRaised(false),
+	numBackBuffers(1),
+	swapChainFlags(0),
+	nextFrameTime(0),
+	useFixedTimestep(true),
+	fixedTimestep(1.0f / 60.0f),
+	maxSimulationSteps(5),
+	interpolation(1.0f),
+	usePipelinedRendering(false),
+	isRenderThreadRunning(false),
+	hasRenderFrame(false),
+	renderDeltaTime(0.0f),
+	renderTotalTime(0.0f),
+	drawnPresentMode(PRESENT_MODE_UNCAPPED),
 	depthStencilBuffer(0),
 	renderTargetView(0),
 	depthStencilView(0),
@@ -62,7 +86,9 @@ DirectXGameCore::DirectXGameCore(HINSTANCE hInstance)
 	currentTime(0),
 	previousTime(0),
 	totalTime(0.0f),
-	deltaTime(0.0f)
+	deltaTime(0.0f),
+	simulationAccumulator(0.0),
+	simulationTime(0.0)
 {
 	// Zero out the viewport struct
 	ZeroMemory(&viewport, sizeof(D3D11_VIEWPORT));
@@ -82,11 +108,19 @@ DirectXGameCore::DirectXGameCore(HINSTANCE hInstance)
 // --------------------------------------------------------
 DirectXGameCore::~DirectXGameCore(void)
 {
+	// Nothing can still be drawing while it all gets released
+	StopRenderThread();
+
 	// Release the core DirectX "stuff" we set up
 	ReleaseMacro(renderTargetView);
 	ReleaseMacro(depthStencilView);
+	ReleaseMacro(swapChain2);
 	ReleaseMacro(swapChain);
 	ReleaseMacro(depthStencilBuffer);
+	if (frameLatencyWaitableObject)
+		CloseHandle(frameLatencyWaitableObject);
+	if (isTimerPeriodRaised)
+		timeEndPeriod(1);
 
 	// Restore default device settings
 	if( deviceContext )
@@ -196,28 +230,9 @@ bool DirectXGameCore::InitDirect3D()
 	createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
-	// Set up a swap chain description - 
-	// The swap chain is used for double buffering (a.k.a. page flipping)
-	DXGI_SWAP_CHAIN_DESC swapChainDesc;
-	swapChainDesc.BufferDesc.Width = windowWidth;
-	swapChainDesc.BufferDesc.Height = windowHeight;
-	swapChainDesc.BufferDesc.RefreshRate.Numerator = 60;
-	swapChainDesc.BufferDesc.RefreshRate.Denominator = 1;
-	swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-	swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapChainDesc.BufferCount = 1;
-	swapChainDesc.OutputWindow = hMainWnd;
-	swapChainDesc.Windowed = true;
-	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-	swapChainDesc.Flags = 0;
-	swapChainDesc.SampleDesc.Count = 1;
-	swapChainDesc.SampleDesc.Quality = 0;
-	
-	// Create the device and swap chain with the following global function
+	// Create the device and context with the following global function
 	// This will also determine the supported feature level (version of DirectX)
-	HRESULT hr = D3D11CreateDeviceAndSwapChain(
+	HRESULT hr = D3D11CreateDevice(
 		0,
 		driverType,
 		0,
@@ -225,9 +240,7 @@ bool DirectXGameCore::InitDirect3D()
 		0,
 		0,
 		D3D11_SDK_VERSION,
-		&swapChainDesc,		// We pass in the description
-		&swapChain,			// And the SWAP CHAIN is created
-		&device,			// As well as the DEVICE
+		&device,			// The DEVICE is created
 		&featureLevel,		// The feature level is determined
 		&deviceContext);	// And the CONTEXT is created
 
@@ -238,12 +251,130 @@ bool DirectXGameCore::InitDirect3D()
 		return false;
 	}
 
+	// The swap chain needs the device to make it
+	if( !CreateSwapChain() )
+	{
+		MessageBox(0, L"CreateSwapChain Failed", 0, 0);
+		return false;
+	}
+
 	// There are several remaining steps before we can reasonably use DirectX.
 	// These steps also need to happen each time the window is resized, 
 	// so we simply call the OnResize method here.
 	OnResize();
 	return true;
 }
+
+// --------------------------------------------------------
+// Creates the swap chain through the factory that made the
+// device's adapter.  A flip model swap chain is tried first,
+// FLIP_DISCARD on Windows 10 and FLIP_SEQUENTIAL on 8.1, then
+// the original blt model one if neither works
+// --------------------------------------------------------
+bool DirectXGameCore::CreateSwapChain()
+{
+	IDXGIDevice* dxgiDevice = 0;
+	IDXGIAdapter* adapter = 0;
+	IDXGIFactory* factory = 0;
+	HR(device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice));
+	HR(dxgiDevice->GetAdapter(&adapter));
+	HR(adapter->GetParent(__uuidof(IDXGIFactory), (void**)&factory));
+	ReleaseMacro(adapter);
+
+	// Tearing needs DXGI 1.5 and a display and driver that can do it
+	isTearingSupported = false;
+	IDXGIFactory5* factory5 = 0;
+	if( SUCCEEDED(factory->QueryInterface(__uuidof(IDXGIFactory5), (void**)&factory5)) )
+	{
+		BOOL allowTearing = FALSE;
+		if( SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))) )
+			isTearingSupported = allowTearing == TRUE;
+		ReleaseMacro(factory5);
+	}
+
+	// Flip model needs at least two buffers, one being shown and one being drawn
+	isFlipModel = false;
+	IDXGIFactory2* factory2 = 0;
+	if( SUCCEEDED(factory->QueryInterface(__uuidof(IDXGIFactory2), (void**)&factory2)) )
+	{
+		DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+		swapChainDesc.Width = windowWidth;
+		swapChainDesc.Height = windowHeight;
+		swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		swapChainDesc.SampleDesc.Count = 1;
+		swapChainDesc.SampleDesc.Quality = 0;
+		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		swapChainDesc.BufferCount = 2;
+		swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
+		swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+		swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+		swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+		if( isTearingSupported )
+			swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+		IDXGISwapChain1* swapChain1 = 0;
+		HRESULT hr = factory2->CreateSwapChainForHwnd(device, hMainWnd, &swapChainDesc, 0, 0, &swapChain1);
+		if( FAILED(hr) )
+		{
+			// Anything that old can't tear either
+			isTearingSupported = false;
+			swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+			swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+			hr = factory2->CreateSwapChainForHwnd(device, hMainWnd, &swapChainDesc, 0, 0, &swapChain1);
+		}
+		if( SUCCEEDED(hr) )
+		{
+			swapChain = swapChain1;
+			isFlipModel = true;
+			numBackBuffers = swapChainDesc.BufferCount;
+			swapChainFlags = swapChainDesc.Flags;
+			if( SUCCEEDED(swapChain->QueryInterface(__uuidof(IDXGISwapChain2), (void**)&swapChain2)) )
+			{
+				swapChain2->SetMaximumFrameLatency(maximumFrameLatency);
+				frameLatencyWaitableObject = swapChain2->GetFrameLatencyWaitableObject();
+			}
+		}
+		ReleaseMacro(factory2);
+	}
+
+	if( !isFlipModel )
+	{
+		isTearingSupported = false;
+		DXGI_SWAP_CHAIN_DESC swapChainDesc;
+		swapChainDesc.BufferDesc.Width = windowWidth;
+		swapChainDesc.BufferDesc.Height = windowHeight;
+		swapChainDesc.BufferDesc.RefreshRate.Numerator = 60;
+		swapChainDesc.BufferDesc.RefreshRate.Denominator = 1;
+		swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
+		swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		swapChainDesc.BufferCount = 1;
+		swapChainDesc.OutputWindow = hMainWnd;
+		swapChainDesc.Windowed = true;
+		swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+		swapChainDesc.Flags = 0;
+		swapChainDesc.SampleDesc.Count = 1;
+		swapChainDesc.SampleDesc.Quality = 0;
+		factory->CreateSwapChain(device, &swapChainDesc, &swapChain);
+		numBackBuffers = 1;
+		swapChainFlags = 0;
+
+		// Without a waitable object the device is what stops the CPU from running ahead
+		IDXGIDevice1* dxgiDevice1 = 0;
+		if( SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice1), (void**)&dxgiDevice1)) )
+		{
+			dxgiDevice1->SetMaximumFrameLatency(maximumFrameLatency);
+			ReleaseMacro(dxgiDevice1);
+		}
+	}
+
+	// Alt+Enter would go to exclusive fullscreen, where tearing presents fail
+	factory->MakeWindowAssociation(hMainWnd, DXGI_MWA_NO_ALT_ENTER);
+	ReleaseMacro(factory);
+	ReleaseMacro(dxgiDevice);
+	return swapChain != 0;
+}
 #pragma endregion
 
 #pragma region Window Resizing
@@ -254,19 +385,28 @@ bool DirectXGameCore::InitDirect3D()
 // --------------------------------------------------------
 void DirectXGameCore::OnResize()
 {
+	// Messages come in on the game thread, while the render
+	// thread could still be drawing to the buffers
+	WaitForRenderThread();
+
 	// Release any existing views, since we'll be destroying
 	// the corresponding buffers.
 	ReleaseMacro(renderTargetView);
 	ReleaseMacro(depthStencilView);
 	ReleaseMacro(depthStencilBuffer);
 
-	// Resize the swap chain to match the new window dimensions
+	// The pipeline holds on to the back buffer too, and flip model
+	// swap chains can't resize while anything still does
+	deviceContext->OMSetRenderTargets(0, 0, 0);
+
+	// Resize the swap chain to match the new window dimensions,
+	// keeping the buffer count and flags it was made with
 	HR(swapChain->ResizeBuffers(
-		1, 
+		numBackBuffers, 
 		windowWidth, 
 		windowHeight, 
 		DXGI_FORMAT_R8G8B8A8_UNORM,
-		0));
+		swapChainFlags));
 
 	// Recreate the render target view that points to the swap chain's buffer
 	ID3D11Texture2D* backBuffer;
@@ -340,22 +480,213 @@ int DirectXGameCore::Run()
 		}
 		else // No message to handle
 		{
+			// Hold off until the frame should start, so
+			// the input it reads is as fresh as it can be
+			WaitForNextFrame();
+
 			// Update the timer for this frame
 			UpdateTimer();
 
 			// Standard game loop type stuff
 			CalculateFrameStats();
-			UpdateScene(deltaTime, totalTime);
-			DrawScene(deltaTime, totalTime);			
+			BeginFrame(deltaTime, totalTime);
+			StepSimulation();
+			SubmitScene(deltaTime, totalTime);
+
+			// The last frame has to be done drawing before the
+			// next one can be handed over
+			WaitForRenderThread();
+			drawnPresentMode = presentMode;
+			SwapFrames();
+			if( usePipelinedRendering )
+				DrawOnRenderThread();
+			else
+				DrawScene(deltaTime, totalTime);
 		}
 	}
 
+	// The derived class's things get released once this returns
+	StopRenderThread();
+
 	// If we make it outside the game loop, return the most
 	// recent message's exit code
 	return (int)msg.wParam;
 }
 
 
+// --------------------------------------------------------
+// Presents with the present mode's sync interval.  Tearing is
+// only allowed with a sync interval of 0, in a window
+// --------------------------------------------------------
+void DirectXGameCore::Present()
+{
+	UINT syncInterval = drawnPresentMode == PRESENT_MODE_VSYNC ? 1 : 0;
+	UINT presentFlags = (syncInterval == 0 && isTearingSupported) ? DXGI_PRESENT_ALLOW_TEARING : 0;
+	HR(swapChain->Present(syncInterval, presentFlags));
+
+	// Flip model unbinds the back buffer on every present
+	if( isFlipModel )
+		deviceContext->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+}
+
+void DirectXGameCore::SetPresentMode(int mode)
+{
+	if( mode < 0 || mode >= NUM_PRESENT_MODES )
+		return;
+	presentMode = mode;
+	nextFrameTime = 0;
+}
+
+const wchar_t* DirectXGameCore::GetPresentModeName(int mode)
+{
+	switch(mode)
+	{
+	case PRESENT_MODE_VSYNC:    return L"VSync";
+	case PRESENT_MODE_UNCAPPED: return L"Uncapped";
+	case PRESENT_MODE_CAPPED:   return L"Capped";
+	default:                    return L"???";
+	}
+}
+
+// --------------------------------------------------------
+// Waits out the rest of the frame cap, then for the swap
+// chain to have room for another frame.  Sleep is only good
+// to a scheduler tick, so the timer period is raised while
+// capped and the last couple of milliseconds are spun
+// --------------------------------------------------------
+void DirectXGameCore::WaitForNextFrame()
+{
+	bool isCapped = presentMode == PRESENT_MODE_CAPPED && frameRateCap > 0.0f;
+	if( isCapped != isTimerPeriodRaised )
+	{
+		if( isCapped ) timeBeginPeriod(1);
+		else timeEndPeriod(1);
+		isTimerPeriodRaised = isCapped;
+	}
+
+	if( isCapped )
+	{
+		__int64 ticksPerFrame = (__int64)(1.0 / (frameRateCap * perfCounterSeconds));
+		__int64 now;
+		QueryPerformanceCounter((LARGE_INTEGER*)&now);
+		while( now < nextFrameTime )
+		{
+			Sleep((nextFrameTime - now) * perfCounterSeconds > 0.002 ? 1 : 0);
+			QueryPerformanceCounter((LARGE_INTEGER*)&now);
+		}
+		// A frame that ran long doesn't make the ones after it hurry to catch up
+		if( now - nextFrameTime > ticksPerFrame )
+			nextFrameTime = now;
+		nextFrameTime += ticksPerFrame;
+	}
+
+	// At most a second, so a hung GPU doesn't hang the window too
+	if( frameLatencyWaitableObject )
+		WaitForSingleObjectEx(frameLatencyWaitableObject, 1000, true);
+}
+
+// --------------------------------------------------------
+// Hands the frame that was just swapped to the render thread,
+// starting the thread up if this is the first one
+// --------------------------------------------------------
+void DirectXGameCore::DrawOnRenderThread()
+{
+	if( !renderThread.joinable() )
+	{
+		isRenderThreadRunning = true;
+		renderThread = std::thread(&DirectXGameCore::RenderThreadLoop, this);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		renderDeltaTime = deltaTime;
+		renderTotalTime = totalTime;
+		hasRenderFrame = true;
+	}
+	renderCondition.notify_all();
+}
+
+// --------------------------------------------------------
+// The render thread - draws each frame it's handed, then
+// lets the game thread know it's free for the next one
+// --------------------------------------------------------
+void DirectXGameCore::RenderThreadLoop()
+{
+	std::unique_lock<std::mutex> lock(renderMutex);
+	while( true )
+	{
+		renderCondition.wait(lock, [this]() { return hasRenderFrame || !isRenderThreadRunning; });
+		if( !hasRenderFrame )
+			return;
+
+		lock.unlock();
+		DrawScene(renderDeltaTime, renderTotalTime);
+		lock.lock();
+
+		hasRenderFrame = false;
+		renderCondition.notify_all();
+	}
+}
+
+// --------------------------------------------------------
+// Returns once the render thread has finished its frame.
+// Returns right away if there's no render thread
+// --------------------------------------------------------
+void DirectXGameCore::WaitForRenderThread()
+{
+	std::unique_lock<std::mutex> lock(renderMutex);
+	renderCondition.wait(lock, [this]() { return !hasRenderFrame; });
+}
+
+// --------------------------------------------------------
+// Lets the render thread finish its frame, then joins it
+// --------------------------------------------------------
+void DirectXGameCore::StopRenderThread()
+{
+	if( !renderThread.joinable() )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		isRenderThreadRunning = false;
+	}
+	renderCondition.notify_all();
+	renderThread.join();
+}
+
+// --------------------------------------------------------
+// Calls UpdateScene once per fixedTimestep of time that has
+// passed, then works out how far between steps to draw
+// --------------------------------------------------------
+void DirectXGameCore::StepSimulation()
+{
+	if( !useFixedTimestep )
+	{
+		UpdateScene(deltaTime, totalTime);
+		interpolation = 1.0f;
+		return;
+	}
+
+	// The simulation runs in whole steps, whatever is left over
+	// carries into the next frame and is drawn by interpolating
+	simulationAccumulator += deltaTime;
+	int steps = 0;
+	while( simulationAccumulator >= fixedTimestep && steps < maxSimulationSteps )
+	{
+		simulationTime += fixedTimestep;
+		UpdateScene(fixedTimestep, (float)simulationTime);
+		simulationAccumulator -= fixedTimestep;
+		steps++;
+	}
+
+	// Too far behind (a breakpoint, a long load), so let the lost
+	// time go rather than trying to make it up over later frames
+	if( simulationAccumulator >= fixedTimestep )
+		simulationAccumulator = 0.0;
+
+	interpolation = (float)(simulationAccumulator / fixedTimestep);
+}
+
 // --------------------------------------------------------
 // Updates the timer stats for this frame
 // --------------------------------------------------------
@@ -405,7 +736,12 @@ void DirectXGameCore::CalculateFrameStats()
 			<< L"Width: " << windowWidth << L"    "
 			<< L"Height: " << windowHeight << L"    "
 			<< L"FPS: " << fps << L"    " 
-			<< L"Frame Time: " << mspf << L"ms";
+			<< L"Frame Time: " << mspf << L"ms    "
+			<< GetPresentModeName(presentMode);
+		if( presentMode == PRESENT_MODE_CAPPED )
+			outs << L" " << frameRateCap;
+		if( isFlipModel )
+			outs << L"    Flip";
 
 		// Include feature level
 		switch(featureLevel)
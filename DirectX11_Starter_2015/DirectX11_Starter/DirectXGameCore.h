@@ -13,7 +13,11 @@
 
 #include "Windows.h"
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <d3d11.h>
+#include <dxgi1_5.h>
 
 #include "dxerr.h"
 
@@ -57,6 +61,18 @@
 	#endif
 #endif
 
+// --------------------------------------------------------
+// How frames are paced, see DirectXGameCore::presentMode
+//  - VSYNC waits for the display's refresh every frame
+//  - UNCAPPED presents as soon as a frame is done, tearing
+//    if the display and driver allow it
+//  - CAPPED is UNCAPPED held to frameRateCap frames a second
+// --------------------------------------------------------
+const int PRESENT_MODE_VSYNC = 0;
+const int PRESENT_MODE_UNCAPPED = 1;
+const int PRESENT_MODE_CAPPED = 2;
+const int NUM_PRESENT_MODES = 3;
+
 // --------------------------------------------------------
 // The core class for the DirectX Starter Code
 // --------------------------------------------------------
@@ -73,7 +89,22 @@ public:
 	// derived classes to implement custom functionality
 	virtual bool Init();
 	virtual void OnResize(); 
+	// Called once a frame before any simulation steps, for anything
+	// that should keep up with the frame rate instead (input, camera)
+	virtual void BeginFrame(float deltaTime, float totalTime) { }
+	// One simulation step - fixedTimestep long, called as many times
+	// a frame as it takes to catch up (see useFixedTimestep)
 	virtual void UpdateScene(float deltaTime, float totalTime) = 0;
+	// Called once a frame after the simulation steps - hand the
+	// renderer everything the frame needs to draw here
+	virtual void SubmitScene(float deltaTime, float totalTime) { }
+	// Called between frames with the render thread stopped, the only
+	// time both threads can touch the same things.  Whatever was
+	// submitted gets handed over to the drawing side here
+	virtual void SwapFrames() { }
+	// Draws what the last SwapFrames handed over.  With pipelined
+	// rendering this is on the render thread, so it can't touch
+	// anything the simulation might be changing at the same time
 	virtual void DrawScene(float deltaTime, float totalTime)   = 0;
 	virtual LRESULT ProcessMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
@@ -91,6 +122,17 @@ protected:
 	// Used to properly quit the game
 	void Quit();
 
+	// Blocks until the render thread is done with its frame, so the
+	// game thread can safely use the device context (resizing, etc.)
+	void WaitForRenderThread();
+
+	// Presents the back buffer the way the present mode asks for.
+	// Call this instead of swapChain->Present, once at the end of DrawScene
+	void Present();
+	void SetPresentMode(int mode);
+	int GetPresentMode() const { return presentMode; }
+	static const wchar_t* GetPresentModeName(int mode);
+
 	// Window handles and such
 	HINSTANCE hAppInst;
 	HWND      hMainWnd;
@@ -119,8 +161,55 @@ protected:
 	std::wstring windowCaption;
 	int windowWidth;
 	int windowHeight;
+	int presentMode;            // One of the PRESENT_MODE_* values
+	float frameRateCap;         // Frames per second for PRESENT_MODE_CAPPED
+	UINT maximumFrameLatency;   // Frames the CPU can queue up ahead of the GPU, 1 for the least input lag
+	bool useFixedTimestep;      // False for one UpdateScene per frame with the frame's own deltaTime
+	float fixedTimestep;        // Seconds per simulation step
+	int maxSimulationSteps;     // Per frame, past this the simulation slows down instead of spiraling
+	bool usePipelinedRendering; // Draws each frame on a render thread while the next one simulates
+
+	// How far the frame is between the last two simulation steps,
+	// 0 at the older one and 1 at the newest.  Draw at this point
+	float interpolation;
 
 private:
+	// Flip model swap chains (Windows 8 and up) hand the buffers to the
+	// compositor instead of copying them, and the waitable object lets the
+	// game loop sleep until the swap chain can take another frame, so
+	// input is read as late as possible.  Older systems get the original
+	// blt model swap chain and none of these
+	IDXGISwapChain2*          swapChain2;
+	HANDLE                    frameLatencyWaitableObject;
+	bool                      isFlipModel;
+	bool                      isTearingSupported;
+	bool                      isTimerPeriodRaised;
+	UINT                      numBackBuffers;
+	UINT                      swapChainFlags;   // Have to be given again every ResizeBuffers
+	__int64                   nextFrameTime;    // When PRESENT_MODE_CAPPED lets the next frame start
+
+	bool CreateSwapChain();
+
+	// Waits until the next frame should start, right before input is read
+	void WaitForNextFrame();
+
+	// With pipelined rendering, frame N is drawn here while the game
+	// thread simulates and submits frame N+1.  The two only meet at
+	// SwapFrames, which costs a frame of latency but means a frame
+	// takes about as long as the slower of the two instead of both
+	std::thread               renderThread;       // Started the first time it's needed
+	std::mutex                renderMutex;
+	std::condition_variable   renderCondition;
+	bool                      isRenderThreadRunning;
+	bool                      hasRenderFrame;     // Handed over and not drawn yet
+	float                     renderDeltaTime;
+	float                     renderTotalTime;
+	int                       drawnPresentMode;   // presentMode as of the frame being drawn
+
+	void DrawOnRenderThread();
+	void RenderThreadLoop();
+	void StopRenderThread();
+
 	// Timer related data
 	double perfCounterSeconds;
 	__int64 startTime;
@@ -128,6 +217,11 @@ private:
 	__int64 previousTime;
 	float totalTime;
 	float deltaTime;
+	double simulationAccumulator; // Time the simulation is behind the frame
+	double simulationTime;
+
+	// Runs however many fixed steps the frame's time adds up to
+	void StepSimulation();
 
 	// Updates the timer for this frame
 	void UpdateTimer();
@@ -2,47 +2,76 @@
 #include "Render.h"
 #include "Transform.h"
 
+//Screen size each level takes over below, the mesh itself is drawn above the first
+const static float LOD_SCREEN_SIZES[Mesh::MAX_LODS] = { 1.0f, 0.25f, 0.1f, 0.04f };
+const static float LOD_HYSTERESIS = 0.1f;
+
 DrawnMesh::DrawnMesh()
 {
 	Component::Component();
 	render = nullptr;
 	mesh = nullptr;
+	meshHandle = INVALID_RESOURCE_HANDLE;
+	material = nullptr;
+	currentLOD = 0;
 }
 
-DrawnMesh::DrawnMesh(Render* newRender, Mesh* newMesh, Material* newMaterial)
+DrawnMesh::DrawnMesh(Render* newRender, Mesh* newMesh, Material* newMaterial, ResourceHandle newMeshHandle)
 {
 	Component::Component();
 	render = newRender;
 	mesh = newMesh;
+	meshHandle = newMeshHandle;
 	material = newMaterial;
+	currentLOD = 0;
 }
 
 DrawnMesh::~DrawnMesh()
 {
-	//Don't delete the mesh, the mesh will handle itself
+	//Don't delete the mesh, Resources owns it and the entity system gives back the reference
+}
+
+void DrawnMesh::Update()
+{
+	Component::Update();
+	Submit(GetTransform().GetWorldMatrix());
 }
 
-#include "Entity.h"
+void DrawnMesh::Submit(const DirectX::XMFLOAT4X4& worldMatrix, const LODView* lodView)
+{
+	//Meshes that are still streaming in are skipped until they're ready
+	if (render == nullptr || mesh == nullptr || !mesh->IsReady()) return;
+	currentLOD = lodView != nullptr && mesh->GetNumLODs() > 1 ? SelectLOD(worldMatrix, *lodView) : 0;
+	render->AddToRenderList(mesh->GetLOD(currentLOD), material, worldMatrix);
+}
 
-//This is just temporary, I still have to figure out how exactly I want to do rendering
-void DrawnMesh::Draw(RenderInfo& renderInfo)
+void DrawnMesh::SubmitShadowCaster(int cascade, bool isStatic, const DirectX::XMFLOAT4X4& worldMatrix)
 {
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
+	if (render == nullptr || mesh == nullptr || !mesh->IsReady()) return;
+	render->AddShadowCaster(cascade, isStatic, isStatic ? mesh : mesh->GetLOD(currentLOD), material, worldMatrix);
+}
 
-	material->PrepareMaterial(renderInfo, GetTransform());
+int DrawnMesh::SelectLOD(const DirectX::XMFLOAT4X4& worldMatrix, const LODView& lodView)
+{
+	//Stored transposed
+	DirectX::XMMATRIX world = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&worldMatrix));
+	DirectX::XMVECTOR center = DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&mesh->GetBoundsCenter()), world);
+	float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(center, DirectX::XMLoadFloat3(&lodView.position))));
+	//The biggest scale on any axis, so the sphere still holds the whole mesh
+	float scale = DirectX::XMVectorGetX(DirectX::XMVectorMax(DirectX::XMVector3LengthSq(world.r[0]),
+		DirectX::XMVectorMax(DirectX::XMVector3LengthSq(world.r[1]), DirectX::XMVector3LengthSq(world.r[2]))));
+	float radius = mesh->GetBoundingRadius() * sqrtf(scale);
+	//Inside the sphere it covers the whole screen
+	if (distance <= radius) return 0;
+	float screenSize = radius * lodView.projectionScale / distance;
 
-	if (renderInfo.currentMesh != mesh) {
-		renderInfo.deviceContext->IASetVertexBuffers(0, 1, mesh->GetVertexBuffer(), &stride, &offset);
-		renderInfo.deviceContext->IASetIndexBuffer(mesh->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
-		renderInfo.currentMesh = mesh;
-	}
-	renderInfo.deviceContext->DrawIndexed(mesh->GetNumberOfIndices(), 0, 0);
+	int lod = currentLOD < mesh->GetNumLODs() ? currentLOD : mesh->GetNumLODs() - 1;
+	while (lod + 1 < mesh->GetNumLODs() && screenSize < LOD_SCREEN_SIZES[lod + 1] * (1.0f - LOD_HYSTERESIS)) lod++;
+	while (lod > 0 && screenSize > LOD_SCREEN_SIZES[lod] * (1.0f + LOD_HYSTERESIS)) lod--;
+	return lod;
 }
 
-void DrawnMesh::Update()
+float DrawnMesh::GetLODScreenSize(int lod)
 {
-	Component::Update();
-	if (render == nullptr) return;
-	render->AddToRenderList(*this);
+	return LOD_SCREEN_SIZES[lod];
 }
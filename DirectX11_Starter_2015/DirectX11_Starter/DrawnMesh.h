@@ -4,23 +4,47 @@
 #include <d3d11.h>
 #include "SimpleShader.h"
 #include "Material.h"
+#include "ResourceRegistry.h"
 
-struct RenderInfo;
 class Render;
 
+//Where LODs are picked from, the camera's position and its projection's _22 (1 / tan(fov y / 2))
+struct LODView {
+	DirectX::XMFLOAT3 position;
+	float projectionScale;
+};
+
 class DrawnMesh : public Component
 {
 public:
 	DrawnMesh();
-	DrawnMesh(Render* newRender, Mesh* newMesh, Material* newMaterial);
+	//The mesh handle is a reference the drawn mesh takes over, the entity system gives it back when its entity is removed.
+	//Meshes nothing owns through Resources leave it invalid
+	DrawnMesh(Render* newRender, Mesh* newMesh, Material* newMaterial, ResourceHandle newMeshHandle = INVALID_RESOURCE_HANDLE);
 	~DrawnMesh();
 
-	void Draw(RenderInfo& renderInfo);
 	void Update() override;
+	//Called by the entity system for pooled drawn meshes, so there is no virtual call or transform lookup.
+	//Without a view the full mesh is always drawn
+	void Submit(const DirectX::XMFLOAT4X4& worldMatrix, const LODView* lodView = nullptr);
+	int GetCurrentLOD() const { return currentLOD; }//As of the last Submit
+	//Into one shadow cascade. Static casters get cached so they draw the full mesh, dynamic ones use the camera's LOD
+	void SubmitShadowCaster(int cascade, bool isStatic, const DirectX::XMFLOAT4X4& worldMatrix);
 
 	Mesh* GetMesh() { return mesh; }
+	ResourceHandle GetMeshHandle() const { return meshHandle; }
+	Material* GetMaterial() { return material; }
+	Render* GetRender() { return render; }
+	//Where level lod takes over, for anything else picking LODs the same way
+	static float GetLODScreenSize(int lod);
 private:
 	Render* render;
 	Mesh* mesh;
+	ResourceHandle meshHandle;
 	Material* material;
+	int currentLOD;
+
+	//Screen size is the bounding sphere's height over the screen's. A level sticks until the size is past its
+	//switch point by LOD_HYSTERESIS, so something sitting right on one doesn't flicker between the two
+	int SelectLOD(const DirectX::XMFLOAT4X4& worldMatrix, const LODView& lodView);
 };
\ No newline at end of file
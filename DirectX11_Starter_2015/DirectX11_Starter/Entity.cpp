@@ -27,3 +27,12 @@ void Entity::Update()
 		components[c]->Update();
 	}
 }
+
+void Entity::Reset()
+{
+	for (int c = 0; c < numberOfComponents; ++c) {
+		delete components[c];
+	}
+	numberOfComponents = 0;
+	transform = Transform();
+}
@@ -13,7 +13,9 @@ public:
 
 	void AddComponent(Component* newComponent);
 	void Update();
+	void Reset();//Deletes the components and puts the transform back to the default
 
+	int GetNumberOfComponents() const { return numberOfComponents; }
 	Transform& GetTransform() { return transform; }
 private:
 	Transform transform;
@@ -1,60 +1,482 @@
 #include "EntitySystem.h"
 #include "Entity.h"
 #include "Component.h"
+#include "TransformStore.h"
+#include "JobSystem.h"
+#include "Render.h"
+#include "Frustum.h"
+#include "Profiler.h"
+#include "LinearArena.h"
+#include "Resources.h"
 
-EntitySystem::EntitySystem(const int newMaxNumberOfEntsCanHold)
+EntitySystem::EntitySystem(const int newMaxNumberOfEntsCanHold, JobSystem* newJobs) : drawnMeshes(newMaxNumberOfEntsCanHold)
 {
+	jobs = newJobs;
+	resources = nullptr;
+	lastRender = nullptr;
+	cullingFrustum = nullptr;
+	hasLODView = false;
+	numCulledDrawnMeshes = 0;
 	maxNumberOfEntsCanHold = newMaxNumberOfEntsCanHold;
 	ents = new Entity[maxNumberOfEntsCanHold];
+	transforms = new TransformStore(maxNumberOfEntsCanHold);
+	for (int e = 0; e < maxNumberOfEntsCanHold; e++) {
+		ents[e].GetTransform().BindToStore(transforms, e);
+	}
+	generations = new unsigned int[maxNumberOfEntsCanHold];
+	activeEnts = new bool[maxNumberOfEntsCanHold];
+	staticEnts = new bool[maxNumberOfEntsCanHold];
+	dynamicDrawnSlots = new int[maxNumberOfEntsCanHold];
+	freeSlots = new int[maxNumberOfEntsCanHold];
+	for (int e = 0; e < maxNumberOfEntsCanHold; e++) {
+		generations[e] = 0;
+		activeEnts[e] = false;
+		staticEnts[e] = false;
+		dynamicDrawnSlots[e] = -1;
+	}
+	isDynamicSceneValid = false;
+	dynamicSceneMeshLoads = 0;
+	isStaticSceneValid = false;
+	isStaticSceneGPUCulled = false;
+	hasStaticSceneChanged = true;
+	staticSceneMeshLoads = 0;
+	numFreeSlots = 0;
 	numEnts = 0;
+	lastAddedIndex = -1;
+	transformOrder = new int[maxNumberOfEntsCanHold];
+	transformDepths = new int[maxNumberOfEntsCanHold];
+	numOrderedEnts = 0;
+	isTransformOrderValid = false;
+	transformOrderHierarchyVersion = 0;
 }
 
 EntitySystem::~EntitySystem()
 {
+	//Nothing is drawing by now, so the references can go right away
+	if (resources != nullptr) {
+		for (int d = 0; d < drawnMeshes.GetCount(); d++) {
+			resources->ReleaseMesh(drawnMeshes[d].GetMeshHandle());
+		}
+	}
 	if (ents != nullptr) {
 		delete[] ents;
 		ents = nullptr;
 	}
+	delete transforms;
+	delete[] generations;
+	delete[] activeEnts;
+	delete[] staticEnts;
+	delete[] dynamicDrawnSlots;
+	delete[] freeSlots;
+	delete[] transformOrder;
+	delete[] transformDepths;
 }
 
-void EntitySystem::Update()
+void EntitySystem::Step()
 {
-	for (int e = 0; e < numEnabledEnts; e++) {
-		ents[e].Update();
+	CPUProfileScope scope("EntitySystem::Step");
+	//Anything that isn't pooled yet still goes through the virtual update
+	for (int e = 0; e < numEnts; e++) {
+		if (activeEnts[e] && ents[e].GetNumberOfComponents() > 0) {
+			ents[e].Update();
+		}
 	}
+	UpdateTransforms();
+	transforms->EndStep();
 }
 
-// 'Adds' an entity to the active list. Also resets the entity.
-Entity* EntitySystem::AddEntity()
+void EntitySystem::SubmitDraws(float interpolation, LinearArena& frameArena)
 {
-	Entity* addedEnt = EnableEntity(numEnabledEnts);
-	if (addedEnt != nullptr) {
-		//addedEnt->Reset();
+	CPUProfileScope scope("EntitySystem::SubmitDraws");
+	UpdateRenderMatrices(interpolation);
+	UpdateDrawnMeshes(frameArena);
+}
+
+void EntitySystem::UpdateRenderMatrices(float interpolation)
+{
+	CPUProfileScope scope("Interpolation");
+	if (!isTransformOrderValid || transformOrderHierarchyVersion != Transform::GetHierarchyVersion()) {
+		RebuildTransformOrder();
 	}
-	return addedEnt;
+	transforms->UpdateRenderMatrices(transformOrder, numOrderedEnts, numEnts, interpolation);
 }
 
-Entity* EntitySystem::EnableEntity(int index)
+void EntitySystem::SetLODView(const DirectX::XMFLOAT3& position, float projectionScale)
 {
-	//Index is not in the bounds, we don't care about it
-	if (!IsEntityIndexValid(index)) return nullptr;
-	//We are already active do nothing
-	if (IsEntityActive(index)) return &ents[index];
-	if (index >= numEnabledEnts && index < numEnts) {
-		//Entity temp = ents[index];
-		std::swap(ents[index], ents[numEnabledEnts]);
-		numEnabledEnts++;
-		return &ents[index];
+	lodView.position = position;
+	lodView.projectionScale = projectionScale;
+	hasLODView = true;
+}
+
+void EntitySystem::UpdateDrawnMeshes(LinearArena& frameArena)
+{
+	CPUProfileScope scope("Draw list build");
+	numCulledDrawnMeshes = 0;
+	Render* render = GetRender();
+	//A streamed in mesh might belong in the static tree
+	if (staticSceneMeshLoads != Mesh::GetNumFinishedLoads()) isStaticSceneValid = false;
+	if (render != nullptr && render->GetUseGPUCulling() != isStaticSceneGPUCulled) isStaticSceneValid = false;
+	if (!isStaticSceneValid) BuildStaticScenes(frameArena);
+	UpdateDynamicScene(frameArena);
+
+	int numDrawnMeshes = drawnMeshes.GetCount();
+	if (numDrawnMeshes == 0) return;
+	//Every drawn mesh adds at most one draw, so making room up front lets them all add at once
+	if (cullingFrustum == nullptr) {
+		//The static tree then the dynamic list, so the GPU culled ones are never gone through
+		int numStatic = staticScene.GetNumItems();
+		int numSubmitted = numStatic + (int)dynamicDrawnEnts.size();
+		if (render != nullptr) render->ReserveDraws(numSubmitted);
+		auto submitAll = [this, numStatic](int start, int end) {
+			const LODView* view = hasLODView ? &lodView : nullptr;
+			for (int s = start; s < end; s++) {
+				int e = s < numStatic ? staticScene.GetItemID(s) : dynamicDrawnEnts[s - numStatic];
+				drawnMeshes.Get(e)->Submit(transforms->GetRenderMatrix(e), view);
+			}
+		};
+		if (jobs != nullptr) {
+			jobs->ParallelFor(numSubmitted, MIN_DRAWN_MESHES_PER_JOB, submitAll);
+		}
+		else {
+			submitAll(0, numSubmitted);
+		}
+		SubmitShadowCasters(render, frameArena);
+		return;
+	}
+
+	int* visibleEnts = frameArena.Allocate<int>(staticScene.GetNumItems() + dynamicScene.GetNumItems());
+	int numVisible = staticScene.Cull(*cullingFrustum, visibleEnts);
+	numVisible += dynamicScene.Cull(*cullingFrustum, visibleEnts + numVisible);
+	//The GPU culled ones are never looked at here
+	numCulledDrawnMeshes = numDrawnMeshes - gpuCulledScene.GetNumItems() - numVisible;
+	if (render != nullptr) render->ReserveDraws(numVisible);
+	auto submitVisible = [this, visibleEnts](int start, int end) {
+		const LODView* view = hasLODView ? &lodView : nullptr;
+		for (int v = start; v < end; v++) {
+			int e = visibleEnts[v];
+			drawnMeshes.Get(e)->Submit(transforms->GetRenderMatrix(e), view);
+		}
+	};
+	if (jobs != nullptr) {
+		jobs->ParallelFor(numVisible, MIN_DRAWN_MESHES_PER_JOB, submitVisible);
+	}
+	else {
+		submitVisible(0, numVisible);
+	}
+	SubmitShadowCasters(render, frameArena);
+}
+
+void EntitySystem::SubmitShadowCasters(Render* render, LinearArena& frameArena)
+{
+	CPUProfileScope scope("Shadow casters");
+	if (render == nullptr) return;
+	if (hasStaticSceneChanged) {
+		render->InvalidateStaticShadows();
+		hasStaticSceneChanged = false;
+	}
+	//Every cascade's casters are submitted before the next one is culled, so they can all share the same space
+	int* shadowCasters = frameArena.Allocate<int>(staticScene.GetNumItems() + gpuCulledScene.GetNumItems() + dynamicScene.GetNumItems());
+	for (int c = 0; c < render->GetNumShadowCascades(); c++) {
+		const Frustum& frustum = render->GetShadowFrustum(c);
+		//Cached static casters only have to be sent when the cache is about to be redrawn, static ones go first.
+		//The GPU culled ones are static too, they only skip the camera's culling
+		int numStatic = 0;
+		if (render->NeedsStaticShadowCasters(c)) {
+			numStatic = staticScene.Cull(frustum, shadowCasters);
+			numStatic += gpuCulledScene.Cull(frustum, shadowCasters + numStatic);
+		}
+		int numCasters = numStatic + dynamicScene.Cull(frustum, shadowCasters + numStatic);
+		render->ReserveDraws(numCasters);
+		auto submitCasters = [this, c, numStatic, shadowCasters](int start, int end) {
+			for (int s = start; s < end; s++) {
+				int e = shadowCasters[s];
+				drawnMeshes.Get(e)->SubmitShadowCaster(c, s < numStatic, transforms->GetRenderMatrix(e));
+			}
+		};
+		if (jobs != nullptr) {
+			jobs->ParallelFor(numCasters, MIN_DRAWN_MESHES_PER_JOB, submitCasters);
+		}
+		else {
+			submitCasters(0, numCasters);
+		}
+	}
+}
+
+//GPU culling only draws instanced materials, and only while the static trees are built for it.
+//Only asked when they are rebuilt, never per frame
+int EntitySystem::GetSceneType(int drawnMeshIndex)
+{
+	if (!staticEnts[drawnMeshes.GetOwner(drawnMeshIndex)]) return SCENE_DYNAMIC;
+	Material* material = drawnMeshes[drawnMeshIndex].GetMaterial();
+	if (isStaticSceneGPUCulled && material != nullptr && material->IsInstanced()) return SCENE_GPU_CULLED;
+	return SCENE_STATIC;
+}
+
+//World bounds of every drawn mesh that goes in one of the trees, meshes that aren't loaded yet are left out.
+//The dynamic tree only looks at its own list, the static ones go through every drawn mesh but are rarely rebuilt.
+//Returns how many, both arrays come out of arena
+int EntitySystem::GatherSceneBounds(int sceneType, LinearArena& arena, int*& sceneEnts, BvhBounds*& sceneBounds)
+{
+	bool isDynamic = sceneType == SCENE_DYNAMIC;
+	int numCandidates = isDynamic ? (int)dynamicDrawnEnts.size() : drawnMeshes.GetCount();
+	sceneEnts = arena.Allocate<int>(numCandidates);
+	sceneBounds = arena.Allocate<BvhBounds>(numCandidates);
+	int count = 0;
+	for (int c = 0; c < numCandidates; c++) {
+		if (!isDynamic && GetSceneType(c) != sceneType) continue;
+		int e = isDynamic ? dynamicDrawnEnts[c] : drawnMeshes.GetOwner(c);
+		Mesh* mesh = isDynamic ? drawnMeshes.Get(e)->GetMesh() : drawnMeshes[c].GetMesh();
+		if (mesh == nullptr || !mesh->IsReady()) continue;
+		sceneEnts[count] = e;
+		sceneBounds[count] = Bvh::TransformBounds(mesh->GetBoundsCenter(), mesh->GetBoundsExtents(), transforms->GetRenderMatrix(e));
+		count++;
+	}
+	return count;
+}
+
+void EntitySystem::BuildScene(Bvh& scene, int sceneType, LinearArena& scratch)
+{
+	size_t mark = scratch.GetMark();
+	int* sceneEnts;
+	BvhBounds* sceneBounds;
+	int count = GatherSceneBounds(sceneType, scratch, sceneEnts, sceneBounds);
+	scene.Build(sceneEnts, sceneBounds, count, scratch);
+	if (sceneType == SCENE_DYNAMIC) dynamicSceneEnts.assign(sceneEnts, sceneEnts + count);
+	//The renderer keeps its own copy of the GPU culled instances, they're never sent again until this is rebuilt
+	Render* render = GetRender();
+	if (sceneType == SCENE_GPU_CULLED && render != nullptr) {
+		GPUCullSource* sources = scratch.Allocate<GPUCullSource>(count);
+		for (int s = 0; s < count; s++) {
+			DrawnMesh* drawnMesh = drawnMeshes.Get(sceneEnts[s]);
+			sources[s].mesh = drawnMesh->GetMesh();
+			sources[s].material = drawnMesh->GetMaterial();
+			sources[s].worldMatrix = transforms->GetRenderMatrix(sceneEnts[s]);
+		}
+		render->SetGPUScene(sources, count);
+	}
+	scratch.Rewind(mark);
+}
+
+void EntitySystem::BuildStaticScenes(LinearArena& scratch)
+{
+	Render* render = GetRender();
+	isStaticSceneGPUCulled = render != nullptr && render->GetUseGPUCulling();
+	staticSceneMeshLoads = Mesh::GetNumFinishedLoads();
+	BuildScene(staticScene, SCENE_STATIC, scratch);
+	BuildScene(gpuCulledScene, SCENE_GPU_CULLED, scratch);
+	isStaticSceneValid = true;
+	hasStaticSceneChanged = true;
+}
+
+void EntitySystem::UpdateDynamicScene(LinearArena& frameArena)
+{
+	//A streamed in mesh might belong in the tree now
+	if (dynamicSceneMeshLoads != Mesh::GetNumFinishedLoads()) isDynamicSceneValid = false;
+	if (!isDynamicSceneValid) {
+		//Only happens when the dynamic set changes, and dynamicSceneEnts keeps its capacity
+		BuildScene(dynamicScene, SCENE_DYNAMIC, frameArena);
+		isDynamicSceneValid = true;
+		dynamicSceneMeshLoads = Mesh::GetNumFinishedLoads();
+		return;
+	}
+	//Same entities in the same order as the build, only their bounds moved
+	size_t mark = frameArena.GetMark();
+	int count = dynamicSceneEnts.size();
+	BvhBounds* sceneBounds = frameArena.Allocate<BvhBounds>(count);
+	for (int s = 0; s < count; s++) {
+		int e = dynamicSceneEnts[s];
+		Mesh* mesh = drawnMeshes.Get(e)->GetMesh();
+		sceneBounds[s] = Bvh::TransformBounds(mesh->GetBoundsCenter(), mesh->GetBoundsExtents(), transforms->GetRenderMatrix(e));
+	}
+	dynamicScene.Refit(sceneBounds);
+	frameArena.Rewind(mark);
+}
+
+void EntitySystem::AddDynamicDrawn(int entityIndex)
+{
+	if (dynamicDrawnSlots[entityIndex] >= 0) return;
+	dynamicDrawnSlots[entityIndex] = dynamicDrawnEnts.size();
+	dynamicDrawnEnts.push_back(entityIndex);
+	isDynamicSceneValid = false;
+}
+
+//The last one takes its place, the order only matters to the tree and that gets rebuilt anyway
+void EntitySystem::RemoveDynamicDrawn(int entityIndex)
+{
+	int slot = dynamicDrawnSlots[entityIndex];
+	if (slot < 0) return;
+	int last = dynamicDrawnEnts.back();
+	dynamicDrawnEnts[slot] = last;
+	dynamicDrawnSlots[last] = slot;
+	dynamicDrawnEnts.pop_back();
+	dynamicDrawnSlots[entityIndex] = -1;
+	isDynamicSceneValid = false;
+}
+
+void EntitySystem::BuildStaticScene(LinearArena& scratch)
+{
+	//The world matrices have to be up to date for the bounds to be right, and nothing is halfway anywhere yet
+	UpdateTransforms();
+	UpdateRenderMatrices(1.0f);
+	BuildStaticScenes(scratch);
+}
+
+//Everything shares the one renderer
+Render* EntitySystem::GetRender()
+{
+	if (drawnMeshes.GetCount() > 0) lastRender = drawnMeshes[0].GetRender();
+	return lastRender;
+}
+
+void EntitySystem::SetStatic(EntityHandle handle, bool isStatic)
+{
+	if (!IsHandleValid(handle) || staticEnts[handle.index] == isStatic) return;
+	staticEnts[handle.index] = isStatic;
+	isStaticSceneValid = false;
+	if (isStatic) RemoveDynamicDrawn(handle.index);
+	else if (drawnMeshes.Has(handle.index)) AddDynamicDrawn(handle.index);
+}
+
+bool EntitySystem::IsStatic(EntityHandle handle)
+{
+	return IsHandleValid(handle) && staticEnts[handle.index];
+}
+
+EntityHandle EntitySystem::Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, float& hitDistance)
+{
+	int hitEnt = -1;
+	float closest = maxDistance;
+	int hitId;
+	float distance;
+	if (staticScene.Raycast(origin, direction, closest, hitId, distance)) {
+		hitEnt = hitId;
+		closest = distance;
+	}
+	if (gpuCulledScene.Raycast(origin, direction, closest, hitId, distance)) {
+		hitEnt = hitId;
+		closest = distance;
 	}
-	else if (index >= numEnts && index < maxNumberOfEntsCanHold) {
-		std::swap(ents[index], ents[numEnabledEnts]);
-		std::swap(ents[index], ents[numEnts]);
-		numEnts++;
-		numEnabledEnts++;
-		return &ents[index];
+	if (dynamicScene.Raycast(origin, direction, closest, hitId, distance)) {
+		hitEnt = hitId;
+		closest = distance;
 	}
-	//I fell like I convered all cases, but I could be wrong, this is likely to change
-	return nullptr;
+	if (hitEnt < 0) return INVALID_ENTITY_HANDLE;
+	hitDistance = closest;
+	return GetHandle(hitEnt);
+}
+
+void EntitySystem::UpdateTransforms()
+{
+	CPUProfileScope scope("Transforms");
+	if (!isTransformOrderValid || transformOrderHierarchyVersion != Transform::GetHierarchyVersion()) {
+		RebuildTransformOrder();
+	}
+	if (jobs == nullptr) {
+		transforms->UpdateWorldMatrices(transformOrder, numOrderedEnts, numEnts);
+		return;
+	}
+	transforms->PropagateDirty(transformOrder, numOrderedEnts);
+	jobs->ParallelFor(TransformStore::GetNumBatches(numEnts), MIN_TRANSFORM_BATCHES_PER_JOB, [this](int start, int end) {
+		transforms->ComposeLocalMatrices(start, end);
+	});
+	//Each depth only needs the one above it, so everything on the same depth can go at once
+	for (unsigned int d = 1; d + 1 < depthStarts.size(); d++) {
+		int depthStart = depthStarts[d];
+		jobs->ParallelFor(depthStarts[d + 1] - depthStart, MIN_TRANSFORM_BATCHES_PER_JOB * TransformStore::BATCH_SIZE, [this, depthStart](int start, int end) {
+			transforms->ApplyParrents(transformOrder, depthStart + start, depthStart + end);
+		});
+	}
+	transforms->ClearDirty(numEnts);
+}
+
+//Only happens when something gets parented or entities are moved around, so it doesn't need to be fast
+void EntitySystem::RebuildTransformOrder()
+{
+	int maxDepth = 0;
+	for (int e = 0; e < numEnts; e++) {
+		if (!activeEnts[e]) continue;
+		int depth = 0;
+		for (Transform* parrent = ents[e].GetTransform().GetParrent(); parrent != nullptr; parrent = parrent->GetParrent()) {
+			depth++;
+		}
+		transformDepths[e] = depth;
+		if (depth > maxDepth) maxDepth = depth;
+	}
+	//Counting sort on the depth
+	std::vector<int> depthCounts(maxDepth + 1, 0);
+	numOrderedEnts = 0;
+	for (int e = 0; e < numEnts; e++) {
+		if (!activeEnts[e]) continue;
+		depthCounts[transformDepths[e]]++;
+		numOrderedEnts++;
+	}
+	depthStarts.assign(maxDepth + 2, 0);
+	for (int d = 0; d <= maxDepth; d++) {
+		depthStarts[d + 1] = depthStarts[d] + depthCounts[d];
+		depthCounts[d] = depthStarts[d];
+	}
+	for (int e = 0; e < numEnts; e++) {
+		if (!activeEnts[e]) continue;
+		transformOrder[depthCounts[transformDepths[e]]++] = e;
+	}
+	isTransformOrderValid = true;
+	transformOrderHierarchyVersion = Transform::GetHierarchyVersion();
+}
+
+EntityHandle EntitySystem::AddEntity()
+{
+	int index;
+	if (numFreeSlots > 0) {
+		index = freeSlots[--numFreeSlots];
+	}
+	else if (numEnts < maxNumberOfEntsCanHold) {
+		index = numEnts++;
+	}
+	else {
+		return INVALID_ENTITY_HANDLE;
+	}
+	activeEnts[index] = true;
+	//Whatever had the slot before isn't somewhere to blend from
+	transforms->Teleport(index);
+	lastAddedIndex = index;
+	isTransformOrderValid = false;
+	return GetHandle(index);
+}
+
+void EntitySystem::RemoveEntity(EntityHandle handle)
+{
+	if (!IsHandleValid(handle)) return;
+	if (staticEnts[handle.index] && drawnMeshes.Has(handle.index)) isStaticSceneValid = false;
+	staticEnts[handle.index] = false;
+	RemoveDynamicDrawn(handle.index);
+	//The slot gets reused, children left pointing at it would follow whatever goes there next.
+	//They move up to its parent instead, SetParrent changes the hierarchy version so the order is rebuilt
+	Transform& removed = ents[handle.index].GetTransform();
+	for (int e = 0; e < numEnts; e++) {
+		if (activeEnts[e] && e != handle.index && ents[e].GetTransform().GetParrent() == &removed) {
+			ents[e].GetTransform().SetParrent(removed.GetParrent());
+		}
+	}
+	//Frames already handed to the renderer can still draw the mesh
+	if (resources != nullptr && drawnMeshes.Has(handle.index)) {
+		resources->ReleaseMeshAfterDraw(drawnMeshes.Get(handle.index)->GetMeshHandle());
+	}
+	drawnMeshes.Remove(handle.index);
+	ents[handle.index].Reset();
+	activeEnts[handle.index] = false;
+	generations[handle.index]++;
+	freeSlots[numFreeSlots++] = handle.index;
+	isTransformOrderValid = false;
+}
+
+DrawnMesh* EntitySystem::AddDrawnMesh(EntityHandle handle, const DrawnMesh& drawnMesh)
+{
+	if (!IsHandleValid(handle)) return nullptr;
+	DrawnMesh* added = drawnMeshes.Add(handle.index, drawnMesh);
+	if (added != nullptr) added->SetEntiy(&ents[handle.index]);
+	if (added != nullptr && staticEnts[handle.index]) isStaticSceneValid = false;
+	else if (added != nullptr) AddDynamicDrawn(handle.index);
+	return added;
 }
 
 void EntitySystem::AddComponentToEntity(int index, Component * addedComponent)
@@ -67,7 +489,7 @@ void EntitySystem::AddComponentToEntity(int index, Component * addedComponent)
 
 void EntitySystem::AddComponentToEntity(Component * addedComponent)
 {
-	AddComponentToEntity(numEnabledEnts - 1, addedComponent);
+	AddComponentToEntity(lastAddedIndex, addedComponent);
 }
 
 Entity * EntitySystem::GetEntity(int index)
@@ -78,6 +500,19 @@ Entity * EntitySystem::GetEntity(int index)
 	return &ents[index];
 }
 
+Entity* EntitySystem::GetEntity(EntityHandle handle)
+{
+	if (!IsHandleValid(handle)) return nullptr;
+	return &ents[handle.index];
+}
+
+EntityHandle EntitySystem::GetHandle(int index)
+{
+	if (!IsEntityActive(index)) return INVALID_ENTITY_HANDLE;
+	EntityHandle handle = { index, generations[index] };
+	return handle;
+}
+
 bool EntitySystem::IsEntityIndexValid(int index)
 {
 	return index >= 0 && index < maxNumberOfEntsCanHold;
@@ -85,5 +520,10 @@ bool EntitySystem::IsEntityIndexValid(int index)
 
 bool EntitySystem::IsEntityActive(int index)
 {
-	return IsEntityIndexValid(index) && index < numEnabledEnts;
+	return IsEntityIndexValid(index) && activeEnts[index];
+}
+
+bool EntitySystem::IsHandleValid(EntityHandle handle)
+{
+	return IsEntityActive(handle.index) && generations[handle.index] == handle.generation;
 }
\ No newline at end of file
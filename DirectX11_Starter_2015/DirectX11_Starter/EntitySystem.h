@@ -1,29 +1,139 @@
 #pragma once
+#include "ComponentPool.h"
+#include "DrawnMesh.h"
+#include "Bvh.h"
+#include <atomic>
+#include <vector>
 
 class Entity;
 class Component;
+class TransformStore;
+class JobSystem;
+class Frustum;
+class Render;
+class LinearArena;
+class Resources;
+
+//Refers to an entity without pointing at it. The generation goes up every time the slot is reused,
+//so a handle to a removed entity stops being valid instead of pointing at whatever took its place.
+struct EntityHandle {
+	int index;
+	unsigned int generation;
+};
+
+const EntityHandle INVALID_ENTITY_HANDLE = { -1, 0 };
 
 class EntitySystem
 {
 public:
-	EntitySystem(const int newMaxNumberOfEntsCanHold);
+	//Smallest amount of work worth handing to another thread
+	const static int MIN_TRANSFORM_BATCHES_PER_JOB = 64;
+	const static int MIN_DRAWN_MESHES_PER_JOB = 256;
+
+	EntitySystem(const int newMaxNumberOfEntsCanHold, JobSystem* newJobs = nullptr);
 	~EntitySystem();
 
-	void Update();
+	//One fixed simulation step, after the game has moved things for it. Updates the components that aren't
+	//pooled, then the world matrices
+	void Step();
+	//Once per frame, after however many steps it took. Blends everything that moved in the last step
+	//interpolation of the way there, then culls and sends the drawn meshes to the renderer.
+	//Its working space comes out of frameArena, which only has to last until it returns
+	void SubmitDraws(float interpolation, LinearArena& frameArena);
+	//Recalculates the world matrices that changed, parents before children so each one is only done once
+	void UpdateTransforms();
+	void SetJobSystem(JobSystem* newJobs) { jobs = newJobs; }//nullptr runs everything on the calling thread
+	//Where drawn meshes give back their mesh references. Has to outlive the entity system, nullptr keeps them forever
+	void SetResources(Resources* newResources) { resources = newResources; }
+	//Drawn meshes outside of it never reach the renderer, nullptr draws everything. Has to outlive the next SubmitDraws
+	void SetCullingFrustum(const Frustum* newFrustum) { cullingFrustum = newFrustum; }
+	//Shadow casters are culled against each of the renderer's cascades on their own, whether the camera sees them or not
+	int GetNumCulledDrawnMeshes() const { return numCulledDrawnMeshes; }//From the last SubmitDraws
+	//Drawn meshes pick their LOD by how big they are on screen from here. Until it's set they're always drawn in full
+	void SetLODView(const DirectX::XMFLOAT3& position, float projectionScale);
+
+	//Static entities are promised not to move, so they go in a tree that's only built once.
+	//Everything else goes in a tree that's refit every update. When the renderer does GPU culling, static instanced
+	//meshes go in a tree of their own that's only used for shadows and raycasts, the renderer culls them for the camera
+	void SetStatic(EntityHandle handle, bool isStatic);
+	bool IsStatic(EntityHandle handle);
+	//Call once the level is loaded, also happens on the next SubmitDraws whenever the static set changed
+	void BuildStaticScene(LinearArena& scratch);
+	//Closest drawn mesh whose world bounds the ray hits, as of the last SubmitDraws
+	EntityHandle Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, float& hitDistance);
 
-	Entity* AddEntity();
-	Entity* EnableEntity(int index);//Enables an entity
+	EntityHandle AddEntity();//Returns INVALID_ENTITY_HANDLE when full
+	void RemoveEntity(EntityHandle handle);
 	void AddComponentToEntity(int index, Component* addedComponent);//Adds component at index
-																	//Adds Component at last active index
+																	//Adds Component at last added entity
 	void AddComponentToEntity(Component* addedComponent);
+	DrawnMesh* AddDrawnMesh(EntityHandle handle, const DrawnMesh& drawnMesh);
 	Entity* GetEntity(int index);
+	Entity* GetEntity(EntityHandle handle);//nullptr if the handle is stale
+	EntityHandle GetHandle(int index);
 
 	bool IsEntityIndexValid(int index);
 	bool IsEntityActive(int index);
+	bool IsHandleValid(EntityHandle handle);
 private:
 	Entity* ents;
+	JobSystem* jobs;
+	Resources* resources;
+	TransformStore* transforms;//Entity i's transform is slot i
+	unsigned int* generations;
+	bool* activeEnts;
+	int* freeSlots;//Removed slots, reused before any new ones
+	int numFreeSlots;
 	int maxNumberOfEntsCanHold;
-	int numEnts;
-	int numEnabledEnts;
-};
+	int numEnts;//Slots that have ever been used
+	int lastAddedIndex;
+
+	ComponentPool<DrawnMesh> drawnMeshes;
+	const Frustum* cullingFrustum;
+	LODView lodView;
+	bool hasLODView;
+	std::atomic<int> numCulledDrawnMeshes;
+	void UpdateDrawnMeshes(LinearArena& frameArena);
+
+	//Which tree a drawn mesh goes in
+	const static int SCENE_DYNAMIC = 0;
+	const static int SCENE_STATIC = 1;
+	const static int SCENE_GPU_CULLED = 2;
 
+	bool* staticEnts;
+	Bvh staticScene;
+	Bvh gpuCulledScene;
+	bool isStaticSceneValid;
+	bool isStaticSceneGPUCulled;//Whether the renderer was doing GPU culling when the static trees were built
+	unsigned int staticSceneMeshLoads;//Mesh::GetNumFinishedLoads when the static tree was built
+	Bvh dynamicScene;
+	std::vector<int> dynamicSceneEnts;//What the dynamic tree was built from, in the order it was given them
+	//Every entity with a drawn mesh that isn't static, kept up to date as they change so updating the dynamic tree
+	//never has to look at the static ones
+	std::vector<int> dynamicDrawnEnts;
+	int* dynamicDrawnSlots;//Where each entity is in dynamicDrawnEnts, -1 if it isn't
+	bool isDynamicSceneValid;
+	unsigned int dynamicSceneMeshLoads;//Mesh::GetNumFinishedLoads when the dynamic tree was built
+	void AddDynamicDrawn(int entityIndex);
+	void RemoveDynamicDrawn(int entityIndex);
+	bool hasStaticSceneChanged;//Since the shadows last heard about it
+	void SubmitShadowCasters(Render* render, LinearArena& frameArena);
+	int GetSceneType(int drawnMeshIndex);
+	int GatherSceneBounds(int sceneType, LinearArena& arena, int*& sceneEnts, BvhBounds*& sceneBounds);
+	void BuildScene(Bvh& scene, int sceneType, LinearArena& scratch);
+	void BuildStaticScenes(LinearArena& scratch);
+	void UpdateDynamicScene(LinearArena& frameArena);
+	Render* GetRender();
+	//Kept once the last drawn mesh is gone, so the GPU culled scene still gets emptied instead of pointing at released meshes
+	Render* lastRender;
+
+	//Active entity indices ordered so every parent comes before its children
+	int* transformOrder;
+	int* transformDepths;
+	std::vector<int> depthStarts;//Where each depth starts in transformOrder, plus one past the end
+	int numOrderedEnts;
+	bool isTransformOrderValid;
+	unsigned int transformOrderHierarchyVersion;
+	void RebuildTransformOrder();
+	void UpdateRenderMatrices(float interpolation);
+};
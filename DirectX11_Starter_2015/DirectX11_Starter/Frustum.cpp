@@ -0,0 +1,98 @@
+#include "Frustum.h"
+#include <math.h>
+
+Frustum::Frustum()
+{
+	//Everything is visible until a real frustum gets set
+	for (int g = 0; g < 2; g++) {
+		planeX[g] = DirectX::XMFLOAT4(0, 0, 0, 0);
+		planeY[g] = DirectX::XMFLOAT4(0, 0, 0, 0);
+		planeZ[g] = DirectX::XMFLOAT4(0, 0, 0, 0);
+		planeW[g] = DirectX::XMFLOAT4(1, 1, 1, 1);
+	}
+}
+
+//Gribb/Hartmann plane extraction. The rows of the transposed view projection are the columns
+//of the real one, and each plane is a sum or difference of two of them
+void Frustum::SetFromViewProjection(const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix)
+{
+	DirectX::XMMATRIX viewProjectionT = DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&projectionMatrix), DirectX::XMLoadFloat4x4(&viewMatrix));
+	DirectX::XMVECTOR planes[6] = {
+		DirectX::XMVectorAdd(viewProjectionT.r[3], viewProjectionT.r[0]),//Left
+		DirectX::XMVectorSubtract(viewProjectionT.r[3], viewProjectionT.r[0]),//Right
+		DirectX::XMVectorAdd(viewProjectionT.r[3], viewProjectionT.r[1]),//Bottom
+		DirectX::XMVectorSubtract(viewProjectionT.r[3], viewProjectionT.r[1]),//Top
+		viewProjectionT.r[2],//Near, D3D depth starts at 0
+		DirectX::XMVectorSubtract(viewProjectionT.r[3], viewProjectionT.r[2]),//Far
+	};
+	for (int p = 0; p < 8; p++) {
+		DirectX::XMFLOAT4 plane;
+		DirectX::XMStoreFloat4(&plane, DirectX::XMPlaneNormalize(planes[p < 6 ? p : 5]));
+		(&planeX[p / 4].x)[p % 4] = plane.x;
+		(&planeY[p / 4].x)[p % 4] = plane.y;
+		(&planeZ[p / 4].x)[p % 4] = plane.z;
+		(&planeW[p / 4].x)[p % 4] = plane.w;
+	}
+}
+
+void Frustum::GetPlanes(DirectX::XMFLOAT4 planes[6]) const
+{
+	for (int p = 0; p < 6; p++) {
+		planes[p] = DirectX::XMFLOAT4((&planeX[p / 4].x)[p % 4], (&planeY[p / 4].x)[p % 4], (&planeZ[p / 4].x)[p % 4], (&planeW[p / 4].x)[p % 4]);
+	}
+}
+
+bool Frustum::IsSphereVisible(const DirectX::XMFLOAT3& center, float radius) const
+{
+	DirectX::XMVECTOR centerX = DirectX::XMVectorReplicate(center.x);
+	DirectX::XMVECTOR centerY = DirectX::XMVectorReplicate(center.y);
+	DirectX::XMVECTOR centerZ = DirectX::XMVectorReplicate(center.z);
+	DirectX::XMVECTOR negativeRadius = DirectX::XMVectorReplicate(-radius);
+	for (int g = 0; g < 2; g++) {
+		//Signed distance from each of the four planes
+		DirectX::XMVECTOR distance = DirectX::XMVectorMultiplyAdd(DirectX::XMLoadFloat4(&planeX[g]), centerX, DirectX::XMLoadFloat4(&planeW[g]));
+		distance = DirectX::XMVectorMultiplyAdd(DirectX::XMLoadFloat4(&planeY[g]), centerY, distance);
+		distance = DirectX::XMVectorMultiplyAdd(DirectX::XMLoadFloat4(&planeZ[g]), centerZ, distance);
+		//Completely behind any one plane means it's outside
+		if (!DirectX::XMVector4GreaterOrEqual(distance, negativeRadius)) return false;
+	}
+	return true;
+}
+
+bool Frustum::IsSphereVisible(const DirectX::XMFLOAT3& localCenter, float localRadius, const DirectX::XMFLOAT4X4& worldMatrix) const
+{
+	DirectX::XMMATRIX world = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&worldMatrix));
+	DirectX::XMFLOAT3 center;
+	DirectX::XMStoreFloat3(&center, DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&localCenter), world));
+	//Non uniform scale stretches the sphere, the biggest axis keeps it conservative
+	float scaleSquared = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(world.r[0]));
+	float scaleYSquared = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(world.r[1]));
+	float scaleZSquared = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(world.r[2]));
+	if (scaleYSquared > scaleSquared) scaleSquared = scaleYSquared;
+	if (scaleZSquared > scaleSquared) scaleSquared = scaleZSquared;
+	return IsSphereVisible(center, localRadius * sqrtf(scaleSquared));
+}
+
+bool Frustum::IsBoxVisible(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents) const
+{
+	DirectX::XMVECTOR centerX = DirectX::XMVectorReplicate(center.x);
+	DirectX::XMVECTOR centerY = DirectX::XMVectorReplicate(center.y);
+	DirectX::XMVECTOR centerZ = DirectX::XMVectorReplicate(center.z);
+	DirectX::XMVECTOR extentsX = DirectX::XMVectorReplicate(extents.x);
+	DirectX::XMVECTOR extentsY = DirectX::XMVectorReplicate(extents.y);
+	DirectX::XMVECTOR extentsZ = DirectX::XMVectorReplicate(extents.z);
+	for (int g = 0; g < 2; g++) {
+		DirectX::XMVECTOR normalX = DirectX::XMLoadFloat4(&planeX[g]);
+		DirectX::XMVECTOR normalY = DirectX::XMLoadFloat4(&planeY[g]);
+		DirectX::XMVECTOR normalZ = DirectX::XMLoadFloat4(&planeZ[g]);
+		DirectX::XMVECTOR distance = DirectX::XMVectorMultiplyAdd(normalX, centerX, DirectX::XMLoadFloat4(&planeW[g]));
+		distance = DirectX::XMVectorMultiplyAdd(normalY, centerY, distance);
+		distance = DirectX::XMVectorMultiplyAdd(normalZ, centerZ, distance);
+		//How far the box reaches towards each plane
+		DirectX::XMVECTOR reach = DirectX::XMVectorMultiply(DirectX::XMVectorAbs(normalX), extentsX);
+		reach = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorAbs(normalY), extentsY, reach);
+		reach = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorAbs(normalZ), extentsZ, reach);
+		if (!DirectX::XMVector4GreaterOrEqual(DirectX::XMVectorAdd(distance, reach), DirectX::XMVectorZero())) return false;
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <DirectXMath.h>
+
+//The six planes of a camera's view volume, kept as structure of arrays so one
+//SSE compare tests a sphere against four planes at once
+class Frustum
+{
+public:
+	Frustum();
+
+	//Both matrices stored transposed, the same way the camera hands them to the shaders
+	void SetFromViewProjection(const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix);
+
+	bool IsSphereVisible(const DirectX::XMFLOAT3& center, float radius) const;
+	//Moves a local space sphere into world space first, worldMatrix is stored transposed
+	bool IsSphereVisible(const DirectX::XMFLOAT3& localCenter, float localRadius, const DirectX::XMFLOAT4X4& worldMatrix) const;
+	bool IsBoxVisible(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents) const;
+	//One plane per element again, left, right, bottom, top, near then far. Normals point inwards
+	void GetPlanes(DirectX::XMFLOAT4 planes[6]) const;
+private:
+	//Planes 0-3 and 4-5, the last two lanes repeat plane 5 so they never change the result
+	DirectX::XMFLOAT4 planeX[2];
+	DirectX::XMFLOAT4 planeY[2];
+	DirectX::XMFLOAT4 planeZ[2];
+	DirectX::XMFLOAT4 planeW[2];
+};
@@ -0,0 +1,100 @@
+#include "GBuffer.h"
+#include "DirectXGameCore.h"
+#include <DirectXMath.h>
+#include "Logger.h"
+
+//Has to match the TARGET_ order
+static const DXGI_FORMAT TARGET_FORMATS[GBuffer::NUM_TARGETS] = {
+	DXGI_FORMAT_R8G8B8A8_UNORM,
+	DXGI_FORMAT_R10G10B10A2_UNORM,
+	DXGI_FORMAT_R32_FLOAT,
+};
+static const int TARGET_REGISTERS[GBuffer::NUM_TARGETS] = {
+	GBuffer::ALBEDO_REGISTER,
+	GBuffer::NORMAL_REGISTER,
+	GBuffer::DEPTH_REGISTER,
+};
+
+GBuffer::GBuffer(ID3D11Device* newDevice)
+{
+	device = newDevice;
+	width = 0;
+	height = 0;
+	for (int t = 0; t < NUM_TARGETS; t++) {
+		textures[t] = nullptr;
+		renderTargets[t] = nullptr;
+		shaderResources[t] = nullptr;
+	}
+}
+
+GBuffer::~GBuffer()
+{
+	Release();
+}
+
+void GBuffer::Release()
+{
+	for (int t = 0; t < NUM_TARGETS; t++) {
+		ReleaseMacro(shaderResources[t]);
+		ReleaseMacro(renderTargets[t]);
+		ReleaseMacro(textures[t]);
+	}
+}
+
+bool GBuffer::Resize(unsigned int newWidth, unsigned int newHeight)
+{
+	if (newWidth == width && newHeight == height && textures[0] != nullptr) return true;
+	Release();
+	width = newWidth;
+	height = newHeight;
+	if (width == 0 || height == 0) return false;
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	for (int t = 0; t < NUM_TARGETS; t++) {
+		textureDesc.Format = TARGET_FORMATS[t];
+		if (FAILED(device->CreateTexture2D(&textureDesc, nullptr, &textures[t])) ||
+			FAILED(device->CreateRenderTargetView(textures[t], nullptr, &renderTargets[t])) ||
+			FAILED(device->CreateShaderResourceView(textures[t], nullptr, &shaderResources[t]))) {
+			LogText("--ERROR--//Couldn't create the G-buffer.");
+			Release();
+			return false;
+		}
+	}
+	return true;
+}
+
+void GBuffer::Clear(ID3D11DeviceContext* context)
+{
+	//Zero depth is how the lighting pass knows to leave the background alone
+	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int t = 0; t < NUM_TARGETS; t++) {
+		if (renderTargets[t] != nullptr) context->ClearRenderTargetView(renderTargets[t], clearColor);
+	}
+}
+
+void GBuffer::BindTargets(ID3D11DeviceContext* context, ID3D11DepthStencilView* depthStencilView)
+{
+	context->OMSetRenderTargets(NUM_TARGETS, renderTargets, depthStencilView);
+}
+
+void GBuffer::BindForLighting(ID3D11DeviceContext* context)
+{
+	for (int t = 0; t < NUM_TARGETS; t++) {
+		context->PSSetShaderResources(TARGET_REGISTERS[t], 1, &shaderResources[t]);
+	}
+}
+
+void GBuffer::UnbindForLighting(ID3D11DeviceContext* context)
+{
+	ID3D11ShaderResourceView* noSRV = nullptr;
+	for (int t = 0; t < NUM_TARGETS; t++) {
+		context->PSSetShaderResources(TARGET_REGISTERS[t], 1, &noSRV);
+	}
+}
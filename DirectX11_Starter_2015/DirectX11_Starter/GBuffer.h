@@ -0,0 +1,48 @@
+#pragma once
+#include <d3d11.h>
+
+//The render targets deferred shading draws the scene into, lit afterwards by one full screen pass.
+//The depth test still uses the back buffer's depth buffer, so forward draws after the lighting pass sort against it.
+//Targets are made to match the viewport the first time it's drawn to and again whenever that changes size
+class GBuffer
+{
+public:
+	//Order of the targets, also their pixel shader registers in the lighting pass
+	const static int TARGET_ALBEDO = 0;//RGBA8, alpha marks toon shading
+	const static int TARGET_NORMAL = 1;//RGB10A2, packed into [0, 1]
+	const static int TARGET_DEPTH = 2;//R32F view space depth, 0 where nothing was drawn
+	const static int NUM_TARGETS = 3;
+	//Registers 2 and 3 are the light clusters'
+	const static int ALBEDO_REGISTER = 0;
+	const static int NORMAL_REGISTER = 1;
+	const static int DEPTH_REGISTER = 4;
+
+	GBuffer(ID3D11Device* newDevice);
+	~GBuffer();
+
+	//Does nothing if the targets are already this size
+	bool Resize(unsigned int newWidth, unsigned int newHeight);
+	void Clear(ID3D11DeviceContext* context);
+	//Draws go into the targets from here on, depth goes into depthStencilView as usual
+	void BindTargets(ID3D11DeviceContext* context, ID3D11DepthStencilView* depthStencilView);
+	//The targets have to be unbound before this, a texture can't be read and written at once
+	void BindForLighting(ID3D11DeviceContext* context);
+	void UnbindForLighting(ID3D11DeviceContext* context);
+
+	unsigned int GetWidth() const { return width; }
+	unsigned int GetHeight() const { return height; }
+private:
+	ID3D11Device* device;
+	unsigned int width;
+	unsigned int height;
+
+	ID3D11Texture2D* textures[NUM_TARGETS];
+	ID3D11RenderTargetView* renderTargets[NUM_TARGETS];
+	ID3D11ShaderResourceView* shaderResources[NUM_TARGETS];
+
+	void Release();
+
+	//Copying would release the targets twice
+	GBuffer(const GBuffer&);
+	GBuffer& operator=(const GBuffer&);
+};
@@ -0,0 +1,205 @@
+#include "GPUCulling.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "Bvh.h"
+#include "DrawnMesh.h"
+#include "Frustum.h"
+#include "SimpleShader.h"
+#include "DirectXGameCore.h"
+#include "Logger.h"
+
+//CullInstances.hlsl picks from four levels
+static_assert(Mesh::MAX_LODS == 4, "lodScreenSizes is a float4");
+
+GPUCulling::GPUCulling(ID3D11Device* newDevice, ID3D11DeviceContext* newContext)
+{
+	device = newDevice;
+	context = newContext;
+	cullShader = nullptr;
+	areBuffersStale = false;
+	instanceBuffer = nullptr;
+	instanceSRV = nullptr;
+	argsBuffer = nullptr;
+	argsUAV = nullptr;
+	visibleBuffer = nullptr;
+	visibleUAV = nullptr;
+}
+
+GPUCulling::~GPUCulling()
+{
+	ReleaseBuffers();
+}
+
+void GPUCulling::ReleaseBuffers()
+{
+	ReleaseMacro(instanceSRV);
+	ReleaseMacro(instanceBuffer);
+	ReleaseMacro(argsUAV);
+	ReleaseMacro(argsBuffer);
+	ReleaseMacro(visibleUAV);
+	ReleaseMacro(visibleBuffer);
+}
+
+void GPUCulling::BuildScene(const GPUCullSource* sources, int count, std::vector<GPUCullInstance>& instances, std::vector<GPUCullBucket>& buckets)
+{
+	instances.resize(count);
+	buckets.clear();
+	if (count == 0) return;
+	//Only runs when the static scene changes, so a plain sort is fine
+	std::vector<int> order(count);
+	for (int s = 0; s < count; s++) order[s] = s;
+	std::sort(order.begin(), order.end(), [sources](int a, int b) {
+		if (sources[a].material->GetSortID() != sources[b].material->GetSortID()) return sources[a].material->GetSortID() < sources[b].material->GetSortID();
+		return sources[a].mesh->GetSortID() < sources[b].mesh->GetSortID();
+	});
+
+	unsigned int numVisibleSlots = 0;
+	int runStart = 0;
+	while (runStart < count) {
+		Mesh* mesh = sources[order[runStart]].mesh;
+		Material* material = sources[order[runStart]].material;
+		int runEnd = runStart + 1;
+		while (runEnd < count && sources[order[runEnd]].mesh == mesh && sources[order[runEnd]].material == material) runEnd++;
+
+		unsigned int firstBucket = buckets.size();
+		unsigned int runSize = runEnd - runStart;
+		for (int l = 0; l < mesh->GetNumLODs(); l++) {
+			GPUCullBucket bucket;
+			bucket.mesh = mesh->GetLOD(l);
+			bucket.material = material;
+			bucket.firstInstance = numVisibleSlots;
+			bucket.capacity = runSize;
+			buckets.push_back(bucket);
+			numVisibleSlots += runSize;
+		}
+
+		for (int s = runStart; s < runEnd; s++) {
+			const GPUCullSource& source = sources[order[s]];
+			GPUCullInstance& instance = instances[s];
+			memcpy(instance.World, &source.worldMatrix, sizeof(DirectX::XMFLOAT4X4));
+			BvhBounds bounds = Bvh::TransformBounds(mesh->GetBoundsCenter(), mesh->GetBoundsExtents(), source.worldMatrix);
+			instance.BoundsCenter = DirectX::XMFLOAT3((bounds.min.x + bounds.max.x) * 0.5f, (bounds.min.y + bounds.max.y) * 0.5f, (bounds.min.z + bounds.max.z) * 0.5f);
+			instance.BoundsExtents = DirectX::XMFLOAT3((bounds.max.x - bounds.min.x) * 0.5f, (bounds.max.y - bounds.min.y) * 0.5f, (bounds.max.z - bounds.min.z) * 0.5f);
+			//Same sphere DrawnMesh picks its LOD from, the biggest scale on any axis keeps the whole mesh in it
+			DirectX::XMMATRIX world = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&source.worldMatrix));
+			float scale = DirectX::XMVectorGetX(DirectX::XMVectorMax(DirectX::XMVector3LengthSq(world.r[0]),
+				DirectX::XMVectorMax(DirectX::XMVector3LengthSq(world.r[1]), DirectX::XMVector3LengthSq(world.r[2]))));
+			instance.Radius = mesh->GetBoundingRadius() * sqrtf(scale);
+			instance.FirstBucket = firstBucket;
+			instance.NumLODs = mesh->GetNumLODs();
+			instance.Padding = DirectX::XMFLOAT3(0, 0, 0);
+		}
+		runStart = runEnd;
+	}
+}
+
+void GPUCulling::SetScene(std::vector<GPUCullInstance>& newInstances, std::vector<GPUCullBucket>& newBuckets)
+{
+	instances.swap(newInstances);
+	buckets.swap(newBuckets);
+	clearArgs.resize(buckets.size());
+	for (unsigned int b = 0; b < buckets.size(); b++) {
+		clearArgs[b].IndexCountPerInstance = buckets[b].mesh->GetNumberOfIndices();
+		clearArgs[b].InstanceCount = 0;
+		clearArgs[b].StartIndexLocation = 0;
+		clearArgs[b].BaseVertexLocation = 0;
+		clearArgs[b].StartInstanceLocation = buckets[b].firstInstance;
+	}
+	areBuffersStale = true;
+}
+
+void GPUCulling::CreateBuffers()
+{
+	ReleaseBuffers();
+	areBuffersStale = false;
+	if (instances.empty()) return;
+
+	//Only read by the compute pass, and it never changes until the scene does
+	D3D11_BUFFER_DESC instanceDesc;
+	instanceDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	instanceDesc.ByteWidth = sizeof(GPUCullInstance) * instances.size();
+	instanceDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	instanceDesc.CPUAccessFlags = 0;
+	instanceDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	instanceDesc.StructureByteStride = sizeof(GPUCullInstance);
+	D3D11_SUBRESOURCE_DATA instanceData = {};
+	instanceData.pSysMem = instances.data();
+	HR(device->CreateBuffer(&instanceDesc, &instanceData, &instanceBuffer));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = instances.size();
+	HR(device->CreateShaderResourceView(instanceBuffer, &srvDesc, &instanceSRV));
+
+	//Counted into with atomics, so both of these are raw views
+	D3D11_BUFFER_DESC argsDesc;
+	argsDesc.Usage = D3D11_USAGE_DEFAULT;
+	argsDesc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS) * buckets.size();
+	argsDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	argsDesc.CPUAccessFlags = 0;
+	argsDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	argsDesc.StructureByteStride = 0;
+	HR(device->CreateBuffer(&argsDesc, nullptr, &argsBuffer));
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = argsDesc.ByteWidth / sizeof(unsigned int);
+	uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	HR(device->CreateUnorderedAccessView(argsBuffer, &uavDesc, &argsUAV));
+
+	//Written by the compute pass, then read as the instance stream
+	const GPUCullBucket& lastBucket = buckets.back();
+	D3D11_BUFFER_DESC visibleDesc;
+	visibleDesc.Usage = D3D11_USAGE_DEFAULT;
+	visibleDesc.ByteWidth = sizeof(DirectX::XMFLOAT4X4) * (lastBucket.firstInstance + lastBucket.capacity);
+	visibleDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_UNORDERED_ACCESS;
+	visibleDesc.CPUAccessFlags = 0;
+	visibleDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	visibleDesc.StructureByteStride = 0;
+	HR(device->CreateBuffer(&visibleDesc, nullptr, &visibleBuffer));
+
+	uavDesc.Buffer.NumElements = visibleDesc.ByteWidth / sizeof(unsigned int);
+	HR(device->CreateUnorderedAccessView(visibleBuffer, &uavDesc, &visibleUAV));
+	LogText("GPU culling: " + std::to_string(instances.size()) + " instances in " + std::to_string(buckets.size()) + " buckets");
+}
+
+bool GPUCulling::Cull(const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix, const DirectX::XMFLOAT3& cameraPosition)
+{
+	if (areBuffersStale) CreateBuffers();
+	if (cullShader == nullptr || instanceSRV == nullptr) return false;
+	context->UpdateSubresource(argsBuffer, 0, nullptr, clearArgs.data(), 0, 0);
+
+	Frustum frustum;
+	frustum.SetFromViewProjection(viewMatrix, projectionMatrix);
+	DirectX::XMFLOAT4 planes[6];
+	frustum.GetPlanes(planes);
+	DirectX::XMFLOAT4 lodScreenSizes(DrawnMesh::GetLODScreenSize(0), DrawnMesh::GetLODScreenSize(1), DrawnMesh::GetLODScreenSize(2), DrawnMesh::GetLODScreenSize(3));
+	cullShader->SetData("planes", planes, sizeof(planes));
+	cullShader->SetFloat4("lodScreenSizes", lodScreenSizes);
+	cullShader->SetFloat3("cameraPosition", cameraPosition);
+	//The projection is stored transposed, the diagonal doesn't care
+	cullShader->SetFloat("projectionScale", projectionMatrix._22);
+	cullShader->SetInt("numInstances", instances.size());
+	//Still the instance stream from last frame, it can't be read and written at once
+	ID3D11Buffer* noBuffer = nullptr;
+	UINT noStride = 0;
+	context->IASetVertexBuffers(SimpleVertexShader::INSTANCE_INPUT_SLOT, 1, &noBuffer, &noStride, &noStride);
+	cullShader->SetShader(true);
+	cullShader->SetShaderResourceView("instances", instanceSRV);
+	cullShader->SetUnorderedAccessView("drawArgs", argsUAV);
+	cullShader->SetUnorderedAccessView("visibleInstances", visibleUAV);
+	cullShader->DispatchByThreads(instances.size(), 1, 1);
+
+	//Neither can be drawn from while they're still bound for writing
+	ID3D11UnorderedAccessView* noUAV = nullptr;
+	ID3D11ShaderResourceView* noSRV = nullptr;
+	cullShader->SetUnorderedAccessView("drawArgs", noUAV);
+	cullShader->SetUnorderedAccessView("visibleInstances", noUAV);
+	cullShader->SetShaderResourceView("instances", noSRV);
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <vector>
+
+class SimpleComputeShader;
+class Mesh;
+class Material;
+
+//What the scene hands over for each GPU culled instance
+struct GPUCullSource {
+	Mesh* mesh;//The full mesh, its LODs get buckets of their own
+	Material* material;//Has to be instanced
+	DirectX::XMFLOAT4X4 worldMatrix;//Stored transposed
+};
+
+//Matches CullInstance in CullInstances.hlsl
+struct GPUCullInstance {
+	DirectX::XMFLOAT4 World[4];//The transposed world matrix's rows, copied into the instance stream as they are
+	DirectX::XMFLOAT3 BoundsCenter;//World space box
+	float Radius;//World space sphere around BoundsCenter, for the LOD
+	DirectX::XMFLOAT3 BoundsExtents;
+	unsigned int FirstBucket;//Its mesh's full LOD, the rest follow it
+	unsigned int NumLODs;
+	DirectX::XMFLOAT3 Padding;
+};
+
+//One mesh LOD and material pair. Its survivors go in one run of the instance stream, so it's one indirect draw
+struct GPUCullBucket {
+	Mesh* mesh;
+	Material* material;
+	unsigned int firstInstance;
+	unsigned int capacity;//Every instance of the pair could end up at this LOD
+};
+
+//Frustum culls static instances on the GPU. Every instance's bounds are uploaded once, then a compute pass tests them
+//against the view each frame, picks their LOD, and writes the survivors' world matrices and the instance counts for
+//DrawIndexedInstancedIndirect. The CPU only goes through the buckets, never the instances
+class GPUCulling
+{
+public:
+	GPUCulling(ID3D11Device* newDevice, ID3D11DeviceContext* newContext);
+	~GPUCulling();
+
+	void SetShader(SimpleComputeShader* newCullShader) { cullShader = newCullShader; }
+	bool HasShader() const { return cullShader != nullptr; }
+	//Groups the sources into buckets by material then mesh. Touches nothing but its arguments, so it can run while the
+	//last scene is still being drawn with
+	static void BuildScene(const GPUCullSource* sources, int count, std::vector<GPUCullInstance>& instances, std::vector<GPUCullBucket>& buckets);
+	//Takes the built scene's contents, the buffers are made the next time it culls
+	void SetScene(std::vector<GPUCullInstance>& instances, std::vector<GPUCullBucket>& buckets);
+	bool IsEmpty() const { return instances.empty(); }
+
+	//Counts every bucket over from nothing on the immediate context, before anything draws with them.
+	//Both matrices are stored transposed. False if there was nothing to cull, then the buckets can't be drawn
+	bool Cull(const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix, const DirectX::XMFLOAT3& cameraPosition);
+
+	int GetNumBuckets() const { return buckets.size(); }
+	const GPUCullBucket& GetBucket(int bucket) const { return buckets[bucket]; }
+	//The survivors' world matrices, laid out for SimpleVertexShader::INSTANCE_INPUT_SLOT
+	ID3D11Buffer* GetInstanceBuffer() { return visibleBuffer; }
+	ID3D11Buffer* GetArgsBuffer() { return argsBuffer; }
+	static UINT GetArgsOffset(int bucket) { return bucket * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS); }
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	SimpleComputeShader* cullShader;
+	std::vector<GPUCullInstance> instances;
+	std::vector<GPUCullBucket> buckets;
+	bool areBuffersStale;
+
+	//Every bucket with no instances yet, uploaded over the arguments before each cull
+	std::vector<D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS> clearArgs;
+
+	ID3D11Buffer* instanceBuffer;
+	ID3D11ShaderResourceView* instanceSRV;
+	ID3D11Buffer* argsBuffer;
+	ID3D11UnorderedAccessView* argsUAV;
+	ID3D11Buffer* visibleBuffer;
+	ID3D11UnorderedAccessView* visibleUAV;
+
+	void CreateBuffers();
+	void ReleaseBuffers();
+
+	//Copying would release the buffers twice
+	GPUCulling(const GPUCulling&);
+	GPUCulling& operator=(const GPUCulling&);
+};
@@ -0,0 +1,150 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+thread_local int JobSystem::threadQueueIndex = 0;
+
+JobSystem::JobSystem()
+{
+	int numHardwareThreads = (int)std::thread::hardware_concurrency();
+	StartWorkers(numHardwareThreads > 1 ? numHardwareThreads - 1 : 0);
+}
+
+JobSystem::JobSystem(int numWorkers)
+{
+	StartWorkers(numWorkers > 0 ? numWorkers : 0);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		isRunning = false;
+	}
+	wakeCondition.notify_all();
+	for (unsigned int w = 0; w < workers.size(); w++) {
+		workers[w].join();
+	}
+	delete[] queues;
+}
+
+void JobSystem::StartWorkers(int numWorkers)
+{
+	isRunning = true;
+	numQueuedJobs = 0;
+	numQueues = numWorkers + 1;
+	queues = new WorkQueue[numQueues];
+	for (int w = 1; w <= numWorkers; w++) {
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this, w));
+	}
+}
+
+void JobSystem::Run(const std::function<void()>& job, JobCounter* counter)
+{
+	{
+		WorkQueue& queue = queues[threadQueueIndex];
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		if (queue.count == MAX_QUEUED_JOBS) {
+			//Whoever's adding this many jobs is going to wait on them anyway
+			lock.unlock();
+			CPUProfileScope scope("Job");
+			job();
+			return;
+		}
+		if (counter != nullptr) counter->value++;
+		Job& newJob = queue.jobs[(queue.first + queue.count) % MAX_QUEUED_JOBS];
+		newJob.function = job;
+		newJob.counter = counter;
+		queue.count++;
+	}
+	{
+		//Taking the lock makes sure a worker that's about to sleep sees the new job
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		numQueuedJobs++;
+	}
+	wakeCondition.notify_one();
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (counter.value > 0) {
+		if (!TryRunJob(threadQueueIndex)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::ParallelFor(int count, int minBatchSize, const std::function<void(int start, int end)>& body)
+{
+	if (count <= 0) return;
+	if (minBatchSize < 1) minBatchSize = 1;
+	int numBatches = count / minBatchSize;
+	//A few batches per thread so stealing can even out uneven work
+	if (numBatches > numQueues * 4) numBatches = numQueues * 4;
+	if (numBatches <= 1 || numQueues == 1) {
+		body(0, count);
+		return;
+	}
+	int batchSize = (count + numBatches - 1) / numBatches;
+
+	JobCounter counter;
+	for (int start = batchSize; start < count; start += batchSize) {
+		int end = start + batchSize < count ? start + batchSize : count;
+		Run([&body, start, end]() { body(start, end); }, &counter);
+	}
+	//The caller does the first batch itself instead of just waiting
+	body(0, batchSize);
+	Wait(counter);
+}
+
+void JobSystem::WorkerLoop(int queueIndex)
+{
+	threadQueueIndex = queueIndex;
+	while (isRunning) {
+		if (TryRunJob(queueIndex)) continue;
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeCondition.wait(lock, [this]() { return !isRunning || numQueuedJobs > 0; });
+	}
+}
+
+bool JobSystem::TryRunJob(int queueIndex)
+{
+	Job job;
+	if (!TryPop(queueIndex, job) && !TrySteal(queueIndex, job)) return false;
+	numQueuedJobs--;
+	{
+		CPUProfileScope scope("Job");
+		job.function();
+	}
+	if (job.counter != nullptr) job.counter->value--;
+	return true;
+}
+
+//Newest first from our own queue, it's the most likely to still be in cache
+bool JobSystem::TryPop(int queueIndex, Job& job)
+{
+	WorkQueue& queue = queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.count == 0) return false;
+	Job& back = queue.jobs[(queue.first + queue.count - 1) % MAX_QUEUED_JOBS];
+	job.function.swap(back.function);
+	job.counter = back.counter;
+	queue.count--;
+	return true;
+}
+
+//Oldest first from everyone else
+bool JobSystem::TrySteal(int queueIndex, Job& job)
+{
+	for (int offset = 1; offset < numQueues; offset++) {
+		WorkQueue& queue = queues[(queueIndex + offset) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count == 0) continue;
+		Job& front = queue.jobs[queue.first];
+		job.function.swap(front.function);
+		job.counter = front.counter;
+		queue.first = (queue.first + 1) % MAX_QUEUED_JOBS;
+		queue.count--;
+		return true;
+	}
+	return false;
+}
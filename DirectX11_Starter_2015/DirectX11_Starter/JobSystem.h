@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Counts the jobs that still have to finish, wait on it to depend on them
+struct JobCounter {
+	std::atomic<int> value;
+	JobCounter() : value(0) {}
+};
+
+//Work stealing job scheduler. Every worker has its own queue and takes from the back of it,
+//when it runs dry it steals from the front of the others. Threads that aren't workers (the
+//window thread) share queue 0. Waiting threads run jobs instead of sleeping.
+//Queues are fixed size rings so queuing a job never goes to the heap, a job that doesn't fit runs right away instead.
+class JobSystem
+{
+public:
+	const static int MAX_QUEUED_JOBS = 256;//Per queue
+
+	JobSystem();//One worker per hardware thread, minus the one that's already running the game
+	JobSystem(int numWorkers);
+	~JobSystem();
+
+	void Run(const std::function<void()>& job, JobCounter* counter);
+	void Wait(JobCounter& counter);
+	//Splits [0, count) into batches of at least minBatchSize and runs body(start, end) on each, returns once all are done
+	void ParallelFor(int count, int minBatchSize, const std::function<void(int start, int end)>& body);
+
+	int GetNumThreads() const { return numQueues; }//Workers plus the calling thread
+	static int GetThreadIndex() { return threadQueueIndex; }//0 on anything that isn't a worker
+private:
+	struct Job {
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+	//Jobs are in [first, first + count), wrapping around the end
+	struct WorkQueue {
+		std::mutex mutex;
+		Job jobs[MAX_QUEUED_JOBS];
+		int first;
+		int count;
+		WorkQueue() : first(0), count(0) {}
+	};
+
+	static thread_local int threadQueueIndex;
+
+	std::vector<std::thread> workers;
+	WorkQueue* queues;
+	int numQueues;
+	std::atomic<bool> isRunning;
+	std::atomic<int> numQueuedJobs;
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+
+	void StartWorkers(int numWorkers);
+	void WorkerLoop(int queueIndex);
+	bool TryRunJob(int queueIndex);
+	bool TryPop(int queueIndex, Job& job);
+	bool TrySteal(int queueIndex, Job& job);
+};
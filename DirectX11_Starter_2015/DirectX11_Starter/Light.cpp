@@ -5,6 +5,9 @@ GameLight::GameLight()
 	renderLight.AmbientColor = DirectX::XMFLOAT4(0.1f, 0.1f, 0.1f, 1);
 	renderLight.DiffuseColor = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1);
 	renderLight.Type = LIGHT_DIRECTIONAL;
+	renderLight.Range = DEFAULT_LIGHT_RANGE;
+	renderLight.CastsShadows = 0;
+	renderLight.Padding = DirectX::XMFLOAT2(0, 0);
 }
 
 GameLight::GameLight(int type, DirectX::XMFLOAT4 newAmbientColor, DirectX::XMFLOAT4 newDiffuseColor)
@@ -12,6 +15,9 @@ GameLight::GameLight(int type, DirectX::XMFLOAT4 newAmbientColor, DirectX::XMFLO
 	renderLight.AmbientColor = newAmbientColor;
 	renderLight.DiffuseColor = newDiffuseColor;
 	renderLight.Type = type;
+	renderLight.Range = DEFAULT_LIGHT_RANGE;
+	renderLight.CastsShadows = 0;
+	renderLight.Padding = DirectX::XMFLOAT2(0, 0);
 }
 
 GameLight::~GameLight()
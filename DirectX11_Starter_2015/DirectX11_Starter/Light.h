@@ -5,11 +5,17 @@
 const int LIGHT_DIRECTIONAL = 0;
 const int LIGHT_POINT = 1;
 
+const float DEFAULT_LIGHT_RANGE = 10.0f;
+
+//Matches Light in the shaders, which read them from a structured buffer
 struct RenderLight {
 	DirectX::XMFLOAT4 AmbientColor;
 	DirectX::XMFLOAT4 DiffuseColor;
 	DirectX::XMFLOAT3 Fluid3;
 	int Type;
+	float Range;//Point lights fade out to nothing here, which is what they're binned into clusters by
+	int CastsShadows;//Set by the renderer for the directional light its shadow maps are for
+	DirectX::XMFLOAT2 Padding;
 };
 
 class GameLight
@@ -24,6 +30,7 @@ public:
 	Transform& GetTransform() { return transform; }
 	//DO NOT pass get render light directly into a shaders set data
 	RenderLight& GetRenderLight() { return renderLight; }
+	void SetRange(float newRange) { renderLight.Range = newRange; }
 	RenderLight& GetRenderLightData();
 private:
 	RenderLight renderLight;
@@ -0,0 +1,132 @@
+#include "LightClusters.h"
+#include <cmath>
+#include <cstring>
+#include "SimpleShader.h"
+#include "DirectXGameCore.h"
+#include "Logger.h"
+
+LightClusters::LightClusters(ID3D11Device* newDevice, ID3D11DeviceContext* newContext, int newMaxLights)
+{
+	device = newDevice;
+	context = newContext;
+	clusterShader = nullptr;
+	maxLights = newMaxLights;
+	lightBuffer = nullptr;
+	lightSRV = nullptr;
+	clusterBuffer = nullptr;
+	clusterSRV = nullptr;
+	clusterUAV = nullptr;
+
+	clusterInfo.TileSize = DirectX::XMFLOAT2(1, 1);
+	clusterInfo.DepthScale = 0;
+	clusterInfo.DepthBias = 0;
+	clusterInfo.CountX = CLUSTERS_X;
+	clusterInfo.CountY = CLUSTERS_Y;
+	clusterInfo.CountZ = CLUSTERS_Z;
+	clusterInfo.ClusterStride = MAX_LIGHTS_PER_CLUSTER + 1;
+	CreateBuffers();
+}
+
+LightClusters::~LightClusters()
+{
+	ReleaseMacro(lightSRV);
+	ReleaseMacro(lightBuffer);
+	ReleaseMacro(clusterUAV);
+	ReleaseMacro(clusterSRV);
+	ReleaseMacro(clusterBuffer);
+}
+
+void LightClusters::CreateBuffers()
+{
+	D3D11_BUFFER_DESC lightDesc;
+	lightDesc.Usage = D3D11_USAGE_DYNAMIC;
+	lightDesc.ByteWidth = sizeof(RenderLight) * maxLights;
+	lightDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	lightDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	lightDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	lightDesc.StructureByteStride = sizeof(RenderLight);
+	HR(device->CreateBuffer(&lightDesc, nullptr, &lightBuffer));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = maxLights;
+	HR(device->CreateShaderResourceView(lightBuffer, &srvDesc, &lightSRV));
+
+	//Written by the compute pass and read by the pixel shader, so it needs to be both
+	unsigned int numEntries = NUM_CLUSTERS * clusterInfo.ClusterStride;
+	D3D11_BUFFER_DESC clusterDesc;
+	clusterDesc.Usage = D3D11_USAGE_DEFAULT;
+	clusterDesc.ByteWidth = sizeof(unsigned int) * numEntries;
+	clusterDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	clusterDesc.CPUAccessFlags = 0;
+	clusterDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	clusterDesc.StructureByteStride = sizeof(unsigned int);
+	HR(device->CreateBuffer(&clusterDesc, nullptr, &clusterBuffer));
+
+	srvDesc.Buffer.NumElements = numEntries;
+	HR(device->CreateShaderResourceView(clusterBuffer, &srvDesc, &clusterSRV));
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = numEntries;
+	HR(device->CreateUnorderedAccessView(clusterBuffer, &uavDesc, &clusterUAV));
+}
+
+void LightClusters::Update(const RenderLight* lights, int numLights, const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix,
+	float nearPlane, float farPlane)
+{
+	if (numLights > maxLights) {
+		LogText("--ERROR--//More lights than the light buffer holds, the rest are left out.");
+		numLights = maxLights;
+	}
+	if (numLights > 0) {
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (SUCCEEDED(context->Map(lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+			memcpy(mapped.pData, lights, sizeof(RenderLight) * numLights);
+			context->Unmap(lightBuffer, 0);
+		}
+	}
+
+	//Tiles are sized off whatever the viewport is right now
+	D3D11_VIEWPORT viewport;
+	UINT numViewports = 1;
+	context->RSGetViewports(&numViewports, &viewport);
+	if (numViewports == 0) return;
+	clusterInfo.TileSize = DirectX::XMFLOAT2(ceilf(viewport.Width / CLUSTERS_X), ceilf(viewport.Height / CLUSTERS_Y));
+	float logDepthRange = logf(farPlane / nearPlane);
+	clusterInfo.DepthScale = CLUSTERS_Z / logDepthRange;
+	clusterInfo.DepthBias = -CLUSTERS_Z * logf(nearPlane) / logDepthRange;
+
+	if (clusterShader == nullptr) return;
+	//The projection is stored transposed, the diagonal doesn't care
+	DirectX::XMFLOAT2 projectionScale(projectionMatrix._11, projectionMatrix._22);
+	clusterShader->SetMatrix4x4("view", viewMatrix);
+	clusterShader->SetFloat2("projectionScale", projectionScale);
+	clusterShader->SetFloat2("screenSize", DirectX::XMFLOAT2(viewport.Width, viewport.Height));
+	clusterShader->SetFloat("nearPlane", nearPlane);
+	clusterShader->SetFloat("farPlane", farPlane);
+	clusterShader->SetInt("numLights", numLights);
+	clusterShader->SetData("clusterInfo", &clusterInfo, sizeof(ClusterInfo));
+	//Still bound to the pixel shader from last frame, it can't be read and written at once
+	ID3D11ShaderResourceView* noSRV = nullptr;
+	context->PSSetShaderResources(CLUSTER_BUFFER_REGISTER, 1, &noSRV);
+	clusterShader->SetShader(true);
+	clusterShader->SetShaderResourceView("lights", lightSRV);
+	clusterShader->SetUnorderedAccessView("clusterLights", clusterUAV);
+	clusterShader->DispatchByThreads(NUM_CLUSTERS, 1, 1);
+
+	//The pixel shader can't read it while it's still bound for writing
+	ID3D11UnorderedAccessView* noUAV = nullptr;
+	clusterShader->SetUnorderedAccessView("clusterLights", noUAV);
+	clusterShader->SetShaderResourceView("lights", noSRV);
+}
+
+void LightClusters::Bind(ID3D11DeviceContext* bindContext)
+{
+	bindContext->PSSetShaderResources(LIGHT_BUFFER_REGISTER, 1, &lightSRV);
+	bindContext->PSSetShaderResources(CLUSTER_BUFFER_REGISTER, 1, &clusterSRV);
+}
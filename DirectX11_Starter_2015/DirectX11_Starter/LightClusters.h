@@ -0,0 +1,58 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include "Light.h"
+
+class SimpleComputeShader;
+
+//Matches ClusterInfo in the shaders, tells them how the view is cut up
+struct ClusterInfo {
+	DirectX::XMFLOAT2 TileSize;//In pixels
+	float DepthScale;//slice = log(view depth) * DepthScale + DepthBias
+	float DepthBias;
+	unsigned int CountX;
+	unsigned int CountY;
+	unsigned int CountZ;
+	unsigned int ClusterStride;//A light count then up to MAX_LIGHTS_PER_CLUSTER indices
+};
+
+//Clustered forward lighting. Every light goes into one structured buffer, then a compute pass splits the view into
+//screen tiles and exponential depth slices and writes which lights reach each one.
+//The pixel shader only loops over the lights in its own cluster, directional lights are in all of them
+class LightClusters
+{
+public:
+	const static int CLUSTERS_X = 16;
+	const static int CLUSTERS_Y = 9;
+	const static int CLUSTERS_Z = 24;
+	const static int NUM_CLUSTERS = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+	const static int MAX_LIGHTS_PER_CLUSTER = 63;//Lights past this in a cluster are dropped
+	//Pixel shader registers, have to match PixelShader.hlsl
+	const static int LIGHT_BUFFER_REGISTER = 2;
+	const static int CLUSTER_BUFFER_REGISTER = 3;
+
+	LightClusters(ID3D11Device* newDevice, ID3D11DeviceContext* newContext, int newMaxLights);
+	~LightClusters();
+
+	void SetShader(SimpleComputeShader* newClusterShader) { clusterShader = newClusterShader; }
+	//Uploads the lights and bins them on the immediate context, before anything is drawn
+	void Update(const RenderLight* lights, int numLights, const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix,
+		float nearPlane, float farPlane);
+	//Binds the light and cluster lists for the pixel shader, every context that draws needs this
+	void Bind(ID3D11DeviceContext* bindContext);
+	const ClusterInfo& GetClusterInfo() const { return clusterInfo; }
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	SimpleComputeShader* clusterShader;
+	int maxLights;
+	ClusterInfo clusterInfo;
+
+	ID3D11Buffer* lightBuffer;
+	ID3D11ShaderResourceView* lightSRV;
+	ID3D11Buffer* clusterBuffer;
+	ID3D11ShaderResourceView* clusterSRV;
+	ID3D11UnorderedAccessView* clusterUAV;
+
+	void CreateBuffers();
+};
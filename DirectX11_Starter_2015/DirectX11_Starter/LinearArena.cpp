@@ -0,0 +1,60 @@
+#include "LinearArena.h"
+#include <cstdint>
+#include <string>
+#include <DirectXMath.h>
+#include "Logger.h"
+
+LinearArena::LinearArena(size_t newCapacity)
+{
+	capacity = newCapacity;
+	memory = new unsigned char[capacity];
+	offset = 0;
+	overflowUsed = 0;
+	highWaterMark = 0;
+}
+
+LinearArena::~LinearArena()
+{
+	for (unsigned int b = 0; b < overflowBlocks.size(); b++) {
+		delete[] overflowBlocks[b];
+	}
+	delete[] memory;
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	uintptr_t start = (uintptr_t)memory + offset;
+	uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	size_t end = offset + (size_t)(aligned - start) + size;
+	if (end <= capacity) {
+		offset = end;
+		if (offset + overflowUsed > highWaterMark) highWaterMark = offset + overflowUsed;
+		return (void*)aligned;
+	}
+
+	//Each overflow gets a block of its own, Reset folds them all into the main one
+	unsigned char* block = new unsigned char[size + alignment];
+	overflowBlocks.push_back(block);
+	overflowUsed += size + alignment;
+	if (offset + overflowUsed > highWaterMark) highWaterMark = offset + overflowUsed;
+	return (void*)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void LinearArena::Reset()
+{
+	offset = 0;
+	if (overflowBlocks.empty()) return;
+	for (unsigned int b = 0; b < overflowBlocks.size(); b++) {
+		delete[] overflowBlocks[b];
+	}
+	overflowBlocks.clear();
+	overflowUsed = 0;
+	//A bit extra so a slowly growing scene doesn't grow it every frame
+	size_t newCapacity = highWaterMark + highWaterMark / 2;
+	if (newCapacity > capacity) {
+		delete[] memory;
+		capacity = newCapacity;
+		memory = new unsigned char[capacity];
+		LogText("Linear arena grew to " + std::to_string(capacity) + " bytes");
+	}
+}
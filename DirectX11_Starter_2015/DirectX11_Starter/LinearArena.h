@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+
+//Hands out memory by bumping an offset and takes it all back at once with Reset. Nothing is constructed or
+//destructed, so it's only for plain data. Anything that doesn't fit goes on the heap until the next Reset,
+//which grows the block to the most that was ever used, so after the first few frames it stops touching the heap.
+//Not thread safe, one thread fills it
+class LinearArena
+{
+public:
+	const static size_t DEFAULT_CAPACITY = 1024 * 1024;
+	const static size_t DEFAULT_ALIGNMENT = 16;
+
+	LinearArena(size_t newCapacity = DEFAULT_CAPACITY);
+	~LinearArena();
+
+	//Never fails, alignment has to be a power of two
+	void* Allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT);
+	template <typename T>
+	T* Allocate(size_t count) { return (T*)Allocate(sizeof(T) * count, alignof(T) > DEFAULT_ALIGNMENT ? alignof(T) : DEFAULT_ALIGNMENT); }
+
+	//Rewind gives back everything allocated since the mark, marks have to be rewound newest first.
+	//Only the block is rewound, anything that went on the heap stays until Reset
+	size_t GetMark() const { return offset; }
+	void Rewind(size_t mark) { if (mark < offset) offset = mark; }
+	void Reset();
+
+	size_t GetUsed() const { return offset + overflowUsed; }//Since the last Reset
+	size_t GetCapacity() const { return capacity; }
+	size_t GetHighWaterMark() const { return highWaterMark; }
+private:
+	unsigned char* memory;
+	size_t capacity;
+	size_t offset;
+	std::vector<unsigned char*> overflowBlocks;
+	size_t overflowUsed;
+	size_t highWaterMark;//Most used between two Resets, alignment padding included
+
+	//Copying would delete the block twice
+	LinearArena(const LinearArena&);
+	LinearArena& operator=(const LinearArena&);
+};
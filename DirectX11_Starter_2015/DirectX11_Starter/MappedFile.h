@@ -0,0 +1,27 @@
+#pragma once
+#include <Windows.h>
+
+//Read only view of a whole file through the OS file mapping, pages get read in as they're touched
+//instead of the file being copied into a buffer up front
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const char* filePath);
+	void Close();
+
+	const void* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+	bool IsOpen() const { return data != nullptr; }
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const void* data;
+	size_t size;
+
+	//Copying would unmap the view twice
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
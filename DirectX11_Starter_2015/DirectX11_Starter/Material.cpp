@@ -1,18 +1,34 @@
 #include "Material.h"
 #include "Render.h"
+#include "Mesh.h"
 #include "Logger.h"
+#include "Profiler.h"
+#include <vector>
 
-Material::Material(SimpleVertexShader* newVertexShader, 
+unsigned int Material::nextSortID = 0;
+
+Material::Material(ShaderCache* newShaderCache,
+					SimpleVertexShader* newVertexShader, 
 					SimplePixelShader* newPixelShader, 
 					ID3D11ShaderResourceView* newDiffuseSRV,
 					ID3D11ShaderResourceView* newNormalMapSRV,
 					ID3D11SamplerState* newSamplerState)
 {
+	shaderCache = newShaderCache;
+	blendState = BLEND_STATE_OPAQUE;
+	rasterState = RASTER_STATE_CULL_BACK;
+	depthState = DEPTH_STATE_READ_WRITE;
 	vertexShader = newVertexShader;
+	instancedVertexShader = nullptr;
+	compactVertexShader = nullptr;
+	instancedCompactVertexShader = nullptr;
 	pixelShader = newPixelShader;
+	gBufferPixelShader = nullptr;
 	diffuseTextureSRV = newDiffuseSRV;
 	normalMapSRV = newNormalMapSRV;
 	samplerState = newSamplerState;
+	sortID = nextSortID++;
+	UpdateShaderSortID();
 }
 
 
@@ -20,39 +36,140 @@ Material::~Material()
 {
 }
 
-void Material::PrepareMaterial(RenderInfo& renderInfo, Transform& transform)
+void Material::PrepareMaterial(RenderInfo& renderInfo, const DirectX::XMFLOAT4X4& worldMatrix, const Mesh* mesh)
 {
 	//The numbers only work if everything is passed in correctly into the shader 
 
-	//"world" = 0
-	//"view" = 1
-	//"projection" = 2
+	//perFrame = buffer 0
+	//"view" = 0
+	//"projection" = 1
+	//perObject = buffer 1
+	//"world" = 2
+	//Compact only
+	//"positionScale" = 3
+	//"positionOffset" = 4
 
 
+	//perFrame = buffer 0
 	//"cameraPosition" = 0
-	//"light1" = 1
-	//"light2" = 2
+	//"cameraForward" = 1
+	//"clusterInfo" = 2
 
 	//diffuseTexture 0
 	//normalMap 1
 	//samplerState 0
-	vertexShader->SetMatrix4x4(0, transform.GetWorldMatrix());
-	if (renderInfo.currentMaterial != this) {
-		vertexShader->SetMatrix4x4(1, renderInfo.viewMatrix);
-		vertexShader->SetMatrix4x4(2, renderInfo.projectionMatrix);
-		vertexShader->SetShader(true);
-
-		pixelShader->SetFloat3(0, renderInfo.cameraPosition);
-		pixelShader->SetData(1, &renderInfo.light1, sizeof(RenderLight));
-		pixelShader->SetData(2, &renderInfo.light2, sizeof(RenderLight));
-		pixelShader->SetShaderResourceView(0, diffuseTextureSRV);
-		pixelShader->SetShaderResourceView(1, normalMapSRV);
-		pixelShader->SetSamplerState(0, samplerState);
-		pixelShader->SetShader(true);
-
-		renderInfo.currentMaterial = this;
+	bool isCompact = mesh->GetVertexFormat() == VERTEX_FORMAT_COMPACT && compactVertexShader != nullptr;
+	SimpleVertexShader* usedVertexShader = isCompact ? compactVertexShader : vertexShader;
+	usedVertexShader->SetMatrix4x4(2, worldMatrix);
+	if (isCompact) {
+		usedVertexShader->SetFloat3(3, mesh->GetPositionScale());
+		usedVertexShader->SetFloat3(4, mesh->GetPositionOffset());
+	}
+	SimplePixelShader* usedPixelShader = GetUsedPixelShader(renderInfo);
+	//The render list is sorted by shader, so the per frame data only gets sent once per shader change
+	if (renderInfo.currentVertexShader != usedVertexShader || renderInfo.currentPixelShader != usedPixelShader) {
+		PrepareShaders(renderInfo, usedVertexShader);
 	}
 	else {
-		vertexShader->CopyBufferData(0);//The world matrix needs to be set per object
+		usedVertexShader->CopyBufferData(1);//The world matrix needs to be set per object
+	}
+
+	PrepareRenderStates(renderInfo);
+	PrepareTextures(renderInfo, usedPixelShader);
+}
+
+void Material::PrepareInstancedMaterial(RenderInfo& renderInfo, const Mesh* mesh)
+{
+	//perFrame = buffer 0
+	//"view" = 0
+	//"projection" = 1
+	//Compact only, perObject = buffer 1
+	//"positionScale" = 2
+	//"positionOffset" = 3
+	bool isCompact = mesh->GetVertexFormat() == VERTEX_FORMAT_COMPACT && instancedCompactVertexShader != nullptr;
+	SimpleVertexShader* usedVertexShader = isCompact ? instancedCompactVertexShader : instancedVertexShader;
+	if (isCompact) {
+		usedVertexShader->SetFloat3(2, mesh->GetPositionScale());
+		usedVertexShader->SetFloat3(3, mesh->GetPositionOffset());
+	}
+	SimplePixelShader* usedPixelShader = GetUsedPixelShader(renderInfo);
+	if (renderInfo.currentVertexShader != usedVertexShader || renderInfo.currentPixelShader != usedPixelShader) {
+		PrepareInstancedShaders(renderInfo, usedVertexShader);
 	}
+	else if (isCompact) {
+		usedVertexShader->CopyBufferData(1);//Each mesh is quantized differently
+	}
+	PrepareRenderStates(renderInfo);
+	PrepareTextures(renderInfo, usedPixelShader);
+}
+
+void Material::UpdateShaderSortID()
+{
+	//Instanced materials never use the regular vertex shader, so they sort with the instanced one
+	PipelineStateDesc desc;
+	desc.vertexShader = IsInstanced() ? instancedVertexShader : vertexShader;
+	desc.pixelShader = pixelShader;
+	desc.blendState = blendState;
+	desc.rasterState = rasterState;
+	desc.depthState = depthState;
+	shaderSortID = shaderCache->GetPipelineStateID(desc);
+	//Same fall back as the Prepare functions when there's no compact version
+	SimpleVertexShader* compactShader = IsInstanced() ? instancedCompactVertexShader : compactVertexShader;
+	if (compactShader != nullptr) desc.vertexShader = compactShader;
+	compactShaderSortID = shaderCache->GetPipelineStateID(desc);
+}
+
+//Split buffers that didn't change since they were last copied on this context only get bound again
+void Material::PrepareShaders(RenderInfo& renderInfo, SimpleVertexShader* usedVertexShader)
+{
+	usedVertexShader->SetMatrix4x4(0, renderInfo.viewMatrix);
+	usedVertexShader->SetMatrix4x4(1, renderInfo.projectionMatrix);
+	usedVertexShader->SetShader(true);
+	renderInfo.currentVertexShader = usedVertexShader;
+
+	PreparePixelShader(renderInfo, GetUsedPixelShader(renderInfo));
+}
+
+void Material::PrepareInstancedShaders(RenderInfo& renderInfo, SimpleVertexShader* usedVertexShader)
+{
+	usedVertexShader->SetMatrix4x4(0, renderInfo.viewMatrix);
+	usedVertexShader->SetMatrix4x4(1, renderInfo.projectionMatrix);
+	usedVertexShader->SetShader(true);
+	renderInfo.currentVertexShader = usedVertexShader;
+
+	PreparePixelShader(renderInfo, GetUsedPixelShader(renderInfo));
+}
+
+//The G-buffer shader has the same constants and textures as the forward one
+SimplePixelShader* Material::GetUsedPixelShader(const RenderInfo& renderInfo) const
+{
+	return renderInfo.gBufferPass && gBufferPixelShader != nullptr ? gBufferPixelShader : pixelShader;
+}
+
+void Material::PreparePixelShader(RenderInfo& renderInfo, SimplePixelShader* usedPixelShader)
+{
+	if (renderInfo.currentPixelShader == usedPixelShader) return;
+	usedPixelShader->SetFloat3(0, renderInfo.cameraPosition);
+	usedPixelShader->SetFloat3(1, renderInfo.cameraForward);
+	usedPixelShader->SetData(2, &renderInfo.clusterInfo, sizeof(ClusterInfo));
+	usedPixelShader->SetShader(true);
+	renderInfo.currentPixelShader = usedPixelShader;
+}
+
+void Material::PrepareRenderStates(RenderInfo& renderInfo)
+{
+	if (renderInfo.currentPipelineState == shaderSortID) return;
+	//The pre-pass already wrote this depth, anything not exactly on it is hidden
+	shaderCache->ApplyRenderStates(renderInfo.deviceContext, shaderSortID, renderInfo.depthEqual && WritesDepth());
+	renderInfo.currentPipelineState = shaderSortID;
+}
+
+void Material::PrepareTextures(RenderInfo& renderInfo, SimplePixelShader* usedPixelShader)
+{
+	if (renderInfo.currentMaterial == this) return;
+	usedPixelShader->SetShaderResourceView(0, diffuseTextureSRV);
+	usedPixelShader->SetShaderResourceView(1, normalMapSRV);
+	usedPixelShader->SetSamplerState(0, samplerState);
+	renderInfo.currentMaterial = this;
+	Profiler::Count(PROFILE_COUNTER_STATE_CHANGES, 1);
 }
@@ -1,30 +1,81 @@
 #pragma once
 #include "SimpleShader.h"
+#include "ShaderCache.h"
+#include "Vertex.h"
 
 #include "Transform.h"
 
 struct RenderInfo;
+class Mesh;
 
 class Material
 {
 public:
-	//This constructor should probably be changed
-	Material(SimpleVertexShader* newVertexShader, 
+	//The shader cache hands out the pipeline state ids everything gets sorted by
+	Material(ShaderCache* newShaderCache,
+			SimpleVertexShader* newVertexShader, 
 			SimplePixelShader* newPixelShader, 
 			ID3D11ShaderResourceView* newDiffuseSRV,
 			ID3D11ShaderResourceView* newNormalMapSRV,
 			ID3D11SamplerState* newSamplerState);
 	~Material();
 
-	void SetVertexShader(SimpleVertexShader* newVertexShader) { vertexShader = newVertexShader;  }
-	void SetPixelShader(SimplePixelShader* newPixelShader) { pixelShader = newPixelShader; }
+	void SetVertexShader(SimpleVertexShader* newVertexShader) { vertexShader = newVertexShader; UpdateShaderSortID(); }
+	void SetPixelShader(SimplePixelShader* newPixelShader) { pixelShader = newPixelShader; UpdateShaderSortID(); }
+	//Optional, when set everything drawn with this material is drawn instanced
+	void SetInstancedVertexShader(SimpleVertexShader* newInstancedVertexShader) { instancedVertexShader = newInstancedVertexShader; UpdateShaderSortID(); }
+	//Used instead of the two above for meshes in VERTEX_FORMAT_COMPACT, they decode the packed vertices
+	void SetCompactVertexShaders(SimpleVertexShader* newCompactVertexShader, SimpleVertexShader* newInstancedCompactVertexShader) {
+		compactVertexShader = newCompactVertexShader; instancedCompactVertexShader = newInstancedCompactVertexShader; UpdateShaderSortID();
+	}
+	//Optional, writes the G-buffer for deferred shading instead of lighting. Without one the material is drawn forward
+	void SetGBufferPixelShader(SimplePixelShader* newGBufferPixelShader) { gBufferPixelShader = newGBufferPixelShader; }
 	void SetDiffuseSRV(ID3D11ShaderResourceView* newDiffuseSRV) { diffuseTextureSRV = newDiffuseSRV;  }
 	void SetNormalMapSRV(ID3D11ShaderResourceView* newNormalMapSRV) { normalMapSRV = newNormalMapSRV; }
 	void SetSamplerState(ID3D11SamplerState* newSamplerState) { samplerState = newSamplerState; }
-	void PrepareMaterial(RenderInfo& renderInfo, Transform& transform);
+	//One of the BLEND_STATE_, RASTER_STATE_ and DEPTH_STATE_ presets each
+	void SetRenderStates(unsigned int newBlendState, unsigned int newRasterState, unsigned int newDepthState) {
+		blendState = newBlendState; rasterState = newRasterState; depthState = newDepthState; UpdateShaderSortID();
+	}
+	void PrepareMaterial(RenderInfo& renderInfo, const DirectX::XMFLOAT4X4& worldMatrix, const Mesh* mesh);
+	void PrepareInstancedMaterial(RenderInfo& renderInfo, const Mesh* mesh);//The world matrices come from the instance buffer
+
+	bool IsInstanced() const { return instancedVertexShader != nullptr; }
+	SimpleVertexShader* GetVertexShader() { return vertexShader; }
+	SimpleVertexShader* GetInstancedVertexShader() { return instancedVertexShader; }
+	SimplePixelShader* GetPixelShader() { return pixelShader; }
+	bool HasGBufferShader() const { return gBufferPixelShader != nullptr; }
+	//Opaque and depth writing, so it goes in the depth pre-pass
+	bool WritesDepth() const { return blendState == BLEND_STATE_OPAQUE && depthState == DEPTH_STATE_READ_WRITE; }
+	//Small unique ids used by the render queue sort key
+	unsigned int GetSortID() const { return sortID; }
+	//Meshes in different vertex formats go through different vertex shaders, so they sort apart
+	unsigned int GetShaderSortID(int vertexFormat = VERTEX_FORMAT_FULL) const { return vertexFormat == VERTEX_FORMAT_COMPACT ? compactShaderSortID : shaderSortID; }
 private:
+	static unsigned int nextSortID;
+	unsigned int sortID;
+	unsigned int shaderSortID;//The pipeline state id, shared by every material with the same shaders and render states
+	unsigned int compactShaderSortID;//Same render states, with whichever vertex shader compact meshes use
+
+	ShaderCache* shaderCache;
+	unsigned int blendState;
+	unsigned int rasterState;
+	unsigned int depthState;
+
+	void UpdateShaderSortID();
+	void PrepareShaders(RenderInfo& renderInfo, SimpleVertexShader* usedVertexShader);
+	void PrepareInstancedShaders(RenderInfo& renderInfo, SimpleVertexShader* usedVertexShader);
+	void PreparePixelShader(RenderInfo& renderInfo, SimplePixelShader* usedPixelShader);
+	void PrepareRenderStates(RenderInfo& renderInfo);
+	void PrepareTextures(RenderInfo& renderInfo, SimplePixelShader* usedPixelShader);
+	SimplePixelShader* GetUsedPixelShader(const RenderInfo& renderInfo) const;
+
 	SimpleVertexShader* vertexShader;
+	SimpleVertexShader* instancedVertexShader;
+	SimpleVertexShader* compactVertexShader;
+	SimpleVertexShader* instancedCompactVertexShader;
 	SimplePixelShader* pixelShader;
+	SimplePixelShader* gBufferPixelShader;
 	//Stuff for textures
 	ID3D11ShaderResourceView* diffuseTextureSRV;//Texture
 	ID3D11ShaderResourceView* normalMapSRV;//Texture
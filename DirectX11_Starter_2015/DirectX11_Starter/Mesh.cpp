@@ -1,31 +1,140 @@
 #include "Mesh.h"
 #include <vector>
 #include <fstream>
+#include <math.h>
+#include <cstring>
+#include <DirectXPackedVector.h>
 #include "Logger.h"
+#include "SimpleShader.h"
+#include "BlockPool.h"
 
-Mesh::Mesh(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device)
+unsigned int Mesh::nextSortID = 0;
+std::atomic<unsigned int> Mesh::numFinishedLoads(0);
+
+const static int MESH_BLOCKS_PER_CHUNK = 64;
+
+//Made on first use, so it's there for any mesh no matter when it's made
+static BlockPool& GetMeshPool()
+{
+	static BlockPool pool(sizeof(Mesh), MESH_BLOCKS_PER_CHUNK);
+	return pool;
+}
+
+const D3D11_INPUT_ELEMENT_DESC Mesh::COMPACT_INPUT_ELEMENTS[Mesh::NUM_COMPACT_INPUT_ELEMENTS] = {
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+const D3D11_INPUT_ELEMENT_DESC Mesh::INSTANCED_COMPACT_INPUT_ELEMENTS[Mesh::NUM_INSTANCED_COMPACT_INPUT_ELEMENTS] = {
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "INSTANCE_WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
+const D3D11_INPUT_ELEMENT_DESC Mesh::COMPACT_POSITION_INPUT_ELEMENTS[Mesh::NUM_COMPACT_POSITION_INPUT_ELEMENTS] = {
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+const D3D11_INPUT_ELEMENT_DESC Mesh::INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS[Mesh::NUM_INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS] = {
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "INSTANCE_WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, SimpleVertexShader::INSTANCE_INPUT_SLOT, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
+Mesh::Mesh(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device, int newVertexFormat)
+{
+	sortID = nextSortID++;
+	isReady = false;
+	InitLODs();
+	InitNewData(vertices, numVerts, indices, newNumIndices, device, newVertexFormat);
+}
+
+Mesh::Mesh(const Vertex* vertices, int numVerts, const void* indices, DXGI_FORMAT newIndexFormat, int newNumIndices, const DirectX::XMFLOAT3& newBoundsCenter,
+	const DirectX::XMFLOAT3& newBoundsExtents, float newBoundingRadius, ID3D11Device* device, int newVertexFormat)
+{
+	sortID = nextSortID++;
+	isReady = false;
+	InitLODs();
+	InitNewData(vertices, numVerts, indices, newIndexFormat, newNumIndices, newBoundsCenter, newBoundsExtents, newBoundingRadius, device, newVertexFormat);
+}
+
+void Mesh::InitNewData(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device, int newVertexFormat)
+{
+	vertexFormat = newVertexFormat;
+	CalculateBounds(vertices, numVerts);
+	CalculateTangents(vertices, numVerts, indices, newNumIndices);
+	if (CanUse16BitIndices(numVerts)) {
+		indexFormat = DXGI_FORMAT_R16_UINT;
+		//Every index fits, CanUse16BitIndices checked the vertex count
+		std::vector<unsigned short> shortIndices(newNumIndices);
+		for (int i = 0; i < newNumIndices; i++) shortIndices[i] = static_cast<unsigned short>(indices[i]);
+		CreateBuffers(vertices, numVerts, &shortIndices[0], newNumIndices, device);
+	}
+	else {
+		indexFormat = DXGI_FORMAT_R32_UINT;
+		CreateBuffers(vertices, numVerts, indices, newNumIndices, device);
+	}
+}
+
+void Mesh::InitNewData(const Vertex* vertices, int numVerts, const void* indices, DXGI_FORMAT newIndexFormat, int newNumIndices, const DirectX::XMFLOAT3& newBoundsCenter,
+	const DirectX::XMFLOAT3& newBoundsExtents, float newBoundingRadius, ID3D11Device* device, int newVertexFormat)
+{
+	vertexFormat = newVertexFormat;
+	boundsCenter = newBoundsCenter;
+	boundsExtents = newBoundsExtents;
+	boundingRadius = newBoundingRadius;
+	indexFormat = newIndexFormat;
+	CreateBuffers(vertices, numVerts, indices, newNumIndices, device);
+}
+
+//indexFormat has to be set first
+void Mesh::CreateBuffers(const Vertex* vertices, int numVerts, const void* indices, int newNumIndices, ID3D11Device* device)
 {
-	CalculateTangents(vertices, numVerts, indices, numIndices);
 	//Set the indices
 	numIndices = newNumIndices;
 
+	std::vector<CompactVertex> compactVertices;
+	if (vertexFormat == VERTEX_FORMAT_COMPACT) {
+		compactVertices.resize(numVerts);
+		CompressVertices(vertices, numVerts, &compactVertices[0]);
+	}
+
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * numVerts;
+	vbd.ByteWidth = GetVertexStride() * numVerts;
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
 
 	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = vertices;
+	initialVertexData.pSysMem = vertexFormat == VERTEX_FORMAT_COMPACT ? (const void*)&compactVertices[0] : (const void*)vertices;
 
 	HR(device->CreateBuffer(&vbd, &initialVertexData, &vertexBuffer));
 
+	//A second, smaller copy of just the positions, so depth only passes fetch less per vertex.
+	//Kept in the same encoding so they decode to exactly the same positions
+	std::vector<char> positions(GetPositionStride() * numVerts);
+	for (int v = 0; v < numVerts; v++) {
+		const void* position = vertexFormat == VERTEX_FORMAT_COMPACT ? (const void*)compactVertices[v].Position : (const void*)&vertices[v].Position;
+		memcpy(&positions[v * GetPositionStride()], position, GetPositionStride());
+	}
+	vbd.ByteWidth = GetPositionStride() * numVerts;
+	initialVertexData.pSysMem = &positions[0];
+	HR(device->CreateBuffer(&vbd, &initialVertexData, &positionBuffer));
 
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * newNumIndices;
+	ibd.ByteWidth = (indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(UINT)) * newNumIndices;
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
@@ -35,20 +144,148 @@ Mesh::Mesh(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3
 	initialIndexData.pSysMem = indices;
 
 	HR(device->CreateBuffer(&ibd, &initialIndexData, &indexBuffer));
+
+	//Everything above has to be visible before anything sees the mesh as ready
+	isReady.store(true, std::memory_order_release);
+	numFinishedLoads++;
 }
 
 Mesh::Mesh()
 {
+	sortID = nextSortID++;
 	numIndices = 0;
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	vertexFormat = VERTEX_FORMAT_FULL;
+	boundsCenter = DirectX::XMFLOAT3(0, 0, 0);
+	boundsExtents = DirectX::XMFLOAT3(0, 0, 0);
+	boundingRadius = 0;
 	vertexBuffer = nullptr;
+	positionBuffer = nullptr;
 	indexBuffer = nullptr;
+	isReady = false;
+	InitLODs();
+}
+
+//Anything bigger than a Mesh, like a class made from it, doesn't fit in the blocks and goes on the heap
+void* Mesh::operator new(size_t size)
+{
+	if (size > GetMeshPool().GetBlockSize()) return ::operator new(size);
+	return GetMeshPool().Allocate();
+}
+
+void Mesh::operator delete(void* block, size_t size)
+{
+	if (size > GetMeshPool().GetBlockSize()) ::operator delete(block);
+	else GetMeshPool().Free(block);
 }
 
 Mesh::~Mesh()
 {
+	for (int l = 0; l < numLODs - 1; l++) {
+		delete lods[l];
+	}
 	ReleaseMacro(vertexBuffer);
+	ReleaseMacro(positionBuffer);
 	ReleaseMacro(indexBuffer);
 }
+
+void Mesh::InitLODs()
+{
+	numLODs = 1;
+	for (int l = 0; l < MAX_LODS - 1; l++) {
+		lods[l] = nullptr;
+	}
+}
+
+void Mesh::SetLOD(int level, Mesh* lod)
+{
+	//Drawing could already be picking levels once the mesh is ready
+	if (IsReady() || level != numLODs || level >= MAX_LODS) {
+		LogText("--ERROR--//LODs have to be added in order before the mesh is ready, this one is left out.");
+		delete lod;
+		return;
+	}
+	lods[level - 1] = lod;
+	numLODs++;
+}
+//Folds the unit sphere onto a square, the lower half gets flipped out into the corners
+static void EncodeOctahedral(const DirectX::XMFLOAT3& direction, short encoded[2])
+{
+	float length = fabsf(direction.x) + fabsf(direction.y) + fabsf(direction.z);
+	float x = length > 0 ? direction.x / length : 0;
+	float y = length > 0 ? direction.y / length : 0;
+	if (direction.z < 0) {
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = (short)floorf(x * 32767.0f + (x >= 0 ? 0.5f : -0.5f));
+	encoded[1] = (short)floorf(y * 32767.0f + (y >= 0 ? 0.5f : -0.5f));
+}
+
+//Bounds have to be worked out first, positions are quantized across them
+void Mesh::CompressVertices(const Vertex* vertices, int numVerts, CompactVertex* compactVertices)
+{
+	DirectX::XMFLOAT3 offset = GetPositionOffset();
+	DirectX::XMFLOAT3 scale = GetPositionScale();
+	//A flat axis has nothing to quantize, everything sits at the offset
+	float inverseScale[3] = {
+		scale.x > 0 ? 1.0f / scale.x : 0,
+		scale.y > 0 ? 1.0f / scale.y : 0,
+		scale.z > 0 ? 1.0f / scale.z : 0,
+	};
+	for (int v = 0; v < numVerts; v++) {
+		const Vertex& vertex = vertices[v];
+		CompactVertex& compact = compactVertices[v];
+		float position[3] = {
+			(vertex.Position.x - offset.x) * inverseScale[0],
+			(vertex.Position.y - offset.y) * inverseScale[1],
+			(vertex.Position.z - offset.z) * inverseScale[2],
+		};
+		for (int a = 0; a < 3; a++) {
+			float clamped = position[a] < 0 ? 0 : (position[a] > 1 ? 1 : position[a]);
+			compact.Position[a] = (unsigned short)(clamped * 65535.0f + 0.5f);
+		}
+		compact.Position[3] = 0;
+		EncodeOctahedral(vertex.Normal, compact.Normal);
+		EncodeOctahedral(vertex.Tangent, compact.Tangent);
+		compact.UV[0] = DirectX::PackedVector::XMConvertFloatToHalf(vertex.UV.x);
+		compact.UV[1] = DirectX::PackedVector::XMConvertFloatToHalf(vertex.UV.y);
+	}
+}
+
+//Box from the min and max of the positions, then a sphere at the box center that reaches the farthest vertex.
+//That sphere is usually tighter than the one around the box corners.
+void Mesh::CalculateBounds(Vertex* verts, int numVerts)
+{
+	if (numVerts <= 0) {
+		boundsCenter = DirectX::XMFLOAT3(0, 0, 0);
+		boundsExtents = DirectX::XMFLOAT3(0, 0, 0);
+		boundingRadius = 0;
+		return;
+	}
+	DirectX::XMVECTOR minPosition = DirectX::XMLoadFloat3(&verts[0].Position);
+	DirectX::XMVECTOR maxPosition = minPosition;
+	for (int i = 1; i < numVerts; i++)
+	{
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&verts[i].Position);
+		minPosition = DirectX::XMVectorMin(minPosition, position);
+		maxPosition = DirectX::XMVectorMax(maxPosition, position);
+	}
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(minPosition, maxPosition), 0.5f);
+	DirectX::XMStoreFloat3(&boundsCenter, center);
+	DirectX::XMStoreFloat3(&boundsExtents, DirectX::XMVectorScale(DirectX::XMVectorSubtract(maxPosition, minPosition), 0.5f));
+
+	float maxDistanceSquared = 0;
+	for (int i = 0; i < numVerts; i++)
+	{
+		float distanceSquared = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&verts[i].Position), center)));
+		if (distanceSquared > maxDistanceSquared) maxDistanceSquared = distanceSquared;
+	}
+	boundingRadius = sqrtf(maxDistanceSquared);
+}
+
 // Calculates the tangents of the vertices in a mesh
 // Code adapted from: http://www.terathon.com/code/tangent.html
 void Mesh::CalculateTangents(Vertex* verts, int numVerts, UINT* indices, int numIndices)
@@ -60,7 +297,7 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, UINT* indices, int num
 	}
 
 	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numVerts;)
+	for (int i = 0; i + 2 < numIndices;)
 	{
 		// Grab indices and vertices of first triangle
 		unsigned int i1 = indices[i++];
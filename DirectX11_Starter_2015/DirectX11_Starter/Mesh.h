@@ -2,24 +2,91 @@
 #include "Vertex.h"
 #include "DirectXGameCore.h"
 #include <d3d11.h>
+#include <atomic>
 
 class Mesh
 {
 public:
-	Mesh(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device);
-	Mesh();
+	//Input layouts for CompactVertex, reflection can't tell the shader's floats are packed
+	const static unsigned int NUM_COMPACT_INPUT_ELEMENTS = 4;
+	const static unsigned int NUM_INSTANCED_COMPACT_INPUT_ELEMENTS = 8;
+	static const D3D11_INPUT_ELEMENT_DESC COMPACT_INPUT_ELEMENTS[NUM_COMPACT_INPUT_ELEMENTS];
+	static const D3D11_INPUT_ELEMENT_DESC INSTANCED_COMPACT_INPUT_ELEMENTS[NUM_INSTANCED_COMPACT_INPUT_ELEMENTS];//Plus the world matrix rows
+	//Input layouts for the compact position stream, the full one is plain float3 and reflection gets it right
+	const static unsigned int NUM_COMPACT_POSITION_INPUT_ELEMENTS = 1;
+	const static unsigned int NUM_INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS = 5;
+	static const D3D11_INPUT_ELEMENT_DESC COMPACT_POSITION_INPUT_ELEMENTS[NUM_COMPACT_POSITION_INPUT_ELEMENTS];
+	static const D3D11_INPUT_ELEMENT_DESC INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS[NUM_INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS];
+	const static int MAX_LODS = 4;//Counting the mesh itself as level 0
+
+	//Fills in the tangents and bounds. The vertices are always given full size, newVertexFormat is what goes to the GPU
+	Mesh(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device, int newVertexFormat = VERTEX_FORMAT_FULL);
+	//For data that already has its tangents and bounds, like a cooked mesh file
+	//indices are already in indexFormat, R16_UINT or R32_UINT
+	Mesh(const Vertex* vertices, int numVerts, const void* indices, DXGI_FORMAT newIndexFormat, int newNumIndices, const DirectX::XMFLOAT3& newBoundsCenter,
+		const DirectX::XMFLOAT3& newBoundsExtents, float newBoundingRadius, ID3D11Device* device, int newVertexFormat = VERTEX_FORMAT_FULL);
+	Mesh();//Empty and not ready, a placeholder for a mesh that's still loading
 	~Mesh();
+	//Meshes and their LODs come out of a BlockPool instead of the heap
+	static void* operator new(size_t size);
+	static void operator delete(void* block, size_t size);
 	
-	//void InitNewData(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device);
+	//Fill in an empty mesh, same as the constructors. Only once per mesh, and it's safe off the main thread
+	//since the mesh only counts as ready after everything is set
+	void InitNewData(Vertex* vertices, int numVerts, UINT* indices, int newNumIndices, ID3D11Device* device, int newVertexFormat = VERTEX_FORMAT_FULL);
+	void InitNewData(const Vertex* vertices, int numVerts, const void* indices, DXGI_FORMAT newIndexFormat, int newNumIndices, const DirectX::XMFLOAT3& newBoundsCenter,
+		const DirectX::XMFLOAT3& newBoundsExtents, float newBoundingRadius, ID3D11Device* device, int newVertexFormat = VERTEX_FORMAT_FULL);
+	//Nothing else about the mesh means anything until this is true
+	bool IsReady() const { return isReady.load(std::memory_order_acquire); }
+	//Goes up every time a mesh becomes ready, so anything built from mesh bounds can tell when to redo itself
+	static unsigned int GetNumFinishedLoads() { return numFinishedLoads; }
 
 	ID3D11Buffer* const* GetVertexBuffer() { return &vertexBuffer;  }
+	//Only the positions, in the same encoding as the full vertices, for depth only passes
+	ID3D11Buffer* const* GetPositionBuffer() { return &positionBuffer; }
+	UINT GetPositionStride() const { return vertexFormat == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex::Position) : sizeof(DirectX::XMFLOAT3); }
 	ID3D11Buffer* GetIndexBuffer() const { return indexBuffer; }
 	int GetNumberOfIndices() { return numIndices; }
+	DXGI_FORMAT GetIndexFormat() const { return indexFormat; }//R16_UINT whenever every vertex fits, half the index memory
+	static bool CanUse16BitIndices(int numVerts) { return numVerts <= 65536; }
+	int GetVertexFormat() const { return vertexFormat; }
+	UINT GetVertexStride() const { return vertexFormat == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex); }
+	//Compact positions decode as position * scale + offset, the box the positions were quantized across
+	DirectX::XMFLOAT3 GetPositionScale() const { return DirectX::XMFLOAT3(boundsExtents.x * 2, boundsExtents.y * 2, boundsExtents.z * 2); }
+	DirectX::XMFLOAT3 GetPositionOffset() const { return DirectX::XMFLOAT3(boundsCenter.x - boundsExtents.x, boundsCenter.y - boundsExtents.y, boundsCenter.z - boundsExtents.z); }
+	unsigned int GetSortID() const { return sortID; }//Small unique id used by the render queue sort key
+	//Local space bounds, worked out once when the mesh is made
+	const DirectX::XMFLOAT3& GetBoundsCenter() const { return boundsCenter; }
+	const DirectX::XMFLOAT3& GetBoundsExtents() const { return boundsExtents; }//Half the size of the box on each axis
+	float GetBoundingRadius() const { return boundingRadius; }//Sphere around GetBoundsCenter
+
+	//Cheaper versions of the mesh for when it's small on screen, level 0 is the mesh itself.
+	//Every level uses the same vertex format, and the mesh owns and deletes them
+	int GetNumLODs() const { return numLODs; }
+	Mesh* GetLOD(int level) { return level == 0 ? this : lods[level - 1]; }
+	//Only before the mesh is ready, levels go in order and each one has fewer triangles than the last
+	void SetLOD(int level, Mesh* lod);
 private:
+	static unsigned int nextSortID;
+	static std::atomic<unsigned int> numFinishedLoads;
+	std::atomic<bool> isReady;
 	ID3D11Buffer* vertexBuffer;
+	ID3D11Buffer* positionBuffer;
 	ID3D11Buffer* indexBuffer;
 	int numIndices;
+	DXGI_FORMAT indexFormat;
+	int vertexFormat;
+	unsigned int sortID;
+	DirectX::XMFLOAT3 boundsCenter;
+	DirectX::XMFLOAT3 boundsExtents;
+	float boundingRadius;
+	Mesh* lods[MAX_LODS - 1];
+	int numLODs;
 
+	void InitLODs();
+	void CreateBuffers(const Vertex* vertices, int numVerts, const void* indices, int newNumIndices, ID3D11Device* device);
+	void CompressVertices(const Vertex* vertices, int numVerts, CompactVertex* compactVertices);
+	void CalculateBounds(Vertex* verts, int numVerts);
 	void CalculateTangents(Vertex* verts, int numVerts, UINT* indices, int numIndices);
 };
 
@@ -0,0 +1,252 @@
+#include "MeshOptimizer.h"
+#include <vector>
+#include <unordered_map>
+#include <math.h>
+
+//Scoring constants from the original write up
+const static int FORSYTH_CACHE_SIZE = 32;
+const static float CACHE_DECAY_POWER = 1.5f;
+const static float LAST_TRIANGLE_SCORE = 0.75f;
+const static float VALENCE_BOOST_SCALE = 2.0f;
+const static float VALENCE_BOOST_POWER = 0.5f;
+
+//Vertices in the cache score high, the three just used a bit less so the next triangle moves on.
+//Vertices with few triangles left get a boost so they get finished instead of left hanging
+static float ScoreVertex(int cachePosition, int numActiveTriangles)
+{
+	if (numActiveTriangles == 0) return -1.0f;
+	float score = 0;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+	score += VALENCE_BOOST_SCALE * powf((float)numActiveTriangles, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+void MeshOptimizer::OptimizeVertexCache(UINT* indices, int numIndices, int numVerts)
+{
+	int numTriangles = numIndices / 3;
+	if (numTriangles == 0 || numVerts == 0) return;
+
+	//Which triangles use each vertex, packed
+	std::vector<int> numActiveTriangles(numVerts, 0);
+	for (int i = 0; i < numTriangles * 3; i++) {
+		numActiveTriangles[indices[i]]++;
+	}
+	std::vector<int> adjacencyStarts(numVerts + 1, 0);
+	for (int v = 0; v < numVerts; v++) {
+		adjacencyStarts[v + 1] = adjacencyStarts[v] + numActiveTriangles[v];
+	}
+	std::vector<int> adjacency(numTriangles * 3);
+	std::vector<int> adjacencyFill(adjacencyStarts.begin(), adjacencyStarts.end() - 1);
+	for (int i = 0; i < numTriangles * 3; i++) {
+		adjacency[adjacencyFill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cachePositions(numVerts, -1);
+	std::vector<float> vertexScores(numVerts);
+	for (int v = 0; v < numVerts; v++) {
+		vertexScores[v] = ScoreVertex(-1, numActiveTriangles[v]);
+	}
+	std::vector<float> triangleScores(numTriangles);
+	std::vector<unsigned char> isTriangleAdded(numTriangles, 0);
+	for (int t = 0; t < numTriangles; t++) {
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<UINT> newIndices(numTriangles * 3);
+	int cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int bestTriangle = -1;
+	int nextUnaddedTriangle = 0;//Where the fallback search carries on from
+
+	for (int added = 0; added < numTriangles; added++) {
+		if (bestTriangle < 0) {
+			//Nothing in the cache touches a triangle that's left, start again from the best one anywhere
+			float bestScore = -1.0f;
+			for (int t = nextUnaddedTriangle; t < numTriangles; t++) {
+				if (isTriangleAdded[t]) continue;
+				if (bestTriangle < 0) nextUnaddedTriangle = t;
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+		int t = bestTriangle;
+		isTriangleAdded[t] = 1;
+		const UINT* triangle = &indices[t * 3];
+		newIndices[added * 3] = triangle[0];
+		newIndices[added * 3 + 1] = triangle[1];
+		newIndices[added * 3 + 2] = triangle[2];
+
+		//The triangle's vertices go to the front of the LRU cache, everything else gets pushed back
+		int newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCacheCount = 0;
+		for (int c = 0; c < 3; c++) {
+			int v = triangle[c];
+			newCache[newCacheCount++] = v;
+			//Take the triangle off the vertex's active list
+			int start = adjacencyStarts[v];
+			int end = start + numActiveTriangles[v];
+			for (int a = start; a < end; a++) {
+				if (adjacency[a] == t) {
+					adjacency[a] = adjacency[end - 1];
+					break;
+				}
+			}
+			numActiveTriangles[v]--;
+		}
+		for (int c = 0; c < cacheCount; c++) {
+			int v = cache[c];
+			if (v != (int)triangle[0] && v != (int)triangle[1] && v != (int)triangle[2]) newCache[newCacheCount++] = v;
+		}
+		//Anything that fell off the end is out of the cache now
+		for (int c = FORSYTH_CACHE_SIZE; c < newCacheCount; c++) {
+			cachePositions[newCache[c]] = -1;
+			vertexScores[newCache[c]] = ScoreVertex(-1, numActiveTriangles[newCache[c]]);
+		}
+		cacheCount = newCacheCount < FORSYTH_CACHE_SIZE ? newCacheCount : FORSYTH_CACHE_SIZE;
+		for (int c = 0; c < cacheCount; c++) {
+			cache[c] = newCache[c];
+			cachePositions[cache[c]] = c;
+			vertexScores[cache[c]] = ScoreVertex(c, numActiveTriangles[cache[c]]);
+		}
+
+		//Only triangles touching the cache changed score, the best of them goes next
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int c = 0; c < cacheCount; c++) {
+			int v = cache[c];
+			int start = adjacencyStarts[v];
+			for (int a = start; a < start + numActiveTriangles[v]; a++) {
+				int other = adjacency[a];
+				const UINT* otherTriangle = &indices[other * 3];
+				float score = vertexScores[otherTriangle[0]] + vertexScores[otherTriangle[1]] + vertexScores[otherTriangle[2]];
+				triangleScores[other] = score;
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = other;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < numTriangles * 3; i++) {
+		indices[i] = newIndices[i];
+	}
+}
+
+void MeshOptimizer::OptimizeVertexFetch(Vertex* vertices, int numVerts, UINT* indices, int numIndices)
+{
+	std::vector<int> remap(numVerts, -1);
+	std::vector<Vertex> newVertices;
+	newVertices.reserve(numVerts);
+	for (int i = 0; i < numIndices; i++) {
+		UINT v = indices[i];
+		if (remap[v] < 0) {
+			remap[v] = (int)newVertices.size();
+			newVertices.push_back(vertices[v]);
+		}
+		indices[i] = remap[v];
+	}
+	//Vertices no triangle uses end up dropped off the end, keep them so the count doesn't change
+	for (int v = 0; v < numVerts; v++) {
+		if (remap[v] < 0) newVertices.push_back(vertices[v]);
+	}
+	for (int v = 0; v < numVerts; v++) {
+		vertices[v] = newVertices[v];
+	}
+}
+
+float MeshOptimizer::CalculateACMR(const UINT* indices, int numIndices, int numVerts, int cacheSize)
+{
+	int numTriangles = numIndices / 3;
+	if (numTriangles == 0) return 0;
+	//When each vertex went in, it's still cached if fewer than cacheSize others went in since
+	std::vector<int> cacheTimes(numVerts, -cacheSize - 1);
+	int time = 0;
+	int misses = 0;
+	for (int i = 0; i < numTriangles * 3; i++) {
+		UINT v = indices[i];
+		if (time - cacheTimes[v] > cacheSize) {
+			cacheTimes[v] = time++;
+			misses++;
+		}
+	}
+	return (float)misses / numTriangles;
+}
+
+void MeshOptimizer::SimplifyByClustering(const Vertex* vertices, int numVerts, const UINT* indices, int numIndices, int gridSize,
+	std::vector<Vertex>& outVertices, std::vector<UINT>& outIndices)
+{
+	outVertices.clear();
+	outIndices.clear();
+	if (numVerts == 0 || gridSize < 1) return;
+
+	DirectX::XMFLOAT3 minPosition = vertices[0].Position;
+	DirectX::XMFLOAT3 maxPosition = vertices[0].Position;
+	for (int v = 1; v < numVerts; v++) {
+		const DirectX::XMFLOAT3& p = vertices[v].Position;
+		minPosition = DirectX::XMFLOAT3(fminf(minPosition.x, p.x), fminf(minPosition.y, p.y), fminf(minPosition.z, p.z));
+		maxPosition = DirectX::XMFLOAT3(fmaxf(maxPosition.x, p.x), fmaxf(maxPosition.y, p.y), fmaxf(maxPosition.z, p.z));
+	}
+	//Cube cells sized off the longest side, so a long thin mesh isn't squashed flat along its short sides
+	float longestSide = fmaxf(maxPosition.x - minPosition.x, fmaxf(maxPosition.y - minPosition.y, maxPosition.z - minPosition.z));
+	float cellScale = longestSide > 0 ? gridSize / longestSide : 0;
+
+	std::unordered_map<UINT64, UINT> clusters;
+	std::vector<UINT> remap(numVerts);
+	std::vector<int> clusterSizes;
+	for (int v = 0; v < numVerts; v++) {
+		const Vertex& vertex = vertices[v];
+		UINT64 x = (UINT64)fminf((vertex.Position.x - minPosition.x) * cellScale, (float)(gridSize - 1));
+		UINT64 y = (UINT64)fminf((vertex.Position.y - minPosition.y) * cellScale, (float)(gridSize - 1));
+		UINT64 z = (UINT64)fminf((vertex.Position.z - minPosition.z) * cellScale, (float)(gridSize - 1));
+		//Which way the normal points on each axis, so both sides of a thin wall or a hard edge don't get averaged together
+		UINT64 facing = (vertex.Normal.x >= 0 ? 1 : 0) | (vertex.Normal.y >= 0 ? 2 : 0) | (vertex.Normal.z >= 0 ? 4 : 0);
+		UINT64 key = (((x * gridSize + y) * gridSize + z) << 3) | facing;
+		auto found = clusters.find(key);
+		if (found == clusters.end()) {
+			//The first vertex in keeps its UV, averaging UVs breaks across seams
+			UINT cluster = (UINT)outVertices.size();
+			clusters[key] = cluster;
+			outVertices.push_back(vertex);
+			clusterSizes.push_back(1);
+			remap[v] = cluster;
+			continue;
+		}
+		Vertex& sum = outVertices[found->second];
+		sum.Position = DirectX::XMFLOAT3(sum.Position.x + vertex.Position.x, sum.Position.y + vertex.Position.y, sum.Position.z + vertex.Position.z);
+		sum.Normal = DirectX::XMFLOAT3(sum.Normal.x + vertex.Normal.x, sum.Normal.y + vertex.Normal.y, sum.Normal.z + vertex.Normal.z);
+		clusterSizes[found->second]++;
+		remap[v] = found->second;
+	}
+
+	for (unsigned int c = 0; c < outVertices.size(); c++) {
+		Vertex& vertex = outVertices[c];
+		float scale = 1.0f / clusterSizes[c];
+		vertex.Position = DirectX::XMFLOAT3(vertex.Position.x * scale, vertex.Position.y * scale, vertex.Position.z * scale);
+		float normalLength = sqrtf(vertex.Normal.x * vertex.Normal.x + vertex.Normal.y * vertex.Normal.y + vertex.Normal.z * vertex.Normal.z);
+		if (normalLength > 0) {
+			vertex.Normal = DirectX::XMFLOAT3(vertex.Normal.x / normalLength, vertex.Normal.y / normalLength, vertex.Normal.z / normalLength);
+		}
+	}
+
+	for (int i = 0; i + 2 < numIndices; i += 3) {
+		UINT a = remap[indices[i]];
+		UINT b = remap[indices[i + 1]];
+		UINT c = remap[indices[i + 2]];
+		//Collapsed to a line or a point
+		if (a == b || b == c || a == c) continue;
+		outIndices.push_back(a);
+		outIndices.push_back(b);
+		outIndices.push_back(c);
+	}
+}
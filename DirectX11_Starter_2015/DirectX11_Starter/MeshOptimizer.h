@@ -0,0 +1,29 @@
+#pragma once
+#include "Vertex.h"
+#include <d3d11.h>
+#include <vector>
+
+//Reorders an indexed triangle list so the GPU does less work. Meant to run once when a mesh is
+//cooked, the result draws exactly the same triangles, just in a different order.
+//Also makes the cut down versions of a mesh used for its LODs
+class MeshOptimizer
+{
+public:
+	const static int SIMULATED_CACHE_SIZE = 16;//Post transform cache size the miss ratio is measured with
+
+	//Triangle order for the post transform vertex cache (Tom Forsyth's linear speed algorithm)
+	static void OptimizeVertexCache(UINT* indices, int numIndices, int numVerts);
+	//Vertex order matching the first time each one is used, so fetches walk forward through memory.
+	//Run after OptimizeVertexCache, indices get remapped
+	static void OptimizeVertexFetch(Vertex* vertices, int numVerts, UINT* indices, int numIndices);
+
+	//Average cache miss ratio, vertex shader runs per triangle through a FIFO cache.
+	//3 is the worst, anything under 1 is good, around 0.5 is about as good as it gets
+	static float CalculateACMR(const UINT* indices, int numIndices, int numVerts, int cacheSize = SIMULATED_CACHE_SIZE);
+
+	//Vertex clustering: every vertex in the same grid cell, facing about the same way, becomes one, and triangles
+	//that collapse are dropped. gridSize cells along the longest side of the bounds, fewer cells is a coarser mesh.
+	//Tangents aren't kept, the mesh works them out again
+	static void SimplifyByClustering(const Vertex* vertices, int numVerts, const UINT* indices, int numIndices, int gridSize,
+		std::vector<Vertex>& outVertices, std::vector<UINT>& outIndices);
+};
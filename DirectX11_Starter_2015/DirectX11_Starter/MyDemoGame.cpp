@@ -27,12 +27,17 @@
 #include <fstream>
 #include <iostream>
 #include "Logger.h"
+#include "SceneLoader.h"
 
 #include "WICTextureLoader.h"
 
 // For the DirectX Math library
 using namespace DirectX;
 
+//What benchmarks spawn, one after another
+const int NUM_BENCHMARK_MESHES = 5;
+static const char* const BENCHMARK_MESH_NAMES[NUM_BENCHMARK_MESHES] = { "Cube", "Sphere", "Cylinder", "Torus", "Cone" };
+
 
 #pragma region Win32 Entry Point (WinMain)
 // --------------------------------------------------------
@@ -47,7 +52,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 #endif
 
 	// Create the game object.
-	MyDemoGame game(hInstance);
+	MyDemoGame game(hInstance, cmdLine);
 	
 	// This is where we'll create the window, initialize DirectX, 
 	// set up geometry and shaders, etc.
@@ -65,7 +70,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 // Base class constructor will set up all of the underlying
 // fields, and then we can overwrite any that we'd like
 // --------------------------------------------------------
-MyDemoGame::MyDemoGame(HINSTANCE hInstance) 
+MyDemoGame::MyDemoGame(HINSTANCE hInstance, const char* cmdLine) 
 	: DirectXGameCore(hInstance)
 {
 	// Set up a custom caption for the game window.
@@ -78,6 +83,28 @@ MyDemoGame::MyDemoGame(HINSTANCE hInstance)
 	// Custom window size - will be created by Init() later
 	windowWidth = 1280;
 	windowHeight = 720;
+
+	renderPathKeyDown = false;
+	depthPrePassKeyDown = false;
+	profilerOverlayKeyDown = false;
+	profilerTraceKeyDown = false;
+	showProfilerOverlay = false;
+	drawsProfilerOverlay = false;
+
+	frameArena = nullptr;
+	renderArena = nullptr;
+	presentModeKeyDown = false;
+	pipelineKeyDown = false;
+	gpuCullingKeyDown = false;
+	usePipelinedRendering = true;
+	benchmark = nullptr;
+	BenchmarkSettings benchmarkSettings;
+	if (Benchmark::ParseCommandLine(cmdLine, benchmarkSettings)) benchmark = new Benchmark(benchmarkSettings);
+	//Benchmarks measure how fast frames can go, not the display
+	presentMode = benchmark != nullptr ? PRESENT_MODE_UNCAPPED : PRESENT_MODE_VSYNC;
+	//A benchmark frame is exactly one step, so its frames are the same however fast it runs
+	useFixedTimestep = benchmark == nullptr;
+	frameRateCap = 144.0f;
 }
 
 // --------------------------------------------------------
@@ -93,37 +120,22 @@ MyDemoGame::~MyDemoGame()
 
 
 	delete render;
+	delete shaderCache;
 
-	// Delete our simple shaders
-	delete vertexShader;
-	delete pixelShader;
-
-	delete basicMaterial1;
-	delete basicMaterial2;
-
-	if (texture1SRC != nullptr) {
-		texture1SRC->Release();
-		texture1SRC = nullptr;
-	}
-	if (texture1NSRC != nullptr) {
-		texture1NSRC->Release();
-		texture1NSRC = nullptr;
-	}
-	if (texture2SRC != nullptr) {
-		texture2SRC->Release();
-		texture2SRC = nullptr;
-	}
-	if (texture2NSRC != nullptr) {
-		texture2NSRC->Release();
-		texture2NSRC = nullptr;
-	}
+	//Shaders, materials and textures belong to Resources
 	if (samplerState != nullptr) {
 		samplerState->Release();
 		samplerState = nullptr;
 	}
 	
 	delete entSys;
+	delete jobs;
 	delete res;
+	delete profilerOverlay;
+	delete profiler;
+	delete benchmark;
+	delete frameArena;
+	delete renderArena;
 }
 
 #pragma endregion
@@ -145,13 +157,49 @@ bool MyDemoGame::Init()
 	// with and set up matrices so we can see how to pass data to the GPU.
 	//  - For your own projects, feel free to expand/replace these.
 
-	render = new Render(deviceContext);
-	res = new Resources(device);
-	entSys = new EntitySystem(200);
+	//First, so everything made after it can be timed
+	profiler = new Profiler(device, deviceContext);
+	Profiler::SetActive(profiler);
+	profilerOverlay = new ProfilerOverlay(device, deviceContext);
+
+	res = new Resources(device, deviceContext);
+	shaderCache = new ShaderCache(device, deviceContext, res);
+	render = new Render(device, deviceContext, shaderCache);
+	res->SetVertexFormat(VERTEX_FORMAT_COMPACT);
+	jobs = new JobSystem();
+	frameArena = new LinearArena();
+	renderArena = new LinearArena();
+	render->SetJobSystem(jobs);
+	render->SetUseDeferredContexts(true);
+	int maxEntities = MAX_NUM_OF_ENTITIES + (benchmark != nullptr ? benchmark->GetSettings().numSpawnedEntities : 0);
+	entSys = new EntitySystem(maxEntities, jobs);
+	entSys->SetResources(res);
 
 	LoadShaders(); 
 	CreateGeometry();
-	TestLoadLevel("Assets/Maps/Untitled.txt");
+	SceneLoader sceneLoader(entSys, res, render, basicMaterial2);
+	bool hasBenchmarkMap = benchmark != nullptr && !benchmark->GetSettings().mapPath.empty();
+	sceneLoader.Load(hasBenchmarkMap ? benchmark->GetSettings().mapPath.c_str() : "Assets/Maps/Untitled.txt");
+	if (benchmark != nullptr) {
+		ResourceHandle spawnMeshes[NUM_BENCHMARK_MESHES];
+		for (int m = 0; m < NUM_BENCHMARK_MESHES; m++) {
+			spawnMeshes[m] = res->RequestMesh(BENCHMARK_MESH_NAMES[m]);
+		}
+		benchmark->SpawnEntities(entSys, render, res, spawnMeshes, NUM_BENCHMARK_MESHES, basicMaterial1);
+		//The spawned entities hold their own references
+		for (int m = 0; m < NUM_BENCHMARK_MESHES; m++) {
+			res->ReleaseMesh(spawnMeshes[m]);
+		}
+		benchmark->LoadCameraPath();
+		render->SetUseGPUCulling(benchmark->GetSettings().useGPUCulling);
+		//Streaming in during the run would land in the numbers
+		res->WaitForPendingLoads();
+	}
+	{
+		//Only for building the scene, gone once it's built
+		LinearArena loadArena;
+		entSys->BuildStaticScene(loadArena);
+	}
 
 	// Tell the input assembler stage of the pipeline what kind of
 	// geometric primitives we'll be using and how to interpret them
@@ -164,8 +212,12 @@ bool MyDemoGame::Init()
 	light1.GetTransform().SetRotation(XMFLOAT3(1, 0, 0));
 	GameLight light2 = GameLight(LIGHT_POINT ,XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), XMFLOAT4(0.4f, 0.8f, 0.4f, 1.0f));
 	//light2.GetTransform().SetRotation(XMFLOAT3(1, -1, 0));
-	render->SetLight(light1, 0);
-	render->SetLight(light2, 1);
+	light2.SetRange(20.0f);
+	render->AddLight(light1);
+	render->AddLight(light2);
+
+	//Every frame after this ends and the next begins in SwapFrames
+	profiler->BeginFrame();
 
 	// Successfully initialized
 	return true;
@@ -173,23 +225,38 @@ bool MyDemoGame::Init()
 
 
 // --------------------------------------------------------
-// Loads shaders from compiled shader object (.cso) files
+// Loads shader permutations through the shader cache, which
+// compiles them the first time and keeps them from then on
 // - These simple shaders provide helpful methods for sending
 //   data to individual variables on the GPU
 // --------------------------------------------------------
 void MyDemoGame::LoadShaders()
 {
-	vertexShader = new SimpleVertexShader(device, deviceContext);
-	vertexShader->LoadShaderFile(L"VertexShader.cso");
+	//The vertex shaders don't have any features of their own
+	ShaderDefines vertexDefines = 0;
+	vertexShader = shaderCache->GetVertexShader("VertexShader", vertexDefines);
+	instancedVertexShader = shaderCache->GetVertexShader("InstancedVertexShader", vertexDefines);
+	compactVertexShader = shaderCache->GetVertexShader("CompactVertexShader", vertexDefines,
+		Mesh::COMPACT_INPUT_ELEMENTS, Mesh::NUM_COMPACT_INPUT_ELEMENTS);
+	instancedCompactVertexShader = shaderCache->GetVertexShader("InstancedCompactVertexShader", vertexDefines,
+		Mesh::INSTANCED_COMPACT_INPUT_ELEMENTS, Mesh::NUM_INSTANCED_COMPACT_INPUT_ELEMENTS);
+	pixelShader = shaderCache->GetPixelShader("PixelShader", SHADER_FEATURE_NORMAL_MAP);
+	render->SetClusterShader(shaderCache->GetComputeShader("ClusterLights", 0));
+	render->SetCullShader(shaderCache->GetComputeShader("CullInstances", 0));
+	gBufferPixelShader = shaderCache->GetPixelShader("GBufferPixelShader", SHADER_FEATURE_NORMAL_MAP);
+	fullscreenVertexShader = shaderCache->GetVertexShader("FullscreenVertexShader", 0);
+	deferredLightingShader = shaderCache->GetPixelShader("DeferredLighting", 0);
+	render->SetDeferredLighting(fullscreenVertexShader, deferredLightingShader);
+	render->SetDepthPrePassShader(VERTEX_FORMAT_FULL, false, shaderCache->GetVertexShader("DepthVertexShader", 0));
+	render->SetDepthPrePassShader(VERTEX_FORMAT_FULL, true, shaderCache->GetVertexShader("DepthVertexShader", SHADER_FEATURE_INSTANCED));
+	render->SetDepthPrePassShader(VERTEX_FORMAT_COMPACT, false, shaderCache->GetVertexShader("DepthVertexShader", SHADER_FEATURE_COMPACT_VERTEX,
+		Mesh::COMPACT_POSITION_INPUT_ELEMENTS, Mesh::NUM_COMPACT_POSITION_INPUT_ELEMENTS));
+	render->SetDepthPrePassShader(VERTEX_FORMAT_COMPACT, true, shaderCache->GetVertexShader("DepthVertexShader", SHADER_FEATURE_COMPACT_VERTEX | SHADER_FEATURE_INSTANCED,
+		Mesh::INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS, Mesh::NUM_INSTANCED_COMPACT_POSITION_INPUT_ELEMENTS));
+	render->SetUseDepthPrePass(true);
+	render->SetUseShadows(true);
 
-	pixelShader = new SimplePixelShader(device, deviceContext);
-	pixelShader->LoadShaderFile(L"PixelShader.cso");
 
-
-	CreateWICTextureFromFile(device, deviceContext, L"Assets/Textures/BrickOldMixedSize.jpg", NULL, &texture1SRC);
-	CreateWICTextureFromFile(device, deviceContext, L"Assets/Textures/Normal_BrickOldMixedSize.jpg", NULL, &texture1NSRC);
-	CreateWICTextureFromFile(device, deviceContext, L"Assets/Textures/RockSmooth.jpg", NULL, &texture2SRC);
-	CreateWICTextureFromFile(device, deviceContext, L"Assets/Textures/Normal_RockSmooth.jpg", NULL, &texture2NSRC);
 	//Sampler State
 	D3D11_SAMPLER_DESC samplerDesc = {};
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -200,86 +267,30 @@ void MyDemoGame::LoadShaders()
 	device->CreateSamplerState(&samplerDesc, &samplerState);
 
 
-	basicMaterial1 = new Material(vertexShader, pixelShader, texture1SRC, texture1NSRC, samplerState);
-	basicMaterial2 = new Material(vertexShader, pixelShader, texture2SRC, texture2NSRC, samplerState);
-}
-
-void MyDemoGame::TestLoadLevel(char* mapName) {
-	std::ifstream s(mapName);
-	if (!s.is_open()) {
-		return;
-	}
-
-	int state = 0;
-	//0 is the meta data
-	//1 is the turrets
-	//2 is light
-	//3 is background
-	//4 is arena
-	char chars[400];
-	Entity* currentEntity = nullptr;
-	while (s.good())
-	{
-		s.getline(chars, 400);
-		std::string line(chars);
-		bool statelessRead = false;
-		//LogText(chars);
-		if (std::strstr(chars, "arena")) {
-			statelessRead = true;
-			state = 4;
-		}
-		else if (std::strstr(chars, "pos")) {
-			DirectX::XMFLOAT3 pos;
-			sscanf_s(chars, "pos %f %f %f", &pos.x, &pos.y, &pos.z);
-			if (currentEntity != nullptr) {
-				currentEntity->GetTransform().SetPosition(pos);
-			}
-			statelessRead = true;
-		}
-		else if (std::strstr(chars, "rot")) {
-			DirectX::XMFLOAT3 rot;
-			sscanf_s(chars, "rot %f %f %f", &rot.x, &rot.y, &rot.z);
-			if (currentEntity != nullptr) {
-				currentEntity->GetTransform().SetRotation(rot);
-			}
-			statelessRead = true;
-		}
-		else if (std::strstr(chars, "scl")) {
-			DirectX::XMFLOAT3 scl;
-			sscanf_s(chars, "scl %f %f %f", &scl.x, &scl.y, &scl.z);
-			if (currentEntity != nullptr) {
-				currentEntity->GetTransform().SetScale(scl);
-			}
-			statelessRead = true;
-		}
-		if (!statelessRead) {
-			switch (state)
-			{
-			case 4:
-				if (std::strstr(chars, "model")) 
-				{
-					std::string modelName = line.substr(6, line.length());
-					//LogText(modelName);
-					Mesh* newMesh = nullptr;
-					if (!res->IsMeshLoaded(modelName.c_str())) {
-						res->LoadMesh(modelName.c_str());
-					}
-					newMesh = res->GetMeshIfLoaded(modelName.c_str());
-					if (newMesh != nullptr) {
-						currentEntity = entSys->AddEntity();
-						currentEntity->AddComponent(new DrawnMesh(render, newMesh, basicMaterial2));
-						//ents.push_back(currentEntity);
-					}
-					else {
-						currentEntity = nullptr;
-					}
-				}
-				break;
-			default:
-				break;
-			}
-		}
-	}
+	//Textures stream in, the materials draw with the placeholders until they're done
+	basicMaterial1 = new Material(shaderCache, vertexShader, pixelShader, res->GetPlaceholderTexture(), res->GetFlatNormalMap(), samplerState);
+	basicMaterial2 = new Material(shaderCache, vertexShader, pixelShader, res->GetPlaceholderTexture(), res->GetFlatNormalMap(), samplerState);
+	res->RequestTexture(L"Assets/Textures/BrickOldMixedSize.jpg", [this](ID3D11ShaderResourceView* srv) {
+		basicMaterial1->SetDiffuseSRV(srv);
+	});
+	res->RequestTexture(L"Assets/Textures/Normal_BrickOldMixedSize.jpg", [this](ID3D11ShaderResourceView* srv) {
+		basicMaterial1->SetNormalMapSRV(srv);
+	});
+	res->RequestTexture(L"Assets/Textures/RockSmooth.jpg", [this](ID3D11ShaderResourceView* srv) {
+		basicMaterial2->SetDiffuseSRV(srv);
+	});
+	res->RequestTexture(L"Assets/Textures/Normal_RockSmooth.jpg", [this](ID3D11ShaderResourceView* srv) {
+		basicMaterial2->SetNormalMapSRV(srv);
+	});
+	basicMaterial1->SetGBufferPixelShader(gBufferPixelShader);
+	basicMaterial2->SetGBufferPixelShader(gBufferPixelShader);
+	basicMaterial1->SetInstancedVertexShader(instancedVertexShader);
+	basicMaterial2->SetInstancedVertexShader(instancedVertexShader);
+	basicMaterial1->SetCompactVertexShaders(compactVertexShader, instancedCompactVertexShader);
+	basicMaterial2->SetCompactVertexShaders(compactVertexShader, instancedCompactVertexShader);
+
+	res->GetMaterials().Add(HashResourceName("Brick"), basicMaterial1);
+	res->GetMaterials().Add(HashResourceName("Rock"), basicMaterial2);
 }
 
 // --------------------------------------------------------
@@ -290,9 +301,10 @@ void MyDemoGame::CreateGeometry()
 	XMFLOAT3 normal	= XMFLOAT3(0, 1, 0);
 	XMFLOAT3 tangent = XMFLOAT3(0, 0, 1);
 
-	Mesh* mesh1 = res->GetMeshAndLoadIfNotFound("Helix");
-	Entity* entity1 = entSys->AddEntity();
-	entity1->AddComponent(new DrawnMesh(render, mesh1, basicMaterial1));
+	//Each drawn mesh takes over the reference its mesh was made or requested with
+	ResourceHandle mesh1 = res->RequestMesh("Helix");
+	EntityHandle entity1 = entSys->AddEntity();
+	entSys->AddDrawnMesh(entity1, DrawnMesh(render, res->GetMesh(mesh1), basicMaterial1, mesh1));
 	//ents.push_back(entity1);
 
 	float halfSize = 10 * 0.5f;
@@ -305,14 +317,14 @@ void MyDemoGame::CreateGeometry()
 		{ XMFLOAT3(+halfSize, +yPos, +halfSize), normal, XMFLOAT2(1, 1), tangent },// 3
 	};
 	UINT indices2[] = { 0, 1, 2, 0, 3, 1 };
-	Mesh* mesh2 = res->AddMesh("ground" ,vertices2, 4, indices2, 6);
-	Entity* entity2 = entSys->AddEntity();
-	entity2->AddComponent(new DrawnMesh(render, mesh2, basicMaterial2));
+	ResourceHandle mesh2 = res->AddMesh("ground" ,vertices2, 4, indices2, 6);
+	EntityHandle entity2 = entSys->AddEntity();
+	entSys->AddDrawnMesh(entity2, DrawnMesh(render, res->GetMesh(mesh2), basicMaterial2, mesh2));
 	//ents.push_back(entity2);
 
-	Mesh* mesh3 = res->GetMeshAndLoadIfNotFound("Sphere");//vertices3, 3, indices3, 3
-	Entity* entity3 = entSys->AddEntity();
-	entity3->AddComponent(new DrawnMesh(render, mesh3, basicMaterial1));
+	ResourceHandle mesh3 = res->RequestMesh("Sphere");//vertices3, 3, indices3, 3
+	EntityHandle entity3 = entSys->AddEntity();
+	entSys->AddDrawnMesh(entity3, DrawnMesh(render, res->GetMesh(mesh3), basicMaterial1, mesh3));
 	//ents.push_back(entity3);
 }
 
@@ -337,42 +349,112 @@ void MyDemoGame::OnResize()
 #pragma region Game Loop
 
 // --------------------------------------------------------
-// Update your game here - take input, move objects, etc.
+// Once a frame, before the simulation catches up - anything
+// that should feel as fast as the frame rate goes here
 // --------------------------------------------------------
-float x = 0;
-void MyDemoGame::UpdateScene(float deltaTime, float totalTime)
+void MyDemoGame::BeginFrame(float deltaTime, float totalTime)
 {
+	CPUProfileScope scope("BeginFrame");
+
 	// Quit if the escape key is pressed
 	if (GetAsyncKeyState(VK_ESCAPE))
 		Quit();
 
+	//Benchmarks run the same frames no matter how long the last one took or what gets pressed
+	if (benchmark == nullptr) UpdateToggles();
+
+	//Temp camera and input stuff
+	//The camera isn't part of the simulation, so looking around isn't held to the step rate
+	if (benchmark != nullptr) {
+		XMFLOAT3 cameraPosition;
+		XMFLOAT3 cameraRotation;
+		benchmark->GetCameraPose(cameraPosition, cameraRotation);
+		camera.GetTransform().SetPosition(cameraPosition);
+		camera.GetTransform().SetRotation(cameraRotation);
+	}
+	else {
+		LONG deltaMouseX = curMousePos.x - prevMousePos.x;
+		LONG deltaMouseY = curMousePos.y - prevMousePos.y;
+		camera.Update(deltaTime, deltaMouseX, deltaMouseY);
+	}
+	prevMousePos.x = curMousePos.x;
+	prevMousePos.y = curMousePos.y;
+
+	DirectX::XMFLOAT3 cpos = camera.GetTransform().GetPosition();
+	//cpos.y = 0;
+	//cpos.z = 0;
+	render->GetLight(1).GetTransform().SetPosition(cpos);
+}
+
+// --------------------------------------------------------
+// Update your game here - move objects, etc.
+// One fixed step of the simulation, can run a few times a frame
+// --------------------------------------------------------
+float x = 0;
+void MyDemoGame::UpdateScene(float deltaTime, float totalTime)
+{
+	CPUProfileScope scope("UpdateScene");
+
+	//Benchmarks step once a frame, by their own timestep
+	if (benchmark != nullptr) {
+		deltaTime = benchmark->GetSettings().timestep;
+		totalTime = benchmark->GetTime();
+	}
+
 	DirectX::XMFLOAT3 rot = entSys->GetEntity(0)->GetTransform().GetRotation();
 	float rotRate = 0.5f;
 	rot.x += rotRate * deltaTime;
 	rot.y += rotRate * deltaTime;
 	rot.z += rotRate * deltaTime;
 	//render->GetLight(0).GetTransform().SetRotation(rot);
-	DirectX::XMFLOAT3 cpos = camera.GetTransform().GetPosition();
-	//cpos.y = 0;
-	//cpos.z = 0;
-	render->GetLight(1).GetTransform().SetPosition(cpos);
 	entSys->GetEntity(0)->GetTransform().SetRotation(rot);
 	DirectX::XMFLOAT3 pos = entSys->GetEntity(0)->GetTransform().GetPosition();
 	pos.x += 0.08f * deltaTime;
 	entSys->GetEntity(0)->GetTransform().SetPosition(pos);
 	entSys->GetEntity(2)->GetTransform().SetParrent(&entSys->GetEntity(0)->GetTransform());
 
-	entSys->Update();
+	entSys->Step();
 	/*for (int e = 0; e < ents.size(); e++) {
 		ents[e]->Update();
 	}*/
+}
 
-	//Temp camera and input stuff
-	LONG deltaMouseX = curMousePos.x - prevMousePos.x;
-	LONG deltaMouseY = curMousePos.y - prevMousePos.y;
-	camera.Update(deltaTime, deltaMouseX, deltaMouseY);
-	prevMousePos.x = curMousePos.x;
-	prevMousePos.y = curMousePos.y;
+// --------------------------------------------------------
+// Culls against this frame's view and sends what's left to
+// the renderer, where things are between the last two steps
+// --------------------------------------------------------
+void MyDemoGame::SubmitScene(float deltaTime, float totalTime)
+{
+	CPUProfileScope scope("SubmitScene");
+	entSys->SetCullingFrustum(&camera.GetFrustum());
+	render->SetView(camera);
+	entSys->SetLODView(camera.GetTransform().GetPosition(), camera.GetProjectionMatrix()._22);//Stored transposed, the diagonal doesn't care
+	entSys->SubmitDraws(interpolation, *frameArena);
+}
+
+// --------------------------------------------------------
+// Between frames, with nothing drawing - the one place the
+// device context and what the renderer reads can be shared
+// --------------------------------------------------------
+void MyDemoGame::SwapFrames()
+{
+	render->SwapFrames();
+	res->SwapFrames();
+	drawsProfilerOverlay = showProfilerOverlay;
+	//All of the submitted frame got copied into the renderer, so the next one starts on an empty arena
+	Profiler::Count(PROFILE_COUNTER_FRAME_ARENA_BYTES, (long long)frameArena->GetUsed());
+	frameArena->Reset();
+
+	//A profiler frame is everything between two swaps, the simulation of one frame alongside the drawing of the one before
+	profiler->EndFrame();
+	if (benchmark != nullptr && benchmark->RecordFrame(*profiler)) {
+		LogText(benchmark->WriteResults() ? "Benchmark finished" : "--ERROR--//Benchmark finished but its results couldn't be written.");
+		Quit();
+	}
+	profiler->BeginFrame();
+
+	//Finished loads make their mips on the context and go into materials the renderer reads
+	res->Update();
 }
 
 // --------------------------------------------------------
@@ -383,24 +465,80 @@ void MyDemoGame::DrawScene(float deltaTime, float totalTime)
 	// Background color (Cornflower Blue in this case) for clearing
 	const float color[4] = {0.4f, 0.6f, 0.75f, 0.0f};
 
-	// Clear the render target and depth buffer (erases what's on the screen)
-	//  - Do this ONCE PER FRAME
-	//  - At the beginning of DrawScene (before drawing *anything*)
-	deviceContext->ClearRenderTargetView(renderTargetView, color);
-	deviceContext->ClearDepthStencilView(
-		depthStencilView, 
-		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
-		1.0f,
-		0);
-
-	render->UpdateAndRender(camera);
-
+	{
+		CPUProfileScope scope("DrawScene");
+		GPUProfileScope gpuScope("Frame");
+
+		// Clear the render target and depth buffer (erases what's on the screen)
+		//  - Do this ONCE PER FRAME
+		//  - At the beginning of DrawScene (before drawing *anything*)
+		deviceContext->ClearRenderTargetView(renderTargetView, color);
+		deviceContext->ClearDepthStencilView(
+			depthStencilView, 
+			D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
+			1.0f,
+			0);
+
+		//Only what was handed over in SwapFrames, the next frame can be simulating while this runs
+		render->UpdateAndRender(*renderArena);
+		//The last finished frame's numbers, over the top of everything
+		if (drawsProfilerOverlay) profilerOverlay->Draw(*profiler, windowWidth);
+	}
 
 	// Present the buffer
 	//  - Puts the image we're drawing into the window so the user can see it
 	//  - Do this exactly ONCE PER FRAME
 	//  - Always at the very end of the frame
-	HR(swapChain->Present(0, 0));
+	{
+		CPUProfileScope scope("Present");
+		Present();
+	}
+	Profiler::Count(PROFILE_COUNTER_FRAME_ARENA_BYTES, (long long)renderArena->GetUsed());
+	renderArena->Reset();
+}
+
+// --------------------------------------------------------
+// Debug keys, each one flips its setting once per press
+// --------------------------------------------------------
+void MyDemoGame::UpdateToggles()
+{
+	//Both paths draw the same scene, so they can be compared side by side
+	bool renderPathKey = (GetAsyncKeyState('G') & 0x8000) != 0;
+	if (renderPathKey && !renderPathKeyDown) {
+		render->SetRenderPath(render->GetRenderPath() == RENDER_PATH_FORWARD ? RENDER_PATH_DEFERRED : RENDER_PATH_FORWARD);
+	}
+	renderPathKeyDown = renderPathKey;
+	bool depthPrePassKey = (GetAsyncKeyState('Z') & 0x8000) != 0;
+	if (depthPrePassKey && !depthPrePassKeyDown) {
+		render->SetUseDepthPrePass(!render->GetUseDepthPrePass());
+		LogText(render->GetUseDepthPrePass() ? "Depth pre-pass: on" : "Depth pre-pass: off");
+	}
+	depthPrePassKeyDown = depthPrePassKey;
+	bool profilerOverlayKey = (GetAsyncKeyState('P') & 0x8000) != 0;
+	if (profilerOverlayKey && !profilerOverlayKeyDown) showProfilerOverlay = !showProfilerOverlay;
+	profilerOverlayKeyDown = profilerOverlayKey;
+	bool profilerTraceKey = (GetAsyncKeyState('T') & 0x8000) != 0;
+	if (profilerTraceKey && !profilerTraceKeyDown && profiler->WriteChromeTrace("profile_trace.json")) {
+		LogText("Wrote profile_trace.json");
+	}
+	profilerTraceKeyDown = profilerTraceKey;
+	bool presentModeKey = (GetAsyncKeyState('V') & 0x8000) != 0;
+	if (presentModeKey && !presentModeKeyDown) SetPresentMode((GetPresentMode() + 1) % NUM_PRESENT_MODES);
+	presentModeKeyDown = presentModeKey;
+	//Takes effect from the next frame that's handed over
+	bool pipelineKey = (GetAsyncKeyState('F') & 0x8000) != 0;
+	if (pipelineKey && !pipelineKeyDown) {
+		usePipelinedRendering = !usePipelinedRendering;
+		LogText(usePipelinedRendering ? "Pipelined rendering: on" : "Pipelined rendering: off");
+	}
+	pipelineKeyDown = pipelineKey;
+	//The static scene gets rebuilt for it on the next submit
+	bool gpuCullingKey = (GetAsyncKeyState('C') & 0x8000) != 0;
+	if (gpuCullingKey && !gpuCullingKeyDown) {
+		render->SetUseGPUCulling(!render->GetUseGPUCulling());
+		LogText(render->GetUseGPUCulling() ? "GPU culling: on" : "GPU culling: off");
+	}
+	gpuCullingKeyDown = gpuCullingKey;
 }
 
 #pragma endregion
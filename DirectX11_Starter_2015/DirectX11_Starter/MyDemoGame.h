@@ -14,6 +14,12 @@
 #include "Material.h"
 #include "Light.h"
 #include "Resources.h"
+#include "ShaderCache.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "Benchmark.h"
+#include "LinearArena.h"
 
 // Include run-time memory checking in debug builds, so 
 // we can be notified of memory leaks
@@ -28,13 +34,19 @@
 class MyDemoGame : public DirectXGameCore
 {
 public:
-	MyDemoGame(HINSTANCE hInstance);
+	const static int MAX_NUM_OF_ENTITIES = 4096;
+
+	//"-benchmark" on the command line runs a benchmark and quits, see Benchmark for the rest of the options
+	MyDemoGame(HINSTANCE hInstance, const char* cmdLine);
 	~MyDemoGame();
 
 	// Overrides for base level methods
 	bool Init();
 	void OnResize();
+	void BeginFrame(float deltaTime, float totalTime);
 	void UpdateScene(float deltaTime, float totalTime);
+	void SubmitScene(float deltaTime, float totalTime);
+	void SwapFrames();
 	void DrawScene(float deltaTime, float totalTime);
 
 	// For handing mouse input
@@ -48,8 +60,8 @@ private:
 	// start doing something more advanced!
 	void LoadShaders(); 
 	void CreateGeometry();
+	void UpdateToggles();
 
-	void TestLoadLevel(char* mapName);
 
 	// Buffers to hold actual geometry data
 	ID3D11Buffer* vertexBuffer;
@@ -58,18 +70,29 @@ private:
 	Camera camera;
 	Resources* res;
 	Render* render;
+	ShaderCache* shaderCache;
 	Material* basicMaterial1;
 	Material* basicMaterial2;
-	ID3D11ShaderResourceView* texture1SRC;
-	ID3D11ShaderResourceView* texture1NSRC;//Normal
-	ID3D11ShaderResourceView* texture2SRC;
-	ID3D11ShaderResourceView* texture2NSRC;//Normal
 	ID3D11SamplerState* samplerState;
 	EntitySystem* entSys;
+	JobSystem* jobs;
+	Profiler* profiler;
+	ProfilerOverlay* profilerOverlay;
+	bool showProfilerOverlay;
+	bool drawsProfilerOverlay;//showProfilerOverlay as of the frame being drawn
+	Benchmark* benchmark;//nullptr outside of benchmarks
+	LinearArena* frameArena;//Submission's, everything in it is gone once the frame is handed over
+	LinearArena* renderArena;//DrawScene's, so it never shares one with the game thread
 
 	// Wrappers for DirectX shaders to provide simplified functionality
 	SimpleVertexShader* vertexShader;
+	SimpleVertexShader* instancedVertexShader;//Draws runs of the same mesh and material in one call
+	SimpleVertexShader* compactVertexShader;//Versions of the two above for meshes with CompactVertex
+	SimpleVertexShader* instancedCompactVertexShader;
 	SimplePixelShader* pixelShader;
+	SimplePixelShader* gBufferPixelShader;//Deferred shading versions of pixelShader and the pass that lights them
+	SimpleVertexShader* fullscreenVertexShader;
+	SimplePixelShader* deferredLightingShader;
 
 	// The matrices to go from model space to screen space
 	//DirectX::XMFLOAT4X4 worldMatrix;
@@ -78,4 +101,17 @@ private:
 	// determining how far the mouse moved in a single frame.
 	POINT prevMousePos;
 	POINT curMousePos;
+
+	//G switches between forward and deferred shading, Z turns the depth pre-pass on and off, once per press
+	bool renderPathKeyDown;
+	bool depthPrePassKeyDown;
+	//P shows and hides the profiler overlay, T writes the frames the profiler has to a trace
+	bool profilerOverlayKeyDown;
+	bool profilerTraceKeyDown;
+	//V goes through vsync, uncapped and capped, the window title says which
+	bool presentModeKeyDown;
+	//F draws on the render thread or right after the simulation, to compare the two
+	bool pipelineKeyDown;
+	//C culls the static instanced meshes on the GPU or with everything else
+	bool gpuCullingKeyDown;
 };
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include "Profiler.h"
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <DirectXMath.h>
+#include "DirectXGameCore.h"
+#include "Logger.h"
+
+Profiler* Profiler::active = nullptr;
+
+//Each thread's open CPU scopes, so nested ones know how deep they are
+static thread_local int cpuDepth = 0;
+
+static const char* const COUNTER_NAMES[NUM_PROFILE_COUNTERS] = {
+	"Draw calls",
+	"State changes",
+	"Constant bytes",
+	"Triangles",
+	"Heap allocations",
+	"Frame arena bytes",
+};
+
+//Replaced for the whole program so every heap allocation gets counted, the array forms and
+//sized deletes end up in these. Allocations made before there's a profiler just aren't counted
+void* operator new(size_t size)
+{
+	Profiler::Count(PROFILE_COUNTER_HEAP_ALLOCATIONS, 1);
+	void* memory = malloc(size > 0 ? size : 1);
+	if (memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+Profiler::Profiler(ID3D11Device* newDevice, ID3D11DeviceContext* newContext)
+{
+	device = newDevice;
+	context = newContext;
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	ticksToMicroseconds = 1000000.0 / (double)frequency.QuadPart;
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	startTicks = now.QuadPart;
+
+	history.resize(NUM_HISTORY_FRAMES);
+	for (int f = 0; f < NUM_HISTORY_FRAMES; f++) {
+		history[f].number = 0;
+		history[f].start = 0;
+		history[f].end = 0;
+		history[f].hasGPUTimings = false;
+		for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) history[f].counters[c] = 0;
+	}
+	frameNumber = 0;
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) counters[c] = 0;
+
+	D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+	D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+	for (int q = 0; q < NUM_QUERY_FRAMES; q++) {
+		QueryFrame& queryFrame = queryFrames[q];
+		HR(device->CreateQuery(&disjointDesc, &queryFrame.disjoint));
+		HR(device->CreateQuery(&timestampDesc, &queryFrame.frameStart));
+		for (int s = 0; s < MAX_GPU_SCOPES; s++) {
+			HR(device->CreateQuery(&timestampDesc, &queryFrame.scopeStarts[s]));
+			HR(device->CreateQuery(&timestampDesc, &queryFrame.scopeEnds[s]));
+			queryFrame.names[s] = nullptr;
+			queryFrame.depths[s] = 0;
+		}
+		queryFrame.numScopes = 0;
+		queryFrame.frameNumber = 0;
+		queryFrame.isPending = false;
+	}
+	gpuDepth = 0;
+	lastGPUFrame = 0;
+	hasGPUFrame = false;
+}
+
+Profiler::~Profiler()
+{
+	if (active == this) active = nullptr;
+	for (int q = 0; q < NUM_QUERY_FRAMES; q++) {
+		ReleaseMacro(queryFrames[q].disjoint);
+		ReleaseMacro(queryFrames[q].frameStart);
+		for (int s = 0; s < MAX_GPU_SCOPES; s++) {
+			ReleaseMacro(queryFrames[q].scopeStarts[s]);
+			ReleaseMacro(queryFrames[q].scopeEnds[s]);
+		}
+	}
+}
+
+const char* Profiler::GetCounterName(int counter)
+{
+	return counter >= 0 && counter < NUM_PROFILE_COUNTERS ? COUNTER_NAMES[counter] : "";
+}
+
+//Windows paths are full of backslashes, and names could have anything in them
+std::string Profiler::EscapeJSON(const std::string& text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (unsigned int c = 0; c < text.size(); c++) {
+		unsigned char character = (unsigned char)text[c];
+		if (character == '"' || character == '\\') {
+			escaped += '\\';
+			escaped += (char)character;
+		}
+		else if (character < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", character);
+			escaped += code;
+		}
+		else {
+			escaped += (char)character;
+		}
+	}
+	return escaped;
+}
+
+long long Profiler::GetGPUDuration(const Frame& frame)
+{
+	if (!frame.hasGPUTimings || frame.gpuEvents.empty()) return 0;
+	long long start = frame.gpuEvents[0].start;
+	long long end = frame.gpuEvents[0].end;
+	for (unsigned int e = 1; e < frame.gpuEvents.size(); e++) {
+		if (frame.gpuEvents[e].start < start) start = frame.gpuEvents[e].start;
+		if (frame.gpuEvents[e].end > end) end = frame.gpuEvents[e].end;
+	}
+	return end - start;
+}
+
+long long Profiler::GetTime() const
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (long long)((now.QuadPart - startTicks) * ticksToMicroseconds);
+}
+
+void Profiler::BeginFrame()
+{
+	//Jobs still running from last frame can be adding events
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		Frame& frame = GetRecordingFrame();
+		frame.number = frameNumber;
+		frame.start = GetTime();
+		frame.end = frame.start;
+		frame.cpuEvents.clear();
+		frame.gpuEvents.clear();
+		frame.hasGPUTimings = false;
+	}
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) counters[c] = 0;
+
+	//EndFrame already read this slot, or gave up on it if the GPU was still that far behind
+	QueryFrame& queryFrame = queryFrames[frameNumber % NUM_QUERY_FRAMES];
+	queryFrame.numScopes = 0;
+	queryFrame.frameNumber = frameNumber;
+	queryFrame.isPending = true;
+	gpuDepth = 0;
+	context->Begin(queryFrame.disjoint);
+	context->End(queryFrame.frameStart);
+}
+
+void Profiler::EndFrame()
+{
+	Frame& frame = GetRecordingFrame();
+	frame.end = GetTime();
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) frame.counters[c] = counters[c];
+	context->End(queryFrames[frameNumber % NUM_QUERY_FRAMES].disjoint);
+	{
+		std::lock_guard<std::mutex> lock(eventMutex);
+		frameNumber++;
+	}
+
+	//The oldest frame in flight, the next one to be reused
+	ReadGPUFrame(queryFrames[frameNumber % NUM_QUERY_FRAMES]);
+}
+
+//Never flushes or waits, if the GPU isn't done yet the frame just goes without
+void Profiler::ReadGPUFrame(QueryFrame& queryFrame)
+{
+	if (!queryFrame.isPending) return;
+	queryFrame.isPending = false;
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	if (context->GetData(queryFrame.disjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) return;
+	//The clock changed speed part way through, none of it can be trusted
+	if (disjoint.Disjoint || disjoint.Frequency == 0) return;
+	UINT64 frameStart;
+	if (context->GetData(queryFrame.frameStart, &frameStart, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) return;
+	//Only if the frame is still in the history
+	if (frameNumber - queryFrame.frameNumber > NUM_HISTORY_FRAMES) return;
+	Frame& frame = history[queryFrame.frameNumber % NUM_HISTORY_FRAMES];
+	if (frame.number != queryFrame.frameNumber) return;
+
+	double gpuToMicroseconds = 1000000.0 / (double)disjoint.Frequency;
+	frame.gpuEvents.clear();
+	for (int s = 0; s < queryFrame.numScopes; s++) {
+		UINT64 start;
+		UINT64 end;
+		if (context->GetData(queryFrame.scopeStarts[s], &start, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			context->GetData(queryFrame.scopeEnds[s], &end, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+			return;
+		}
+		Event e;
+		e.name = queryFrame.names[s];
+		e.start = frame.start + (long long)((start - frameStart) * gpuToMicroseconds);
+		e.end = frame.start + (long long)((end - frameStart) * gpuToMicroseconds);
+		e.threadID = 0;
+		e.depth = queryFrame.depths[s];
+		frame.gpuEvents.push_back(e);
+	}
+	frame.hasGPUTimings = true;
+	lastGPUFrame = queryFrame.frameNumber;
+	hasGPUFrame = true;
+}
+
+void Profiler::AddCPUEvent(const Event& e)
+{
+	std::lock_guard<std::mutex> lock(eventMutex);
+	GetRecordingFrame().cpuEvents.push_back(e);
+}
+
+int Profiler::BeginGPUScope(const char* name)
+{
+	QueryFrame& queryFrame = queryFrames[frameNumber % NUM_QUERY_FRAMES];
+	if (queryFrame.numScopes >= MAX_GPU_SCOPES) return -1;
+	int scope = queryFrame.numScopes++;
+	queryFrame.names[scope] = name;
+	queryFrame.depths[scope] = gpuDepth++;
+	context->End(queryFrame.scopeStarts[scope]);
+	return scope;
+}
+
+void Profiler::EndGPUScope(int scope)
+{
+	if (scope < 0) return;
+	context->End(queryFrames[frameNumber % NUM_QUERY_FRAMES].scopeEnds[scope]);
+	gpuDepth--;
+}
+
+const Profiler::Frame* Profiler::GetLastFrame() const
+{
+	if (frameNumber == 0) return nullptr;
+	return &history[(frameNumber - 1) % NUM_HISTORY_FRAMES];
+}
+
+const Profiler::Frame* Profiler::GetLastGPUFrame() const
+{
+	if (!hasGPUFrame || frameNumber - lastGPUFrame > NUM_HISTORY_FRAMES) return nullptr;
+	const Frame& frame = history[lastGPUFrame % NUM_HISTORY_FRAMES];
+	return frame.number == lastGPUFrame && frame.hasGPUTimings ? &frame : nullptr;
+}
+
+//Complete events for the scopes and counter events for the counters. The GPU gets a thread of its own
+bool Profiler::WriteChromeTrace(const std::string& path) const
+{
+	std::ofstream trace(path, std::ios::trunc);
+	if (!trace.is_open()) {
+		LogText("--ERROR--//Couldn't write the trace.");
+		return false;
+	}
+	trace << "{\"traceEvents\":[\n";
+	trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+	unsigned int numFrames = frameNumber < NUM_HISTORY_FRAMES ? frameNumber : NUM_HISTORY_FRAMES;
+	for (unsigned int f = frameNumber - numFrames; f < frameNumber; f++) {
+		const Frame& frame = history[f % NUM_HISTORY_FRAMES];
+		trace << ",\n{\"name\":\"Frame " << frame.number << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << frame.start <<
+			",\"dur\":" << frame.end - frame.start << "}";
+		const std::vector<Event>* events[2] = { &frame.cpuEvents, &frame.gpuEvents };
+		for (int list = 0; list < 2; list++) {
+			for (unsigned int e = 0; e < events[list]->size(); e++) {
+				const Event& event = (*events[list])[e];
+				trace << ",\n{\"name\":\"" << EscapeJSON(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadID <<
+					",\"ts\":" << event.start << ",\"dur\":" << event.end - event.start << "}";
+			}
+		}
+		for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+			trace << ",\n{\"name\":\"" << COUNTER_NAMES[c] << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << frame.start <<
+				",\"args\":{\"value\":" << frame.counters[c] << "}}";
+		}
+	}
+	trace << "\n]}\n";
+	return trace.good();
+}
+
+CPUProfileScope::CPUProfileScope(const char* name)
+{
+	profiler = Profiler::GetActive();
+	if (profiler == nullptr) return;
+	e.name = name;
+	e.threadID = GetCurrentThreadId();
+	e.depth = cpuDepth++;
+	e.start = profiler->GetTime();
+}
+
+CPUProfileScope::~CPUProfileScope()
+{
+	if (profiler == nullptr) return;
+	e.end = profiler->GetTime();
+	cpuDepth--;
+	profiler->AddCPUEvent(e);
+}
+
+GPUProfileScope::GPUProfileScope(const char* name)
+{
+	profiler = Profiler::GetActive();
+	scope = profiler != nullptr ? profiler->BeginGPUScope(name) : -1;
+}
+
+GPUProfileScope::~GPUProfileScope()
+{
+	if (profiler != nullptr) profiler->EndGPUScope(scope);
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <d3d11.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//What the profiler counts every frame
+const int PROFILE_COUNTER_DRAW_CALLS = 0;
+const int PROFILE_COUNTER_STATE_CHANGES = 1;//Shaders, pipeline states and material textures
+const int PROFILE_COUNTER_CONSTANT_BYTES = 2;//Written to constant buffers, ranges that are only bound again don't count
+const int PROFILE_COUNTER_TRIANGLES = 3;
+const int PROFILE_COUNTER_HEAP_ALLOCATIONS = 4;//Every operator new on any thread, a steady frame should have none
+const int PROFILE_COUNTER_FRAME_ARENA_BYTES = 5;//Used out of the frame arena by the time the frame ends
+const int NUM_PROFILE_COUNTERS = 6;
+
+//Scoped CPU timers from any thread, GPU timestamps on the immediate context and a few counters, kept for the
+//last NUM_HISTORY_FRAMES frames. GPU timings come in NUM_QUERY_FRAMES frames late, so reading them never waits on the GPU.
+//Everything goes through the active profiler and does nothing without one, so instrumented code doesn't need to hold one
+class Profiler
+{
+public:
+	const static int NUM_QUERY_FRAMES = 4;
+	const static int MAX_GPU_SCOPES = 32;//Per frame, any more are left out
+	const static int NUM_HISTORY_FRAMES = 240;//What the overlay and a trace can see
+
+	//Times are microseconds since the profiler was made. GPU scopes are lined up with the start of their frame on the CPU
+	struct Event {
+		const char* name;//Not copied, string literals only
+		long long start;
+		long long end;
+		unsigned int threadID;
+		int depth;
+	};
+	struct Frame {
+		unsigned int number;
+		long long start;
+		long long end;
+		std::vector<Event> cpuEvents;
+		std::vector<Event> gpuEvents;
+		bool hasGPUTimings;
+		long long counters[NUM_PROFILE_COUNTERS];
+	};
+
+	Profiler(ID3D11Device* newDevice, ID3D11DeviceContext* newContext);
+	~Profiler();
+
+	static void SetActive(Profiler* profiler) { active = profiler; }
+	static Profiler* GetActive() { return active; }
+
+	//On the main thread, around everything the frame does including Present
+	void BeginFrame();
+	void EndFrame();
+
+	static void Count(int counter, long long amount)
+	{
+		if (active != nullptr) active->counters[counter].fetch_add(amount, std::memory_order_relaxed);
+	}
+	static const char* GetCounterName(int counter);
+	//Ready to go between quotes in a JSON file, for the traces and anything else written as JSON
+	static std::string EscapeJSON(const std::string& text);
+	//From the first GPU scope starting to the last one ending, 0 without GPU timings
+	static long long GetGPUDuration(const Frame& frame);
+
+	long long GetTime() const;
+	void AddCPUEvent(const Event& e);
+	int BeginGPUScope(const char* name);//-1 when the frame has no room left
+	void EndGPUScope(int scope);
+
+	//The newest finished frame, and the newest one whose GPU timings are in. nullptr before there is one
+	const Frame* GetLastFrame() const;
+	const Frame* GetLastGPUFrame() const;
+	//Every frame in the history, in the trace event format chrome://tracing and Perfetto load
+	bool WriteChromeTrace(const std::string& path) const;
+private:
+	//One frame's worth of queries, reused every NUM_QUERY_FRAMES frames
+	struct QueryFrame {
+		ID3D11Query* disjoint;
+		ID3D11Query* frameStart;
+		ID3D11Query* scopeStarts[MAX_GPU_SCOPES];
+		ID3D11Query* scopeEnds[MAX_GPU_SCOPES];
+		const char* names[MAX_GPU_SCOPES];
+		int depths[MAX_GPU_SCOPES];
+		int numScopes;
+		unsigned int frameNumber;
+		bool isPending;//Issued but not read back yet
+	};
+
+	static Profiler* active;
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	long long startTicks;
+	double ticksToMicroseconds;
+
+	std::vector<Frame> history;
+	unsigned int frameNumber;//The frame being recorded, history slot frameNumber % NUM_HISTORY_FRAMES
+	std::mutex eventMutex;
+	std::atomic<long long> counters[NUM_PROFILE_COUNTERS];
+
+	QueryFrame queryFrames[NUM_QUERY_FRAMES];
+	int gpuDepth;
+	unsigned int lastGPUFrame;
+	bool hasGPUFrame;
+
+	Frame& GetRecordingFrame() { return history[frameNumber % NUM_HISTORY_FRAMES]; }
+	void ReadGPUFrame(QueryFrame& queryFrame);
+
+	//Copying would release the queries twice
+	Profiler(const Profiler&);
+	Profiler& operator=(const Profiler&);
+};
+
+//Times from here to the end of the block, on whatever thread it's on
+class CPUProfileScope
+{
+public:
+	CPUProfileScope(const char* name);
+	~CPUProfileScope();
+private:
+	Profiler* profiler;
+	Profiler::Event e;
+};
+
+//GPU time for everything the immediate context is given from here to the end of the block
+class GPUProfileScope
+{
+public:
+	GPUProfileScope(const char* name);
+	~GPUProfileScope();
+private:
+	Profiler* profiler;
+	int scope;
+};
@@ -0,0 +1,199 @@
+#include "ProfilerOverlay.h"
+#include <algorithm>
+#include <cstdint>
+#include <cwchar>
+#include <DirectXMath.h>
+#include "SpriteBatch.h"
+#include "SpriteFont.h"
+#include "DirectXGameCore.h"
+#include "Logger.h"
+
+static const wchar_t* const FONT_PATH = L"Assets/Fonts/Overlay.spritefont";
+//The timeline is two 60hz frames wide, with a line where the first one ends
+const static long long TIMELINE_MICROSECONDS = 33333;
+const static long long FRAME_BUDGET_MICROSECONDS = 16667;
+const static int MARGIN = 8;
+const static int ROW_HEIGHT = 8;
+const static int TIMELINE_GAP = 4;//Between the CPU and GPU timelines
+const static int MAX_TIMELINE_WIDTH = 800;
+const static float COLUMN_WIDTH = 260.0f;
+
+//Scopes keep their color from frame to frame, their names are literals so the pointer is enough to tell them apart
+const static int NUM_COLORS = 6;
+static const float COLORS[NUM_COLORS][4] = {
+	{ 0.9f, 0.4f, 0.3f, 1.0f },
+	{ 0.3f, 0.7f, 0.9f, 1.0f },
+	{ 0.5f, 0.9f, 0.3f, 1.0f },
+	{ 0.9f, 0.8f, 0.3f, 1.0f },
+	{ 0.7f, 0.4f, 0.9f, 1.0f },
+	{ 0.3f, 0.9f, 0.7f, 1.0f },
+};
+
+static const wchar_t* const COUNTER_LABELS[NUM_PROFILE_COUNTERS] = {
+	L"Draw calls",
+	L"State changes",
+	L"Constant bytes",
+	L"Triangles",
+	L"Heap allocations",
+	L"Frame arena bytes",
+};
+
+static int GetColorIndex(const char* name)
+{
+	return (int)(((uintptr_t)name >> 3) % NUM_COLORS);
+}
+
+static bool IsEarlier(const Profiler::Event& a, const Profiler::Event& b)
+{
+	return a.start < b.start || (a.start == b.start && a.depth < b.depth);
+}
+
+ProfilerOverlay::ProfilerOverlay(ID3D11Device* newDevice, ID3D11DeviceContext* newContext)
+{
+	spriteBatch = new DirectX::SpriteBatch(newContext);
+	mainThreadID = GetCurrentThreadId();
+	font = nullptr;
+	//SpriteFont throws when the file isn't there
+	if (GetFileAttributesW(FONT_PATH) != INVALID_FILE_ATTRIBUTES) {
+		font = new DirectX::SpriteFont(newDevice, FONT_PATH);
+	}
+	else {
+		LogText("--ERROR--//No overlay font, the profiler overlay won't have any text.");
+	}
+
+	whiteTexture = nullptr;
+	whiteSRV = nullptr;
+	UINT white = 0xFFFFFFFF;
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = 1;
+	textureDesc.Height = 1;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = &white;
+	data.SysMemPitch = sizeof(UINT);
+	HR(newDevice->CreateTexture2D(&textureDesc, &data, &whiteTexture));
+	HR(newDevice->CreateShaderResourceView(whiteTexture, nullptr, &whiteSRV));
+}
+
+ProfilerOverlay::~ProfilerOverlay()
+{
+	delete font;
+	delete spriteBatch;
+	ReleaseMacro(whiteSRV);
+	ReleaseMacro(whiteTexture);
+}
+
+void ProfilerOverlay::Draw(const Profiler& profiler, int screenWidth)
+{
+	const Profiler::Frame* frame = profiler.GetLastFrame();
+	if (frame == nullptr || whiteSRV == nullptr) return;
+	const Profiler::Frame* gpuFrame = profiler.GetLastGPUFrame();
+	int width = min(screenWidth - MARGIN * 2, MAX_TIMELINE_WIDTH);
+	if (width <= 0) return;
+	//Zero when everything is drawn on the main thread
+	unsigned int renderThreadID = GetCurrentThreadId() != mainThreadID ? GetCurrentThreadId() : 0;
+
+	spriteBatch->Begin();
+	int timelineTop = MARGIN;
+	int top = DrawTimeline(frame->cpuEvents, frame->start, mainThreadID, timelineTop, width);
+	if (renderThreadID != 0) {
+		top = DrawTimeline(frame->cpuEvents, frame->start, renderThreadID, top + TIMELINE_GAP, width);
+	}
+	if (gpuFrame != nullptr) {
+		top = DrawTimeline(gpuFrame->gpuEvents, gpuFrame->start, 0, top + TIMELINE_GAP, width);
+	}
+	RECT budgetLine;
+	budgetLine.left = MARGIN + (LONG)(FRAME_BUDGET_MICROSECONDS * width / TIMELINE_MICROSECONDS);
+	budgetLine.right = budgetLine.left + 1;
+	budgetLine.top = timelineTop;
+	budgetLine.bottom = top;
+	spriteBatch->Draw(whiteSRV, budgetLine, DirectX::XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f));
+
+	if (font != nullptr) {
+		float y = (float)(top + TIMELINE_GAP);
+		wchar_t line[128];
+		float gpuMilliseconds = gpuFrame != nullptr ? Profiler::GetGPUDuration(*gpuFrame) / 1000.0f : 0.0f;
+		swprintf_s(line, L"Frame %u  CPU %.2f ms  GPU %.2f ms", frame->number, (frame->end - frame->start) / 1000.0f, gpuMilliseconds);
+		font->DrawString(spriteBatch, line, DirectX::XMFLOAT2((float)MARGIN, y), DirectX::XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f));
+		y += font->GetLineSpacing();
+
+		float x = (float)MARGIN;
+		DrawEventTimes(frame->cpuEvents, mainThreadID, L"CPU", x, y);
+		if (renderThreadID != 0) {
+			x += COLUMN_WIDTH;
+			DrawEventTimes(frame->cpuEvents, renderThreadID, L"Render thread", x, y);
+		}
+		x += COLUMN_WIDTH;
+		if (gpuFrame != nullptr) DrawEventTimes(gpuFrame->gpuEvents, 0, L"GPU", x, y);
+		float counterX = x + COLUMN_WIDTH;
+		for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+			swprintf_s(line, L"%ls %lld", COUNTER_LABELS[c], frame->counters[c]);
+			font->DrawString(spriteBatch, line, DirectX::XMFLOAT2(counterX, y + c * font->GetLineSpacing()), DirectX::XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f));
+		}
+	}
+	spriteBatch->End();
+}
+
+void ProfilerOverlay::DrawBar(long long start, long long end, long long frameStart, int row, int top, int width, int colorIndex)
+{
+	RECT bar;
+	bar.left = MARGIN + (LONG)(min(max(start - frameStart, (long long)0), TIMELINE_MICROSECONDS) * width / TIMELINE_MICROSECONDS);
+	bar.right = MARGIN + (LONG)(min(max(end - frameStart, (long long)0), TIMELINE_MICROSECONDS) * width / TIMELINE_MICROSECONDS);
+	//Anything too short to see still gets a pixel
+	if (bar.right <= bar.left) bar.right = bar.left + 1;
+	bar.top = top + row * ROW_HEIGHT;
+	bar.bottom = bar.top + ROW_HEIGHT - 1;
+	const float* color = COLORS[colorIndex];
+	spriteBatch->Draw(whiteSRV, bar, DirectX::XMVectorSet(color[0], color[1], color[2], color[3]));
+}
+
+//One row per depth, returns where the next thing down can go
+int ProfilerOverlay::DrawTimeline(const std::vector<Profiler::Event>& events, long long frameStart, unsigned int threadID, int top, int width)
+{
+	int numRows = 1;
+	RECT background;
+	background.left = MARGIN;
+	background.right = MARGIN + width;
+	background.top = top;
+	for (unsigned int e = 0; e < events.size(); e++) {
+		const Profiler::Event& event = events[e];
+		if ((threadID != 0 && event.threadID != threadID) || event.depth >= MAX_TIMELINE_DEPTH) continue;
+		numRows = max(numRows, event.depth + 1);
+	}
+	background.bottom = top + numRows * ROW_HEIGHT;
+	spriteBatch->Draw(whiteSRV, background, DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.6f));
+	for (unsigned int e = 0; e < events.size(); e++) {
+		const Profiler::Event& event = events[e];
+		if ((threadID != 0 && event.threadID != threadID) || event.depth >= MAX_TIMELINE_DEPTH) continue;
+		DrawBar(event.start, event.end, frameStart, event.depth, top, width, GetColorIndex(event.name));
+	}
+	return background.bottom;
+}
+
+//In the order they started, indented by depth
+void ProfilerOverlay::DrawEventTimes(const std::vector<Profiler::Event>& events, unsigned int threadID, const wchar_t* heading, float x, float y)
+{
+	sortedEvents.clear();
+	for (unsigned int e = 0; e < events.size(); e++) {
+		if (threadID != 0 && events[e].threadID != threadID) continue;
+		sortedEvents.push_back(events[e]);
+	}
+	std::sort(sortedEvents.begin(), sortedEvents.end(), IsEarlier);
+	if ((int)sortedEvents.size() > MAX_LISTED_EVENTS) sortedEvents.resize(MAX_LISTED_EVENTS);
+
+	font->DrawString(spriteBatch, heading, DirectX::XMFLOAT2(x, y), DirectX::XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f));
+	y += font->GetLineSpacing();
+	wchar_t line[128];
+	for (unsigned int e = 0; e < sortedEvents.size(); e++) {
+		const Profiler::Event& event = sortedEvents[e];
+		swprintf_s(line, L"%*ls%hs %.2f ms", event.depth * 2, L"", event.name, (event.end - event.start) / 1000.0f);
+		const float* color = COLORS[GetColorIndex(event.name)];
+		font->DrawString(spriteBatch, line, DirectX::XMFLOAT2(x, y), DirectX::XMVectorSet(color[0], color[1], color[2], color[3]));
+		y += font->GetLineSpacing();
+	}
+}
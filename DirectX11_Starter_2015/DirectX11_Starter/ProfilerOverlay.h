@@ -0,0 +1,42 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include "Profiler.h"
+
+namespace DirectX {
+	class SpriteBatch;
+	class SpriteFont;
+}
+
+//Draws the profiler's last frame over the top of the screen. A timeline of the main thread's and the GPU's scopes
+//against the frame budget, then their times and the counters as text. Drawn from a render thread, that thread gets
+//a timeline and a column too. Text needs a SpriteFont made with MakeSpriteFont at FONT_PATH, without one there are only the bars
+class ProfilerOverlay
+{
+public:
+	const static int MAX_LISTED_EVENTS = 24;//Per timeline, the rest are only in the trace
+	const static int MAX_TIMELINE_DEPTH = 4;//Deeper scopes don't get a row
+
+	//On the main thread
+	ProfilerOverlay(ID3D11Device* newDevice, ID3D11DeviceContext* newContext);
+	~ProfilerOverlay();
+
+	//Last thing before Present, it leaves the pipeline in SpriteBatch's state
+	void Draw(const Profiler& profiler, int screenWidth);
+private:
+	DirectX::SpriteBatch* spriteBatch;
+	DirectX::SpriteFont* font;//nullptr without the font file
+	ID3D11Texture2D* whiteTexture;//1x1, the bars are stretched out of it
+	ID3D11ShaderResourceView* whiteSRV;
+	std::vector<Profiler::Event> sortedEvents;//Scratch space, keeps its capacity between frames
+	unsigned int mainThreadID;
+
+	//threadID 0 takes events from every thread
+	void DrawBar(long long start, long long end, long long frameStart, int row, int top, int width, int colorIndex);
+	int DrawTimeline(const std::vector<Profiler::Event>& events, long long frameStart, unsigned int threadID, int top, int width);
+	void DrawEventTimes(const std::vector<Profiler::Event>& events, unsigned int threadID, const wchar_t* heading, float x, float y);
+
+	//Copying would release the texture twice
+	ProfilerOverlay(const ProfilerOverlay&);
+	ProfilerOverlay& operator=(const ProfilerOverlay&);
+};
@@ -1,47 +1,846 @@
 #include "Render.h"
 
 #include "Logger.h"
+#include "JobSystem.h"
+#include "ConstantBufferRing.h"
+#include "Profiler.h"
+#include "LinearArena.h"
+#include <cstring>
 
-Render::Render(ID3D11DeviceContext* newDeviceContext)
+//GPU scope names have to outlive the frame
+static const char* const CASCADE_SCOPE_NAMES[ShadowMaps::NUM_CASCADES] = {
+	"Shadow cascade 0",
+	"Shadow cascade 1",
+	"Shadow cascade 2",
+	"Shadow cascade 3",
+};
+
+static void CountDraw(Mesh* mesh, int numInstances)
+{
+	Profiler::Count(PROFILE_COUNTER_DRAW_CALLS, 1);
+	Profiler::Count(PROFILE_COUNTER_TRIANGLES, mesh->GetNumberOfIndices() / 3 * numInstances);
+}
+
+Render::Render(ID3D11Device* newDevice, ID3D11DeviceContext* newDeviceContext, ShaderCache* newShaderCache)
 {
+	device = newDevice;
 	deviceContext = newDeviceContext;
-	endIndex = 0;
+	for (int f = 0; f < 2; f++) {
+		frames[f].renderList.resize(STARTING_RENDER_LIST_CAPACITY);
+		frames[f].worldMatrices.resize(STARTING_RENDER_LIST_CAPACITY);
+		frames[f].numDraws = 0;
+		frames[f].renderPath = RENDER_PATH_FORWARD;
+		frames[f].useDepthPrePass = false;
+		frames[f].useGPUCulling = false;
+		frames[f].shadowLightIndex = -1;
+	}
+	submitFrame = &frames[0];
+	drawFrame = &frames[1];
+	numDraws = 0;
+	highWaterMark = 0;
+	instanceBuffer = nullptr;
+	instanceCapacity = 0;
+	jobs = nullptr;
+	useDeferredContexts = false;
+	for (int c = 0; c < MAX_COMMAND_LISTS; c++) {
+		deferredContexts[c] = nullptr;
+		deferredRings[c] = nullptr;
+	}
+	immediateRing = new ConstantBufferRing(device, deviceContext);
+	ISimpleShader::SetDefaultConstantBufferRing(immediateRing);
+	lightClusters = new LightClusters(device, deviceContext, MAX_NUM_OF_LIGHTS);
+	renderPath = RENDER_PATH_FORWARD;
+	gBuffer = new GBuffer(device);
+	shaderCache = newShaderCache;
+	fullscreenVertexShader = nullptr;
+	lightingPixelShader = nullptr;
+	lightingPipelineState = INVALID_PIPELINE_STATE;
+	renderInfo.gBufferPass = false;
+	useDepthPrePass = false;
+	for (int f = 0; f < 2; f++) {
+		depthShaders[f][0] = nullptr;
+		depthShaders[f][1] = nullptr;
+	}
+	renderInfo.depthPrePass = false;
+	renderInfo.depthEqual = false;
+	useShadows = false;
+	shadowMaps = new ShadowMaps(device, deviceContext);
+	for (int c = 0; c < ShadowMaps::NUM_CASCADES; c++) {
+		shadowStats[c].numStaticCasters = 0;
+		shadowStats[c].numDynamicCasters = 0;
+		shadowStats[c].redrewStaticCache = false;
+	}
+	useGPUCulling = false;
+	gpuCulling = new GPUCulling(device, deviceContext);
+	hasPendingGPUScene = false;
+	drawsGPUCulled = false;
 }
 
 
 Render::~Render()
 {
-	
+	ReleaseMacro(instanceBuffer);
+	for (int c = 0; c < MAX_COMMAND_LISTS; c++) {
+		ReleaseMacro(deferredContexts[c]);
+		delete deferredRings[c];
+	}
+	ISimpleShader::SetDefaultConstantBufferRing(nullptr);
+	delete immediateRing;
+	delete lightClusters;
+	delete gBuffer;
+	delete shadowMaps;
+	delete gpuCulling;
+}
+
+void Render::SetRenderPath(int newRenderPath)
+{
+	if (newRenderPath == RENDER_PATH_DEFERRED && lightingPipelineState == INVALID_PIPELINE_STATE) {
+		LogText("--ERROR--//No deferred lighting shaders, staying forward.");
+		return;
+	}
+	renderPath = newRenderPath;
+	LogText(renderPath == RENDER_PATH_DEFERRED ? "Render path: deferred" : "Render path: forward");
+}
+
+void Render::SetDeferredLighting(SimpleVertexShader* newFullscreenVertexShader, SimplePixelShader* newLightingPixelShader)
+{
+	fullscreenVertexShader = newFullscreenVertexShader;
+	lightingPixelShader = newLightingPixelShader;
+	if (shaderCache == nullptr || fullscreenVertexShader == nullptr || lightingPixelShader == nullptr) {
+		lightingPipelineState = INVALID_PIPELINE_STATE;
+		renderPath = RENDER_PATH_FORWARD;
+		return;
+	}
+	//Covers every pixel once, so nothing to cull and depth was already settled by the G-buffer pass
+	PipelineStateDesc desc;
+	desc.vertexShader = fullscreenVertexShader;
+	desc.pixelShader = lightingPixelShader;
+	desc.blendState = BLEND_STATE_OPAQUE;
+	desc.rasterState = RASTER_STATE_CULL_NONE;
+	desc.depthState = DEPTH_STATE_OFF;
+	lightingPipelineState = shaderCache->GetPipelineStateID(desc);
+}
+
+int Render::AddLight(const GameLight& light)
+{
+	if ((int)lights.size() >= MAX_NUM_OF_LIGHTS) {
+		LogText("--ERROR--//Too many lights, the light buffer only holds " + std::to_string(MAX_NUM_OF_LIGHTS));
+		return -1;
+	}
+	lights.push_back(light);
+	return lights.size() - 1;
+}
+
+void Render::SetView(Camera& camera)
+{
+	RenderFrame& frame = *submitFrame;
+	frame.viewMatrix = camera.GetViewMatrix();
+	frame.projectionMatrix = camera.GetProjectionMatrix();
+	frame.cameraPosition = camera.GetTransform().GetPosition();
+	frame.cameraForward = camera.GetTransform().GetForwardVector();
+	frame.nearPlane = camera.GetNearPlane();
+	frame.farPlane = camera.GetFarPlane();
+	frame.renderPath = renderPath;
+	frame.useDepthPrePass = useDepthPrePass && HasDepthPrePassShaders();
+	frame.useGPUCulling = GetUseGPUCulling();
+
+	frame.shadowLightIndex = -1;
+	if (useShadows && HasDepthPrePassShaders()) {
+		for (unsigned int l = 0; l < lights.size(); l++) {
+			if (lights[l].GetRenderLight().Type == LIGHT_DIRECTIONAL) {
+				frame.shadowLightIndex = l;
+				break;
+			}
+		}
+	}
+	frame.lights.resize(lights.size());
+	for (unsigned int l = 0; l < lights.size(); l++) {
+		frame.lights[l] = lights[l].GetRenderLightData();
+		frame.lights[l].CastsShadows = (int)l == frame.shadowLightIndex ? 1 : 0;
+	}
+	if (frame.shadowLightIndex < 0) return;
+
+	shadowMaps->Update(camera, lights[frame.shadowLightIndex].GetTransform().GetForwardVector());
+	frame.shadowViewMatrix = shadowMaps->GetViewMatrix();
+	for (int c = 0; c < ShadowMaps::NUM_CASCADES; c++) {
+		frame.shadowProjectionMatrices[c] = shadowMaps->GetProjectionMatrix(c);
+		frame.shadowCascades[c] = shadowMaps->GetCascade(c);
+	}
+}
+
+void Render::SwapFrames()
+{
+	RenderFrame* submitted = submitFrame;
+	submitted->numDraws = numDraws;
+	if (submitted->numDraws > highWaterMark) highWaterMark = submitted->numDraws;
+	//Static casters were only sent for the cascades whose caches were stale, so those are what get redrawn.
+	//Invalidating after this only affects the next frame
+	for (int c = 0; c < ShadowMaps::NUM_CASCADES; c++) {
+		submitted->redrawStaticShadows[c] = submitted->shadowLightIndex >= 0 && shadowMaps->TakeStaticRedraw(c);
+	}
+	submitFrame = drawFrame;
+	drawFrame = submitted;
+	numDraws = 0;
+	if (hasPendingGPUScene) {
+		gpuCulling->SetScene(pendingGPUInstances, pendingGPUBuckets);
+		hasPendingGPUScene = false;
+	}
+}
+
+void Render::SetGPUScene(const GPUCullSource* sources, int count)
+{
+	GPUCulling::BuildScene(sources, count, pendingGPUInstances, pendingGPUBuckets);
+	hasPendingGPUScene = true;
 }
 
-//This is probably going to get re written, for one the materials 
-//can be sorted so we only have to call view and projection matrix once per unique vertex shader
 void Render::AddToRenderList(DrawnMesh& drawnMesh)
+{
+	AddToRenderList(drawnMesh.GetMesh(), drawnMesh.GetMaterial(), drawnMesh.GetTransform().GetWorldMatrix());
+}
+
+//Everything but the depth goes into the key here, the depth is filled in once we know where the camera is
+void Render::AddToRenderList(Mesh* mesh, Material* material, const DirectX::XMFLOAT4X4& worldMatrix)
 {
 	//We don't want to actually draw something if it has no mesh
-	if (drawnMesh.GetMesh() == nullptr) return;
-	if (endIndex + 1 >= MAX_NUM_OF_RENDERED_OBJECTS) return;
-	renderList[endIndex] = &drawnMesh;
-	endIndex += 1;
+	if (mesh == nullptr || material == nullptr) return;
+	//Deferred shading lights everything it can in one pass, the rest is drawn forward after it
+	unsigned int pass = renderPath == RENDER_PATH_DEFERRED && !material->HasGBufferShader() ? RENDER_PASS_FORWARD : RENDER_PASS_OPAQUE;
+	AddDraw(pass, mesh, material, worldMatrix);
 }
 
-void Render::UpdateAndRender(Camera& camera)
+void Render::AddShadowCaster(int cascade, bool isStatic, Mesh* mesh, Material* material, const DirectX::XMFLOAT4X4& worldMatrix)
 {
+	//See through materials don't write depth, so they don't cast
+	if (mesh == nullptr || material == nullptr || !material->WritesDepth()) return;
+	AddDraw(RENDER_PASS_SHADOW + cascade * 2 + (isStatic ? 0 : 1), mesh, material, worldMatrix);
+}
+
+void Render::AddDraw(unsigned int pass, Mesh* mesh, Material* material, const DirectX::XMFLOAT4X4& worldMatrix)
+{
+	int index = numDraws++;
+	if (index >= (int)submitFrame->renderList.size()) {
+		//Only reached when nothing reserved room, so nothing else is adding right now
+		ReserveDraws(1);
+	}
+	DrawCall& drawCall = submitFrame->renderList[index];
+	drawCall.sortKey = CreateSortKey(pass, material->GetShaderSortID(mesh->GetVertexFormat()), material->GetSortID(), mesh->GetSortID(), 0);
+	drawCall.mesh = mesh;
+	drawCall.material = material;
+	drawCall.worldMatrixIndex = index;
+	submitFrame->worldMatrices[index] = worldMatrix;
+}
+
+void Render::ReserveDraws(int count)
+{
+	int needed = numDraws + count;
+	int size = submitFrame->renderList.size();
+	if (needed <= size) return;
+	int newSize = size * 2 > needed ? size * 2 : needed;
+	LogText("Render list grew to " + std::to_string(newSize) + " draws");
+	submitFrame->renderList.resize(newSize);
+	submitFrame->worldMatrices.resize(newSize);
+}
+
+void Render::UpdateAndRender(LinearArena& frameArena)
+{
+	CPUProfileScope scope("Render");
+	RenderFrame& frame = *drawFrame;
 	renderInfo.deviceContext = deviceContext;
-	renderInfo.viewMatrix = camera.GetViewMatrix();
-	renderInfo.projectionMatrix = camera.GetProjectionMatrix();
-	renderInfo.cameraPosition = camera.GetTransform().GetPosition();
-	renderInfo.light1 = lights[0].GetRenderLightData();
-	renderInfo.light2 = lights[1].GetRenderLightData();
-	renderInfo.currentMaterial = nullptr;
-	//renderInfo.currentPixelShader = nullptr;
-	renderInfo.currentMesh = nullptr;
-
-	//vertShader->SetMatrix4x4("view", renderInfo.viewMatrix);
-	//vertShader->SetMatrix4x4("projection", renderInfo.projectionMatrix);
-	//LogText("Frame");
-	for (int r = 0; r < endIndex; r++) {
-		renderList[r]->Draw(renderInfo);
-	}
-	endIndex = 0;
+	immediateRing->Reset();
+	renderInfo.viewMatrix = frame.viewMatrix;
+	renderInfo.projectionMatrix = frame.projectionMatrix;
+	renderInfo.cameraPosition = frame.cameraPosition;
+	renderInfo.cameraForward = frame.cameraForward;
+	//Has to finish binning before anything reads the clusters
+	{
+		GPUProfileScope gpuScope("Light clusters");
+		lightClusters->Update(frame.lights.data(), frame.lights.size(), renderInfo.viewMatrix, renderInfo.projectionMatrix,
+			frame.nearPlane, frame.farPlane);
+	}
+	lightClusters->Bind(deviceContext);
+	renderInfo.clusterInfo = lightClusters->GetClusterInfo();
+	drawsGPUCulled = false;
+	if (frame.useGPUCulling) {
+		GPUProfileScope gpuScope("GPU culling");
+		drawsGPUCulled = gpuCulling->Cull(frame.viewMatrix, frame.projectionMatrix, frame.cameraPosition);
+	}
+	renderInfo.gBufferPass = false;
+	renderInfo.depthPrePass = false;
+	renderInfo.depthEqual = false;
+	ClearCurrentState(renderInfo);
+
+	//Depth only breaks ties between draws that share everything else, so it won't split up state changes
+	int drawCount = frame.numDraws;
+	{
+		CPUProfileScope sortScope("Sort");
+		DirectX::XMVECTOR cameraPos = DirectX::XMLoadFloat3(&renderInfo.cameraPosition);
+		for (int r = 0; r < drawCount; r++) {
+			const DirectX::XMFLOAT4X4& world = frame.worldMatrices[frame.renderList[r].worldMatrixIndex];
+			//The world matrix is stored transposed, so the translation is in the last column
+			DirectX::XMVECTOR toObject = DirectX::XMVectorSubtract(DirectX::XMVectorSet(world._14, world._24, world._34, 0.0f), cameraPos);
+			frame.renderList[r].sortKey |= QuantizeDepth(DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(toObject)));
+		}
+		SortRenderList(frameArena);
+		FillInstanceBuffer();
+	}
+
+	CPUProfileScope submitScope("Submission");
+	int mainEnd = FindPassStart(RENDER_PASS_SHADOW, drawCount);
+	DrawShadowMaps(drawCount);
+	if (frame.useDepthPrePass) {
+		GPUProfileScope gpuScope("Depth pre-pass");
+		DrawDepthPrePass(mainEnd);
+		renderInfo.depthEqual = true;
+	}
+	if (frame.renderPath == RENDER_PATH_DEFERRED) {
+		DrawDeferred(mainEnd);
+	}
+	else {
+		GPUProfileScope gpuScope("Forward");
+		DrawPass(0, mainEnd);
+		DrawGPUCulled(RENDER_PASS_OPAQUE);
+	}
+}
+
+void Render::DrawPass(int start, int end)
+{
+	int numCommandLists = GetNumCommandLists(end - start);
+	if (numCommandLists > 1) {
+		DrawWithCommandLists(numCommandLists, start, end);
+	}
+	else {
+		DrawRange(renderInfo, start, end);
+	}
+}
+
+bool Render::HasDepthPrePassShaders() const
+{
+	//A mesh left out of the pre-pass would fail the equal test and disappear
+	for (int f = 0; f < 2; f++) {
+		if (depthShaders[f][0] == nullptr || depthShaders[f][1] == nullptr) return false;
+	}
+	return true;
+}
+
+//Depth only, no pixel shader and no color targets, in the same order as the main pass
+void Render::DrawDepthPrePass(int drawCount)
+{
+	ID3D11RenderTargetView* backBuffer = nullptr;
+	ID3D11DepthStencilView* depthStencil = nullptr;
+	deviceContext->OMGetRenderTargets(1, &backBuffer, &depthStencil);
+	deviceContext->OMSetRenderTargets(0, nullptr, depthStencil);
+	deviceContext->PSSetShader(nullptr, nullptr, 0);
+
+	renderInfo.depthPrePass = true;
+	DrawPass(0, drawCount);
+	DrawGPUCulled(-1);
+	renderInfo.depthPrePass = false;
+
+	deviceContext->OMSetRenderTargets(1, &backBuffer, depthStencil);
+	ReleaseMacro(backBuffer);
+	ReleaseMacro(depthStencil);
+	ClearCurrentState(renderInfo);
+}
+
+//One indirect draw per bucket, after the render list's part of the pass. Only the compute pass knows how many
+//instances each one has, so they aren't counted as triangles. A negative pass draws all of them
+void Render::DrawGPUCulled(int pass)
+{
+	if (!drawsGPUCulled) return;
+	for (int b = 0; b < gpuCulling->GetNumBuckets(); b++) {
+		const GPUCullBucket& bucket = gpuCulling->GetBucket(b);
+		//Same split as AddToRenderList
+		int bucketPass = drawFrame->renderPath == RENDER_PATH_DEFERRED && !bucket.material->HasGBufferShader() ? RENDER_PASS_FORWARD : RENDER_PASS_OPAQUE;
+		if (pass >= 0 && bucketPass != pass) continue;
+		if (renderInfo.depthPrePass) {
+			if (!bucket.material->WritesDepth()) continue;
+			PrepareDepthInstanced(renderInfo, bucket.material, bucket.mesh);
+			BindInstances(renderInfo, bucket.mesh, true, gpuCulling->GetInstanceBuffer());
+		}
+		else {
+			bucket.material->PrepareInstancedMaterial(renderInfo, bucket.mesh);
+			BindInstances(renderInfo, bucket.mesh, false, gpuCulling->GetInstanceBuffer());
+		}
+		deviceContext->DrawIndexedInstancedIndirect(gpuCulling->GetArgsBuffer(), GPUCulling::GetArgsOffset(b));
+		Profiler::Count(PROFILE_COUNTER_DRAW_CALLS, 1);
+	}
+}
+
+//Every cascade through the same sorted, instanced depth only path as the pre-pass, just from the light
+void Render::DrawShadowMaps(int drawCount)
+{
+	const RenderFrame& frame = *drawFrame;
+	if (frame.shadowLightIndex < 0) {
+		shadowMaps->Unbind(deviceContext);
+		return;
+	}
+	ID3D11RenderTargetView* backBuffer = nullptr;
+	ID3D11DepthStencilView* depthStencil = nullptr;
+	deviceContext->OMGetRenderTargets(1, &backBuffer, &depthStencil);
+	D3D11_VIEWPORT viewport;
+	UINT numViewports = 1;
+	deviceContext->RSGetViewports(&numViewports, &viewport);
+	shadowMaps->Unbind(deviceContext);
+	shadowMaps->Upload(frame.shadowCascades);
+	deviceContext->PSSetShader(nullptr, nullptr, 0);
+
+	DirectX::XMFLOAT4X4 cameraView = renderInfo.viewMatrix;
+	DirectX::XMFLOAT4X4 cameraProjection = renderInfo.projectionMatrix;
+	renderInfo.depthPrePass = true;
+	renderInfo.viewMatrix = frame.shadowViewMatrix;
+	for (int c = 0; c < ShadowMaps::NUM_CASCADES; c++) {
+		int staticStart = FindPassStart(RENDER_PASS_SHADOW + c * 2, drawCount);
+		int dynamicStart = FindPassStart(RENDER_PASS_SHADOW + c * 2 + 1, drawCount);
+		int dynamicEnd = FindPassStart(RENDER_PASS_SHADOW + c * 2 + 2, drawCount);
+		GPUProfileScope gpuScope(CASCADE_SCOPE_NAMES[c]);
+		renderInfo.projectionMatrix = frame.shadowProjectionMatrices[c];
+		shadowStats[c].numStaticCasters = dynamicStart - staticStart;
+		shadowStats[c].numDynamicCasters = dynamicEnd - dynamicStart;
+		shadowStats[c].redrewStaticCache = frame.redrawStaticShadows[c];
+		if (shadowStats[c].redrewStaticCache) {
+			shadowMaps->BeginStatic(deviceContext, c);
+			//The depth shader's view and projection are only set when it changes
+			ClearCurrentState(renderInfo);
+			DrawPass(staticStart, dynamicStart);
+		}
+		if (shadowMaps->BeginDynamic(deviceContext, c, dynamicEnd - dynamicStart)) {
+			ClearCurrentState(renderInfo);
+			DrawPass(dynamicStart, dynamicEnd);
+		}
+	}
+	renderInfo.depthPrePass = false;
+	renderInfo.viewMatrix = cameraView;
+	renderInfo.projectionMatrix = cameraProjection;
+
+	deviceContext->OMSetRenderTargets(1, &backBuffer, depthStencil);
+	if (numViewports > 0) deviceContext->RSSetViewports(1, &viewport);
+	ReleaseMacro(backBuffer);
+	ReleaseMacro(depthStencil);
+	ClearCurrentState(renderInfo);
+	shadowMaps->Bind(deviceContext);
+}
+
+//The opaque pass goes into the G-buffer, then gets lit once per pixel no matter how much overdraw it had
+void Render::DrawDeferred(int drawCount)
+{
+	ID3D11RenderTargetView* backBuffer = nullptr;
+	ID3D11DepthStencilView* depthStencil = nullptr;
+	deviceContext->OMGetRenderTargets(1, &backBuffer, &depthStencil);
+	D3D11_VIEWPORT viewport;
+	UINT numViewports = 1;
+	deviceContext->RSGetViewports(&numViewports, &viewport);
+	if (numViewports == 0 || !gBuffer->Resize((unsigned int)viewport.Width, (unsigned int)viewport.Height)) {
+		GPUProfileScope gpuScope("Forward");
+		DrawPass(0, drawCount);
+		DrawGPUCulled(-1);
+		ReleaseMacro(backBuffer);
+		ReleaseMacro(depthStencil);
+		return;
+	}
+
+	int forwardStart = FindPassStart(RENDER_PASS_FORWARD, drawCount);
+	{
+		GPUProfileScope gpuScope("G-buffer");
+		gBuffer->Clear(deviceContext);
+		gBuffer->BindTargets(deviceContext, depthStencil);
+		renderInfo.gBufferPass = true;
+		DrawPass(0, forwardStart);
+		DrawGPUCulled(RENDER_PASS_OPAQUE);
+		renderInfo.gBufferPass = false;
+	}
+
+	deviceContext->OMSetRenderTargets(1, &backBuffer, depthStencil);
+	{
+		GPUProfileScope gpuScope("Lighting");
+		DrawLighting();
+	}
+	GPUProfileScope gpuScope("Forward");
+	DrawPass(forwardStart, drawCount);
+	DrawGPUCulled(RENDER_PASS_FORWARD);
+	ReleaseMacro(backBuffer);
+	ReleaseMacro(depthStencil);
+}
+
+void Render::DrawLighting()
+{
+	//perFrame = buffer 0
+	//"cameraPosition" = 0
+	//"cameraForward" = 1
+	//"clusterInfo" = 2
+	//"inverseView" = 3
+	//"projectionScale" = 4
+	//Positions come back from the depth, so the lighting pass needs to undo the view and projection.
+	//The matrices are stored transposed
+	DirectX::XMMATRIX view = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&renderInfo.viewMatrix));
+	DirectX::XMFLOAT4X4 inverseView;
+	DirectX::XMStoreFloat4x4(&inverseView, DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(nullptr, view)));
+	lightingPixelShader->SetFloat3(0, renderInfo.cameraPosition);
+	lightingPixelShader->SetFloat3(1, renderInfo.cameraForward);
+	lightingPixelShader->SetData(2, &renderInfo.clusterInfo, sizeof(ClusterInfo));
+	lightingPixelShader->SetMatrix4x4(3, inverseView);
+	DirectX::XMFLOAT2 projectionScale(renderInfo.projectionMatrix._11, renderInfo.projectionMatrix._22);
+	lightingPixelShader->SetData(4, &projectionScale, sizeof(DirectX::XMFLOAT2));
+
+	fullscreenVertexShader->SetShader(true);
+	lightingPixelShader->SetShader(true);
+	shaderCache->ApplyRenderStates(deviceContext, lightingPipelineState);
+	gBuffer->BindForLighting(deviceContext);
+	deviceContext->Draw(3, 0);
+	Profiler::Count(PROFILE_COUNTER_DRAW_CALLS, 1);
+	Profiler::Count(PROFILE_COUNTER_TRIANGLES, 1);
+	//The G-buffer gets drawn into again next frame
+	gBuffer->UnbindForLighting(deviceContext);
+
+	//The forward pass after this has to set everything up again
+	ClearCurrentState(renderInfo);
+}
+
+//The render list is sorted with the pass in the top bits, so every pass is one run
+int Render::FindPassStart(unsigned int pass, int drawCount)
+{
+	const int passShift = 64 - SORT_KEY_PASS_BITS;
+	const std::vector<DrawCall>& renderList = drawFrame->renderList;
+	int low = 0;
+	int high = drawCount;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if ((unsigned int)(renderList[middle].sortKey >> passShift) < pass) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+void Render::ClearCurrentState(RenderInfo& info)
+{
+	info.currentVertexShader = nullptr;
+	info.currentPixelShader = nullptr;
+	info.currentPipelineState = INVALID_PIPELINE_STATE;
+	info.currentMaterial = nullptr;
+	info.currentMesh = nullptr;
+}
+
+//The sort puts draws with the same material and mesh next to each other, so each run becomes one instanced draw
+void Render::DrawRange(RenderInfo& info, int start, int end)
+{
+	const std::vector<DrawCall>& renderList = drawFrame->renderList;
+	int r = start;
+	while (r < end) {
+		Material* material = renderList[r].material;
+		Mesh* mesh = renderList[r].mesh;
+		if (info.depthPrePass && !material->WritesDepth()) {
+			r++;
+			continue;
+		}
+		if (!material->IsInstanced()) {
+			if (info.depthPrePass) DrawDepthSingle(info, renderList[r]);
+			else DrawSingle(info, renderList[r]);
+			r++;
+			continue;
+		}
+		int runEnd = r + 1;
+		while (runEnd < end && renderList[runEnd].material == material && renderList[runEnd].mesh == mesh) {
+			runEnd++;
+		}
+		if (info.depthPrePass) DrawDepthInstanced(info, material, mesh, r, runEnd - r);
+		else DrawInstanced(info, material, mesh, r, runEnd - r);
+		r = runEnd;
+	}
+}
+
+int Render::GetNumCommandLists(int drawCount)
+{
+	if (!useDeferredContexts || jobs == nullptr) return 1;
+	int numCommandLists = drawCount / MIN_DRAWS_PER_COMMAND_LIST;
+	if (numCommandLists > jobs->GetNumThreads()) numCommandLists = jobs->GetNumThreads();
+	if (numCommandLists > MAX_COMMAND_LISTS) numCommandLists = MAX_COMMAND_LISTS;
+	return numCommandLists;
+}
+
+//Each chunk of the sorted list is recorded on its own deferred context, then they are all played back in order
+void Render::DrawWithCommandLists(int numCommandLists, int start, int end)
+{
+	//Deferred contexts start out with nothing set, so they copy what the immediate context has.
+	//The G-buffer pass has more than one target. It's all in one struct so the jobs only capture a pointer to it,
+	//small enough for std::function to keep without going to the heap
+	struct InheritedState {
+		ID3D11RenderTargetView* renderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		UINT numRenderTargets;
+		ID3D11DepthStencilView* depthStencil;
+		D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		UINT numViewports;
+		ID3D11RasterizerState* rasterizerState;
+		ID3D11DepthStencilState* depthStencilState;
+		UINT stencilRef;
+		ID3D11CommandList* commandLists[MAX_COMMAND_LISTS];
+	};
+	InheritedState state = {};
+	state.numViewports = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+	deviceContext->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, state.renderTargets, &state.depthStencil);
+	while (state.numRenderTargets < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT && state.renderTargets[state.numRenderTargets] != nullptr) state.numRenderTargets++;
+	deviceContext->RSGetViewports(&state.numViewports, state.viewports);
+	deviceContext->RSGetState(&state.rasterizerState);
+	deviceContext->OMGetDepthStencilState(&state.depthStencilState, &state.stencilRef);
+
+	int drawsPerList = (end - start + numCommandLists - 1) / numCommandLists;
+	JobCounter counter;
+	for (int l = 0; l < numCommandLists; l++) {
+		int listStart = start + l * drawsPerList;
+		int listEnd = listStart + drawsPerList < end ? listStart + drawsPerList : end;
+		InheritedState* inherited = &state;
+		jobs->Run([this, l, listStart, listEnd, inherited]() {
+			ID3D11DeviceContext* context = GetDeferredContext(l);
+			if (context == nullptr) return;
+			//Every command list starts its ring over, the first map on a deferred context has to discard
+			deferredRings[l]->Reset();
+			//Slot 0 is the immediate context's
+			ISimpleShader::SetThreadContext(context, l + 1, deferredRings[l]);
+			context->OMSetRenderTargets(inherited->numRenderTargets, inherited->renderTargets, inherited->depthStencil);
+			context->RSSetViewports(inherited->numViewports, inherited->viewports);
+			context->RSSetState(inherited->rasterizerState);
+			context->OMSetDepthStencilState(inherited->depthStencilState, inherited->stencilRef);
+			context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			BindFrameResources(context);
+
+			RenderInfo info = renderInfo;
+			info.deviceContext = context;
+			DrawRange(info, listStart, listEnd);
+
+			context->FinishCommandList(FALSE, &inherited->commandLists[l]);
+			ISimpleShader::SetThreadContext(nullptr, 0);
+		}, &counter);
+	}
+	jobs->Wait(counter);
+
+	for (int l = 0; l < numCommandLists; l++) {
+		if (state.commandLists[l] == nullptr) continue;
+		//Restoring keeps the immediate context's state around for whatever gets drawn after us
+		deviceContext->ExecuteCommandList(state.commandLists[l], TRUE);
+		ReleaseMacro(state.commandLists[l]);
+	}
+	for (UINT t = 0; t < state.numRenderTargets; t++) {
+		ReleaseMacro(state.renderTargets[t]);
+	}
+	ReleaseMacro(state.depthStencil);
+	ReleaseMacro(state.rasterizerState);
+	ReleaseMacro(state.depthStencilState);
+}
+
+//What the pixel shaders read on top of their materials, every context that draws needs it
+void Render::BindFrameResources(ID3D11DeviceContext* context)
+{
+	lightClusters->Bind(context);
+	//Depth only passes don't read them, and the shadow passes are drawing into them
+	if (!renderInfo.depthPrePass && drawFrame->shadowLightIndex >= 0) shadowMaps->Bind(context);
+}
+
+ID3D11DeviceContext* Render::GetDeferredContext(int index)
+{
+	if (deferredContexts[index] == nullptr) {
+		if (FAILED(device->CreateDeferredContext(0, &deferredContexts[index]))) {
+			LogText("--ERROR--//Couldn't create a deferred context");
+			deferredContexts[index] = nullptr;
+			return nullptr;
+		}
+		deferredRings[index] = new ConstantBufferRing(device, deferredContexts[index]);
+	}
+	return deferredContexts[index];
+}
+
+//Writes the world matrix of every draw into the instance buffer in sorted order,
+//so a run of draws in the render list is also a run of instances in the buffer
+void Render::FillInstanceBuffer()
+{
+	const RenderFrame& frame = *drawFrame;
+	int drawCount = frame.numDraws;
+	if (drawCount == 0) return;
+	if (drawCount > instanceCapacity) {
+		ReleaseMacro(instanceBuffer);
+		if (instanceCapacity == 0) instanceCapacity = STARTING_INSTANCE_CAPACITY;
+		while (instanceCapacity < drawCount) instanceCapacity *= 2;
+
+		D3D11_BUFFER_DESC ibd;
+		ibd.Usage = D3D11_USAGE_DYNAMIC;
+		ibd.ByteWidth = sizeof(DirectX::XMFLOAT4X4) * instanceCapacity;
+		ibd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		ibd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		ibd.MiscFlags = 0;
+		ibd.StructureByteStride = 0;
+		HR(device->CreateBuffer(&ibd, 0, &instanceBuffer));
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(deviceContext->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) return;
+	DirectX::XMFLOAT4X4* instances = (DirectX::XMFLOAT4X4*)mapped.pData;
+	for (int r = 0; r < drawCount; r++) {
+		instances[r] = frame.worldMatrices[frame.renderList[r].worldMatrixIndex];
+	}
+	deviceContext->Unmap(instanceBuffer, 0);
+}
+
+void Render::DrawSingle(RenderInfo& info, const DrawCall& drawCall)
+{
+	drawCall.material->PrepareMaterial(info, drawFrame->worldMatrices[drawCall.worldMatrixIndex], drawCall.mesh);
+
+	if (info.currentMesh != drawCall.mesh) {
+		UINT stride = drawCall.mesh->GetVertexStride();
+		UINT offset = 0;
+		info.deviceContext->IASetVertexBuffers(0, 1, drawCall.mesh->GetVertexBuffer(), &stride, &offset);
+		info.deviceContext->IASetIndexBuffer(drawCall.mesh->GetIndexBuffer(), drawCall.mesh->GetIndexFormat(), 0);
+		info.currentMesh = drawCall.mesh;
+	}
+	info.deviceContext->DrawIndexed(drawCall.mesh->GetNumberOfIndices(), 0, 0);
+	CountDraw(drawCall.mesh, 1);
+}
+
+void Render::DrawInstanced(RenderInfo& info, Material* material, Mesh* mesh, int firstInstance, int numInstances)
+{
+	material->PrepareInstancedMaterial(info, mesh);
+	BindInstances(info, mesh, false, instanceBuffer);
+	info.deviceContext->DrawIndexedInstanced(mesh->GetNumberOfIndices(), numInstances, 0, 0, firstInstance);
+	CountDraw(mesh, numInstances);
+}
+
+//Uses the same instancing as the main pass, so both work out the position the same way
+void Render::DrawDepthSingle(RenderInfo& info, const DrawCall& drawCall)
+{
+	//perFrame = buffer 0
+	//"view" = 0
+	//"projection" = 1
+	//perObject = buffer 1
+	//"world" = 2
+	//"positionScale" = 3
+	//"positionOffset" = 4
+	Mesh* mesh = drawCall.mesh;
+	bool isCompact = mesh->GetVertexFormat() == VERTEX_FORMAT_COMPACT;
+	SimpleVertexShader* depthShader = depthShaders[isCompact ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FULL][0];
+	depthShader->SetMatrix4x4(2, drawFrame->worldMatrices[drawCall.worldMatrixIndex]);
+	if (isCompact) {
+		depthShader->SetFloat3(3, mesh->GetPositionScale());
+		depthShader->SetFloat3(4, mesh->GetPositionOffset());
+	}
+	if (info.currentVertexShader != depthShader) {
+		depthShader->SetMatrix4x4(0, info.viewMatrix);
+		depthShader->SetMatrix4x4(1, info.projectionMatrix);
+		depthShader->SetShader(true);
+		info.currentVertexShader = depthShader;
+	}
+	else {
+		depthShader->CopyBufferData(1);
+	}
+	PrepareDepthRenderStates(info, drawCall.material);
+
+	if (info.currentMesh != mesh) {
+		UINT stride = mesh->GetPositionStride();
+		UINT offset = 0;
+		info.deviceContext->IASetVertexBuffers(0, 1, mesh->GetPositionBuffer(), &stride, &offset);
+		info.deviceContext->IASetIndexBuffer(mesh->GetIndexBuffer(), mesh->GetIndexFormat(), 0);
+		info.currentMesh = mesh;
+	}
+	info.deviceContext->DrawIndexed(mesh->GetNumberOfIndices(), 0, 0);
+	CountDraw(mesh, 1);
+}
+
+void Render::DrawDepthInstanced(RenderInfo& info, Material* material, Mesh* mesh, int firstInstance, int numInstances)
+{
+	PrepareDepthInstanced(info, material, mesh);
+	BindInstances(info, mesh, true, instanceBuffer);
+	info.deviceContext->DrawIndexedInstanced(mesh->GetNumberOfIndices(), numInstances, 0, 0, firstInstance);
+	CountDraw(mesh, numInstances);
+}
+
+void Render::PrepareDepthInstanced(RenderInfo& info, Material* material, Mesh* mesh)
+{
+	bool isCompact = mesh->GetVertexFormat() == VERTEX_FORMAT_COMPACT;
+	SimpleVertexShader* depthShader = depthShaders[isCompact ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FULL][1];
+	if (isCompact) {
+		depthShader->SetFloat3(3, mesh->GetPositionScale());
+		depthShader->SetFloat3(4, mesh->GetPositionOffset());
+	}
+	if (info.currentVertexShader != depthShader) {
+		depthShader->SetMatrix4x4(0, info.viewMatrix);
+		depthShader->SetMatrix4x4(1, info.projectionMatrix);
+		depthShader->SetShader(true);
+		info.currentVertexShader = depthShader;
+	}
+	else if (isCompact) {
+		depthShader->CopyBufferData(1);
+	}
+	PrepareDepthRenderStates(info, material);
+}
+
+//The instance buffer is bound next to the mesh, so the mesh can't be skipped even if it didn't change
+void Render::BindInstances(RenderInfo& info, Mesh* mesh, bool positionsOnly, ID3D11Buffer* instances)
+{
+	UINT stride = positionsOnly ? mesh->GetPositionStride() : mesh->GetVertexStride();
+	UINT instanceStride = sizeof(DirectX::XMFLOAT4X4);
+	UINT offset = 0;
+	info.deviceContext->IASetVertexBuffers(0, 1, positionsOnly ? mesh->GetPositionBuffer() : mesh->GetVertexBuffer(), &stride, &offset);
+	info.deviceContext->IASetVertexBuffers(SimpleVertexShader::INSTANCE_INPUT_SLOT, 1, &instances, &instanceStride, &offset);
+	info.deviceContext->IASetIndexBuffer(mesh->GetIndexBuffer(), mesh->GetIndexFormat(), 0);
+	info.currentMesh = nullptr;
+}
+
+//Only the culling matters here, the material's own depth test and write are what the pre-pass needs
+void Render::PrepareDepthRenderStates(RenderInfo& info, Material* material)
+{
+	if (info.currentPipelineState == material->GetShaderSortID()) return;
+	shaderCache->ApplyRenderStates(info.deviceContext, material->GetShaderSortID());
+	info.currentPipelineState = material->GetShaderSortID();
+}
+
+UINT64 Render::CreateSortKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, unsigned int depth)
+{
+	UINT64 key = 0;
+	key |= (UINT64)(pass & ((1 << SORT_KEY_PASS_BITS) - 1));
+	key = (key << SORT_KEY_SHADER_BITS) | (UINT64)(shader & ((1 << SORT_KEY_SHADER_BITS) - 1));
+	key = (key << SORT_KEY_MATERIAL_BITS) | (UINT64)(material & ((1 << SORT_KEY_MATERIAL_BITS) - 1));
+	key = (key << SORT_KEY_MESH_BITS) | (UINT64)(mesh & ((1 << SORT_KEY_MESH_BITS) - 1));
+	key = (key << SORT_KEY_DEPTH_BITS) | (UINT64)(depth & ((1 << SORT_KEY_DEPTH_BITS) - 1));
+	return key;
+}
+
+//Positive floats keep their order when their bits are compared as integers,
+//so the top bits (exponent and some of the mantissa) make a cheap front to back depth
+unsigned int Render::QuantizeDepth(float distanceSquared)
+{
+	unsigned int bits;
+	memcpy(&bits, &distanceSquared, sizeof(float));
+	return bits >> (32 - SORT_KEY_DEPTH_BITS);
+}
+
+//LSD radix sort on the 64 bit keys, one byte per pass.
+//Passes where every key has the same byte are skipped, which is common since most of the key is ids.
+void Render::SortRenderList(LinearArena& scratch)
+{
+	std::vector<DrawCall>& renderList = drawFrame->renderList;
+	int drawCount = drawFrame->numDraws;
+	if (drawCount < 2) return;
+	size_t mark = scratch.GetMark();
+	DrawCall* source = renderList.data();
+	DrawCall* destination = scratch.Allocate<DrawCall>(drawCount);
+	for (int shift = 0; shift < 64; shift += 8) {
+		unsigned int counts[256] = { 0 };
+		for (int r = 0; r < drawCount; r++) {
+			counts[(source[r].sortKey >> shift) & 0xFF]++;
+		}
+		if (counts[(source[0].sortKey >> shift) & 0xFF] == (unsigned int)drawCount) continue;
+
+		unsigned int offset = 0;
+		for (int b = 0; b < 256; b++) {
+			unsigned int count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+		for (int r = 0; r < drawCount; r++) {
+			destination[counts[(source[r].sortKey >> shift) & 0xFF]++] = source[r];
+		}
+		DrawCall* temp = source;
+		source = destination;
+		destination = temp;
+	}
+	//An odd number of passes leaves the result in the scratch buffer
+	if (source != renderList.data()) {
+		memcpy(renderList.data(), source, sizeof(DrawCall) * drawCount);
+	}
+	scratch.Rewind(mark);
 }
@@ -4,7 +4,26 @@
 #include "SimpleShader.h"
 #include "Light.h"
 #include "Camera.h"
+#include "LightClusters.h"
+#include "GBuffer.h"
+#include "ShadowMaps.h"
+#include "GPUCulling.h"
+#include "ShaderCache.h"
 #include <d3d11.h>
+#include <vector>
+#include <atomic>
+
+//Passes are the most significant part of the sort key, everything in a pass is drawn before the next pass
+const int RENDER_PASS_OPAQUE = 0;
+//Only used with deferred shading, for materials without a G-buffer shader. Lit forward after the lighting pass
+const int RENDER_PASS_FORWARD = 1;
+//Shadow casters, drawn depth only before everything else. Cascade c's static casters are RENDER_PASS_SHADOW + c * 2
+//and its dynamic ones the pass after. Sorted last so the main passes stay one run at the front
+const int RENDER_PASS_SHADOW = 8;
+
+//How the opaque pass gets lit, can be switched between frames
+const int RENDER_PATH_FORWARD = 0;
+const int RENDER_PATH_DEFERRED = 1;
 
 struct RenderInfo {
 	//Critical stuff
@@ -14,36 +33,217 @@ struct RenderInfo {
 
 	//Various stuff
 	DirectX::XMFLOAT3 cameraPosition;
+	DirectX::XMFLOAT3 cameraForward;
+
+	//Light stuff, the lights themselves are in the cluster buffers
+	ClusterInfo clusterInfo;
 
-	//Light stuff
-	RenderLight light1;
-	RenderLight light2;
+	bool gBufferPass;//Materials draw with their G-buffer pixel shader
+	bool depthPrePass;//Only positions get drawn, with the depth shaders
+	bool depthEqual;//The pre-pass already has the depth, so depth writing materials test for equal
 
+	SimpleVertexShader* currentVertexShader;
+	SimplePixelShader* currentPixelShader;
+	unsigned int currentPipelineState;
 	Material* currentMaterial;
 	Mesh* currentMesh;
 };
 
+//What the shadow maps cost last frame, per cascade
+struct ShadowCascadeStats {
+	int numStaticCasters;//Only drawn when the cache was redrawn
+	int numDynamicCasters;
+	bool redrewStaticCache;
+};
+
+//A single entry in the render list, the sort key decides the order everything gets submitted in.
+//Only holds what drawing needs so sorting and instancing walk contiguous memory
+struct DrawCall {
+	UINT64 sortKey;
+	Mesh* mesh;
+	Material* material;
+	unsigned int worldMatrixIndex;//Into the render list's world matrices
+};
+
+//Everything a frame gets drawn from, copied out of the scene as it's submitted. One is filled in on the game thread
+//while the other is drawn, so drawing never looks at anything the simulation can be changing
+struct RenderFrame {
+	std::vector<DrawCall> renderList;//Never shrinks, only the first numDraws are this frame's
+	std::vector<DirectX::XMFLOAT4X4> worldMatrices;
+	int numDraws;
+
+	DirectX::XMFLOAT4X4 viewMatrix;
+	DirectX::XMFLOAT4X4 projectionMatrix;
+	DirectX::XMFLOAT3 cameraPosition;
+	DirectX::XMFLOAT3 cameraForward;
+	float nearPlane;
+	float farPlane;
+	std::vector<RenderLight> lights;
+
+	int renderPath;
+	bool useDepthPrePass;
+	bool useGPUCulling;
+
+	int shadowLightIndex;//-1 when nothing casts shadows
+	DirectX::XMFLOAT4X4 shadowViewMatrix;
+	DirectX::XMFLOAT4X4 shadowProjectionMatrices[ShadowMaps::NUM_CASCADES];
+	ShadowCascade shadowCascades[ShadowMaps::NUM_CASCADES];
+	bool redrawStaticShadows[ShadowMaps::NUM_CASCADES];//Decided when the frame is swapped, the casters were sent for it
+};
+
+class JobSystem;
+class ConstantBufferRing;
+class LinearArena;
+
 class Render
 {
 public:
-	const static int MAX_NUM_OF_RENDERED_OBJECTS = 100;//Very likely to changed
-	const static int MAX_NUM_OF_LIGHTS = 2;
+	const static int STARTING_RENDER_LIST_CAPACITY = 256;//Grows as needed and keeps its size between frames
+	const static int MAX_NUM_OF_LIGHTS = 1024;//How many the light buffer holds
+	const static int STARTING_INSTANCE_CAPACITY = 256;//The instance buffer doubles in size whenever it runs out
+	//Recording on deferred contexts only pays off with enough draws per list
+	const static int MIN_DRAWS_PER_COMMAND_LIST = 128;
+	const static int MAX_COMMAND_LISTS = 8;//Has to stay below ISimpleShader::MAX_CONTEXT_SLOTS
+
+	//Bit layout of the sort key, from most to least significant
+	//| pass 4 | shader 12 | material 16 | mesh 16 | depth 16 |
+	const static int SORT_KEY_PASS_BITS = 4;
+	const static int SORT_KEY_SHADER_BITS = 12;
+	const static int SORT_KEY_MATERIAL_BITS = 16;
+	const static int SORT_KEY_MESH_BITS = 16;
+	const static int SORT_KEY_DEPTH_BITS = 16;
 
-	Render(ID3D11DeviceContext* newDeviceContext);
+	Render(ID3D11Device* newDevice, ID3D11DeviceContext* newDeviceContext, ShaderCache* newShaderCache);
 	~Render();
 
+	//Draws are added to the frame being submitted, which only gets drawn after the next SwapFrames
 	void AddToRenderList(DrawnMesh& drawnMesh);
-	void UpdateAndRender(Camera& camera);
+	//Safe to call from several threads at once, as long as ReserveDraws already made room for all of them
+	void AddToRenderList(Mesh* mesh, Material* material, const DirectX::XMFLOAT4X4& worldMatrix);
+	void ReserveDraws(int count);//Not thread safe
+	//Copies the camera and the lights into the frame being submitted and fits the shadow cascades to the camera.
+	//Has to run after they've moved for the frame and before anything is culled against the cascades
+	void SetView(Camera& camera);
+	//The submitted frame becomes the one that gets drawn and the next one starts out empty.
+	//Nothing can be submitting or drawing while it runs
+	void SwapFrames();
+	//Draws the last swapped frame. It only reads that frame's copies, so it can run on another thread while the next
+	//frame is submitted. The sort's scratch space comes out of frameArena
+	void UpdateAndRender(LinearArena& frameArena);
 
+	//Returns the new light's index
+	int AddLight(const GameLight& light);
 	GameLight& GetLight(int index) { return lights[index]; }
 	void SetLight(GameLight light, int index) { lights[index] = light; }
+	int GetNumLights() const { return lights.size(); }
+	//Bins the lights into clusters every frame, without it nothing gets lit
+	void SetClusterShader(SimpleComputeShader* clusterShader) { lightClusters->SetShader(clusterShader); }
+	//Deferred shading needs the lighting shaders, without them it stays forward
+	void SetRenderPath(int newRenderPath);
+	int GetRenderPath() const { return renderPath; }
+	void SetDeferredLighting(SimpleVertexShader* newFullscreenVertexShader, SimplePixelShader* newLightingPixelShader);
+	//Lays down depth for every opaque draw first, so the main pass shades each pixel about once.
+	//Needs all four depth shaders, one per vertex format with and without instancing
+	void SetUseDepthPrePass(bool newUseDepthPrePass) { useDepthPrePass = newUseDepthPrePass; }
+	bool GetUseDepthPrePass() const { return useDepthPrePass; }
+	void SetDepthPrePassShader(int vertexFormat, bool instanced, SimpleVertexShader* shader) { depthShaders[vertexFormat][instanced ? 1 : 0] = shader; }
+	//Cascaded shadows for the first directional light. They're drawn with the depth pre-pass shaders, so they need all four.
+	//The cascades are fitted in SetView
+	void SetUseShadows(bool newUseShadows) { useShadows = newUseShadows; }
+	bool GetUseShadows() const { return useShadows; }
+	int GetNumShadowCascades() const { return submitFrame->shadowLightIndex >= 0 ? ShadowMaps::NUM_CASCADES : 0; }//0 when there are no shadows this frame
+	const Frustum& GetShadowFrustum(int cascade) const { return shadowMaps->GetFrustum(cascade); }
+	//Static casters only need adding when the cascade's cache is going to be redrawn
+	bool NeedsStaticShadowCasters(int cascade) const { return !shadowMaps->IsStaticCacheValid(cascade); }
+	void InvalidateStaticShadows() { shadowMaps->InvalidateStaticCache(); }//Whenever static geometry moves, comes or goes
+	//Same rules as AddToRenderList, and it takes the same room
+	void AddShadowCaster(int cascade, bool isStatic, Mesh* mesh, Material* material, const DirectX::XMFLOAT4X4& worldMatrix);
+	const ShadowCascadeStats& GetShadowCascadeStats(int cascade) const { return shadowStats[cascade]; }//As of the last drawn frame
+	//Static instanced meshes can be culled and have their LOD picked on the GPU, then drawn indirectly a bucket at a time,
+	//so the CPU never goes through them per frame. Needs the cull shader. They still cast shadows through the render list
+	void SetCullShader(SimpleComputeShader* cullShader) { gpuCulling->SetShader(cullShader); }
+	void SetUseGPUCulling(bool newUseGPUCulling) { useGPUCulling = newUseGPUCulling; }
+	bool GetUseGPUCulling() const { return useGPUCulling && gpuCulling->HasShader(); }
+	//Replaces every GPU culled instance, whenever the static scene changes. They're drawn from the next swapped frame on
+	void SetGPUScene(const GPUCullSource* sources, int count);
+	//With both set, big draw lists get split up and recorded on deferred contexts across the job system's threads
+	void SetJobSystem(JobSystem* newJobs) { jobs = newJobs; }
+	void SetUseDeferredContexts(bool newUseDeferredContexts) { useDeferredContexts = newUseDeferredContexts; }
+	//The most draws submitted in a single frame so far
+	int GetHighWaterMark() const { return highWaterMark; }
 
+	static UINT64 CreateSortKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, unsigned int depth);
 private:
+	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
-	DrawnMesh* renderList[MAX_NUM_OF_RENDERED_OBJECTS];
-	GameLight lights[MAX_NUM_OF_LIGHTS];
-	int endIndex;
+	//Their lists never shrink, so once they have grown adding draws doesn't allocate
+	RenderFrame frames[2];
+	RenderFrame* submitFrame;//Only touched on the game thread
+	RenderFrame* drawFrame;//Only touched by UpdateAndRender
+	std::atomic<int> numDraws;//Into submitFrame, it only gets its count when it's swapped
+	std::vector<GameLight> lights;
+	LightClusters* lightClusters;
+	int highWaterMark;
 
 	RenderInfo renderInfo;
+
+	int renderPath;
+	GBuffer* gBuffer;
+	ShaderCache* shaderCache;
+	SimpleVertexShader* fullscreenVertexShader;
+	SimplePixelShader* lightingPixelShader;
+	unsigned int lightingPipelineState;
+
+	bool useDepthPrePass;
+	SimpleVertexShader* depthShaders[2][2];//[vertex format][instanced]
+
+	bool useShadows;
+	ShadowMaps* shadowMaps;
+	ShadowCascadeStats shadowStats[ShadowMaps::NUM_CASCADES];
+
+	bool useGPUCulling;
+	GPUCulling* gpuCulling;//Only touched by UpdateAndRender, apart from the swap
+	//Built on the game thread and handed over in SwapFrames
+	std::vector<GPUCullInstance> pendingGPUInstances;
+	std::vector<GPUCullBucket> pendingGPUBuckets;
+	bool hasPendingGPUScene;
+	bool drawsGPUCulled;//The drawn frame's buckets were culled
+
+	JobSystem* jobs;
+	bool useDeferredContexts;
+	ID3D11DeviceContext* deferredContexts[MAX_COMMAND_LISTS];//Created when first needed
+	//Per object constants get appended to these instead of being updated in place, one per context
+	ConstantBufferRing* immediateRing;
+	ConstantBufferRing* deferredRings[MAX_COMMAND_LISTS];
+
+	//Per instance world matrices, one for every entry in the sorted render list
+	ID3D11Buffer* instanceBuffer;
+	int instanceCapacity;
+
+	void AddDraw(unsigned int pass, Mesh* mesh, Material* material, const DirectX::XMFLOAT4X4& worldMatrix);
+	void SortRenderList(LinearArena& scratch);
+	void FillInstanceBuffer();
+	void DrawPass(int start, int end);
+	void DrawDeferred(int drawCount);
+	void DrawLighting();
+	bool HasDepthPrePassShaders() const;
+	void DrawDepthPrePass(int drawCount);
+	void DrawGPUCulled(int pass);
+	void DrawShadowMaps(int drawCount);
+	void BindFrameResources(ID3D11DeviceContext* context);
+	int FindPassStart(unsigned int pass, int drawCount);
+	void DrawRange(RenderInfo& info, int start, int end);
+	void DrawSingle(RenderInfo& info, const DrawCall& drawCall);
+	void DrawInstanced(RenderInfo& info, Material* material, Mesh* mesh, int firstInstance, int numInstances);
+	void DrawDepthSingle(RenderInfo& info, const DrawCall& drawCall);
+	void DrawDepthInstanced(RenderInfo& info, Material* material, Mesh* mesh, int firstInstance, int numInstances);
+	void PrepareDepthInstanced(RenderInfo& info, Material* material, Mesh* mesh);
+	void PrepareDepthRenderStates(RenderInfo& info, Material* material);
+	void BindInstances(RenderInfo& info, Mesh* mesh, bool positionsOnly, ID3D11Buffer* instances);
+	int GetNumCommandLists(int drawCount);
+	void DrawWithCommandLists(int numCommandLists, int start, int end);
+	ID3D11DeviceContext* GetDeferredContext(int index);
+	static unsigned int QuantizeDepth(float distanceSquared);
+	static void ClearCurrentState(RenderInfo& info);
 };
 
@@ -0,0 +1,183 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+typedef unsigned long long ResourceHash;
+
+//64 bit FNV-1a. constexpr so literal names hash at compile time, 64 bits so names never collide in practice
+constexpr ResourceHash HashResourceName(const char* name, ResourceHash hash = 14695981039346656037ULL)
+{
+	return *name == 0 ? hash : HashResourceName(name + 1, (hash ^ (unsigned char)*name) * 1099511628211ULL);
+}
+
+inline ResourceHash HashResourceName(const std::string& name)
+{
+	ResourceHash hash = 14695981039346656037ULL;
+	for (unsigned int c = 0; c < name.size(); c++) {
+		hash = (hash ^ (unsigned char)name[c]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//For names that aren't null terminated, like ones still in a file
+inline ResourceHash HashResourceNameRange(const char* start, const char* end)
+{
+	ResourceHash hash = 14695981039346656037ULL;
+	for (const char* c = start; c < end; c++) {
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline ResourceHash HashResourceName(const std::wstring& name)
+{
+	ResourceHash hash = 14695981039346656037ULL;
+	for (unsigned int c = 0; c < name.size(); c++) {
+		hash = (hash ^ (unsigned short)name[c]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//Same idea as EntityHandle, a slot that got reused has a newer generation so old handles stop working
+struct ResourceHandle {
+	int index;
+	unsigned int generation;
+};
+
+const ResourceHandle INVALID_RESOURCE_HANDLE = { -1, 0 };
+
+template <typename T>
+void DeleteResource(T* resource)
+{
+	delete resource;
+}
+
+//For the D3D views and states, anything with Release
+template <typename T>
+void ReleaseResource(T* resource)
+{
+	if (resource != nullptr) resource->Release();
+}
+
+//Owns named resources of one type. Lookups go through the name's hash, so they don't depend on how many there are.
+//Every handle handed out by Add or AddRef needs a Release, the resource is destroyed when the last one goes
+template <typename T>
+class ResourceRegistry
+{
+public:
+	ResourceRegistry(void(*newDestroy)(T*) = DeleteResource<T>)
+	{
+		destroy = newDestroy;
+		count = 0;
+	}
+
+	~ResourceRegistry()
+	{
+		Clear();
+	}
+
+	//The resource can be nullptr for something that's still loading, Set fills it in later.
+	//Returns INVALID_RESOURCE_HANDLE if the name is already used
+	ResourceHandle Add(ResourceHash hash, T* resource)
+	{
+		if (nameToSlot.find(hash) != nameToSlot.end()) return INVALID_RESOURCE_HANDLE;
+		int index;
+		if (!freeSlots.empty()) {
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			index = (int)slots.size();
+			Slot slot;
+			slot.generation = 0;
+			slots.push_back(slot);
+		}
+		Slot& slot = slots[index];
+		slot.resource = resource;
+		slot.hash = hash;
+		slot.refCount = 1;
+		nameToSlot[hash] = index;
+		count++;
+		ResourceHandle handle = { index, slot.generation };
+		return handle;
+	}
+
+	//Doesn't add a reference
+	ResourceHandle Find(ResourceHash hash) const
+	{
+		typename std::unordered_map<ResourceHash, int>::const_iterator found = nameToSlot.find(hash);
+		if (found == nameToSlot.end()) return INVALID_RESOURCE_HANDLE;
+		ResourceHandle handle = { found->second, slots[found->second].generation };
+		return handle;
+	}
+
+	bool IsValid(ResourceHandle handle) const
+	{
+		return handle.index >= 0 && handle.index < (int)slots.size() && slots[handle.index].refCount > 0 && slots[handle.index].generation == handle.generation;
+	}
+
+	//nullptr if the handle is stale
+	T* Get(ResourceHandle handle) const { return IsValid(handle) ? slots[handle.index].resource : nullptr; }
+
+	//Destroys whatever was there before. False if the handle is stale, the caller still owns the resource then
+	bool Set(ResourceHandle handle, T* resource)
+	{
+		if (!IsValid(handle)) return false;
+		Slot& slot = slots[handle.index];
+		if (slot.resource != nullptr && slot.resource != resource) destroy(slot.resource);
+		slot.resource = resource;
+		return true;
+	}
+
+	void AddRef(ResourceHandle handle)
+	{
+		if (IsValid(handle)) slots[handle.index].refCount++;
+	}
+
+	void Release(ResourceHandle handle)
+	{
+		if (!IsValid(handle)) return;
+		Slot& slot = slots[handle.index];
+		slot.refCount--;
+		if (slot.refCount == 0) FreeSlot(handle.index);
+	}
+
+	int GetRefCount(ResourceHandle handle) const { return IsValid(handle) ? slots[handle.index].refCount : 0; }
+	int GetCount() const { return count; }
+
+	//Destroys everything no matter how many references are left
+	void Clear()
+	{
+		for (unsigned int s = 0; s < slots.size(); s++) {
+			if (slots[s].refCount > 0) {
+				slots[s].refCount = 0;
+				FreeSlot(s);
+			}
+		}
+	}
+private:
+	struct Slot {
+		T* resource;
+		ResourceHash hash;
+		unsigned int generation;
+		int refCount;//0 when the slot is free
+	};
+
+	void FreeSlot(int index)
+	{
+		Slot& slot = slots[index];
+		if (slot.resource != nullptr) destroy(slot.resource);
+		slot.resource = nullptr;
+		slot.generation++;
+		nameToSlot.erase(slot.hash);
+		freeSlots.push_back(index);
+		count--;
+	}
+
+	std::vector<Slot> slots;
+	std::vector<int> freeSlots;
+	std::unordered_map<ResourceHash, int> nameToSlot;
+	void(*destroy)(T*);
+	int count;
+};
@@ -1,42 +1,99 @@
 #include "Resources.h"
 #include <vector>
+#include <unordered_map>
 #include <fstream>
+#include <cstring>
+#include <cstdio>
 #include "Logger.h"
+#include "CookedMesh.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "LinearArena.h"
+#include "WICTextureLoader.h"
+#include "DDSTextureLoader.h"
 
-Resources::Resources(ID3D11Device* newDevice)
+//A made LOD has to get below this fraction of the last level's triangles to be kept
+const static float MAX_LOD_TRIANGLE_RATIO = 0.8f;
+const static size_t MIN_SCRATCH_LIST_SIZE = 64;
+
+//Import temporaries go in here instead of on the heap. Every thread that parses has its own, and it keeps the size of the
+//biggest file so far, so after the first few meshes loading stops touching the heap for them
+static LinearArena& GetLoadScratch()
+{
+	static thread_local LinearArena loadScratch;
+	return loadScratch;
+}
+
+//A growable array in a linear arena. Plain data only, what it grows out of stays in the arena until it's reset
+template <typename T>
+struct ScratchList {
+	LinearArena* arena;
+	T* items;
+	size_t count;
+	size_t capacity;
+
+	ScratchList(LinearArena& newArena, size_t newCapacity)
+	{
+		arena = &newArena;
+		capacity = newCapacity > MIN_SCRATCH_LIST_SIZE ? newCapacity : MIN_SCRATCH_LIST_SIZE;
+		items = arena->Allocate<T>(capacity);
+		count = 0;
+	}
+
+	void Add(const T& item)
+	{
+		if (count == capacity) {
+			T* grown = arena->Allocate<T>(capacity * 2);
+			memcpy(grown, items, sizeof(T) * count);
+			items = grown;
+			capacity *= 2;
+		}
+		items[count++] = item;
+	}
+	T& operator[](size_t index) { return items[index]; }
+};
+
+Resources::Resources(ID3D11Device* newDevice, ID3D11DeviceContext* newContext)
+	: textures(ReleaseResource<ID3D11ShaderResourceView>)
 {
 	defaultModelPath = "Assets/Models/";
-	numberOfMeshes = 0;
+	optimizeMeshes = true;
+	vertexFormat = VERTEX_FORMAT_FULL;
 	device = newDevice;
-	meshNameToIndex = new std::string[MAX_NUM_MESHES];
+	context = newContext;
+	ioJobs = new JobSystem(NUM_IO_THREADS);
+	placeholderTexture = CreateSolidTexture(128, 128, 128, 255);
+	flatNormalMap = CreateSolidTexture(128, 128, 255, 255);
 }
 
 
 Resources::~Resources()
 {
-	for (int m = 0; m < numberOfMeshes; m++) {
-		if (meshes[m] != nullptr) {
-			delete meshes[m];
-			meshes[m] = nullptr;
-		}
+	//Nothing can still be writing into a mesh or texture when they get deleted
+	ioJobs->Wait(pendingLoads);
+	delete ioJobs;
+	for (unsigned int t = 0; t < loadedTextures.size(); t++) {
+		ReleaseMacro(loadedTextures[t].srv);
 	}
-	delete[] meshNameToIndex;
+	//Materials point at shaders and textures, so they go first
+	materials.Clear();
+	shaders.Clear();
+	textures.Clear();
+	meshes.Clear();
+	ReleaseMacro(placeholderTexture);
+	ReleaseMacro(flatNormalMap);
 }
 
 Mesh* Resources::GetMeshIfLoaded(const char * meshName)
 {
-	int index = FindMesh(meshName);
-	if (index != -1) {
-		return meshes[index];
-	}
-	return nullptr;
+	return meshes.Get(meshes.Find(HashResourceName(meshName)));
 }
 
 Mesh * Resources::GetMeshAndLoadIfNotFound(const char * meshName)
 {
-	int index = FindMesh(meshName);
-	if (index != -1) {
-		return meshes[index];
+	Mesh* mesh = GetMeshIfLoaded(meshName);
+	if (mesh != nullptr) {
+		return mesh;
 	}
 	LoadMesh(meshName);
 	return GetMeshIfLoaded(meshName);
@@ -44,34 +101,123 @@ Mesh * Resources::GetMeshAndLoadIfNotFound(const char * meshName)
 
 bool Resources::IsMeshLoaded(const char * meshName)
 {
-	return FindMesh(meshName) != -1;
+	return meshes.IsValid(meshes.Find(HashResourceName(meshName)));
 }
 
 void Resources::LoadMesh(std::string meshName)
 {
-	int index = FindMesh(meshName);
-	if (index != -1) {
+	ResourceHash hash = HashResourceName(meshName);
+	if (meshes.IsValid(meshes.Find(hash))) {
 		LogText("--Not loading Model--//Trying to load a model with a duplicate name, model will not be loaded.");
 		return;
 	}
+	Mesh* mesh = new Mesh();
+	if (!ReadMeshFile(meshName, mesh)) {
+		delete mesh;
+		return;
+	}
+	meshes.Add(hash, mesh);
+}
+
+ResourceHandle Resources::RequestMesh(std::string meshName)
+{
+	ResourceHash hash = HashResourceName(meshName);
+	ResourceHandle handle = meshes.Find(hash);
+	if (meshes.IsValid(handle)) {
+		meshes.AddRef(handle);
+		return handle;
+	}
+	//Registered right away so asking again gives back the same mesh instead of loading it twice
+	Mesh* mesh = new Mesh();
+	handle = meshes.Add(hash, mesh);
+	ioJobs->Run([this, meshName, mesh]() {
+		if (!ReadMeshFile(meshName, mesh)) {
+			LogText("--ERROR--//Streamed mesh failed to load, it will never be drawn.");
+		}
+	}, &pendingLoads);
+	return handle;
+}
+
+void Resources::ReleaseMesh(ResourceHandle handle)
+{
+	Mesh* mesh = meshes.Get(handle);
+	if (mesh == nullptr) return;
+	//An I/O thread could still be filling it in
+	if (meshes.GetRefCount(handle) == 1 && !mesh->IsReady()) {
+		ioJobs->Wait(pendingLoads);
+	}
+	meshes.Release(handle);
+}
+
+void Resources::ReleaseMeshAfterDraw(ResourceHandle handle)
+{
+	if (!meshes.IsValid(handle)) return;
+	DeferredRelease release = { handle, RELEASE_DELAY_SWAPS };
+	deferredMeshReleases.push_back(release);
+}
+
+void Resources::SwapFrames()
+{
+	unsigned int numWaiting = 0;
+	for (unsigned int r = 0; r < deferredMeshReleases.size(); r++) {
+		DeferredRelease& release = deferredMeshReleases[r];
+		if (--release.swapsLeft > 0) deferredMeshReleases[numWaiting++] = release;
+		else ReleaseMesh(release.handle);
+	}
+	deferredMeshReleases.resize(numWaiting);
+}
+
+//Cooked file if there's a current one, otherwise the OBJ, which then gets cooked.
+//Only reads settings that don't change, so the I/O threads can run it
+bool Resources::ReadMeshFile(std::string meshName, Mesh* mesh)
+{
 	std::string filePath = defaultModelPath + meshName + ".obj";
+	std::string cookedPath = defaultModelPath + meshName + COOKED_MESH_EXTENSION;
+	if (IsCookedMeshCurrent(filePath, cookedPath) && LoadCookedMesh(meshName, mesh)) {
+		return true;
+	}
+	LogText("LOADING MODEL");
+	LogText(meshName);
+	std::vector<Vertex> verts;
+	std::vector<UINT> indices;
+	if (!ParseObjFile(filePath, verts, indices)) {
+		return false;
+	}
+	OptimizeMesh(meshName, verts, indices);
+	//The levels go in first, the mesh can't be ready without them
+	BuildLODs(meshName, verts, indices, mesh);
+	//The mesh fills in the tangents, so cook after it's made
+	mesh->InitNewData(&verts[0], (int)verts.size(), &indices[0], (int)indices.size(), device, vertexFormat);
+	CookMesh(cookedPath, &verts[0], (int)verts.size(), &indices[0], (int)indices.size(), mesh);
+	return true;
+}
+
+bool Resources::ParseObjFile(std::string filePath, std::vector<Vertex>& verts, std::vector<UINT>& indices)
+{
 	// File input object
 	std::ifstream obj(filePath); // <-- Replace filename with your parameter
 								 // Check for successful open
 	if (!obj.is_open()) {
 		LogText("--ERROR--//Cant find file.");
-		return;
+		return false;
 	}
-	LogText("LOADING MODEL");
-	LogText(meshName);
-	// Variables used while reading the file
-	std::vector<DirectX::XMFLOAT3> positions;     // Positions from the file
-	std::vector<DirectX::XMFLOAT3> normals;       // Normals from the file
-	std::vector<DirectX::XMFLOAT2> uvs;           // UVs from the file
-	std::vector<Vertex> verts;           // Verts we're assembling
-	std::vector<UINT> indices;           // Indices of these verts
-	unsigned int vertCounter = 0;        // Count of vertices/indices
+	//Lines are around 30 bytes and each kind is about a quarter of them, a guess from the file size
+	//saves the arrays from growing over and over on a big mesh
+	obj.seekg(0, std::ios::end);
+	size_t estimatedLinesPerKind = (size_t)obj.tellg() / 30 / 4;
+	obj.seekg(0, std::ios::beg);
+
+	// Variables used while reading the file, only needed until the vertices are built
+	LinearArena& scratch = GetLoadScratch();
+	ScratchList<DirectX::XMFLOAT3> positions(scratch, estimatedLinesPerKind); // Positions from the file
+	ScratchList<DirectX::XMFLOAT3> normals(scratch, estimatedLinesPerKind);   // Normals from the file
+	ScratchList<DirectX::XMFLOAT2> uvs(scratch, estimatedLinesPerKind);       // UVs from the file
+	unsigned int vertCounter = 0;        // Count of unique vertices
+	std::unordered_map<UINT64, UINT> uniqueVerts; // Packed OBJ indices of a corner to its vertex
 	char chars[100];                     // String for line reading
+	uniqueVerts.reserve(estimatedLinesPerKind * 2);
+	verts.reserve(estimatedLinesPerKind * 2);
+	indices.reserve(estimatedLinesPerKind * 3);
 
 										 // Still good?
 	while (obj.good())
@@ -89,7 +235,7 @@ void Resources::LoadMesh(std::string meshName)
 				&norm.x, &norm.y, &norm.z);
 
 			// Add to the list of normals
-			normals.push_back(norm);
+			normals.Add(norm);
 		}
 		else if (chars[0] == 'v' && chars[1] == 't')
 		{
@@ -101,7 +247,7 @@ void Resources::LoadMesh(std::string meshName)
 				&uv.x, &uv.y);
 
 			// Add to the list of uv's
-			uvs.push_back(uv);
+			uvs.Add(uv);
 		}
 		else if (chars[0] == 'v')
 		{
@@ -112,7 +258,7 @@ void Resources::LoadMesh(std::string meshName)
 				"v %f %f %f",
 				&pos.x, &pos.y, &pos.z);
 			// Add to the positions
-			positions.push_back(pos);
+			positions.Add(pos);
 		}
 		else if (chars[0] == 'f')
 		{
@@ -125,44 +271,38 @@ void Resources::LoadMesh(std::string meshName)
 				&i[3], &i[4], &i[5],
 				&i[6], &i[7], &i[8]);
 
-			// - Create the verts by looking up
-			//    corresponding data from vectors
+			// - Each corner is a position/uv/normal tuple, corners that match
+			//    an earlier one reuse its vertex instead of adding a new one
 			// - OBJ File indices are 1-based, so
 			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Add the verts to the vector
-			verts.push_back(v1);
-			verts.push_back(v2);
-			verts.push_back(v3);
-
-			// Add three more indices
-			indices.push_back(vertCounter++);
-			indices.push_back(vertCounter++);
-			indices.push_back(vertCounter++);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int* c = &i[corner * 3];
+				//21 bits per index is over two million of each, plenty for one mesh
+				UINT64 key = ((UINT64)(c[0] & 0x1FFFFF) << 42) | ((UINT64)(c[1] & 0x1FFFFF) << 21) | (UINT64)(c[2] & 0x1FFFFF);
+				auto found = uniqueVerts.find(key);
+				if (found != uniqueVerts.end())
+				{
+					indices.push_back(found->second);
+					continue;
+				}
+				Vertex v;
+				v.Position = positions[c[0] - 1];
+				v.UV = uvs[c[1] - 1];
+				v.Normal = normals[c[2] - 1];
+				// Flip the UV's since they're probably "upside down"
+				v.UV.y = 1.0f - v.UV.y;
+				verts.push_back(v);
+				uniqueVerts[key] = vertCounter;
+				indices.push_back(vertCounter++);
+			}
 		}
 	}
 
 	// Close
 	obj.close();
+	//Nothing else lives in it, the next file starts it over
+	scratch.Reset();
 
 	// - At this point, "verts" is a vector of Vertex structs, and can be used
 	//    directly to create a vertex buffer:  &verts[0] is the first vert
@@ -170,44 +310,324 @@ void Resources::LoadMesh(std::string meshName)
 	// - The vector "indices" is similar. It's a vector of unsigned ints and
 	//    can be used directly for the index buffer: &indices[0] is the first int
 	//
-	// - "vertCounter" is BOTH the number of vertices and the number of indices
-	if (vertCounter >= 0 && numberOfMeshes + 1 < MAX_NUM_MESHES) {
-		int index = GetNextMeshIndex();
-		if (index != -1) {
-			AddMesh(meshName, &verts[0], vertCounter, &indices[0], vertCounter);
+	// - "vertCounter" is the number of unique vertices, indices.size() the number of indices
+	return vertCounter > 0;
+}
+
+void Resources::OptimizeMesh(const std::string& meshName, std::vector<Vertex>& verts, std::vector<UINT>& indices)
+{
+	if (!optimizeMeshes || indices.empty()) return;
+	int numVerts = (int)verts.size();
+	int numIndices = (int)indices.size();
+	float acmrBefore = MeshOptimizer::CalculateACMR(&indices[0], numIndices, numVerts);
+	MeshOptimizer::OptimizeVertexCache(&indices[0], numIndices, numVerts);
+	MeshOptimizer::OptimizeVertexFetch(&verts[0], numVerts, &indices[0], numIndices);
+	float acmrAfter = MeshOptimizer::CalculateACMR(&indices[0], numIndices, numVerts);
+	char acmr[64];
+	snprintf(acmr, sizeof(acmr), ": ACMR %.3f -> %.3f", acmrBefore, acmrAfter);
+	LogText("--Mesh optimizer--//" + meshName + acmr);
+}
+
+//A hand made name_lodN.obj is used when there is one, otherwise the level is simplified from the one before it.
+//Each level is cooked to its own file. Editing a hand made level doesn't recook, touch the main OBJ for that
+void Resources::BuildLODs(const std::string& meshName, const std::vector<Vertex>& verts, const std::vector<UINT>& indices, Mesh* mesh)
+{
+	std::vector<Vertex> lodVerts = verts;
+	std::vector<UINT> lodIndices = indices;
+	for (int l = 1; l < Mesh::MAX_LODS; l++) {
+		std::string lodName = GetLODName(meshName, l);
+		std::string lodPath = defaultModelPath + lodName + ".obj";
+		std::vector<Vertex> nextVerts;
+		std::vector<UINT> nextIndices;
+		if (GetFileAttributesA(lodPath.c_str()) != INVALID_FILE_ATTRIBUTES) {
+			if (!ParseObjFile(lodPath, nextVerts, nextIndices)) break;
+		}
+		else {
+			MeshOptimizer::SimplifyByClustering(&lodVerts[0], (int)lodVerts.size(), &lodIndices[0], (int)lodIndices.size(),
+				LOD_BASE_GRID_SIZE >> (l - 1), nextVerts, nextIndices);
+			//Not enough of a saving to be worth another level, and the ones after would only be worse
+			if (nextIndices.size() < MIN_LOD_TRIANGLES * 3 || nextIndices.size() > lodIndices.size() * MAX_LOD_TRIANGLE_RATIO) break;
 		}
+		//A hand made file with no faces parses fine. The levels after it would be built from it, so they go too
+		if (nextVerts.empty() || nextIndices.empty()) {
+			LogText("--ERROR--//" + lodName + " has no triangles, the mesh stops at the LODs before it.");
+			break;
+		}
+		OptimizeMesh(lodName, nextVerts, nextIndices);
+		Mesh* lod = new Mesh(&nextVerts[0], (int)nextVerts.size(), &nextIndices[0], (int)nextIndices.size(), device, vertexFormat);
+		CookMesh(defaultModelPath + lodName + COOKED_MESH_EXTENSION, &nextVerts[0], (int)nextVerts.size(), &nextIndices[0], (int)nextIndices.size(), lod);
+		mesh->SetLOD(l, lod);
+		lodVerts.swap(nextVerts);
+		lodIndices.swap(nextIndices);
 	}
 }
 
-Mesh* Resources::AddMesh(std::string meshName, Vertex * vertices, int numVerts, UINT * indices, int newNumIndices)
+std::string Resources::GetLODName(const std::string& meshName, int level)
+{
+	return meshName + "_lod" + std::to_string(level);
+}
+
+bool Resources::LoadCookedMesh(std::string meshName, Mesh* mesh)
 {
-	int index = GetNextMeshIndex();
-	if (index != -1) {
-		meshes[index] = new Mesh(&vertices[0], numVerts, &indices[0], newNumIndices, device);
-		meshNameToIndex[index] = meshName;
-		numberOfMeshes++;
-		return meshes[index];
+	std::string cookedPath = defaultModelPath + meshName + COOKED_MESH_EXTENSION;
+	MappedFile file;
+	if (!file.Open(cookedPath.c_str())) return false;
+	const CookedMeshHeader* header = (const CookedMeshHeader*)file.GetData();
+	if (file.GetSize() < sizeof(CookedMeshHeader) || memcmp(header->magic, COOKED_MESH_MAGIC, sizeof(COOKED_MESH_MAGIC)) != 0 ||
+		header->version != COOKED_MESH_VERSION || header->vertexSize != sizeof(Vertex) ||
+		(header->indexSize != sizeof(unsigned short) && header->indexSize != sizeof(UINT))) {
+		LogText("--Recooking Model--//Cooked mesh is from an older version, loading the OBJ instead.");
+		return false;
 	}
-	return nullptr;
+	size_t expectedSize = sizeof(CookedMeshHeader) + sizeof(Vertex) * (size_t)header->numVerts + header->indexSize * (size_t)header->numIndices;
+	if (file.GetSize() < expectedSize || header->numVerts == 0 || header->numIndices == 0) {
+		LogText("--ERROR--//Cooked mesh is cut short, loading the OBJ instead.");
+		return false;
+	}
+	const Vertex* vertices = (const Vertex*)(header + 1);
+	const void* indices = vertices + header->numVerts;
+	DXGI_FORMAT indexFormat = header->indexSize == sizeof(unsigned short) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	//Levels before the mesh, same as when it's cooked. A missing level just leaves the mesh with fewer
+	for (unsigned int l = 1; l <= header->numLODs && l < Mesh::MAX_LODS; l++) {
+		Mesh* lod = new Mesh();
+		if (!LoadCookedMesh(GetLODName(meshName, l), lod)) {
+			delete lod;
+			break;
+		}
+		mesh->SetLOD(l, lod);
+	}
+	//The buffers copy the data, so the file can be unmapped as soon as they're made
+	mesh->InitNewData(vertices, header->numVerts, indices, indexFormat, header->numIndices,
+		header->boundsCenter, header->boundsExtents, header->boundingRadius, device, vertexFormat);
+	return true;
 }
 
-int Resources::GetNextMeshIndex()
+void Resources::CookMesh(std::string cookedPath, const Vertex* vertices, int numVerts, const UINT* indices, int numIndices, Mesh* mesh)
 {
-	if (numberOfMeshes + 1 >= MAX_NUM_MESHES) {
-		LogText("--Max Meshes Reached--//Maximum unique number of meshes loaded. Consider loading less or increase the amount of mesh that can be stored.");
-		return -1;
+	CookedMeshHeader header;
+	memcpy(header.magic, COOKED_MESH_MAGIC, sizeof(COOKED_MESH_MAGIC));
+	header.version = COOKED_MESH_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.numVerts = numVerts;
+	header.numIndices = numIndices;
+	header.indexSize = mesh->GetIndexFormat() == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(UINT);
+	header.boundsCenter = mesh->GetBoundsCenter();
+	header.boundsExtents = mesh->GetBoundsExtents();
+	header.boundingRadius = mesh->GetBoundingRadius();
+	header.numLODs = mesh->GetNumLODs() - 1;
+
+	std::ofstream cooked(cookedPath, std::ios::binary | std::ios::trunc);
+	if (!cooked.is_open()) {
+		LogText("--ERROR--//Cant write the cooked mesh, it will be parsed again next time.");
+		return;
+	}
+	cooked.write((const char*)&header, sizeof(header));
+	cooked.write((const char*)vertices, sizeof(Vertex) * numVerts);
+	if (header.indexSize == sizeof(UINT)) {
+		cooked.write((const char*)indices, sizeof(UINT) * numIndices);
+	}
+	else {
+		//Only chosen when every index fits
+		std::vector<unsigned short> shortIndices(numIndices);
+		for (int i = 0; i < numIndices; i++) shortIndices[i] = static_cast<unsigned short>(indices[i]);
+		cooked.write((const char*)&shortIndices[0], sizeof(unsigned short) * numIndices);
+	}
+	if (!cooked.good()) {
+		//A half written file would just get rejected, but don't leave it lying around
+		cooked.close();
+		DeleteFileA(cookedPath.c_str());
 	}
-	
-	return numberOfMeshes;
 }
 
-//Finds the first mesh of the given name
-int Resources::FindMesh(std::string meshName)
+//Cooked files older than their OBJ get redone. With no OBJ at all the cooked file is all there is
+bool Resources::IsCookedMeshCurrent(std::string objPath, std::string cookedPath)
+{
+	WIN32_FILE_ATTRIBUTE_DATA cookedInfo;
+	if (!GetFileAttributesExA(cookedPath.c_str(), GetFileExInfoStandard, &cookedInfo)) return false;
+	WIN32_FILE_ATTRIBUTE_DATA objInfo;
+	if (!GetFileAttributesExA(objPath.c_str(), GetFileExInfoStandard, &objInfo)) return true;
+	return CompareFileTime(&cookedInfo.ftLastWriteTime, &objInfo.ftLastWriteTime) >= 0;
+}
+
+ResourceHandle Resources::AddMesh(std::string meshName, Vertex * vertices, int numVerts, UINT * indices, int newNumIndices)
 {
-	for (int m = 0; m < numberOfMeshes; m++) {
-		if (meshNameToIndex[m].compare(meshName) == 0) {
-			return m;
+	ResourceHash hash = HashResourceName(meshName);
+	if (meshes.IsValid(meshes.Find(hash))) {
+		LogText("--Not adding Model--//Trying to add a model with a duplicate name, model will not be added.");
+		return INVALID_RESOURCE_HANDLE;
+	}
+	return meshes.Add(hash, new Mesh(&vertices[0], numVerts, &indices[0], newNumIndices, device, vertexFormat));
+}
+
+ResourceHandle Resources::RequestTexture(std::wstring fileName, std::function<void(ID3D11ShaderResourceView*)> onLoaded)
+{
+	ResourceHash hash = HashResourceName(fileName);
+	ResourceHandle handle = textures.Find(hash);
+	if (textures.IsValid(handle)) {
+		textures.AddRef(handle);
+		ID3D11ShaderResourceView* srv = textures.Get(handle);
+		if (srv != nullptr) {
+			onLoaded(srv);
+		}
+		else {
+			textureCallbacks.insert(std::make_pair(handle.index, onLoaded));
+		}
+		return handle;
+	}
+	handle = textures.Add(hash, nullptr);
+	textureCallbacks.insert(std::make_pair(handle.index, onLoaded));
+	ioJobs->Run([this, fileName, handle]() {
+		LoadedTexture loaded;
+		loaded.handle = handle;
+		loaded.srv = nullptr;
+		loaded.needsMips = false;
+		//Cooked DDS files already have their mips and are block compressed, so they're ready as they are
+		std::wstring ddsPath = GetCookedTexturePath(fileName);
+		if (GetFileAttributesW(ddsPath.c_str()) != INVALID_FILE_ATTRIBUTES &&
+			SUCCEEDED(DirectX::CreateDDSTextureFromFile(device, ddsPath.c_str(), nullptr, &loaded.srv))) {
+			WarnIfNotBlockCompressed(fileName, loaded.srv);
 		}
+		//No context here, so WIC only makes the top level and Update has the GPU make the rest
+		else if (SUCCEEDED(DirectX::CreateWICTextureFromFile(device, fileName.c_str(), nullptr, &loaded.srv))) {
+			loaded.needsMips = true;
+		}
+		else {
+			LogText("--ERROR--//Streamed texture failed to load, the placeholder will stay.");
+			loaded.srv = nullptr;
+		}
+		std::lock_guard<std::mutex> lock(loadedTexturesMutex);
+		loadedTextures.push_back(loaded);
+	}, &pendingLoads);
+	return handle;
+}
+
+void Resources::ReleaseTexture(ResourceHandle handle)
+{
+	if (!textures.IsValid(handle)) return;
+	if (textures.GetRefCount(handle) == 1) {
+		//The slot can be reused, whoever was waiting on it isn't anymore
+		textureCallbacks.erase(handle.index);
 	}
-	return -1;
+	textures.Release(handle);
+}
+
+void Resources::Update()
+{
+	std::vector<LoadedTexture> finished;
+	{
+		std::lock_guard<std::mutex> lock(loadedTexturesMutex);
+		finished.swap(loadedTextures);
+	}
+	for (unsigned int t = 0; t < finished.size(); t++) {
+		ID3D11ShaderResourceView* srv = finished[t].srv;
+		if (srv == nullptr) continue;
+		if (finished[t].needsMips) {
+			ID3D11ShaderResourceView* withMips = CreateMipChain(srv);
+			if (withMips != nullptr) {
+				srv->Release();
+				srv = withMips;
+			}
+		}
+		//Released while it was loading
+		if (!textures.Set(finished[t].handle, srv)) {
+			srv->Release();
+			continue;
+		}
+		typedef std::unordered_multimap<int, std::function<void(ID3D11ShaderResourceView*)>>::iterator CallbackIterator;
+		std::pair<CallbackIterator, CallbackIterator> callbacks = textureCallbacks.equal_range(finished[t].handle.index);
+		for (CallbackIterator c = callbacks.first; c != callbacks.second; ++c) {
+			c->second(srv);
+		}
+		textureCallbacks.erase(finished[t].handle.index);
+	}
+}
+
+void Resources::WaitForPendingLoads()
+{
+	ioJobs->Wait(pendingLoads);
+	Update();
+}
+
+//Same name with a .dds extension, they're made with texconv: BC1 for opaque color, BC3 with alpha, BC5 for normal maps
+std::wstring Resources::GetCookedTexturePath(const std::wstring& fileName)
+{
+	size_t extension = fileName.find_last_of(L'.');
+	if (extension == std::wstring::npos) return fileName + L".dds";
+	return fileName.substr(0, extension) + L".dds";
+}
+
+//Uncompressed DDS files still work, they just miss out on the memory savings
+void Resources::WarnIfNotBlockCompressed(const std::wstring& fileName, ID3D11ShaderResourceView* srv)
+{
+	D3D11_SHADER_RESOURCE_VIEW_DESC desc;
+	srv->GetDesc(&desc);
+	size_t slash = fileName.find_last_of(L"/\\");
+	bool isNormalMap = fileName.compare(slash == std::wstring::npos ? 0 : slash + 1, 7, L"Normal_") == 0;
+	if (isNormalMap && desc.Format != DXGI_FORMAT_BC5_UNORM) {
+		LogText("--WARNING--//Cooked normal map isn't BC5, the pixel shader only reads x and y from it.");
+	}
+	else if (!isNormalMap && desc.Format != DXGI_FORMAT_BC1_UNORM && desc.Format != DXGI_FORMAT_BC1_UNORM_SRGB &&
+		desc.Format != DXGI_FORMAT_BC3_UNORM && desc.Format != DXGI_FORMAT_BC3_UNORM_SRGB) {
+		LogText("--WARNING--//Cooked texture isn't block compressed.");
+	}
+}
+
+//Copies the top level into a texture with a full mip chain and has the GPU fill in the rest.
+//Needs the immediate context so it's only ever done on the main thread
+ID3D11ShaderResourceView* Resources::CreateMipChain(ID3D11ShaderResourceView* source)
+{
+	ID3D11Resource* sourceResource = nullptr;
+	source->GetResource(&sourceResource);
+	ID3D11Texture2D* sourceTexture = nullptr;
+	HRESULT result = sourceResource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&sourceTexture);
+	sourceResource->Release();
+	if (FAILED(result)) return nullptr;
+
+	D3D11_TEXTURE2D_DESC desc;
+	sourceTexture->GetDesc(&desc);
+	desc.MipLevels = 0;//Full chain
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags |= D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	ID3D11Texture2D* texture = nullptr;
+	//Formats that can't be rendered to can't have mips generated either, those keep the one level
+	if (FAILED(device->CreateTexture2D(&desc, nullptr, &texture))) {
+		sourceTexture->Release();
+		return nullptr;
+	}
+	context->CopySubresourceRegion(texture, 0, 0, 0, 0, sourceTexture, 0, nullptr);
+	sourceTexture->Release();
+
+	ID3D11ShaderResourceView* srv = nullptr;
+	result = device->CreateShaderResourceView(texture, nullptr, &srv);
+	texture->Release();
+	if (FAILED(result)) return nullptr;
+	context->GenerateMips(srv);
+	return srv;
+}
+
+//1x1 texture to sample while the real one streams in
+ID3D11ShaderResourceView* Resources::CreateSolidTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+	unsigned char texel[4] = { r, g, b, a };
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = 1;
+	desc.Height = 1;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = texel;
+	data.SysMemPitch = sizeof(texel);
+
+	ID3D11Texture2D* texture = nullptr;
+	ID3D11ShaderResourceView* srv = nullptr;
+	if (FAILED(device->CreateTexture2D(&desc, &data, &texture))) return nullptr;
+	device->CreateShaderResourceView(texture, nullptr, &srv);
+	texture->Release();
+	return srv;
 }
@@ -1,26 +1,100 @@
 #pragma once
 #include "Mesh.h"
 #include "Material.h"
+#include "JobSystem.h"
+#include "ResourceRegistry.h"
+#include "SimpleShader.h"
+#include <functional>
+#include <mutex>
 
 class Resources
 {
 public:
-	const static int MAX_NUM_MESHES = 50;//Max number of meshes we can load
-	Resources(ID3D11Device* newDevice);
+	const static int NUM_IO_THREADS = 2;//Loading mostly waits on the disk, so these are kept apart from the frame's job system
+	//Made LODs halve the simplification grid each level, starting from this many cells along the longest side
+	const static int LOD_BASE_GRID_SIZE = 32;
+	const static int MIN_LOD_TRIANGLES = 12;//Anything smaller isn't worth a level
+	Resources(ID3D11Device* newDevice, ID3D11DeviceContext* newContext);//The context is only used on the main thread, in Update
 	~Resources();
 
 	Mesh* GetMeshIfLoaded(const char* meshName);//Returns the mesh only if it is loaded
 	Mesh* GetMeshAndLoadIfNotFound(const char* meshName);
 	bool IsMeshLoaded(const char* meshName);
-	void LoadMesh(std::string meshName);//Load a mesh for latter
-	Mesh* AddMesh(std::string meshName, Vertex* vertices, int numVerts, UINT* indices, int newNumIndices);
-	int GetNextMeshIndex();
-	int FindMesh(std::string meshName);
+	void LoadMesh(std::string meshName);//Load a mesh for latter, stays until Resources goes
+	//Loads on an I/O thread and hands back a handle to an empty mesh right away, it gets drawn once Mesh::IsReady.
+	//Asking for the same name again gives back the same mesh. Every request adds a reference
+	ResourceHandle RequestMesh(std::string meshName);
+	Mesh* GetMesh(ResourceHandle handle) { return meshes.Get(handle); }
+	void AddMeshReference(ResourceHandle handle) { meshes.AddRef(handle); }
+	void ReleaseMesh(ResourceHandle handle);
+	//For a mesh the render thread could still be drawing. Draws snapshot the mesh, so the reference only goes once
+	//the frame it was last submitted in has been handed over and drawn, two SwapFrames from now
+	void ReleaseMeshAfterDraw(ResourceHandle handle);
+	void SwapFrames();//Call from the game's SwapFrames, while nothing is drawing
+	ResourceHandle AddMesh(std::string meshName, Vertex* vertices, int numVerts, UINT* indices, int newNumIndices);
+	//Loads on an I/O thread, onLoaded gets the texture on the main thread from Update (right away if it's already loaded).
+	//A cooked .dds next to the file is used instead when there is one, otherwise the mips are made on the GPU.
+	//Cached by path, Resources keeps owning the texture and every request adds a reference
+	ResourceHandle RequestTexture(std::wstring fileName, std::function<void(ID3D11ShaderResourceView*)> onLoaded);
+	ID3D11ShaderResourceView* GetTexture(ResourceHandle handle) { return textures.Get(handle); }//nullptr while it's loading
+	void ReleaseTexture(ResourceHandle handle);
+	void Update();//Hands out the textures that finished loading, call once a frame
+	void WaitForPendingLoads();//Blocks until everything requested so far is in, then calls Update
+	//Stand ins for textures that are still loading, owned by Resources
+	ID3D11ShaderResourceView* GetPlaceholderTexture() { return placeholderTexture; }
+	ID3D11ShaderResourceView* GetFlatNormalMap() { return flatNormalMap; }
+	//Made elsewhere and handed over, these are destroyed before the textures and meshes
+	ResourceRegistry<Material>& GetMaterials() { return materials; }
+	ResourceRegistry<ISimpleShader>& GetShaders() { return shaders; }
+	//Reorders OBJ meshes for the vertex cache before they're cooked, cooked meshes keep whatever they were cooked with
+	void SetOptimizeMeshes(bool shouldOptimize) { optimizeMeshes = shouldOptimize; }
+	//What meshes made from now on are stored as on the GPU, cooked files stay full size either way
+	void SetVertexFormat(int newVertexFormat) { vertexFormat = newVertexFormat; }
 private:
+	const static int RELEASE_DELAY_SWAPS = 2;
+	struct DeferredRelease {
+		ResourceHandle handle;
+		int swapsLeft;
+	};
+
+	struct LoadedTexture {
+		ResourceHandle handle;
+		ID3D11ShaderResourceView* srv;
+		bool needsMips;
+	};
+
+	bool ReadMeshFile(std::string meshName, Mesh* mesh);//Fills in the empty mesh and its LODs
+	bool ParseObjFile(std::string filePath, std::vector<Vertex>& verts, std::vector<UINT>& indices);
+	void OptimizeMesh(const std::string& meshName, std::vector<Vertex>& verts, std::vector<UINT>& indices);//Only when optimizeMeshes is on
+	void BuildLODs(const std::string& meshName, const std::vector<Vertex>& verts, const std::vector<UINT>& indices, Mesh* mesh);
+	static std::string GetLODName(const std::string& meshName, int level);
+	//Cooked meshes skip the OBJ parsing and the tangents, the file is mapped and handed straight to the GPU
+	bool LoadCookedMesh(std::string meshName, Mesh* mesh);
+	void CookMesh(std::string cookedPath, const Vertex* vertices, int numVerts, const UINT* indices, int numIndices, Mesh* mesh);
+	static bool IsCookedMeshCurrent(std::string objPath, std::string cookedPath);
+	static std::wstring GetCookedTexturePath(const std::wstring& fileName);
+	static void WarnIfNotBlockCompressed(const std::wstring& fileName, ID3D11ShaderResourceView* srv);
+	ID3D11ShaderResourceView* CreateMipChain(ID3D11ShaderResourceView* source);
+	ID3D11ShaderResourceView* CreateSolidTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
 	std::string defaultModelPath;
 	ID3D11Device* device;
-	Mesh* meshes[MAX_NUM_MESHES];
-	std::string* meshNameToIndex;
-	int numberOfMeshes;
+	ID3D11DeviceContext* context;
+	ResourceRegistry<Mesh> meshes;
+	ResourceRegistry<ID3D11ShaderResourceView> textures;
+	ResourceRegistry<Material> materials;
+	ResourceRegistry<ISimpleShader> shaders;
+	std::vector<DeferredRelease> deferredMeshReleases;
+	bool optimizeMeshes;
+	int vertexFormat;
+
+	//The device is free threaded, so the I/O threads make the buffers and textures themselves
+	JobSystem* ioJobs;
+	JobCounter pendingLoads;
+	std::vector<LoadedTexture> loadedTextures;//Finished but not handed out yet
+	std::mutex loadedTexturesMutex;
+	std::unordered_multimap<int, std::function<void(ID3D11ShaderResourceView*)>> textureCallbacks;//Keyed by slot, waiting on a texture still loading
+	ID3D11ShaderResourceView* placeholderTexture;
+	ID3D11ShaderResourceView* flatNormalMap;
 };
 
@@ -0,0 +1,265 @@
+#include "SceneLoader.h"
+#include <fstream>
+#include <cstring>
+#include "EntitySystem.h"
+#include "Entity.h"
+#include "Resources.h"
+#include "Render.h"
+#include "MappedFile.h"
+#include "Logger.h"
+
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool IsToken(const char* start, const char* end, const char* token)
+{
+	size_t length = strlen(token);
+	return (size_t)(end - start) == length && memcmp(start, token, length) == 0;
+}
+
+//Works straight on the mapped file, which has no null at the end for strtof or sscanf to stop at
+static const char* ParseFloat(const char* p, const char* end, float& value)
+{
+	while (p < end && IsSpace(*p)) p++;
+	double sign = 1;
+	if (p < end && (*p == '-' || *p == '+')) {
+		if (*p == '-') sign = -1;
+		p++;
+	}
+	double number = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		number = number * 10 + (*p - '0');
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		double place = 0.1;
+		while (p < end && *p >= '0' && *p <= '9') {
+			number += (*p - '0') * place;
+			place *= 0.1;
+			p++;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		int exponentSign = 1;
+		if (p < end && (*p == '-' || *p == '+')) {
+			if (*p == '-') exponentSign = -1;
+			p++;
+		}
+		int exponent = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			exponent = exponent * 10 + (*p - '0');
+			p++;
+		}
+		for (int e = 0; e < exponent; e++) {
+			number = exponentSign > 0 ? number * 10 : number * 0.1;
+		}
+	}
+	value = (float)(sign * number);
+	return p;
+}
+
+static const char* ParseFloat3(const char* p, const char* end, DirectX::XMFLOAT3& value)
+{
+	p = ParseFloat(p, end, value.x);
+	p = ParseFloat(p, end, value.y);
+	return ParseFloat(p, end, value.z);
+}
+
+SceneLoader::SceneLoader(EntitySystem* newEntSys, Resources* newRes, Render* newRender, Material* newLevelMaterial)
+{
+	entSys = newEntSys;
+	res = newRes;
+	render = newRender;
+	levelMaterial = newLevelMaterial;
+	numPlacements = 0;
+}
+
+bool SceneLoader::Load(const char* mapPath)
+{
+	std::string cookedPath = std::string(mapPath) + COOKED_SCENE_EXTENSION;
+	if (IsCookedSceneCurrent(mapPath, cookedPath) && LoadCookedScene(cookedPath)) {
+		return true;
+	}
+	if (!ParseMap(mapPath)) return false;
+	CookScene(cookedPath);
+	CreateEntities(meshNames.empty() ? nullptr : &meshNames[0], (int)meshNameToIndex.size(),
+		placements.empty() ? nullptr : &placements[0], (int)placements.size());
+	return true;
+}
+
+//One pass over the mapped file, a line only costs anything when it places a mesh with a name not seen before
+bool SceneLoader::ParseMap(const char* mapPath)
+{
+	MappedFile file;
+	if (!file.Open(mapPath)) {
+		LogText("--ERROR--//Cant find map file.");
+		return false;
+	}
+	meshNames.clear();
+	meshNameToIndex.clear();
+	placements.clear();
+
+	const char* p = (const char*)file.GetData();
+	const char* end = p + file.GetSize();
+	bool isInArena = false;
+	int current = -1;//Placement pos, rot and scl go to
+	while (p < end) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == nullptr) lineEnd = end;
+		while (p < lineEnd && IsSpace(*p)) p++;
+		const char* tokenEnd = p;
+		while (tokenEnd < lineEnd && !IsSpace(*tokenEnd)) tokenEnd++;
+
+		if (IsToken(p, tokenEnd, "arena")) {
+			isInArena = true;
+		}
+		else if (IsToken(p, tokenEnd, "model")) {
+			current = -1;
+			if (isInArena) {
+				//The name is the rest of the line
+				const char* nameStart = tokenEnd;
+				while (nameStart < lineEnd && IsSpace(*nameStart)) nameStart++;
+				const char* nameEnd = lineEnd;
+				while (nameEnd > nameStart && IsSpace(nameEnd[-1])) nameEnd--;
+				int meshIndex = AddMeshName(nameStart, nameEnd);
+				if (meshIndex >= 0) {
+					CookedScenePlacement placement;
+					placement.meshIndex = meshIndex;
+					placement.position = DirectX::XMFLOAT3(0, 0, 0);
+					placement.rotation = DirectX::XMFLOAT3(0, 0, 0);
+					placement.scale = DirectX::XMFLOAT3(1, 1, 1);
+					current = (int)placements.size();
+					placements.push_back(placement);
+				}
+			}
+		}
+		else if (current >= 0) {
+			if (IsToken(p, tokenEnd, "pos")) ParseFloat3(tokenEnd, lineEnd, placements[current].position);
+			else if (IsToken(p, tokenEnd, "rot")) ParseFloat3(tokenEnd, lineEnd, placements[current].rotation);
+			else if (IsToken(p, tokenEnd, "scl")) ParseFloat3(tokenEnd, lineEnd, placements[current].scale);
+		}
+		p = lineEnd + 1;
+	}
+	return true;
+}
+
+//-1 if the name is empty or too long to cook
+int SceneLoader::AddMeshName(const char* start, const char* end)
+{
+	if (end <= start) return -1;
+	ResourceHash hash = HashResourceNameRange(start, end);
+	std::unordered_map<ResourceHash, int>::iterator found = meshNameToIndex.find(hash);
+	if (found != meshNameToIndex.end()) return found->second;
+	if (end - start >= COOKED_SCENE_NAME_LENGTH) {
+		LogText("--ERROR--//Model name in the map is too long, it will not be placed.");
+		return -1;
+	}
+	int index = (int)meshNameToIndex.size();
+	meshNames.resize((index + 1) * COOKED_SCENE_NAME_LENGTH, 0);
+	memcpy(&meshNames[index * COOKED_SCENE_NAME_LENGTH], start, end - start);
+	meshNameToIndex[hash] = index;
+	return index;
+}
+
+void SceneLoader::CookScene(const std::string& cookedPath)
+{
+	CookedSceneHeader header;
+	memcpy(header.magic, COOKED_SCENE_MAGIC, sizeof(COOKED_SCENE_MAGIC));
+	header.version = COOKED_SCENE_VERSION;
+	header.numMeshNames = (unsigned int)meshNameToIndex.size();
+	header.numPlacements = (unsigned int)placements.size();
+
+	std::ofstream cooked(cookedPath, std::ios::binary | std::ios::trunc);
+	if (!cooked.is_open()) {
+		LogText("--ERROR--//Cant write the cooked scene, the map will be parsed again next time.");
+		return;
+	}
+	cooked.write((const char*)&header, sizeof(header));
+	if (!meshNames.empty()) cooked.write(&meshNames[0], meshNames.size());
+	if (!placements.empty()) cooked.write((const char*)&placements[0], sizeof(CookedScenePlacement) * placements.size());
+	if (!cooked.good()) {
+		cooked.close();
+		DeleteFileA(cookedPath.c_str());
+	}
+}
+
+bool SceneLoader::LoadCookedScene(const std::string& cookedPath)
+{
+	MappedFile file;
+	if (!file.Open(cookedPath.c_str())) return false;
+	const CookedSceneHeader* header = (const CookedSceneHeader*)file.GetData();
+	if (file.GetSize() < sizeof(CookedSceneHeader) || memcmp(header->magic, COOKED_SCENE_MAGIC, sizeof(COOKED_SCENE_MAGIC)) != 0 ||
+		header->version != COOKED_SCENE_VERSION) {
+		LogText("--Recooking Scene--//Cooked scene is from an older version, loading the map instead.");
+		return false;
+	}
+	size_t expectedSize = sizeof(CookedSceneHeader) + COOKED_SCENE_NAME_LENGTH * (size_t)header->numMeshNames +
+		sizeof(CookedScenePlacement) * (size_t)header->numPlacements;
+	if (file.GetSize() < expectedSize) {
+		LogText("--ERROR--//Cooked scene is cut short, loading the map instead.");
+		return false;
+	}
+	const char* names = (const char*)(header + 1);
+	const CookedScenePlacement* cookedPlacements = (const CookedScenePlacement*)(names + COOKED_SCENE_NAME_LENGTH * header->numMeshNames);
+	for (unsigned int p = 0; p < header->numPlacements; p++) {
+		if (cookedPlacements[p].meshIndex >= header->numMeshNames) {
+			LogText("--ERROR--//Cooked scene points at a mesh it doesn't have, loading the map instead.");
+			return false;
+		}
+	}
+	CreateEntities(names, header->numMeshNames, cookedPlacements, header->numPlacements);
+	return true;
+}
+
+void SceneLoader::CreateEntities(const char* names, int numNames, const CookedScenePlacement* newPlacements, int newNumPlacements)
+{
+	std::vector<ResourceHandle> meshHandles(numNames);
+	std::vector<Mesh*> meshes(numNames);
+	std::vector<unsigned char> isReferenceUsed(numNames, 0);
+	for (int n = 0; n < numNames; n++) {
+		const char* name = names + n * COOKED_SCENE_NAME_LENGTH;
+		//Names that fill the whole width have no null
+		meshHandles[n] = res->RequestMesh(std::string(name, strnlen(name, COOKED_SCENE_NAME_LENGTH)));
+		meshes[n] = res->GetMesh(meshHandles[n]);
+	}
+
+	numPlacements = 0;
+	for (int p = 0; p < newNumPlacements; p++) {
+		const CookedScenePlacement& placement = newPlacements[p];
+		Mesh* mesh = meshes[placement.meshIndex];
+		if (mesh == nullptr) continue;
+		EntityHandle entity = entSys->AddEntity();
+		if (!entSys->IsHandleValid(entity)) {
+			LogText("--ERROR--//Entity system is full, the rest of the level will not be placed.");
+			break;
+		}
+		Transform& transform = entSys->GetEntity(entity)->GetTransform();
+		transform.SetPosition(placement.position);
+		transform.SetRotation(placement.rotation);
+		transform.SetScale(placement.scale);
+		entSys->AddDrawnMesh(entity, DrawnMesh(render, mesh, levelMaterial, meshHandles[placement.meshIndex]));
+		//Level pieces never move once they're placed
+		entSys->SetStatic(entity, true);
+		//Each placement's drawn mesh holds its own reference, RequestMesh already gave out the first
+		if (isReferenceUsed[placement.meshIndex]) res->AddMeshReference(meshHandles[placement.meshIndex]);
+		isReferenceUsed[placement.meshIndex] = 1;
+		numPlacements++;
+	}
+	for (int n = 0; n < numNames; n++) {
+		if (!isReferenceUsed[n]) res->ReleaseMesh(meshHandles[n]);
+	}
+}
+
+//Cooked files older than their map get redone. With no map at all the cooked file is all there is
+bool SceneLoader::IsCookedSceneCurrent(const char* mapPath, const std::string& cookedPath)
+{
+	WIN32_FILE_ATTRIBUTE_DATA cookedInfo;
+	if (!GetFileAttributesExA(cookedPath.c_str(), GetFileExInfoStandard, &cookedInfo)) return false;
+	WIN32_FILE_ATTRIBUTE_DATA mapInfo;
+	if (!GetFileAttributesExA(mapPath, GetFileExInfoStandard, &mapInfo)) return true;
+	return CompareFileTime(&cookedInfo.ftLastWriteTime, &mapInfo.ftLastWriteTime) >= 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "CookedScene.h"
+#include "ResourceRegistry.h"
+
+class EntitySystem;
+class Resources;
+class Render;
+class Material;
+
+//Fills the entity system from a map file. Lines are a keyword and its values:
+//"arena" starts the level pieces, "model <name>" places a mesh and "pos", "rot" and "scl" with three numbers move the last one placed.
+//The map is read once into a cooked scene, which is what gets loaded from then on
+class SceneLoader
+{
+public:
+	SceneLoader(EntitySystem* newEntSys, Resources* newRes, Render* newRender, Material* newLevelMaterial);
+
+	//Uses the cooked scene next to the map when it's current, otherwise parses the map and cooks it
+	bool Load(const char* mapPath);
+	int GetNumPlacements() const { return numPlacements; }
+private:
+	//Only fills in meshNames and placements, nothing is created
+	bool ParseMap(const char* mapPath);
+	int AddMeshName(const char* start, const char* end);
+	void CookScene(const std::string& cookedPath);
+	bool LoadCookedScene(const std::string& cookedPath);
+	//Looks each mesh up once, then makes an entity for every placement in one go
+	void CreateEntities(const char* names, int numNames, const CookedScenePlacement* newPlacements, int newNumPlacements);
+	static bool IsCookedSceneCurrent(const char* mapPath, const std::string& cookedPath);
+
+	EntitySystem* entSys;
+	Resources* res;
+	Render* render;
+	Material* levelMaterial;
+	int numPlacements;
+
+	std::vector<char> meshNames;//COOKED_SCENE_NAME_LENGTH chars each, same as in the cooked file
+	std::unordered_map<ResourceHash, int> meshNameToIndex;
+	std::vector<CookedScenePlacement> placements;
+};
@@ -0,0 +1,408 @@
+#include "ShaderCache.h"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include "Resources.h"
+#include "DirectXGameCore.h"
+#include "MappedFile.h"
+#include "Logger.h"
+#include "Profiler.h"
+
+//Layout of a cache file: the header, codeSize bytes of compiled shader, then reflectionSize bytes of reflection.
+//Reflection is counts followed by their entries, strings are a length and then their chars
+struct ShaderCacheHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int codeSize;
+	unsigned int reflectionSize;
+};
+
+static const char SHADER_CACHE_MAGIC[4] = { 'S', 'H', 'D', 'C' };
+static const char* const SHADER_CACHE_EXTENSION = ".shc";
+
+static void WriteUInt(std::vector<char>& out, unsigned int value)
+{
+	out.insert(out.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+static void WriteString(std::vector<char>& out, const std::string& value)
+{
+	WriteUInt(out, (unsigned int)value.size());
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+//Reading stops for good at the first thing that runs past the end
+struct CacheReader {
+	const char* p;
+	const char* end;
+	bool ok;
+
+	unsigned int ReadUInt()
+	{
+		unsigned int value = 0;
+		if (!ok || end - p < (ptrdiff_t)sizeof(value)) { ok = false; return 0; }
+		memcpy(&value, p, sizeof(value));
+		p += sizeof(value);
+		return value;
+	}
+
+	std::string ReadString()
+	{
+		unsigned int length = ReadUInt();
+		if (!ok || (unsigned int)(end - p) < length) { ok = false; return std::string(); }
+		std::string value(p, length);
+		p += length;
+		return value;
+	}
+};
+
+static void WriteReflection(std::vector<char>& out, const SimpleShaderReflection& reflection)
+{
+	WriteUInt(out, (unsigned int)reflection.Resources.size());
+	for (unsigned int r = 0; r < reflection.Resources.size(); r++) {
+		WriteString(out, reflection.Resources[r].Name);
+		WriteUInt(out, reflection.Resources[r].Type);
+		WriteUInt(out, reflection.Resources[r].BindIndex);
+	}
+	WriteUInt(out, (unsigned int)reflection.Buffers.size());
+	for (unsigned int b = 0; b < reflection.Buffers.size(); b++) {
+		const SimpleReflectedBuffer& buffer = reflection.Buffers[b];
+		WriteString(out, buffer.Name);
+		WriteUInt(out, buffer.Size);
+		WriteUInt(out, buffer.BindIndex);
+		WriteUInt(out, (unsigned int)buffer.Variables.size());
+		for (unsigned int v = 0; v < buffer.Variables.size(); v++) {
+			WriteString(out, buffer.Variables[v].Name);
+			WriteUInt(out, buffer.Variables[v].ByteOffset);
+			WriteUInt(out, buffer.Variables[v].Size);
+		}
+	}
+	WriteUInt(out, (unsigned int)reflection.Inputs.size());
+	for (unsigned int i = 0; i < reflection.Inputs.size(); i++) {
+		WriteString(out, reflection.Inputs[i].SemanticName);
+		WriteUInt(out, reflection.Inputs[i].SemanticIndex);
+		WriteUInt(out, reflection.Inputs[i].Mask);
+		WriteUInt(out, reflection.Inputs[i].ComponentType);
+	}
+	for (int t = 0; t < 3; t++) WriteUInt(out, reflection.ThreadGroupSize[t]);
+}
+
+static bool ReadReflection(CacheReader& in, SimpleShaderReflection& reflection)
+{
+	//Counts are checked against what's left so a broken file can't ask for a huge resize
+	unsigned int numResources = in.ReadUInt();
+	if (!in.ok || numResources > (unsigned int)(in.end - in.p)) return false;
+	reflection.Resources.resize(numResources);
+	for (unsigned int r = 0; r < numResources; r++) {
+		reflection.Resources[r].Name = in.ReadString();
+		reflection.Resources[r].Type = in.ReadUInt();
+		reflection.Resources[r].BindIndex = in.ReadUInt();
+	}
+	unsigned int numBuffers = in.ReadUInt();
+	if (!in.ok || numBuffers > (unsigned int)(in.end - in.p)) return false;
+	reflection.Buffers.resize(numBuffers);
+	for (unsigned int b = 0; b < numBuffers && in.ok; b++) {
+		SimpleReflectedBuffer& buffer = reflection.Buffers[b];
+		buffer.Name = in.ReadString();
+		buffer.Size = in.ReadUInt();
+		buffer.BindIndex = in.ReadUInt();
+		unsigned int numVariables = in.ReadUInt();
+		if (!in.ok || numVariables > (unsigned int)(in.end - in.p)) return false;
+		buffer.Variables.resize(numVariables);
+		for (unsigned int v = 0; v < numVariables; v++) {
+			buffer.Variables[v].Name = in.ReadString();
+			buffer.Variables[v].ByteOffset = in.ReadUInt();
+			buffer.Variables[v].Size = in.ReadUInt();
+		}
+	}
+	unsigned int numInputs = in.ReadUInt();
+	if (!in.ok || numInputs > (unsigned int)(in.end - in.p)) return false;
+	reflection.Inputs.resize(numInputs);
+	for (unsigned int i = 0; i < numInputs; i++) {
+		reflection.Inputs[i].SemanticName = in.ReadString();
+		reflection.Inputs[i].SemanticIndex = in.ReadUInt();
+		reflection.Inputs[i].Mask = in.ReadUInt();
+		reflection.Inputs[i].ComponentType = in.ReadUInt();
+	}
+	for (int t = 0; t < 3; t++) reflection.ThreadGroupSize[t] = in.ReadUInt();
+	return in.ok;
+}
+
+ShaderCache::ShaderCache(ID3D11Device* newDevice, ID3D11DeviceContext* newContext, Resources* newRes)
+{
+	device = newDevice;
+	context = newContext;
+	res = newRes;
+	//The game runs from the output directory, the project with the shader sources is next to it
+	sourceDirectory = "../DirectX11_Starter/Shaders/";
+	cacheDirectory = "ShaderCache/";
+	CreateRenderStates();
+}
+
+ShaderCache::~ShaderCache()
+{
+	for (unsigned int s = 0; s < NUM_BLEND_STATES; s++) ReleaseMacro(blendStates[s]);
+	for (unsigned int s = 0; s < NUM_RASTER_STATES; s++) ReleaseMacro(rasterizerStates[s]);
+	for (unsigned int s = 0; s < NUM_DEPTH_STATES; s++) ReleaseMacro(depthStencilStates[s]);
+}
+
+void ShaderCache::CreateRenderStates()
+{
+	D3D11_BLEND_DESC blendDesc = {};
+	blendDesc.RenderTarget[0].BlendEnable = FALSE;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	device->CreateBlendState(&blendDesc, &blendStates[BLEND_STATE_OPAQUE]);
+	blendDesc.RenderTarget[0].BlendEnable = TRUE;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	device->CreateBlendState(&blendDesc, &blendStates[BLEND_STATE_ALPHA]);
+
+	D3D11_RASTERIZER_DESC rasterDesc = {};
+	rasterDesc.FillMode = D3D11_FILL_SOLID;
+	rasterDesc.CullMode = D3D11_CULL_BACK;
+	rasterDesc.DepthClipEnable = TRUE;
+	device->CreateRasterizerState(&rasterDesc, &rasterizerStates[RASTER_STATE_CULL_BACK]);
+	rasterDesc.CullMode = D3D11_CULL_NONE;
+	device->CreateRasterizerState(&rasterDesc, &rasterizerStates[RASTER_STATE_CULL_NONE]);
+	rasterDesc.FillMode = D3D11_FILL_WIREFRAME;
+	device->CreateRasterizerState(&rasterDesc, &rasterizerStates[RASTER_STATE_WIREFRAME]);
+
+	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
+	depthDesc.DepthEnable = TRUE;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	device->CreateDepthStencilState(&depthDesc, &depthStencilStates[DEPTH_STATE_READ_WRITE]);
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	device->CreateDepthStencilState(&depthDesc, &depthStencilStates[DEPTH_STATE_READ_ONLY]);
+	depthDesc.DepthFunc = D3D11_COMPARISON_EQUAL;
+	device->CreateDepthStencilState(&depthDesc, &depthStencilStates[DEPTH_STATE_EQUAL]);
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	depthDesc.DepthEnable = FALSE;
+	device->CreateDepthStencilState(&depthDesc, &depthStencilStates[DEPTH_STATE_OFF]);
+}
+
+SimpleVertexShader* ShaderCache::GetVertexShader(const char* name, ShaderDefines defines,
+	const D3D11_INPUT_ELEMENT_DESC* inputElements, unsigned int numInputElements)
+{
+	std::string permutationName = GetPermutationName(name, defines);
+	ResourceRegistry<ISimpleShader>& shaders = res->GetShaders();
+	ResourceHash hash = HashResourceName(permutationName);
+	ResourceHandle found = shaders.Find(hash);
+	if (shaders.IsValid(found)) return (SimpleVertexShader*)shaders.Get(found);
+
+	SimpleVertexShader* shader = inputElements != nullptr ?
+		new SimpleVertexShader(device, context, inputElements, numInputElements) :
+		new SimpleVertexShader(device, context);
+	if (!LoadPermutation(shader, permutationName, name, defines, "vs_5_0")) {
+		delete shader;
+		return nullptr;
+	}
+	shaders.Add(hash, shader);
+	return shader;
+}
+
+SimplePixelShader* ShaderCache::GetPixelShader(const char* name, ShaderDefines defines)
+{
+	std::string permutationName = GetPermutationName(name, defines);
+	ResourceRegistry<ISimpleShader>& shaders = res->GetShaders();
+	ResourceHash hash = HashResourceName(permutationName);
+	ResourceHandle found = shaders.Find(hash);
+	if (shaders.IsValid(found)) return (SimplePixelShader*)shaders.Get(found);
+
+	SimplePixelShader* shader = new SimplePixelShader(device, context);
+	if (!LoadPermutation(shader, permutationName, name, defines, "ps_5_0")) {
+		delete shader;
+		return nullptr;
+	}
+	shaders.Add(hash, shader);
+	return shader;
+}
+
+SimpleComputeShader* ShaderCache::GetComputeShader(const char* name, ShaderDefines defines)
+{
+	std::string permutationName = GetPermutationName(name, defines);
+	ResourceRegistry<ISimpleShader>& shaders = res->GetShaders();
+	ResourceHash hash = HashResourceName(permutationName);
+	ResourceHandle found = shaders.Find(hash);
+	if (shaders.IsValid(found)) return (SimpleComputeShader*)shaders.Get(found);
+
+	SimpleComputeShader* shader = new SimpleComputeShader(device, context);
+	if (!LoadPermutation(shader, permutationName, name, defines, "cs_5_0")) {
+		delete shader;
+		return nullptr;
+	}
+	shaders.Add(hash, shader);
+	return shader;
+}
+
+bool ShaderCache::LoadPermutation(ISimpleShader* shader, const std::string& permutationName, const char* name, ShaderDefines defines, const char* target)
+{
+	std::string sourcePath = sourceDirectory + name + ".hlsl";
+	std::string cachePath = cacheDirectory + permutationName + SHADER_CACHE_EXTENSION;
+	if (IsCacheCurrent(sourcePath, cachePath) && LoadCachedPermutation(cachePath, shader)) {
+		return true;
+	}
+
+	ID3DBlob* shaderBlob = CompilePermutation(sourcePath, defines, target);
+	if (shaderBlob == nullptr) {
+		//Without the source only what the build compiled is left, which has the default defines
+		std::string compiledPath = std::string(name) + ".cso";
+		LogText("--Shader Cache--//Using " + compiledPath + " for " + permutationName + ", its defines might not match.");
+		return shader->LoadShaderFile(std::wstring(compiledPath.begin(), compiledPath.end()).c_str());
+	}
+	bool loaded = shader->LoadShaderBlob(shaderBlob);
+	if (loaded) WritePermutation(cachePath, shaderBlob, shader->GetReflection());
+	shaderBlob->Release();
+	return loaded;
+}
+
+ID3DBlob* ShaderCache::CompilePermutation(const std::string& sourcePath, ShaderDefines defines, const char* target)
+{
+	if (GetFileAttributesA(sourcePath.c_str()) == INVALID_FILE_ATTRIBUTES) return nullptr;
+
+	//Every define is always passed, the shaders fall back to their own defaults when built without the cache
+	char toon[2] = { (defines & SHADER_FEATURE_TOON) ? '1' : '0', 0 };
+	char normalMap[2] = { (defines & SHADER_FEATURE_NORMAL_MAP) ? '1' : '0', 0 };
+	char compactVertex[2] = { (defines & SHADER_FEATURE_COMPACT_VERTEX) ? '1' : '0', 0 };
+	char instanced[2] = { (defines & SHADER_FEATURE_INSTANCED) ? '1' : '0', 0 };
+	D3D_SHADER_MACRO macros[] = {
+		{ "TOON", toon },
+		{ "NORMAL_MAP", normalMap },
+		{ "COMPACT_VERTEX", compactVertex },
+		{ "INSTANCED", instanced },
+		{ nullptr, nullptr }
+	};
+
+	UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if defined(DEBUG) || defined(_DEBUG)
+	flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+	flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#endif
+	ID3DBlob* shaderBlob = nullptr;
+	ID3DBlob* errors = nullptr;
+	HRESULT hr = D3DCompileFromFile(std::wstring(sourcePath.begin(), sourcePath.end()).c_str(), macros,
+		D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", target, flags, 0, &shaderBlob, &errors);
+	if (FAILED(hr)) {
+		LogText("--ERROR--//Couldn't compile " + sourcePath);
+		if (errors != nullptr) LogText((const char*)errors->GetBufferPointer());
+		ReleaseMacro(errors);
+		ReleaseMacro(shaderBlob);
+		return nullptr;
+	}
+	ReleaseMacro(errors);
+	return shaderBlob;
+}
+
+bool ShaderCache::LoadCachedPermutation(const std::string& cachePath, ISimpleShader* shader)
+{
+	MappedFile file;
+	if (!file.Open(cachePath.c_str())) return false;
+	const ShaderCacheHeader* header = (const ShaderCacheHeader*)file.GetData();
+	if (file.GetSize() < sizeof(ShaderCacheHeader) || memcmp(header->magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC)) != 0 ||
+		header->version != CACHE_VERSION ||
+		file.GetSize() < sizeof(ShaderCacheHeader) + (size_t)header->codeSize + header->reflectionSize) {
+		LogText("--Recompiling Shader--//Cached shader is from an older version or cut short.");
+		return false;
+	}
+
+	const char* code = (const char*)(header + 1);
+	CacheReader reader = { code + header->codeSize, code + header->codeSize + header->reflectionSize, true };
+	SimpleShaderReflection reflection;
+	if (!ReadReflection(reader, reflection)) {
+		LogText("--Recompiling Shader--//Cached shader reflection is broken.");
+		return false;
+	}
+
+	//The shader wants a blob, the mapped file goes away once we return
+	ID3DBlob* shaderBlob = nullptr;
+	if (FAILED(D3DCreateBlob(header->codeSize, &shaderBlob))) return false;
+	memcpy(shaderBlob->GetBufferPointer(), code, header->codeSize);
+	bool loaded = shader->LoadShaderBlob(shaderBlob, &reflection);
+	shaderBlob->Release();
+	return loaded;
+}
+
+void ShaderCache::WritePermutation(const std::string& cachePath, ID3DBlob* shaderBlob, const SimpleShaderReflection& reflection)
+{
+	std::vector<char> reflectionData;
+	WriteReflection(reflectionData, reflection);
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.codeSize = (unsigned int)shaderBlob->GetBufferSize();
+	header.reflectionSize = (unsigned int)reflectionData.size();
+
+	CreateDirectoryA(cacheDirectory.c_str(), nullptr);
+	std::ofstream cached(cachePath, std::ios::binary | std::ios::trunc);
+	if (!cached.is_open()) {
+		LogText("--ERROR--//Cant write the shader cache, the shader will be compiled again next time.");
+		return;
+	}
+	cached.write((const char*)&header, sizeof(header));
+	cached.write((const char*)shaderBlob->GetBufferPointer(), header.codeSize);
+	if (!reflectionData.empty()) cached.write(&reflectionData[0], reflectionData.size());
+	if (!cached.good()) {
+		cached.close();
+		DeleteFileA(cachePath.c_str());
+	}
+}
+
+unsigned int ShaderCache::GetPipelineStateID(const PipelineStateDesc& desc)
+{
+	//Hashed from the fields, the struct itself has padding
+	UINT64 key[3] = { (UINT64)desc.vertexShader, (UINT64)desc.pixelShader,
+		desc.blendState | (desc.rasterState << 8) | ((UINT64)desc.depthState << 16) };
+	ResourceHash hash = HashResourceNameRange((const char*)key, (const char*)(key + 3));
+	std::unordered_map<ResourceHash, unsigned int>::iterator found = pipelineStateIDs.find(hash);
+	if (found != pipelineStateIDs.end()) return found->second;
+
+	if (pipelineStates.size() >= MAX_PIPELINE_STATES) {
+		LogText("--ERROR--//Out of pipeline state ids, sorting by pipeline state will be off.");
+		return MAX_PIPELINE_STATES - 1;
+	}
+	PipelineState state;
+	state.desc = desc;
+	state.blendState = blendStates[desc.blendState < NUM_BLEND_STATES ? desc.blendState : BLEND_STATE_OPAQUE];
+	state.rasterizerState = rasterizerStates[desc.rasterState < NUM_RASTER_STATES ? desc.rasterState : RASTER_STATE_CULL_BACK];
+	state.depthStencilState = depthStencilStates[desc.depthState < NUM_DEPTH_STATES ? desc.depthState : DEPTH_STATE_READ_WRITE];
+	unsigned int id = pipelineStates.size();
+	pipelineStates.push_back(state);
+	pipelineStateIDs[hash] = id;
+	return id;
+}
+
+void ShaderCache::ApplyRenderStates(ID3D11DeviceContext* applyContext, unsigned int id, bool depthEqual)
+{
+	if (id >= pipelineStates.size()) return;
+	const PipelineState& state = pipelineStates[id];
+	applyContext->OMSetBlendState(state.blendState, nullptr, 0xFFFFFFFF);
+	applyContext->RSSetState(state.rasterizerState);
+	applyContext->OMSetDepthStencilState(depthEqual ? depthStencilStates[DEPTH_STATE_EQUAL] : state.depthStencilState, 0);
+	Profiler::Count(PROFILE_COUNTER_STATE_CHANGES, 1);
+}
+
+//Also the cache file's name, so every permutation has its own file
+std::string ShaderCache::GetPermutationName(const char* name, ShaderDefines defines)
+{
+	char suffix[16];
+	sprintf_s(suffix, "_%08X", defines);
+	return std::string(name) + suffix;
+}
+
+//With no source at all the cache is all there is
+bool ShaderCache::IsCacheCurrent(const std::string& sourcePath, const std::string& cachePath)
+{
+	WIN32_FILE_ATTRIBUTE_DATA cacheInfo;
+	if (!GetFileAttributesExA(cachePath.c_str(), GetFileExInfoStandard, &cacheInfo)) return false;
+	WIN32_FILE_ATTRIBUTE_DATA sourceInfo;
+	if (!GetFileAttributesExA(sourcePath.c_str(), GetFileExInfoStandard, &sourceInfo)) return true;
+	return CompareFileTime(&cacheInfo.ftLastWriteTime, &sourceInfo.ftLastWriteTime) >= 0;
+}
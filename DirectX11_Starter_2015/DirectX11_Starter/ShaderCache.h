@@ -0,0 +1,100 @@
+#pragma once
+#include "SimpleShader.h"
+#include "ResourceRegistry.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class Resources;
+
+//Features a shader gets compiled with, each permutation is its own shader instead of a branch in the pixel shader
+typedef unsigned int ShaderDefines;
+const ShaderDefines SHADER_FEATURE_TOON = 1 << 0;
+const ShaderDefines SHADER_FEATURE_NORMAL_MAP = 1 << 1;
+//Vertex shader inputs, only DepthVertexShader.hlsl is built around these
+const ShaderDefines SHADER_FEATURE_COMPACT_VERTEX = 1 << 2;
+const ShaderDefines SHADER_FEATURE_INSTANCED = 1 << 3;
+
+//Fixed function state is picked from a few presets, each is created once up front
+const unsigned int BLEND_STATE_OPAQUE = 0;
+const unsigned int BLEND_STATE_ALPHA = 1;
+const unsigned int NUM_BLEND_STATES = 2;
+const unsigned int RASTER_STATE_CULL_BACK = 0;
+const unsigned int RASTER_STATE_CULL_NONE = 1;
+const unsigned int RASTER_STATE_WIREFRAME = 2;
+const unsigned int NUM_RASTER_STATES = 3;
+const unsigned int DEPTH_STATE_READ_WRITE = 0;
+const unsigned int DEPTH_STATE_READ_ONLY = 1;
+const unsigned int DEPTH_STATE_OFF = 2;
+const unsigned int DEPTH_STATE_EQUAL = 3;//After a depth pre-pass, only the frontmost surface passes
+const unsigned int NUM_DEPTH_STATES = 4;
+
+const unsigned int INVALID_PIPELINE_STATE = 0xFFFFFFFF;
+
+//Everything that gets bound before a draw besides resources and constants, the input layout comes with the vertex shader
+struct PipelineStateDesc {
+	SimpleVertexShader* vertexShader;
+	SimplePixelShader* pixelShader;
+	unsigned int blendState;
+	unsigned int rasterState;
+	unsigned int depthState;
+};
+
+struct PipelineState {
+	PipelineStateDesc desc;
+	ID3D11BlendState* blendState;
+	ID3D11RasterizerState* rasterizerState;
+	ID3D11DepthStencilState* depthStencilState;
+};
+
+//Compiles shader permutations from their source on first use and keeps the code and its reflection in a cache file,
+//so later runs load it straight back without compiling or reflecting. Shaders are registered in Resources, which owns them.
+//Also hands out small ids for whole pipeline states, which is what the render queue sorts by
+class ShaderCache
+{
+public:
+	const static int MAX_PIPELINE_STATES = 1 << 12;//Has to fit in the sort key's shader bits
+	const static unsigned int CACHE_VERSION = 2;//Bump whenever the cache file layout changes
+
+	ShaderCache(ID3D11Device* newDevice, ID3D11DeviceContext* newContext, Resources* newRes);
+	~ShaderCache();
+
+	//name is the source file in the shader directory without ".hlsl". inputElements are optional, like SimpleVertexShader's
+	SimpleVertexShader* GetVertexShader(const char* name, ShaderDefines defines,
+		const D3D11_INPUT_ELEMENT_DESC* inputElements = nullptr, unsigned int numInputElements = 0);
+	SimplePixelShader* GetPixelShader(const char* name, ShaderDefines defines);
+	SimpleComputeShader* GetComputeShader(const char* name, ShaderDefines defines);
+
+	//The same desc always gives back the same id
+	unsigned int GetPipelineStateID(const PipelineStateDesc& desc);
+	const PipelineState& GetPipelineState(unsigned int id) const { return pipelineStates[id]; }
+	//Only the fixed function state, the shaders are set through SimpleShader along with their constants.
+	//depthEqual swaps the depth state for DEPTH_STATE_EQUAL, for draws whose depth a pre-pass already wrote
+	void ApplyRenderStates(ID3D11DeviceContext* context, unsigned int id, bool depthEqual = false);
+
+	//The defaults are relative to the output directory the game runs from
+	void SetSourceDirectory(const std::string& newSourceDirectory) { sourceDirectory = newSourceDirectory; }
+	void SetCacheDirectory(const std::string& newCacheDirectory) { cacheDirectory = newCacheDirectory; }
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	Resources* res;
+	std::string sourceDirectory;
+	std::string cacheDirectory;
+
+	ID3D11BlendState* blendStates[NUM_BLEND_STATES];
+	ID3D11RasterizerState* rasterizerStates[NUM_RASTER_STATES];
+	ID3D11DepthStencilState* depthStencilStates[NUM_DEPTH_STATES];
+	std::vector<PipelineState> pipelineStates;
+	std::unordered_map<ResourceHash, unsigned int> pipelineStateIDs;
+
+	void CreateRenderStates();
+	//Fills in a shader made by the caller, false if it couldn't be loaded or compiled
+	bool LoadPermutation(ISimpleShader* shader, const std::string& permutationName, const char* name, ShaderDefines defines, const char* target);
+	ID3DBlob* CompilePermutation(const std::string& sourcePath, ShaderDefines defines, const char* target);
+	bool LoadCachedPermutation(const std::string& cachePath, ISimpleShader* shader);
+	void WritePermutation(const std::string& cachePath, ID3DBlob* shaderBlob, const SimpleShaderReflection& reflection);
+	static std::string GetPermutationName(const char* name, ShaderDefines defines);
+	//Only the main source file is checked, changing an included file needs the cache cleared
+	static bool IsCacheCurrent(const std::string& sourcePath, const std::string& cachePath);
+};
@@ -0,0 +1,84 @@
+// Bins every light into the view space clusters it reaches, one thread per cluster.
+// Lights are read in batches into group shared memory so each one is only
+// loaded and moved to view space once per group
+
+#define GROUP_SIZE 64
+
+#include "Lighting.hlsli"
+
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	float2 projectionScale;
+	float2 screenSize;
+	float nearPlane;
+	float farPlane;
+	uint numLights;
+	ClusterInfo clusterInfo;
+};
+
+StructuredBuffer<Light> lights : register(t0);
+// For each cluster, a light count and then that many light indices
+RWStructuredBuffer<uint> clusterLights : register(u0);
+
+// View space position and range, directional lights have a negative range
+groupshared float4 sharedLights[GROUP_SIZE];
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	uint cluster = dispatchID.x;
+	// Threads past the last cluster still help load lights
+	bool isCluster = cluster < clusterInfo.CountX * clusterInfo.CountY * clusterInfo.CountZ;
+	uint x = cluster % clusterInfo.CountX;
+	uint y = (cluster / clusterInfo.CountX) % clusterInfo.CountY;
+	uint z = cluster / (clusterInfo.CountX * clusterInfo.CountY);
+
+	// Slices get deeper the further they are, so each one covers about the same amount of the screen
+	float sliceNear = nearPlane * pow(farPlane / nearPlane, z / (float)clusterInfo.CountZ);
+	float sliceFar = nearPlane * pow(farPlane / nearPlane, (z + 1) / (float)clusterInfo.CountZ);
+	float2 pixelMin = float2(x, y) * clusterInfo.TileSize;
+	float2 pixelMax = min(pixelMin + clusterInfo.TileSize, screenSize);
+	// Pixel y goes down, view space y goes up
+	float2 ndcMin = float2(pixelMin.x / screenSize.x * 2 - 1, 1 - pixelMax.y / screenSize.y * 2);
+	float2 ndcMax = float2(pixelMax.x / screenSize.x * 2 - 1, 1 - pixelMin.y / screenSize.y * 2);
+	// The tile's edges spread out with depth, so the box has to fit both ends of the slice
+	float3 boxMin = float3(min(ndcMin * sliceNear, ndcMin * sliceFar) / projectionScale, sliceNear);
+	float3 boxMax = float3(max(ndcMax * sliceNear, ndcMax * sliceFar) / projectionScale, sliceFar);
+
+	uint start = cluster * clusterInfo.ClusterStride;
+	uint maxCount = clusterInfo.ClusterStride - 1;
+	uint count = 0;
+	for (uint batch = 0; batch < numLights; batch += GROUP_SIZE)
+	{
+		uint l = batch + groupIndex;
+		if (l < numLights)
+		{
+			Light light = lights[l];
+			if (light.Type == 1)
+				sharedLights[groupIndex] = float4(mul(float4(light.Fluid3, 1.0f), view).xyz, light.Range);
+			else
+				sharedLights[groupIndex] = float4(0, 0, 0, -1);
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		uint batchCount = min(GROUP_SIZE, numLights - batch);
+		for (uint s = 0; s < batchCount && isCluster; s++)
+		{
+			float4 sphere = sharedLights[s];
+			bool reaches = sphere.w < 0;
+			if (!reaches)
+			{
+				float3 toBox = clamp(sphere.xyz, boxMin, boxMax) - sphere.xyz;
+				reaches = dot(toBox, toBox) <= sphere.w * sphere.w;
+			}
+			if (reaches && count < maxCount)
+			{
+				clusterLights[start + 1 + count] = batch + s;
+				count++;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+	if (isCluster) clusterLights[start] = count;
+}
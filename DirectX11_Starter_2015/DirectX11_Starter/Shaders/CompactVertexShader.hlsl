@@ -0,0 +1,79 @@
+// Constant Buffer
+// - Same as VertexShader.hlsl, plus what's needed to undo the
+//    quantization of this mesh's positions
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+cbuffer perObject : register(b1)
+{
+	matrix world;
+	float3 positionScale;
+	float3 positionOffset;
+};
+
+// Struct representing a single vertex worth of data
+// - Matches CompactVertex in our C++ code, the formats come from
+//    the input layout so everything arrives already unpacked to floats
+struct VertexShaderInput
+{ 
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+	float4 position		: POSITION;     // 0-1 across the mesh's bounding box, w is padding
+	float2 normal		: NORMAL;       // Octahedral
+	float2 tangent		: TANGENT;      // Octahedral
+	float2 uv			: TEXCOORD;
+};
+
+// Struct representing the data we're sending down the pipeline
+// - Should match our pixel shader's input (hence the name: Vertex to Pixel)
+struct VertexToPixel
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+	float4 position		: SV_POSITION;	// XYZW position (System Value Position)
+	float3 normal		: NORMAL;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+	float3 worldPos		: POSITION;
+};
+
+// Unfolds an octahedral encoded direction back onto the unit sphere
+float3 DecodeOctahedral(float2 encoded)
+{
+	float3 direction = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = saturate(-direction.z);
+	direction.xy += direction.xy >= 0.0f ? -fold : fold;
+	return normalize(direction);
+}
+
+// --------------------------------------------------------
+// The entry point (main method) for our compact vertex shader
+// --------------------------------------------------------
+VertexToPixel main( VertexShaderInput input )
+{
+	// Set up output struct
+	VertexToPixel output;
+
+	float3 position = input.position.xyz * positionScale + positionOffset;
+	matrix worldViewProj = mul(mul(world, view), projection);
+
+	// Precise so the depth pre-pass in DepthVertexShader.hlsl comes out exactly the same
+	precise float4 clipPosition = mul(float4(position, 1.0f), worldViewProj);
+	output.position = clipPosition;
+	output.normal = mul(DecodeOctahedral(input.normal), (float3x3)world);
+	output.tangent = mul(DecodeOctahedral(input.tangent), (float3x3)world);
+	output.worldPos = mul(float4(position, 1.0f), world).xyz;
+
+	output.uv = input.uv;
+
+	return output;
+}
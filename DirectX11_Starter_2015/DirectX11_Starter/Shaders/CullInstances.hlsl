@@ -0,0 +1,65 @@
+// Frustum culls every GPU driven instance, one thread each, and picks its LOD.
+// Survivors are counted into their bucket's indirect draw arguments and their
+// world matrices copied into that bucket's run of the instance stream
+
+#define GROUP_SIZE 64
+
+// Has to match GPUCullInstance
+struct CullInstance
+{
+	float4 world[4];
+	float3 boundsCenter;
+	float radius;
+	float3 boundsExtents;
+	uint firstBucket;
+	uint numLODs;
+	float3 padding;
+};
+
+cbuffer perFrame : register(b0)
+{
+	float4 planes[6];
+	float4 lodScreenSizes;
+	float3 cameraPosition;
+	float projectionScale;
+	uint numInstances;
+};
+
+StructuredBuffer<CullInstance> instances : register(t0);
+// D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS for each bucket, five uints
+RWByteAddressBuffer drawArgs : register(u0);
+// One transposed world matrix per slot, read as the instance stream
+RWByteAddressBuffer visibleInstances : register(u1);
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+	if (dispatchID.x >= numInstances) return;
+	CullInstance instance = instances[dispatchID.x];
+
+	// Completely behind any one plane means it's outside
+	[unroll]
+	for (uint p = 0; p < 6; p++)
+	{
+		float distance = dot(planes[p].xyz, instance.boundsCenter) + planes[p].w;
+		if (distance + dot(abs(planes[p].xyz), instance.boundsExtents) < 0) return;
+	}
+
+	// Same switch points as DrawnMesh, inside the sphere it covers the whole screen
+	uint lod = 0;
+	float distanceToCamera = length(instance.boundsCenter - cameraPosition);
+	if (distanceToCamera > instance.radius)
+	{
+		float screenSize = instance.radius * projectionScale / distanceToCamera;
+		while (lod + 1 < instance.numLODs && screenSize < lodScreenSizes[lod + 1]) lod++;
+	}
+
+	uint bucket = instance.firstBucket + lod;
+	uint slot;
+	drawArgs.InterlockedAdd(bucket * 20 + 4, 1, slot);
+	uint address = (drawArgs.Load(bucket * 20 + 16) + slot) * 64;
+	visibleInstances.Store4(address, asuint(instance.world[0]));
+	visibleInstances.Store4(address + 16, asuint(instance.world[1]));
+	visibleInstances.Store4(address + 32, asuint(instance.world[2]));
+	visibleInstances.Store4(address + 48, asuint(instance.world[3]));
+}
@@ -0,0 +1,46 @@
+// Lights the G-buffer once per pixel, with the same clusters and lighting as the forward pixel shader.
+// Drawn over the whole screen by FullscreenVertexShader.hlsl
+
+#include "Lighting.hlsli"
+
+// Has to match the registers in GBuffer.h, 2 and 3 are taken by the light clusters
+Texture2D albedoBuffer : register(t0);
+Texture2D normalBuffer : register(t1);
+StructuredBuffer<Light> lights : register(t2);
+StructuredBuffer<uint> clusterLights : register(t3);
+Texture2D depthBuffer : register(t4);
+// Drawn and bound by ShadowMaps
+Texture2DArray shadowMap : register(t5);
+StructuredBuffer<ShadowCascade> shadowCascades : register(t6);
+SamplerComparisonState shadowSampler : register(s1);
+
+cbuffer perFrame : register(b0)
+{
+	float3 cameraPosition;
+	float3 cameraForward;
+	ClusterInfo clusterInfo;
+	matrix inverseView;
+	float2 projectionScale;
+};
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 ndc			: TEXCOORD;
+};
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	int3 pixel = int3(input.position.xy, 0);
+	float viewDepth = depthBuffer.Load(pixel).r;
+	// Leaves the background alone
+	if (viewDepth <= 0) discard;
+
+	float4 albedo = albedoBuffer.Load(pixel);
+	float3 normal = normalize(normalBuffer.Load(pixel).xyz * 2 - 1);
+	float3 viewPos = float3(input.ndc / projectionScale * viewDepth, viewDepth);
+	float3 worldPos = mul(float4(viewPos, 1.0f), inverseView).xyz;
+
+	return ShadeSurface(float4(albedo.rgb, 1.0f), normal, worldPos, viewDepth, input.position.xy, albedo.a > 0.5f,
+		cameraPosition, clusterInfo, lights, clusterLights, shadowMap, shadowSampler, shadowCascades);
+}
@@ -0,0 +1,57 @@
+// Depth pre-pass, reads only the mesh's position stream and has no pixel shader.
+// The position has to come out bit for bit the same as the main vertex shaders' for the
+// main pass's equal depth test, so the math is the same and the result is precise in all of them.
+// Permutations are built by the shader cache, which always passes all of these.
+#ifndef COMPACT_VERTEX
+#define COMPACT_VERTEX 0
+#endif
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+// Every permutation has the same variables so the indices Render uses don't change
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+cbuffer perObject : register(b1)
+{
+	matrix world;// Not used when instanced
+	float3 positionScale;// Only used by compact vertices
+	float3 positionOffset;
+};
+
+struct VertexShaderInput
+{
+#if COMPACT_VERTEX
+	float4 position		: POSITION;     // 0-1 across the mesh's bounding box, w is padding
+#else
+	float3 position		: POSITION;
+#endif
+#if INSTANCED
+	float4 world0		: INSTANCE_WORLD0;
+	float4 world1		: INSTANCE_WORLD1;
+	float4 world2		: INSTANCE_WORLD2;
+	float4 world3		: INSTANCE_WORLD3;
+#endif
+};
+
+float4 main( VertexShaderInput input ) : SV_POSITION
+{
+#if INSTANCED
+	matrix objectWorld = transpose(matrix(input.world0, input.world1, input.world2, input.world3));
+#else
+	matrix objectWorld = world;
+#endif
+	matrix worldViewProj = mul(mul(objectWorld, view), projection);
+
+#if COMPACT_VERTEX
+	float3 position = input.position.xyz * positionScale + positionOffset;
+#else
+	float3 position = input.position;
+#endif
+	precise float4 clipPosition = mul(float4(position, 1.0f), worldViewProj);
+	return clipPosition;
+}
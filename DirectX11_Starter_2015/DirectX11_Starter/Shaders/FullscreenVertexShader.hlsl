@@ -0,0 +1,17 @@
+// One triangle covering the whole screen, made from the vertex id so it needs no vertex buffer.
+// Drawn with Draw(3, 0) and no input layout
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 ndc			: TEXCOORD;// Where the pixel is on the screen, from -1 to 1
+};
+
+VertexToPixel main(uint id : SV_VertexID)
+{
+	VertexToPixel output;
+	float2 uv = float2((id << 1) & 2, id & 2);
+	output.ndc = float2(uv.x * 2 - 1, 1 - uv.y * 2);
+	output.position = float4(output.ndc, 0, 1);
+	return output;
+}
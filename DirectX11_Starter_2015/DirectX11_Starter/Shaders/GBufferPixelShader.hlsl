@@ -0,0 +1,57 @@
+// Writes what the deferred lighting pass needs instead of lighting anything.
+// Permutations are built by the shader cache, which always passes all of these.
+// The defaults are what the build's own .cso gets
+#ifndef TOON
+#define TOON 0
+#endif
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 1
+#endif
+
+#include "Lighting.hlsli"
+
+Texture2D diffuseTexture : register(t0);
+Texture2D normalMap : register(t1);
+SamplerState samplerState : register(s0);
+
+// Same layout as PixelShader.hlsl, Material sets both the same way
+cbuffer perFrame : register(b0)
+{
+	float3 cameraPosition;
+	float3 cameraForward;
+	ClusterInfo clusterInfo;
+};
+
+// Should match the output of our corresponding vertex shader
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float3 normal		: NORMAL;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+	float3 worldPos		: POSITION;
+};
+
+// Has to match the targets in GBuffer.h
+struct GBufferOutput
+{
+	float4 albedo		: SV_TARGET0;// Alpha is 1 for toon shaded surfaces
+	float4 normal		: SV_TARGET1;// Packed into [0, 1]
+	float depth			: SV_TARGET2;// View space, 0 is nothing drawn
+};
+
+GBufferOutput main(VertexToPixel input)
+{
+	//Normalize inputs
+	input.normal = normalize(input.normal);
+	input.tangent = normalize(input.tangent);
+#if NORMAL_MAP
+	input.normal = CalculateNormalFromMap(normalMap, samplerState, input.uv, input.normal, input.tangent);
+#endif
+
+	GBufferOutput output;
+	output.albedo = float4(diffuseTexture.Sample(samplerState, input.uv).rgb, TOON);
+	output.normal = float4(input.normal * 0.5f + 0.5f, 0);
+	output.depth = dot(input.worldPos - cameraPosition, cameraForward);
+	return output;
+}
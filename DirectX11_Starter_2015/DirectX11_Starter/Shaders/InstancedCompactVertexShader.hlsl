@@ -0,0 +1,88 @@
+// Constant Buffer
+// - Same as InstancedVertexShader.hlsl, plus what's needed to undo
+//    the quantization of this mesh's positions
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+// Changes with the mesh, so once per instanced draw
+cbuffer perObject : register(b1)
+{
+	float3 positionScale;
+	float3 positionOffset;
+};
+
+// Struct representing a single vertex worth of data
+// - The first four members match CompactVertex in our C++ code
+// - Anything with an INSTANCE_ semantic is read from the second vertex
+//    buffer once per instance (SimpleVertexShader sets this up)
+struct VertexShaderInput
+{ 
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+	float4 position		: POSITION;     // 0-1 across the mesh's bounding box, w is padding
+	float2 normal		: NORMAL;       // Octahedral
+	float2 tangent		: TANGENT;      // Octahedral
+	float2 uv			: TEXCOORD;
+	//The rows of the (transposed) world matrix of this instance
+	float4 world0		: INSTANCE_WORLD0;
+	float4 world1		: INSTANCE_WORLD1;
+	float4 world2		: INSTANCE_WORLD2;
+	float4 world3		: INSTANCE_WORLD3;
+};
+
+// Struct representing the data we're sending down the pipeline
+// - Should match our pixel shader's input (hence the name: Vertex to Pixel)
+struct VertexToPixel
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+	float4 position		: SV_POSITION;	// XYZW position (System Value Position)
+	float3 normal		: NORMAL;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+	float3 worldPos		: POSITION;
+};
+
+// Unfolds an octahedral encoded direction back onto the unit sphere
+float3 DecodeOctahedral(float2 encoded)
+{
+	float3 direction = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = saturate(-direction.z);
+	direction.xy += direction.xy >= 0.0f ? -fold : fold;
+	return normalize(direction);
+}
+
+// --------------------------------------------------------
+// The entry point (main method) for our instanced compact vertex shader
+// --------------------------------------------------------
+VertexToPixel main( VertexShaderInput input )
+{
+	// Set up output struct
+	VertexToPixel output;
+
+	// The matrices are uploaded transposed for HLSL (same as the cbuffer version),
+	// so undo that to get back the world matrix
+	matrix world = transpose(matrix(input.world0, input.world1, input.world2, input.world3));
+	matrix worldViewProj = mul(mul(world, view), projection);
+
+	float3 position = input.position.xyz * positionScale + positionOffset;
+	// Precise so the depth pre-pass in DepthVertexShader.hlsl comes out exactly the same
+	precise float4 clipPosition = mul(float4(position, 1.0f), worldViewProj);
+	output.position = clipPosition;
+	output.normal = mul(DecodeOctahedral(input.normal), (float3x3)world);
+	output.tangent = mul(DecodeOctahedral(input.tangent), (float3x3)world);
+	output.worldPos = mul(float4(position, 1.0f), world).xyz;
+
+	output.uv = input.uv;
+
+	return output;
+}
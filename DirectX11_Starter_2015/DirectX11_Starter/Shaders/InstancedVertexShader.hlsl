@@ -0,0 +1,71 @@
+// Constant Buffer
+// - Same as VertexShader.hlsl, but the world matrix comes from the
+//    per instance vertex buffer instead
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+// Struct representing a single vertex worth of data
+// - The first four members match the vertex definition in our C++ code
+// - Anything with an INSTANCE_ semantic is read from the second vertex
+//    buffer once per instance (SimpleVertexShader sets this up)
+struct VertexShaderInput
+{ 
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+	float3 position		: POSITION;     // XYZ position
+	float3 normal		: NORMAL;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+	//The rows of the (transposed) world matrix of this instance
+	float4 world0		: INSTANCE_WORLD0;
+	float4 world1		: INSTANCE_WORLD1;
+	float4 world2		: INSTANCE_WORLD2;
+	float4 world3		: INSTANCE_WORLD3;
+};
+
+// Struct representing the data we're sending down the pipeline
+// - Should match our pixel shader's input (hence the name: Vertex to Pixel)
+struct VertexToPixel
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+	float4 position		: SV_POSITION;	// XYZW position (System Value Position)
+	float3 normal		: NORMAL;
+	float2 uv			: TEXCOORD;
+	float3 tangent		: TANGENT;
+	float3 worldPos		: POSITION;
+};
+
+// --------------------------------------------------------
+// The entry point (main method) for our instanced vertex shader
+// --------------------------------------------------------
+VertexToPixel main( VertexShaderInput input )
+{
+	// Set up output struct
+	VertexToPixel output;
+
+	// The matrices are uploaded transposed for HLSL (same as the cbuffer version),
+	// so undo that to get back the world matrix
+	matrix world = transpose(matrix(input.world0, input.world1, input.world2, input.world3));
+	matrix worldViewProj = mul(mul(world, view), projection);
+
+	// Precise so the depth pre-pass in DepthVertexShader.hlsl comes out exactly the same
+	precise float4 clipPosition = mul(float4(input.position, 1.0f), worldViewProj);
+	output.position = clipPosition;
+	output.normal = mul(input.normal, (float3x3)world);
+	output.tangent = mul(input.tangent, (float3x3)world);
+	output.worldPos = mul(float4(input.position, 1.0f), world).xyz;
+
+	output.uv = input.uv;
+
+	return output;
+}
@@ -0,0 +1,167 @@
+// Lighting shared by the forward pixel shader, the deferred lighting pass and the cluster pass
+
+// Has to match RenderLight in Light.h
+struct Light {
+	float4 AmbientColor;
+	float4 DiffuseColor;
+	//Holds differnet data depending on type
+	//Holds direction for Direction Light
+	//Holds position for point Light
+	float3 Fluid3;
+	//0 is Directional Light
+	//1 is Point Light
+	int Type;
+	//Point lights reach nothing past this
+	float Range;
+	//Only ever the one directional light the shadow maps are for
+	int CastsShadows;
+	float2 Padding;
+};
+
+// Has to match ShadowMaps.h
+#define NUM_SHADOW_CASCADES 4
+// Light space depth a surface has to be behind a caster by to count as shadowed
+#define SHADOW_DEPTH_BIAS 0.0005f
+// How many texels receivers are pushed out along their normal, so they don't shadow themselves
+#define SHADOW_NORMAL_OFFSET 1.5f
+
+// Has to match ShadowCascade in ShadowMaps.h
+struct ShadowCascade {
+	matrix ViewProjection;
+	float SplitDepth;
+	float TexelSize;
+	float2 Padding;
+};
+
+// Has to match ClusterInfo in LightClusters.h
+struct ClusterInfo {
+	float2 TileSize;
+	float DepthScale;
+	float DepthBias;
+	uint CountX;
+	uint CountY;
+	uint CountZ;
+	uint ClusterStride;
+};
+
+float4 CalculateLight(Light light, float3 normal, float3 worldPos, inout float4 baseColor, bool toon, float shadow) : COLOR0
+{
+	float nDotL = 0;
+	baseColor += light.AmbientColor;
+	if (light.Type == 0)// Direction
+	{
+		nDotL = dot(normal, normalize(-light.Fluid3));
+
+	}
+	else if (light.Type == 1)// Point
+	{
+		float distance = length(light.Fluid3 - worldPos);
+		// Fades out to nothing at the range, so leaving the light out past it doesn't show
+		float window = saturate(1 - pow(distance / light.Range, 4));
+		nDotL = dot(normal, normalize(light.Fluid3 - worldPos)) / distance * window * window;
+	}
+
+	if (toon) nDotL = smoothstep(0, 0.03f, nDotL);
+	nDotL *= shadow;
+
+	return (light.DiffuseColor * saturate(nDotL) * baseColor);
+}
+
+float4 CalculateRimLighting(float3 dirToCamera, float3 normal) : COLOR0
+{
+	//FREN
+	/*float bias = 0.56;
+	float scale = 0.17f;
+	float power = 3;
+	float r = 1 - saturate(bias + scale * pow(1 + dot(dirToCamera, normal), power));*/
+	float base = 1 - dot(dirToCamera, normal);
+	float exp = pow(base, 5);
+	float r = exp + 0 * (1 - exp);
+	return r.xxxx;
+}
+
+float4 CalculateSpecular(float3 dirToCamera, float3 reflection, bool toon) : COLOR0
+{
+	float3 spec = pow(max(dot(reflection, dirToCamera), 0), 64);// *0.5f;
+	if (toon) spec = smoothstep(0, 0.03f, spec);
+	return spec.xxxx;
+}
+
+float3 CalculateNormalFromMap(Texture2D normalMap, SamplerState samplerState, float2 uv, float3 normal, float3 tangent) : NORMAL
+{
+	//Get the normal from the map and unpack it to the range [-1, 1]
+	//BC5 maps only keep x and y, z comes back from the normal being unit length
+	float2 mapNormalXY = normalMap.Sample(samplerState, uv).rg * 2 - 1;
+	float3 mapNormal = float3(mapNormalXY, sqrt(saturate(1 - dot(mapNormalXY, mapNormalXY))));
+	//Make sure the normal and the tangent are orthogonal 
+	tangent = normalize(tangent - normal * dot(tangent, normal));
+	return float3(normalize(mul(mapNormal,
+		//Tangent, BiTangent and Normal Matrix
+		float3x3(tangent, cross(tangent, normal), normal)
+		)));
+}
+
+// How lit a surface is by the shadowed light, 0 is fully in shadow. Past the last cascade is always lit
+float CalculateShadow(float3 worldPos, float3 normal, float viewDepth,
+	Texture2DArray shadowMap, SamplerComparisonState shadowSampler, StructuredBuffer<ShadowCascade> shadowCascades)
+{
+	uint cascade = 0;
+	[unroll]
+	for (uint c = 0; c < NUM_SHADOW_CASCADES; c++)
+	{
+		if (viewDepth > shadowCascades[c].SplitDepth) cascade = c + 1;
+	}
+	if (cascade >= NUM_SHADOW_CASCADES) return 1;
+
+	ShadowCascade shadowCascade = shadowCascades[cascade];
+	float4 shadowPosition = mul(float4(worldPos + normal * shadowCascade.TexelSize * SHADOW_NORMAL_OFFSET, 1.0f), shadowCascade.ViewProjection);
+	float2 uv = shadowPosition.xy * float2(0.5f, -0.5f) + 0.5f;
+	float depth = shadowPosition.z - SHADOW_DEPTH_BIAS;
+	float width, height, elements;
+	shadowMap.GetDimensions(width, height, elements);
+	float texel = 1.0f / width;
+
+	// 3x3 taps of the hardware's 2x2 filtered compare
+	float lit = 0;
+	[unroll]
+	for (int y = -1; y <= 1; y++)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; x++)
+		{
+			lit += shadowMap.SampleCmpLevelZero(shadowSampler, float3(uv + float2(x, y) * texel, cascade), depth);
+		}
+	}
+	return lit / 9;
+}
+
+// Where a pixel's cluster starts in the cluster light lists
+uint GetClusterStart(float2 pixel, float viewDepth, ClusterInfo clusterInfo)
+{
+	uint x = min((uint)(pixel.x / clusterInfo.TileSize.x), clusterInfo.CountX - 1);
+	uint y = min((uint)(pixel.y / clusterInfo.TileSize.y), clusterInfo.CountY - 1);
+	uint z = (uint)clamp(floor(log(max(viewDepth, 0.0001f)) * clusterInfo.DepthScale + clusterInfo.DepthBias), 0, clusterInfo.CountZ - 1);
+	return ((z * clusterInfo.CountY + y) * clusterInfo.CountX + x) * clusterInfo.ClusterStride;
+}
+
+// Everything lighting a surface, with the lights from its cluster
+float4 ShadeSurface(float4 albedo, float3 normal, float3 worldPos, float viewDepth, float2 pixel, bool toon,
+	float3 cameraPosition, ClusterInfo clusterInfo, StructuredBuffer<Light> lights, StructuredBuffer<uint> clusterLights,
+	Texture2DArray shadowMap, SamplerComparisonState shadowSampler, StructuredBuffer<ShadowCascade> shadowCascades)
+{
+	float3 dirToCamera = normalize(cameraPosition - worldPos);
+	float4 baseColor = albedo + CalculateRimLighting(dirToCamera, normal);
+	float3 refl = reflect(-dirToCamera, normal);
+
+	float4 lightColor = float4(0.0f, 0.0f, 0.0f, 1.0f);
+	// Only the lights that reach this pixel's cluster
+	uint clusterStart = GetClusterStart(pixel, viewDepth, clusterInfo);
+	uint numLights = clusterLights[clusterStart];
+	for (uint l = 0; l < numLights; l++)
+	{
+		Light light = lights[clusterLights[clusterStart + 1 + l]];
+		float shadow = light.CastsShadows ? CalculateShadow(worldPos, normal, viewDepth, shadowMap, shadowSampler, shadowCascades) : 1;
+		lightColor += CalculateLight(light, normal, worldPos, baseColor, toon, shadow);
+	}
+	return lightColor + CalculateSpecular(dirToCamera, refl, toon);
+}
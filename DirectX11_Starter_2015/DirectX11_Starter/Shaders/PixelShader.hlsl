@@ -1,26 +1,30 @@
-//#define TOON
+// Permutations are built by the shader cache, which always passes all of these.
+// The defaults are what the build's own .cso gets
+#ifndef TOON
+#define TOON 0
+#endif
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 1
+#endif
 
-struct Light {
-	float4 AmbientColor;
-	float4 DiffuseColor;
-	//Holds differnet data depending on type
-	//Holds direction for Direction Light
-	//Holds position for point Light
-	float3 Fluid3;
-	//0 is Directional Light
-	//1 is Point Light
-	int Type;
-};
+#include "Lighting.hlsli"
 
 Texture2D diffuseTexture : register(t0);
 Texture2D normalMap : register(t1);
+// Filled in by ClusterLights.hlsl, bound by LightClusters
+StructuredBuffer<Light> lights : register(t2);
+StructuredBuffer<uint> clusterLights : register(t3);
 SamplerState samplerState : register(s0);
+// Drawn and bound by ShadowMaps
+Texture2DArray shadowMap : register(t5);
+StructuredBuffer<ShadowCascade> shadowCascades : register(t6);
+SamplerComparisonState shadowSampler : register(s1);
 
-cbuffer extData : register(b0)
+cbuffer perFrame : register(b0)
 {
 	float3 cameraPosition;
-	Light light1;
-	Light light2;
+	float3 cameraForward;
+	ClusterInfo clusterInfo;
 };
 
 // Struct representing the data we expect to receive from earlier pipeline stages
@@ -42,64 +46,6 @@ struct VertexToPixel
 	float3 worldPos		: POSITION;
 };
 
-float4 CalculateLight(Light light, VertexToPixel input, inout float4 baseColor) : COLOR0
-{
-	float nDotL = 0;
-	baseColor += light.AmbientColor;
-	if (light.Type == 0)// Direction
-	{
-		nDotL = dot(input.normal, normalize(-light.Fluid3));
-
-	} 
-	else if (light.Type == 1)// Point
-	{
-		//float3 dirToPointLight = normalize(light.Fluid3 - input.worldPos);
-		//float pointNdotL = saturate(dot(input.normal, dirToPointLight));
-		//nDotL = pointNdotL;
-		nDotL = dot(input.normal, normalize(light.Fluid3 - input.worldPos)) / length(light.Fluid3 - input.worldPos);
-	}
-
-#ifdef TOON
-	nDotL = smoothstep(0, 0.03f, nDotL);
-#endif
-
-	return (light.DiffuseColor * saturate(nDotL) * baseColor);
-}
-
-float4 CalculateRimLighting(float3 dirToCamera, VertexToPixel input) : COLOR0
-{
-	//FREN
-	/*float bias = 0.56;
-	float scale = 0.17f;
-	float power = 3;
-	float r = 1 - saturate(bias + scale * pow(1 + dot(dirToCamera, input.normal), power));*/
-	float base = 1 - dot(dirToCamera, input.normal);
-	float exp = pow(base, 5);
-	float r = exp + 0 * (1 - exp);
-	return r.xxxx;
-}
-
-float4 CalculateSpecular(float3 dirToCamera, float3 reflection) : COLOR0
-{
-	float3 spec = pow(max(dot(reflection, dirToCamera), 0), 64);// *0.5f;
-#ifdef TOON
-	spec = smoothstep(0, 0.03f, spec);
-#endif
-	return spec.xxxx;
-}
-
-float3 CalculateNormalFromMap(VertexToPixel input) : NORMAL
-{
-	//Get the normal from the map and unpack it to the range [-1, 1]
-	float3 mapNormal = normalMap.Sample(samplerState, input.uv).rgb * 2 - 1;
-	//Make sure the normal and the tangent are orthogonal 
-	float3 tangent = normalize(input.tangent - input.normal * dot(input.tangent, input.normal));
-	return float3(normalize(mul(mapNormal,
-		//Tangent, BiTangent and Normal Matrix
-		float3x3(tangent, cross(tangent, input.normal), input.normal)
-		)));
-}
-
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
@@ -115,20 +61,11 @@ float4 main(VertexToPixel input) : SV_TARGET
 	input.normal = normalize(input.normal);
 	input.tangent = normalize(input.tangent);
 	//return float4(CalculateNormalFromMap(input), 1);
-	input.normal = CalculateNormalFromMap(input);
-
-	float3 dirToCamera = normalize(cameraPosition - input.worldPos);
-
-	float4 baseColor = diffuseTexture.Sample(samplerState, input.uv);
-	baseColor = baseColor + CalculateRimLighting(dirToCamera, input);
-	//return CalculateRimLighting(dirToCamera, input);
-
-	float3 refl = reflect(-dirToCamera, input.normal);
-
-	float4 lights = float4(0.0f, 0.0f, 0.0f, 1.0f);
-	lights += CalculateLight(light1, input, baseColor);
-	lights += CalculateLight(light2, input, baseColor);
-
+#if NORMAL_MAP
+	input.normal = CalculateNormalFromMap(normalMap, samplerState, input.uv, input.normal, input.tangent);
+#endif
 
-	return  lights + CalculateSpecular(dirToCamera, refl);
-}
\ No newline at end of file
+	return ShadeSurface(diffuseTexture.Sample(samplerState, input.uv), input.normal, input.worldPos,
+		dot(input.worldPos - cameraPosition, cameraForward), input.position.xy, TOON,
+		cameraPosition, clusterInfo, lights, clusterLights, shadowMap, shadowSampler, shadowCascades);
+}
@@ -4,14 +4,19 @@
 //    which will (eventually) hold data from our C++ code
 // - All non-pipeline variables that get their values from 
 //    our C++ code must be defined inside a Constant Buffer
-// - The name of the cbuffer itself is unimportant
-cbuffer externalData : register(b0)
+// - The start of the name says how often it changes (see SimpleShader.h),
+//    per object data goes through the constant buffer ring
+cbuffer perFrame : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
 };
 
+cbuffer perObject : register(b1)
+{
+	matrix world;
+};
+
 // Struct representing a single vertex worth of data
 // - This should match the vertex definition in our C++ code
 // - By "match", I mean the size, order and number of members
@@ -75,7 +80,9 @@ VertexToPixel main( VertexShaderInput input )
 	//
 	// The result is essentially the position (XY) of the vertex on our 2D 
 	// screen and the distance (Z) from the camera (the "depth" of the pixel)
-	output.position = mul(float4(input.position, 1.0f), worldViewProj);
+	// Precise so the depth pre-pass in DepthVertexShader.hlsl comes out exactly the same
+	precise float4 clipPosition = mul(float4(input.position, 1.0f), worldViewProj);
+	output.position = clipPosition;
 	output.normal = mul(input.normal, (float3x3)world);
 	output.tangent = mul(input.tangent, (float3x3)world);
 	output.worldPos = mul(float4(input.position, 1.0f), world).xyz;
@@ -0,0 +1,252 @@
+#include "ShadowMaps.h"
+#include <cmath>
+#include <cstring>
+#include "Camera.h"
+#include "DirectXGameCore.h"
+#include "Logger.h"
+
+//Shadows stop here even if the camera sees further
+const static float MAX_SHADOW_DISTANCE = 60.0f;
+//How far the splits lean towards logarithmic over even, logarithmic keeps texels about the same size on screen
+const static float SPLIT_LOG_WEIGHT = 0.75f;
+//Casters this far past a cascade towards the light still shadow into it
+const static float CASTER_DISTANCE = 50.0f;
+
+ShadowMaps::ShadowMaps(ID3D11Device* newDevice, ID3D11DeviceContext* newContext)
+{
+	device = newDevice;
+	context = newContext;
+	lightDirection = DirectX::XMFLOAT3(0, 0, 0);
+	shadowTexture = nullptr;
+	shadowSRV = nullptr;
+	staticTexture = nullptr;
+	cascadeBuffer = nullptr;
+	cascadeSRV = nullptr;
+	shadowSampler = nullptr;
+	for (int c = 0; c < NUM_CASCADES; c++) {
+		shadowTargets[c] = nullptr;
+		staticTargets[c] = nullptr;
+		snappedBounds[c] = DirectX::XMFLOAT4(0, 0, 0, 0);
+		isStaticCacheValid[c] = false;
+		matchesStaticCache[c] = false;
+	}
+	CreateResources();
+}
+
+ShadowMaps::~ShadowMaps()
+{
+	for (int c = 0; c < NUM_CASCADES; c++) {
+		ReleaseMacro(shadowTargets[c]);
+		ReleaseMacro(staticTargets[c]);
+	}
+	ReleaseMacro(shadowSRV);
+	ReleaseMacro(shadowTexture);
+	ReleaseMacro(staticTexture);
+	ReleaseMacro(cascadeSRV);
+	ReleaseMacro(cascadeBuffer);
+	ReleaseMacro(shadowSampler);
+}
+
+void ShadowMaps::CreateResources()
+{
+	//Typeless so the same texture can be a depth target and read as a float
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = MAP_SIZE;
+	textureDesc.Height = MAP_SIZE;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = NUM_CASCADES;
+	textureDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	HR(device->CreateTexture2D(&textureDesc, nullptr, &shadowTexture));
+	//The cache is only ever copied from
+	textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	HR(device->CreateTexture2D(&textureDesc, nullptr, &staticTexture));
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+	dsvDesc.Texture2DArray.MipSlice = 0;
+	dsvDesc.Texture2DArray.ArraySize = 1;
+	for (int c = 0; c < NUM_CASCADES; c++) {
+		dsvDesc.Texture2DArray.FirstArraySlice = c;
+		HR(device->CreateDepthStencilView(shadowTexture, &dsvDesc, &shadowTargets[c]));
+		HR(device->CreateDepthStencilView(staticTexture, &dsvDesc, &staticTargets[c]));
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = NUM_CASCADES;
+	HR(device->CreateShaderResourceView(shadowTexture, &srvDesc, &shadowSRV));
+
+	D3D11_BUFFER_DESC cascadeDesc;
+	cascadeDesc.Usage = D3D11_USAGE_DYNAMIC;
+	cascadeDesc.ByteWidth = sizeof(ShadowCascade) * NUM_CASCADES;
+	cascadeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	cascadeDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	cascadeDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	cascadeDesc.StructureByteStride = sizeof(ShadowCascade);
+	HR(device->CreateBuffer(&cascadeDesc, nullptr, &cascadeBuffer));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC bufferSRVDesc = {};
+	bufferSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	bufferSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	bufferSRVDesc.Buffer.FirstElement = 0;
+	bufferSRVDesc.Buffer.NumElements = NUM_CASCADES;
+	HR(device->CreateShaderResourceView(cascadeBuffer, &bufferSRVDesc, &cascadeSRV));
+
+	//Hardware 2x2 filtered compares, outside the map counts as lit
+	D3D11_SAMPLER_DESC samplerDesc = {};
+	samplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.BorderColor[0] = 1.0f;
+	samplerDesc.BorderColor[1] = 1.0f;
+	samplerDesc.BorderColor[2] = 1.0f;
+	samplerDesc.BorderColor[3] = 1.0f;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	HR(device->CreateSamplerState(&samplerDesc, &shadowSampler));
+}
+
+void ShadowMaps::InvalidateStaticCache()
+{
+	for (int c = 0; c < NUM_CASCADES; c++) {
+		isStaticCacheValid[c] = false;
+	}
+}
+
+void ShadowMaps::Update(Camera& camera, const DirectX::XMFLOAT3& newLightDirection)
+{
+	if (newLightDirection.x != lightDirection.x || newLightDirection.y != lightDirection.y || newLightDirection.z != lightDirection.z) {
+		lightDirection = newLightDirection;
+		InvalidateStaticCache();
+	}
+	DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&lightDirection));
+	//Any up works as long as it isn't the light direction
+	DirectX::XMVECTOR up = fabsf(DirectX::XMVectorGetY(direction)) > 0.99f ? DirectX::XMVectorSet(0, 0, 1, 0) : DirectX::XMVectorSet(0, 1, 0, 0);
+	DirectX::XMMATRIX view = DirectX::XMMatrixLookToLH(DirectX::XMVectorZero(), direction, up);
+	DirectX::XMStoreFloat4x4(&viewMatrix, DirectX::XMMatrixTranspose(view));
+
+	DirectX::XMFLOAT4X4 cameraProjection = camera.GetProjectionMatrix();
+	DirectX::XMFLOAT3 cameraPosition = camera.GetTransform().GetPosition();
+	DirectX::XMFLOAT3 cameraForward = camera.GetTransform().GetForwardVector();
+	DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&cameraPosition);
+	DirectX::XMVECTOR forward = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&cameraForward));
+	float nearPlane = camera.GetNearPlane();
+	float farPlane = fminf(camera.GetFarPlane(), MAX_SHADOW_DISTANCE);
+	//How far a corner of the view is from the middle, per unit of depth. The diagonal doesn't care about the transpose
+	float cornerSlopeSq = 1.0f / (cameraProjection._11 * cameraProjection._11) + 1.0f / (cameraProjection._22 * cameraProjection._22);
+	//Snapping can move a cascade up to one step off its slice, so each side leaves a margin of SNAP_TEXELS texels.
+	//That's 2 * SNAP_TEXELS / MAP_SIZE of the width, around 6% at 32 in 1024
+	float paddingScale = 1.0f / (1.0f - 2.0f * SNAP_TEXELS / (float)MAP_SIZE);
+
+	float sliceNear = nearPlane;
+	for (int c = 0; c < NUM_CASCADES; c++) {
+		float t = (c + 1) / (float)NUM_CASCADES;
+		float evenSplit = nearPlane + (farPlane - nearPlane) * t;
+		float logSplit = nearPlane * powf(farPlane / nearPlane, t);
+		float sliceFar = evenSplit + (logSplit - evenSplit) * SPLIT_LOG_WEIGHT;
+
+		//Smallest sphere around the slice, it only depends on the depths and the field of view so it never changes size
+		float centerDepth = 0.5f * (sliceNear + sliceFar) * (1.0f + cornerSlopeSq);
+		float radius;
+		if (centerDepth >= sliceFar) {
+			centerDepth = sliceFar;
+			radius = sliceFar * sqrtf(cornerSlopeSq);
+		}
+		else {
+			radius = sqrtf((sliceFar - centerDepth) * (sliceFar - centerDepth) + sliceFar * sliceFar * cornerSlopeSq);
+		}
+		float halfSize = radius * paddingScale;
+		float texelSize = 2.0f * halfSize / MAP_SIZE;
+		float step = texelSize * SNAP_TEXELS;
+
+		//Whole numbers of texels in light space, so the map doesn't shimmer when it moves
+		DirectX::XMFLOAT3 center;
+		DirectX::XMStoreFloat3(&center, DirectX::XMVector3Transform(DirectX::XMVectorMultiplyAdd(forward, DirectX::XMVectorReplicate(centerDepth), position), view));
+		center = DirectX::XMFLOAT3(floorf(center.x / step) * step, floorf(center.y / step) * step, floorf(center.z / step) * step);
+		DirectX::XMFLOAT4 bounds(center.x, center.y, center.z, halfSize);
+		if (memcmp(&bounds, &snappedBounds[c], sizeof(DirectX::XMFLOAT4)) != 0) {
+			snappedBounds[c] = bounds;
+			isStaticCacheValid[c] = false;
+		}
+
+		DirectX::XMMATRIX projection = DirectX::XMMatrixOrthographicOffCenterLH(center.x - halfSize, center.x + halfSize,
+			center.y - halfSize, center.y + halfSize, center.z - halfSize - CASTER_DISTANCE, center.z + halfSize);
+		DirectX::XMStoreFloat4x4(&projectionMatrices[c], DirectX::XMMatrixTranspose(projection));
+		DirectX::XMStoreFloat4x4(&cascades[c].ViewProjection, DirectX::XMMatrixTranspose(view * projection));
+		cascades[c].SplitDepth = sliceFar;
+		cascades[c].TexelSize = texelSize;
+		cascades[c].Padding = DirectX::XMFLOAT2(0, 0);
+		frustums[c].SetFromViewProjection(viewMatrix, projectionMatrices[c]);
+		sliceNear = sliceFar;
+	}
+}
+
+bool ShadowMaps::TakeStaticRedraw(int cascade)
+{
+	if (isStaticCacheValid[cascade]) return false;
+	isStaticCacheValid[cascade] = true;
+	return true;
+}
+
+void ShadowMaps::Upload(const ShadowCascade* newCascades)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (SUCCEEDED(context->Map(cascadeBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+		memcpy(mapped.pData, newCascades, sizeof(ShadowCascade) * NUM_CASCADES);
+		context->Unmap(cascadeBuffer, 0);
+	}
+}
+
+void ShadowMaps::SetTarget(ID3D11DeviceContext* targetContext, ID3D11DepthStencilView* target)
+{
+	D3D11_VIEWPORT viewport;
+	viewport.TopLeftX = 0;
+	viewport.TopLeftY = 0;
+	viewport.Width = (float)MAP_SIZE;
+	viewport.Height = (float)MAP_SIZE;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	targetContext->OMSetRenderTargets(0, nullptr, target);
+	targetContext->RSSetViewports(1, &viewport);
+}
+
+void ShadowMaps::BeginStatic(ID3D11DeviceContext* targetContext, int cascade)
+{
+	targetContext->ClearDepthStencilView(staticTargets[cascade], D3D11_CLEAR_DEPTH, 1.0f, 0);
+	SetTarget(targetContext, staticTargets[cascade]);
+	matchesStaticCache[cascade] = false;
+}
+
+bool ShadowMaps::BeginDynamic(ID3D11DeviceContext* targetContext, int cascade, int numDynamicCasters)
+{
+	if (numDynamicCasters == 0 && matchesStaticCache[cascade]) return false;
+	//Nothing can be targeting it while it's copied into
+	targetContext->OMSetRenderTargets(0, nullptr, nullptr);
+	targetContext->CopySubresourceRegion(shadowTexture, cascade, 0, 0, 0, staticTexture, cascade, nullptr);
+	matchesStaticCache[cascade] = numDynamicCasters == 0;
+	if (numDynamicCasters == 0) return false;
+	SetTarget(targetContext, shadowTargets[cascade]);
+	return true;
+}
+
+void ShadowMaps::Bind(ID3D11DeviceContext* bindContext)
+{
+	bindContext->PSSetShaderResources(SHADOW_MAP_REGISTER, 1, &shadowSRV);
+	bindContext->PSSetShaderResources(CASCADE_BUFFER_REGISTER, 1, &cascadeSRV);
+	bindContext->PSSetSamplers(SHADOW_SAMPLER_REGISTER, 1, &shadowSampler);
+}
+
+void ShadowMaps::Unbind(ID3D11DeviceContext* bindContext)
+{
+	ID3D11ShaderResourceView* noSRV = nullptr;
+	bindContext->PSSetShaderResources(SHADOW_MAP_REGISTER, 1, &noSRV);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include "Frustum.h"
+
+class Camera;
+
+//Matches ShadowCascade in the shaders, which read them from a structured buffer
+struct ShadowCascade {
+	DirectX::XMFLOAT4X4 ViewProjection;//World to shadow map, stored transposed
+	float SplitDepth;//View depth where the next cascade takes over
+	float TexelSize;//World units per texel, how far receivers get pushed out along their normal
+	DirectX::XMFLOAT2 Padding;
+};
+
+//Cascaded shadow maps for one directional light. The camera's view is cut into NUM_CASCADES depth slices,
+//each with its own slice of a depth texture array fitted to a sphere around it, so turning the camera never resizes them.
+//Cascades only move in steps of SNAP_TEXELS texels. Static casters are drawn into a cache that only gets redrawn when
+//the cascade steps, the light turns or the static scene changes, and the cache is copied in before the dynamic casters
+class ShadowMaps
+{
+public:
+	const static int NUM_CASCADES = 4;//Has to match Lighting.hlsli, and fit in the render passes
+	const static int MAP_SIZE = 1024;
+	const static int SNAP_TEXELS = 32;
+	//Pixel shader registers, have to match Lighting.hlsli
+	const static int SHADOW_MAP_REGISTER = 5;
+	const static int CASCADE_BUFFER_REGISTER = 6;
+	const static int SHADOW_SAMPLER_REGISTER = 1;
+
+	ShadowMaps(ID3D11Device* newDevice, ID3D11DeviceContext* newContext);
+	~ShadowMaps();
+
+	//Fits the cascades to the camera, before anything is culled against them. Only does the math, so it can run
+	//while the maps are being drawn from an older fit. Upload the cascades before they're drawn with
+	void Update(Camera& camera, const DirectX::XMFLOAT3& lightDirection);
+	void InvalidateStaticCache();
+	bool IsStaticCacheValid(int cascade) const { return isStaticCacheValid[cascade]; }
+	//True if the cascade's static cache is stale, and it counts as redrawn from then on.
+	//Whatever frame that's for has to draw the static casters into it with BeginStatic
+	bool TakeStaticRedraw(int cascade);
+	const ShadowCascade& GetCascade(int cascade) const { return cascades[cascade]; }
+	const Frustum& GetFrustum(int cascade) const { return frustums[cascade]; }
+	//Stored transposed, every cascade shares the light's view
+	const DirectX::XMFLOAT4X4& GetViewMatrix() const { return viewMatrix; }
+	const DirectX::XMFLOAT4X4& GetProjectionMatrix(int cascade) const { return projectionMatrices[cascade]; }
+
+	void Upload(const ShadowCascade* newCascades);//NUM_CASCADES of them
+	//Clears and targets the cascade's static cache
+	void BeginStatic(ID3D11DeviceContext* context, int cascade);
+	//Copies the static cache in and targets the cascade for the dynamic casters.
+	//False when there's nothing to draw, the copy is skipped too when the map already matches the cache
+	bool BeginDynamic(ID3D11DeviceContext* context, int cascade, int numDynamicCasters);
+	//The maps can't be drawn into while they're bound, Unbind before drawing and Bind once they're done
+	void Bind(ID3D11DeviceContext* bindContext);
+	void Unbind(ID3D11DeviceContext* bindContext);
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+
+	DirectX::XMFLOAT3 lightDirection;
+	DirectX::XMFLOAT4X4 viewMatrix;
+	DirectX::XMFLOAT4X4 projectionMatrices[NUM_CASCADES];
+	DirectX::XMFLOAT4 snappedBounds[NUM_CASCADES];//Light space center and half size, a change means the cache is stale
+	ShadowCascade cascades[NUM_CASCADES];
+	Frustum frustums[NUM_CASCADES];
+	bool isStaticCacheValid[NUM_CASCADES];
+	bool matchesStaticCache[NUM_CASCADES];//Nothing dynamic was drawn over the cache's copy
+
+	ID3D11Texture2D* shadowTexture;
+	ID3D11DepthStencilView* shadowTargets[NUM_CASCADES];
+	ID3D11ShaderResourceView* shadowSRV;
+	ID3D11Texture2D* staticTexture;
+	ID3D11DepthStencilView* staticTargets[NUM_CASCADES];
+	ID3D11Buffer* cascadeBuffer;
+	ID3D11ShaderResourceView* cascadeSRV;
+	ID3D11SamplerState* shadowSampler;
+
+	void CreateResources();
+	void SetTarget(ID3D11DeviceContext* targetContext, ID3D11DepthStencilView* target);
+
+	//Copying would release everything twice
+	ShadowMaps(const ShadowMaps&);
+	ShadowMaps& operator=(const ShadowMaps&);
+};
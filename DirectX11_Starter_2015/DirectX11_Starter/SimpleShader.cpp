@@ -1,10 +1,17 @@
 #include "SimpleShader.h"
+#include "ConstantBufferRing.h"
+#include "Profiler.h"
 #include "Logger.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+thread_local ID3D11DeviceContext* ISimpleShader::threadContext = nullptr;
+thread_local unsigned int ISimpleShader::threadContextSlot = 0;
+thread_local ConstantBufferRing* ISimpleShader::threadRing = nullptr;
+ConstantBufferRing* ISimpleShader::defaultRing = nullptr;
+
 // --------------------------------------------------------
 // Constructor accepts DirectX device & context
 // --------------------------------------------------------
@@ -18,6 +25,29 @@ ISimpleShader::ISimpleShader(ID3D11Device* device, ID3D11DeviceContext* context)
 	constantBufferCount = 0;
 }
 
+// --------------------------------------------------------
+// Binds every shader to a different context on the calling
+// thread only, e.g. a deferred context on a worker thread
+//
+// context - The context to use, nullptr goes back to the one
+//           passed to the constructor
+// slot    - Which copy of the constant buffer data to use, so
+//           threads recording at the same time don't overwrite
+//           each other's values. 0 belongs to the constructor's
+//           context
+// ring    - OPTIONAL constant buffer ring made for this context
+// --------------------------------------------------------
+void ISimpleShader::SetThreadContext(ID3D11DeviceContext* context, unsigned int slot, ConstantBufferRing* ring)
+{
+	if (slot >= MAX_CONTEXT_SLOTS) {
+		LogText("--ERROR--//Context slot out of range");
+		return;
+	}
+	threadContext = context;
+	threadContextSlot = slot;
+	threadRing = ring;
+}
+
 // --------------------------------------------------------
 // Destructor
 // --------------------------------------------------------
@@ -38,6 +68,8 @@ void ISimpleShader::CleanUp()
 	{
 		constantBuffers[i].ConstantBuffer->Release();
 		delete[] constantBuffers[i].LocalDataBuffer;
+		delete[] constantBuffers[i].RingDataBuffer;
+		delete[] constantBuffers[i].RingRanges;
 	}
 	delete[] constantBuffers;
 	constantBufferCount = 0;
@@ -79,56 +111,176 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	bool result = LoadShaderBlob(shaderBlob);
+	shaderBlob->Release();
+	return result;
+}
+
+// --------------------------------------------------------
+// Same as LoadShaderFile, from code that is already in memory
+//
+// shaderBlob        - The compiled shader, not released here
+// cachedReflection  - OPTIONAL what ReflectShader gave back
+//                     for this code before, skips reflection
+//
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBlob(ID3DBlob* shaderBlob, const SimpleShaderReflection* cachedReflection)
+{
+	// Reflect first, creating a vertex shader's input layout
+	// uses the reflected inputs
+	if (cachedReflection)
+		reflection = *cachedReflection;
+	else if (!ReflectShader(shaderBlob, reflection))
+		return false;
+
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
 	shaderValid = CreateShader(shaderBlob);
 	if (!shaderValid)
 	{
-		shaderBlob->Release();
 		return false;
 	}
 
-	// Set up shader reflection to get information about
-	// this shader and its variables,  buffers, etc.
+	BuildTables();
+	return true;
+}
+
+// --------------------------------------------------------
+// Uses shader reflection to get information about a shader
+// and its variables, buffers, etc.
+//
+// shaderBlob - The compiled shader
+// reflection - Filled in with everything SimpleShader needs
+//
+// Returns false if the code couldn't be reflected
+// --------------------------------------------------------
+bool ISimpleShader::ReflectShader(ID3DBlob* shaderBlob, SimpleShaderReflection& reflection)
+{
 	ID3D11ShaderReflection* refl;
-	D3DReflect(
+	HRESULT hr = D3DReflect(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		IID_ID3D11ShaderReflection,
 		(void**)&refl);
+	if (hr != S_OK)
+		return false;
 
 	// Get the description of the shader
 	D3D11_SHADER_DESC shaderDesc;
 	refl->GetDesc(&shaderDesc);
 
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+	reflection.Resources.clear();
+	reflection.Buffers.clear();
+	reflection.Inputs.clear();
+	reflection.ThreadGroupSize[0] = reflection.ThreadGroupSize[1] = reflection.ThreadGroupSize[2] = 0;
+	if (D3D11_SHVER_GET_TYPE(shaderDesc.Version) == D3D11_SHVER_COMPUTE_SHADER)
+	{
+		refl->GetThreadGroupSize(
+			&reflection.ThreadGroupSize[0],
+			&reflection.ThreadGroupSize[1],
+			&reflection.ThreadGroupSize[2]);
+	}
 
 	// Handle bound resources (like shaders and samplers)
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	for (unsigned int r = 0; r < shaderDesc.BoundResources; r++)
 	{
-		// Get this resource's description
 		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
 		refl->GetResourceBindingDesc(r, &resourceDesc);
 
+		SimpleReflectedResource resource;
+		resource.Name = resourceDesc.Name;
+		resource.Type = resourceDesc.Type;
+		resource.BindIndex = resourceDesc.BindPoint;
+		reflection.Resources.push_back(resource);
+	}
+
+	// Loop through all constant buffers
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
+	{
+		// Get this buffer
+		ID3D11ShaderReflectionConstantBuffer* cb =
+			refl->GetConstantBufferByIndex(b);
+
+		// Get the description of this buffer
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		cb->GetDesc(&bufferDesc);
+
+		// Get the description of the resource binding, so
+		// we know exactly how it's bound in the shader
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		SimpleReflectedBuffer buffer;
+		buffer.Name = bufferDesc.Name;
+		buffer.Size = bufferDesc.Size;
+		buffer.BindIndex = bindDesc.BindPoint;
+
+		// Loop through all variables in this buffer
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			// Get the description of the variable
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+
+			SimpleReflectedVariable variable;
+			variable.Name = varDesc.Name;
+			variable.ByteOffset = varDesc.StartOffset;
+			variable.Size = varDesc.Size;
+			buffer.Variables.push_back(variable);
+		}
+		reflection.Buffers.push_back(buffer);
+	}
+
+	// Inputs, for vertex shaders that make their own input layout
+	for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetInputParameterDesc(i, &paramDesc);
+
+		SimpleReflectedInput input;
+		input.SemanticName = paramDesc.SemanticName;
+		input.SemanticIndex = paramDesc.SemanticIndex;
+		input.Mask = paramDesc.Mask;
+		input.ComponentType = paramDesc.ComponentType;
+		reflection.Inputs.push_back(input);
+	}
+
+	refl->Release();
+	return true;
+}
+
+// --------------------------------------------------------
+// Builds the variable table and buffers from the reflection
+// --------------------------------------------------------
+void ISimpleShader::BuildTables()
+{
+	// Create resource arrays
+	constantBufferCount = reflection.Buffers.size();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+
+	// Handle bound resources (like shaders and samplers)
+	for (unsigned int r = 0; r < reflection.Resources.size(); r++)
+	{
+		const SimpleReflectedResource& resource = reflection.Resources[r];
+
 		LogText("RESOURCE");
 
 		// Check the type
-		switch (resourceDesc.Type)
+		switch (resource.Type)
 		{
 		case D3D_SIT_TEXTURE: // A texture resource
+		case D3D_SIT_STRUCTURED: // Read only buffers are SRVs too
+		case D3D_SIT_BYTEADDRESS:
 		{
 			// Create the SRV wrapper
 			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;	// Shader bind point
+			srv->BindIndex = resource.BindIndex;		// Shader bind point
 			srv->Index = shaderResourceViews.size();	// Raw index
 
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
+			textureTable.insert(std::pair<std::string, SimpleSRV*>(resource.Name, srv));
 			LogText("Texture");
 			LogText(textureTableINT.size());
-			//LogText(resourceDesc.Name);
 			textureTableINT.push_back(srv);
 			shaderResourceViews.push_back(srv);
 		}
@@ -138,10 +290,10 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		{
 			// Create the sampler wrapper
 			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;	// Shader bind point
+			samp->BindIndex = resource.BindIndex;		// Shader bind point
 			samp->Index = samplerStates.size();			// Raw index
 
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
+			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resource.Name, samp));
 			LogText("Sampler");
 			LogText(samplerTableINT.size());
 			samplerTableINT.push_back(samp);
@@ -149,39 +301,28 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		}
 		break;
 		}
-		LogText(resourceDesc.Name);
+		LogText(resource.Name);
 	}
 
 	// Loop through all constant buffers
 	for (unsigned int b = 0; b < constantBufferCount; b++)
 	{
-		// Get this buffer
-		ID3D11ShaderReflectionConstantBuffer* cb =
-			refl->GetConstantBufferByIndex(b);
-
-		// Get the description of this buffer
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		cb->GetDesc(&bufferDesc);
+		const SimpleReflectedBuffer& buffer = reflection.Buffers[b];
 
 		LogText("Buffer");
 		LogText(b);
-		LogText(bufferDesc.Name);
-
-		// Get the description of the resource binding, so
-		// we know exactly how it's bound in the shader
-		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+		LogText(buffer.Name);
 
 		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
+		constantBuffers[b].BindIndex = buffer.BindIndex;
+		constantBuffers[b].Name = buffer.Name;
+		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(buffer.Name, &constantBuffers[b]));
 		cbTableINT.push_back(&constantBuffers[b]);
 
 		// Create this constant buffer
 		D3D11_BUFFER_DESC newBuffDesc;
 		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = bufferDesc.Size;
+		newBuffDesc.ByteWidth = buffer.Size;
 		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 		newBuffDesc.CPUAccessFlags = 0;
 		newBuffDesc.MiscFlags = 0;
@@ -189,44 +330,39 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		device->CreateBuffer(&newBuffDesc, 0, &constantBuffers[b].ConstantBuffer);
 
 		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].Size = buffer.Size;
+		constantBuffers[b].LocalDataBuffer = new unsigned char[buffer.Size * MAX_CONTEXT_SLOTS];
+		ZeroMemory(constantBuffers[b].LocalDataBuffer, buffer.Size * MAX_CONTEXT_SLOTS);
+
+		// Split buffers remember what they last put in the ring
+		constantBuffers[b].UpdateFrequency = CONSTANT_BUFFER_UNSPLIT;
+		if (buffer.Name.compare(0, 8, "perFrame") == 0) constantBuffers[b].UpdateFrequency = CONSTANT_BUFFER_PER_FRAME;
+		else if (buffer.Name.compare(0, 11, "perMaterial") == 0) constantBuffers[b].UpdateFrequency = CONSTANT_BUFFER_PER_MATERIAL;
+		else if (buffer.Name.compare(0, 9, "perObject") == 0) constantBuffers[b].UpdateFrequency = CONSTANT_BUFFER_PER_OBJECT;
+		constantBuffers[b].RingDataBuffer = new unsigned char[buffer.Size * MAX_CONTEXT_SLOTS];
+		constantBuffers[b].RingRanges = new SimpleRingRange[MAX_CONTEXT_SLOTS];
+		ZeroMemory(constantBuffers[b].RingRanges, sizeof(SimpleRingRange) * MAX_CONTEXT_SLOTS);
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (unsigned int v = 0; v < buffer.Variables.size(); v++)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-
-			// Get the description of the variable
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
+			const SimpleReflectedVariable& variable = buffer.Variables[v];
 
 			LogText("Var");
 			LogText(v);
-			LogText(varDesc.Name);
+			LogText(variable.Name);
 
 			// Create the variable struct
 			SimpleShaderVariable varStruct;
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
-			varStruct.Size = varDesc.Size;
-
-			// Get a string version
-			std::string varName(varDesc.Name);
+			varStruct.ByteOffset = variable.ByteOffset;
+			varStruct.Size = variable.Size;
 
 			// Add this variable to the table
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
+			varTable.insert(std::pair<std::string, SimpleShaderVariable>(variable.Name, varStruct));
 			varTableINT.push_back(varStruct);
 		}
 	}
-
-	// All set
-	refl->Release();
-	shaderBlob->Release();
-	return true;
 }
 
 // --------------------------------------------------------
@@ -308,11 +444,13 @@ void ISimpleShader::SetShader(bool copyData)
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
+	// Set the shader and any relevant constant buffers, before
+	// copying since buffers in the ring bind their own ranges
+	SetShaderAndCB();
+	Profiler::Count(PROFILE_COUNTER_STATE_CHANGES, 1);
+
 	// Should we automatically copy the data?
 	if (copyData) CopyAllBufferData();
-
-	// Set the shader and any relevant constant buffers
-	SetShaderAndCB();
 }
 
 // --------------------------------------------------------
@@ -332,9 +470,7 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer, 0, 0,
-		cb->LocalDataBuffer, 0, 0);
+	CopyBuffer(cb);
 }
 
 void ISimpleShader::CopyBufferData(int i)
@@ -346,9 +482,7 @@ void ISimpleShader::CopyBufferData(int i)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer, 0, 0,
-		cb->LocalDataBuffer, 0, 0);
+	CopyBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -365,12 +499,65 @@ void ISimpleShader::CopyAllBufferData()
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer, 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		CopyBuffer(&constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Copies one buffer's local data to the GPU, through the
+// constant buffer ring when the buffer is split and there
+// is a ring for the current context
+// --------------------------------------------------------
+void ISimpleShader::CopyBuffer(SimpleConstantBuffer* cb)
+{
+	ConstantBufferRing* ring = GetRing();
+	bool usesRing = cb->UpdateFrequency != CONSTANT_BUFFER_UNSPLIT && ring != nullptr && ring->IsSupported();
+	if (usesRing && CopyBufferToRing(cb, ring)) return;
+
+	GetContext()->UpdateSubresource(
+		cb->ConstantBuffer, 0, 0,
+		GetLocalData(cb), 0, 0);
+	Profiler::Count(PROFILE_COUNTER_CONSTANT_BYTES, cb->Size);
+
+	// The ring ran out of room, its range might still be bound
+	if (usesRing)
+	{
+		unsigned int numConstants = (cb->Size + ConstantBufferRing::RANGE_ALIGNMENT - 1) / ConstantBufferRing::RANGE_ALIGNMENT *
+			(ConstantBufferRing::RANGE_ALIGNMENT / ConstantBufferRing::CONSTANT_SIZE);
+		SetConstantBufferRange(ring->GetContext(), cb->BindIndex, cb->ConstantBuffer, 0, numConstants);
 	}
 }
 
+// --------------------------------------------------------
+// Writes a split buffer into the ring and binds the range
+// it went to. Per frame and per material data that hasn't
+// changed since this context slot last wrote it is only
+// bound again
+//
+// Returns false if the ring is full
+// --------------------------------------------------------
+bool ISimpleShader::CopyBufferToRing(SimpleConstantBuffer* cb, ConstantBufferRing* ring)
+{
+	unsigned char* localData = GetLocalData(cb);
+	unsigned char* ringData = cb->RingDataBuffer + cb->Size * threadContextSlot;
+	SimpleRingRange& range = cb->RingRanges[threadContextSlot];
+
+	bool isUnchanged = cb->UpdateFrequency != CONSTANT_BUFFER_PER_OBJECT &&
+		range.Generation == ring->GetGeneration() &&
+		memcmp(localData, ringData, cb->Size) == 0;
+	if (!isUnchanged)
+	{
+		if (!ring->Write(localData, cb->Size, range.FirstConstant, range.NumConstants))
+			return false;
+		range.Generation = ring->GetGeneration();
+		if (cb->UpdateFrequency != CONSTANT_BUFFER_PER_OBJECT)
+			memcpy(ringData, localData, cb->Size);
+	}
+
+	SetConstantBufferRange(ring->GetContext(), cb->BindIndex, ring->GetBuffer(), range.FirstConstant, range.NumConstants);
+	return true;
+}
+
 // --------------------------------------------------------
 // Sets a variable by name with arbitrary data of the specified size
 //
@@ -390,7 +577,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 
 	// Set the data in the local data buffer
 	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
+		GetLocalData(&constantBuffers[var->ConstantBufferIndex]) + var->ByteOffset,
 		data,
 		size);
 
@@ -407,7 +594,7 @@ bool ISimpleShader::SetData(int i, const void* data, unsigned int size)
 
 	// Set the data in the local data buffer
 	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
+		GetLocalData(&constantBuffers[var->ConstantBufferIndex]) + var->ByteOffset,
 		data,
 		size);
 
@@ -626,6 +813,9 @@ const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(unsigned int index)
 // ------ SIMPLE VERTEX SHADER ------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+// Semantic prefix that marks a vertex shader input as per instance data
+static const char* INSTANCE_SEMANTIC_PREFIX = "INSTANCE_";
+
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
@@ -650,6 +840,20 @@ SimpleVertexShader::SimpleVertexShader(ID3D11Device * device, ID3D11DeviceContex
 	this->inputLayout = inputLayout;
 }
 
+// --------------------------------------------------------
+// Constructor overload which takes the elements of a custom
+// input layout
+//
+// The input layout itself needs the shader code, so it is
+// created from these during LoadShader() instead of reflection
+// --------------------------------------------------------
+SimpleVertexShader::SimpleVertexShader(ID3D11Device * device, ID3D11DeviceContext * context, const D3D11_INPUT_ELEMENT_DESC * inputElements, unsigned int numInputElements)
+	: ISimpleShader(device, context)
+{
+	this->inputLayout = 0;
+	customInputElements.assign(inputElements, inputElements + numInputElements);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -697,39 +901,50 @@ bool SimpleVertexShader::CreateShader(ID3DBlob* shaderBlob)
 	if (inputLayout)
 		return true;
 
+	// Were we given the elements to make one from?
+	if (!customInputElements.empty())
+	{
+		result = device->CreateInputLayout(
+			&customInputElements[0],
+			customInputElements.size(),
+			shaderBlob->GetBufferPointer(),
+			shaderBlob->GetBufferSize(),
+			&inputLayout);
+		return result == S_OK;
+	}
+
 	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
+	// reflected inputs to create an input layout that 
 	// matches what the vertex shader expects.  Code adapted from:
 	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
 
-	// Reflect shader info
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
-
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
 	// Read input layout description from shader info
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
+	for (unsigned int i = 0; i< reflection.Inputs.size(); i++)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
+		const SimpleReflectedInput& paramDesc = reflection.Inputs[i];
+		// System values like SV_VertexID come from the input assembler, not a vertex buffer
+		if (paramDesc.SemanticName.compare(0, 3, "SV_") == 0)
+			continue;
 
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc;
-		elementDesc.SemanticName = paramDesc.SemanticName;
+		elementDesc.SemanticName = paramDesc.SemanticName.c_str();
 		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
 		elementDesc.InputSlot = 0;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
 		elementDesc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 		elementDesc.InstanceDataStepRate = 0;
 
+		// Anything with an "INSTANCE_" semantic is per instance data,
+		// which is read from a second vertex buffer once per instance
+		if (paramDesc.SemanticName.compare(0, strlen(INSTANCE_SEMANTIC_PREFIX), INSTANCE_SEMANTIC_PREFIX) == 0)
+		{
+			elementDesc.InputSlot = INSTANCE_INPUT_SLOT;
+			elementDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+			elementDesc.InstanceDataStepRate = 1;
+		}
+
 		// Determine DXGI format
 		if (paramDesc.Mask == 1)
 		{
@@ -760,6 +975,10 @@ bool SimpleVertexShader::CreateShader(ID3DBlob* shaderBlob)
 		inputLayoutDesc.push_back(elementDesc);
 	}
 
+	// Shaders that make their own vertices don't need one
+	if (inputLayoutDesc.empty())
+		return true;
+
 	// Try to create Input Layout
 	HRESULT hr = device->CreateInputLayout(
 		&inputLayoutDesc[0],
@@ -768,8 +987,6 @@ bool SimpleVertexShader::CreateShader(ID3DBlob* shaderBlob)
 		shaderBlob->GetBufferSize(),
 		&inputLayout);
 
-	// All done, clean up
-	refl->Release();
 	return true;
 }
 
@@ -783,19 +1000,28 @@ void SimpleVertexShader::SetShaderAndCB()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout);
-	deviceContext->VSSetShader(shader, 0, 0);
+	GetContext()->IASetInputLayout(inputLayout);
+	GetContext()->VSSetShader(shader, 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		deviceContext->VSSetConstantBuffers(
+		GetContext()->VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			&constantBuffers[i].ConstantBuffer);
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer as one of this stage's constant
+// buffers, which needs an 11.1 context
+// --------------------------------------------------------
+void SimpleVertexShader::SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants)
+{
+	context->VSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &numConstants);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the vertex shader stage
 //
@@ -812,7 +1038,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, ID3D11ShaderRes
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->VSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -826,7 +1052,7 @@ bool SimpleVertexShader::SetShaderResourceView(int i, ID3D11ShaderResourceView *
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->VSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -848,7 +1074,7 @@ bool SimpleVertexShader::SetSamplerState(std::string name, ID3D11SamplerState* s
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->VSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -862,7 +1088,7 @@ bool SimpleVertexShader::SetSamplerState(int i, ID3D11SamplerState * samplerStat
 		return false;
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->VSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -930,18 +1156,27 @@ void SimplePixelShader::SetShaderAndCB()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->PSSetShader(shader, 0, 0);
+	GetContext()->PSSetShader(shader, 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		deviceContext->PSSetConstantBuffers(
+		GetContext()->PSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			&constantBuffers[i].ConstantBuffer);
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer as one of this stage's constant
+// buffers, which needs an 11.1 context
+// --------------------------------------------------------
+void SimplePixelShader::SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants)
+{
+	context->PSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &numConstants);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the pixel shader stage
 //
@@ -958,7 +1193,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderReso
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->PSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -972,7 +1207,7 @@ bool SimplePixelShader::SetShaderResourceView(int i, ID3D11ShaderResourceView *
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->PSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -994,7 +1229,7 @@ bool SimplePixelShader::SetSamplerState(std::string name, ID3D11SamplerState* sa
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->PSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1008,7 +1243,7 @@ bool SimplePixelShader::SetSamplerState(int i, ID3D11SamplerState * samplerState
 		return false;
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->PSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1078,18 +1313,27 @@ void SimpleDomainShader::SetShaderAndCB()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader, 0, 0);
+	GetContext()->DSSetShader(shader, 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		deviceContext->DSSetConstantBuffers(
+		GetContext()->DSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			&constantBuffers[i].ConstantBuffer);
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer as one of this stage's constant
+// buffers, which needs an 11.1 context
+// --------------------------------------------------------
+void SimpleDomainShader::SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants)
+{
+	context->DSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &numConstants);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the domain shader stage
 //
@@ -1106,7 +1350,7 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, ID3D11ShaderRes
 		return false;
 
 	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->DSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1128,7 +1372,7 @@ bool SimpleDomainShader::SetSamplerState(std::string name, ID3D11SamplerState* s
 		return false;
 
 	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->DSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1197,18 +1441,27 @@ void SimpleHullShader::SetShaderAndCB()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader, 0, 0);
+	GetContext()->HSSetShader(shader, 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		deviceContext->HSSetConstantBuffers(
+		GetContext()->HSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			&constantBuffers[i].ConstantBuffer);
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer as one of this stage's constant
+// buffers, which needs an 11.1 context
+// --------------------------------------------------------
+void SimpleHullShader::SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants)
+{
+	context->HSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &numConstants);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the hull shader stage
 //
@@ -1225,7 +1478,7 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, ID3D11ShaderResou
 		return false;
 
 	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->HSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1247,7 +1500,7 @@ bool SimpleHullShader::SetSamplerState(std::string name, ID3D11SamplerState* sam
 		return false;
 
 	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->HSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1440,18 +1693,27 @@ void SimpleGeometryShader::SetShaderAndCB()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader, 0, 0);
+	GetContext()->GSSetShader(shader, 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		deviceContext->GSSetConstantBuffers(
+		GetContext()->GSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			&constantBuffers[i].ConstantBuffer);
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer as one of this stage's constant
+// buffers, which needs an 11.1 context
+// --------------------------------------------------------
+void SimpleGeometryShader::SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants)
+{
+	context->GSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &numConstants);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the Geometry shader stage
 //
@@ -1468,7 +1730,7 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, ID3D11ShaderR
 		return false;
 
 	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->GSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1490,7 +1752,7 @@ bool SimpleGeometryShader::SetSamplerState(std::string name, ID3D11SamplerState*
 		return false;
 
 	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->GSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1568,34 +1830,19 @@ bool SimpleComputeShader::CreateShader(ID3DBlob* shaderBlob)
 	if (result != S_OK)
 		return false;
 
-	// Set up shader reflection to get information about UAV's
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
-
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
 	// Grab the thread info
-	threadsTotal = refl->GetThreadGroupSize(
-		&threadsX,
-		&threadsY,
-		&threadsZ);
+	threadsX = reflection.ThreadGroupSize[0];
+	threadsY = reflection.ThreadGroupSize[1];
+	threadsZ = reflection.ThreadGroupSize[2];
+	threadsTotal = threadsX * threadsY * threadsZ;
 
 	// Loop and get all UAV resources
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	for (unsigned int r = 0; r < reflection.Resources.size(); r++)
 	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
+		const SimpleReflectedResource& resource = reflection.Resources[r];
 
 		// Check the type, looking for any kind of UAV
-		switch (resourceDesc.Type)
+		switch (resource.Type)
 		{
 		case D3D_SIT_UAV_APPEND_STRUCTURED:
 		case D3D_SIT_UAV_CONSUME_STRUCTURED:
@@ -1603,12 +1850,11 @@ bool SimpleComputeShader::CreateShader(ID3DBlob* shaderBlob)
 		case D3D_SIT_UAV_RWSTRUCTURED:
 		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
 		case D3D_SIT_UAV_RWTYPED:
-			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
+			uavTable.insert(std::pair<std::string, unsigned int>(resource.Name, resource.BindIndex));
 		}
 	}
 
 	// All set
-	refl->Release();
 	return true;
 }
 
@@ -1622,18 +1868,27 @@ void SimpleComputeShader::SetShaderAndCB()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader, 0, 0);
+	GetContext()->CSSetShader(shader, 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		deviceContext->CSSetConstantBuffers(
+		GetContext()->CSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			&constantBuffers[i].ConstantBuffer);
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer as one of this stage's constant
+// buffers, which needs an 11.1 context
+// --------------------------------------------------------
+void SimpleComputeShader::SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants)
+{
+	context->CSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &numConstants);
+}
+
 // --------------------------------------------------------
 // Dispatches the compute shader with the specified amount 
 // of groups, using the number of threads per group
@@ -1656,7 +1911,7 @@ void SimpleComputeShader::SetShaderAndCB()
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
 {
-	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
+	GetContext()->Dispatch(groupsX, groupsY, groupsZ);
 }
 
 // --------------------------------------------------------
@@ -1681,7 +1936,7 @@ void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int gr
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
 {
-	deviceContext->Dispatch(
+	GetContext()->Dispatch(
 		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
 		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
 		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
@@ -1703,7 +1958,21 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, ID3D11ShaderRe
 		return false;
 
 	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+	GetContext()->CSSetShaderResources(srvInfo->BindIndex, 1, &srv);
+
+	// Success
+	return true;
+}
+
+bool SimpleComputeShader::SetShaderResourceView(int i, ID3D11ShaderResourceView * srv)
+{
+	// Look for the variable and verify
+	const SimpleSRV* srvInfo = GetShaderResourceView(i);
+	if (srvInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	GetContext()->CSSetShaderResources(srvInfo->BindIndex, 1, &srv);
 
 	// Success
 	return true;
@@ -1725,7 +1994,21 @@ bool SimpleComputeShader::SetSamplerState(std::string name, ID3D11SamplerState*
 		return false;
 
 	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+	GetContext()->CSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
+
+	// Success
+	return true;
+}
+
+bool SimpleComputeShader::SetSamplerState(int i, ID3D11SamplerState * samplerState)
+{
+	// Look for the variable and verify
+	const SimpleSampler* sampInfo = GetSamplerInfo(i);
+	if (sampInfo == 0)
+		return false;
+
+	// Set the shader resource view
+	GetContext()->CSSetSamplers(sampInfo->BindIndex, 1, &samplerState);
 
 	// Success
 	return true;
@@ -1748,7 +2031,7 @@ bool SimpleComputeShader::SetUnorderedAccessView(std::string name, ID3D11Unorder
 		return false;
 
 	// Set the shader resource view
-	deviceContext->CSSetUnorderedAccessViews(bindIndex, 1, &uav, &appendConsumeOffset);
+	GetContext()->CSSetUnorderedAccessViews(bindIndex, 1, &uav, &appendConsumeOffset);
 
 	// Success
 	return true;
@@ -9,6 +9,21 @@
 #include <vector>
 #include <string>
 
+class ConstantBufferRing;
+struct ID3D11DeviceContext1;
+
+// --------------------------------------------------------
+// How often a constant buffer changes, picked from the start
+// of its name. Split buffers go through the constant buffer
+// ring when there is one, per frame and per material ones are
+// only written again when their data changed. Buffers named
+// anything else are copied every time
+// --------------------------------------------------------
+const unsigned int CONSTANT_BUFFER_UNSPLIT = 0;
+const unsigned int CONSTANT_BUFFER_PER_FRAME = 1;		// "perFrame..."
+const unsigned int CONSTANT_BUFFER_PER_MATERIAL = 2;	// "perMaterial..."
+const unsigned int CONSTANT_BUFFER_PER_OBJECT = 3;		// "perObject..."
+
 // --------------------------------------------------------
 // Used by simple shaders to store information about
 // specific variables in constant buffers
@@ -20,6 +35,17 @@ struct SimpleShaderVariable
 	unsigned int ConstantBufferIndex;
 };
 
+// --------------------------------------------------------
+// Where a constant buffer's data was last written in a
+// constant buffer ring
+// --------------------------------------------------------
+struct SimpleRingRange
+{
+	unsigned int FirstConstant;
+	unsigned int NumConstants;
+	unsigned int Generation;	// The ring's, 0 if never written
+};
+
 // --------------------------------------------------------
 // Contains information about a specific
 // constant buffer in a shader, as well as
@@ -30,8 +56,54 @@ struct SimpleConstantBuffer
 	std::string Name;
 	unsigned int Size;
 	unsigned int BindIndex;
+	unsigned int UpdateFrequency;
 	ID3D11Buffer* ConstantBuffer;
 	unsigned char* LocalDataBuffer;
+	unsigned char* RingDataBuffer;	// What each context slot last wrote to its ring
+	SimpleRingRange* RingRanges;	// Where it went, one per context slot
+};
+
+// --------------------------------------------------------
+// Everything SimpleShader uses from shader reflection, kept
+// so it can be stored next to the compiled code and handed
+// back without reflecting again
+// --------------------------------------------------------
+struct SimpleReflectedVariable
+{
+	std::string Name;
+	unsigned int ByteOffset;
+	unsigned int Size;
+};
+
+struct SimpleReflectedBuffer
+{
+	std::string Name;
+	unsigned int Size;
+	unsigned int BindIndex;
+	std::vector<SimpleReflectedVariable> Variables;
+};
+
+struct SimpleReflectedResource
+{
+	std::string Name;
+	unsigned int Type;		// A D3D_SHADER_INPUT_TYPE
+	unsigned int BindIndex;
+};
+
+struct SimpleReflectedInput
+{
+	std::string SemanticName;
+	unsigned int SemanticIndex;
+	unsigned int Mask;
+	unsigned int ComponentType;	// A D3D_REGISTER_COMPONENT_TYPE
+};
+
+struct SimpleShaderReflection
+{
+	std::vector<SimpleReflectedResource> Resources;
+	std::vector<SimpleReflectedBuffer> Buffers;
+	std::vector<SimpleReflectedInput> Inputs;
+	unsigned int ThreadGroupSize[3];	// Compute shaders only
 };
 
 // --------------------------------------------------------
@@ -58,16 +130,27 @@ struct SimpleSampler
 class ISimpleShader
 {
 public:
+	// Number of contexts that can use the same shaders at once
+	const static unsigned int MAX_CONTEXT_SLOTS = 16;
+
 	ISimpleShader(ID3D11Device* device, ID3D11DeviceContext* context);
 	virtual ~ISimpleShader();
 
 	// Initialization method (since we can't invoke derived class
 	// overrides in the base class constructor)
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderBlob(ID3DBlob* shaderBlob, const SimpleShaderReflection* cachedReflection = nullptr);
+	static bool ReflectShader(ID3DBlob* shaderBlob, SimpleShaderReflection& reflection);
+	const SimpleShaderReflection& GetReflection() { return reflection; }
 
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
 
+	// Per thread context binding, for recording on deferred contexts
+	static void SetThreadContext(ID3D11DeviceContext* context, unsigned int slot, ConstantBufferRing* ring = nullptr);
+	// Ring for the context passed to the constructor
+	static void SetDefaultConstantBufferRing(ConstantBufferRing* ring) { defaultRing = ring; }
+
 	// Activating the shader and copying data
 	void SetShader(bool copyData = true);
 	void CopyAllBufferData();
@@ -122,9 +205,22 @@ protected:
 	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
 
+	// Overrides deviceContext on the thread that set them
+	static thread_local ID3D11DeviceContext* threadContext;
+	static thread_local unsigned int threadContextSlot;
+	static thread_local ConstantBufferRing* threadRing;
+	static ConstantBufferRing* defaultRing;
+	ID3D11DeviceContext* GetContext() { return threadContext != nullptr ? threadContext : deviceContext; }
+	ConstantBufferRing* GetRing() { return threadContext != nullptr ? threadRing : defaultRing; }
+	unsigned char* GetLocalData(SimpleConstantBuffer* cb) { return cb->LocalDataBuffer + cb->Size * threadContextSlot; }
+
 	// Resource counts
 	unsigned int constantBufferCount;
 
+	// What the tables are built from
+	SimpleShaderReflection reflection;
+	void BuildTables();
+
 	// Maps for variables and buffers
 	SimpleConstantBuffer*		constantBuffers; // For index-based lookup
 	std::vector<SimpleSRV*>		shaderResourceViews;
@@ -142,6 +238,10 @@ protected:
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(ID3DBlob* shaderBlob) = 0;
 	virtual void SetShaderAndCB() = 0;
+	virtual void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants) = 0;
+
+	void CopyBuffer(SimpleConstantBuffer* cb);
+	bool CopyBufferToRing(SimpleConstantBuffer* cb, ConstantBufferRing* ring);
 
 	virtual void CleanUp();
 
@@ -158,8 +258,14 @@ protected:
 class SimpleVertexShader : public ISimpleShader
 {
 public:
+	// Inputs with an "INSTANCE_" semantic are read per instance from this slot
+	const static unsigned int INSTANCE_INPUT_SLOT = 1;
+
 	SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext* context);
 	SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11InputLayout* inputLayout);
+	// For vertex formats reflection can't work out (packed or normalized types), the layout
+	// is made from these once the shader loads. Semantic names have to outlive the shader
+	SimpleVertexShader(ID3D11Device* device, ID3D11DeviceContext* context, const D3D11_INPUT_ELEMENT_DESC* inputElements, unsigned int numInputElements);
 	~SimpleVertexShader();
 	ID3D11VertexShader* GetDirectXShader() { return shader; }
 	ID3D11InputLayout* GetInputLayout() { return inputLayout; }
@@ -172,8 +278,10 @@ public:
 protected:
 	ID3D11InputLayout* inputLayout;
 	ID3D11VertexShader* shader;
+	std::vector<D3D11_INPUT_ELEMENT_DESC> customInputElements;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCB();
+	void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants);
 	void CleanUp();
 };
 
@@ -197,6 +305,7 @@ protected:
 	ID3D11PixelShader* shader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCB();
+	void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants);
 	void CleanUp();
 };
 
@@ -217,6 +326,7 @@ protected:
 	ID3D11DomainShader* shader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCB();
+	void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants);
 	void CleanUp();
 };
 
@@ -237,6 +347,7 @@ protected:
 	ID3D11HullShader* shader;
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCB();
+	void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants);
 	void CleanUp();
 };
 
@@ -269,6 +380,7 @@ protected:
 	bool CreateShader(ID3DBlob* shaderBlob);
 	bool CreateShaderWithStreamOut(ID3DBlob* shaderBlob);
 	void SetShaderAndCB();
+	void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants);
 	void CleanUp();
 
 	// Helpers
@@ -290,7 +402,9 @@ public:
 	void DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ);
 
 	bool SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv);
+	bool SetShaderResourceView(int i, ID3D11ShaderResourceView* srv);
 	bool SetSamplerState(std::string name, ID3D11SamplerState* samplerState);
+	bool SetSamplerState(int i, ID3D11SamplerState* samplerState);
 	bool SetUnorderedAccessView(std::string name, ID3D11UnorderedAccessView* uav, unsigned int appendConsumeOffset = -1);
 
 	int GetUnorderedAccessViewIndex(std::string name);
@@ -306,5 +420,6 @@ protected:
 
 	bool CreateShader(ID3DBlob* shaderBlob);
 	void SetShaderAndCB();
+	void SetConstantBufferRange(ID3D11DeviceContext1* context, unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int numConstants);
 	void CleanUp();
 };
\ No newline at end of file
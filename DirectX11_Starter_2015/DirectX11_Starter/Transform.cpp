@@ -1,20 +1,33 @@
 #include "Transform.h"
+#include "TransformStore.h"
 
+unsigned int Transform::hierarchyVersion = 0;
 
 Transform::Transform()
 {
-	isDirty = true;
+	store = nullptr;
+	storeIndex = -1;
 	parrent = nullptr;
+	version = 1;
+	worldVersion = 0;
+	cachedVersion = 0;
+	cachedParrentWorldVersion = 0;
 	position = DirectX::XMFLOAT3(0, 0, 0);
 	rotation = DirectX::XMFLOAT3(0, 0, 0);
 	scale = DirectX::XMFLOAT3(1, 1, 1);
 	DirectX::XMStoreFloat4x4(&worldMatrix, DirectX::XMMatrixIdentity());
 }
 
+//Copies are never bound, only the values come along
 Transform::Transform(const Transform & other)
 {
-	isDirty = other.isDirty;
+	store = nullptr;
+	storeIndex = -1;
 	parrent = other.parrent;
+	version = other.version;
+	worldVersion = other.worldVersion;
+	cachedVersion = other.cachedVersion;
+	cachedParrentWorldVersion = other.cachedParrentWorldVersion;
 	position = other.position;
 	rotation = other.rotation;
 	scale = other.scale;
@@ -24,12 +37,20 @@ Transform::Transform(const Transform & other)
 Transform & Transform::operator=(const Transform & other)
 {
 	if (this == &other) return *this;
-	isDirty = other.isDirty;
 	parrent = other.parrent;
+	version = other.version;
+	worldVersion = other.worldVersion;
+	cachedVersion = other.cachedVersion;
+	cachedParrentWorldVersion = other.cachedParrentWorldVersion;
 	position = other.position;
 	rotation = other.rotation;
 	scale = other.scale;
 	worldMatrix = other.worldMatrix;
+	//Keep our own slot, but give it the other transform's values
+	if (store != nullptr) {
+		version++;
+		WriteToStore();
+	}
 	return *this;
 }
 
@@ -38,50 +59,80 @@ Transform::~Transform()
 {
 }
 
+void Transform::BindToStore(TransformStore* newStore, int newStoreIndex)
+{
+	store = newStore;
+	storeIndex = newStoreIndex;
+	version++;
+	WriteToStore();
+}
+
+void Transform::WriteToStore()
+{
+	DirectX::XMFLOAT4 quaternion;
+	DirectX::XMStoreFloat4(&quaternion, DirectX::XMQuaternionRotationRollPitchYawFromVector(DirectX::XMLoadFloat3(&rotation)));
+	store->SetPosition(storeIndex, position);
+	store->SetRotation(storeIndex, quaternion);
+	store->SetScale(storeIndex, scale);
+	int parrentIndex = (parrent != nullptr && parrent->store == store) ? parrent->storeIndex : -1;
+	store->SetParrent(storeIndex, parrentIndex);
+}
+
 void Transform::SetPosition(DirectX::XMFLOAT3 newPos)
 {
-	isDirty = true;
+	version++;
 	position = newPos;
+	if (store != nullptr) store->SetPosition(storeIndex, position);
 }
 
 void Transform::MoveRelative(float addX, float addY, float addZ)
 {
-	isDirty = true;
+	version++;
 	DirectX::XMVECTOR dir = DirectX::XMVector3Rotate(DirectX::XMVectorSet(addX, addY, addZ, 0.0f),
 		DirectX::XMQuaternionRotationRollPitchYawFromVector(DirectX::XMLoadFloat3(&rotation)));
 	DirectX::XMStoreFloat3(&position, DirectX::XMVectorAdd(dir, DirectX::XMLoadFloat3(&position)));
+	if (store != nullptr) store->SetPosition(storeIndex, position);
 }
 
 void Transform::SetRotation(DirectX::XMFLOAT3 newRot)
 {
-	isDirty = true;
+	version++;
 	rotation = newRot;
+	if (store != nullptr) {
+		DirectX::XMFLOAT4 quaternion;
+		DirectX::XMStoreFloat4(&quaternion, DirectX::XMQuaternionRotationRollPitchYawFromVector(DirectX::XMLoadFloat3(&rotation)));
+		store->SetRotation(storeIndex, quaternion);
+	}
 }
 
 void Transform::SetScale(DirectX::XMFLOAT3 newScale)
 {
-	isDirty = true;
+	version++;
 	scale = newScale;
+	if (store != nullptr) store->SetScale(storeIndex, scale);
 }
 
 void Transform::SetParrent(Transform * newParrent)
 {
-	if (newParrent == nullptr || newParrent == this) return;
+	if (newParrent == this || newParrent == parrent) return;
 	//TODO: test this function, circular dependency issues should be fixed, but only test on trying to set a transforms parrent to itself
 	Transform* current = newParrent;
-	while(current->GetParrent() != nullptr) {
+	while(current != nullptr && current->GetParrent() != nullptr) {
 		if (current == this) return;
 		current = current->GetParrent();
 	}
 	parrent = newParrent;
+	version++;//Same local values, but a different world matrix
+	hierarchyVersion++;
+	if (store != nullptr) WriteToStore();
 }
 
-bool Transform::GetIsDirty()
+//Only looks one level up, a change further up reaches us once the parent has been updated
+bool Transform::GetIsDirty() const
 {
-	if (parrent == nullptr) {
-		return isDirty;
-	}
-	return isDirty || parrent->GetIsDirty();
+	if (store != nullptr) return store->GetIsDirty(storeIndex);
+	if (cachedVersion != version) return true;
+	return parrent != nullptr && cachedParrentWorldVersion != parrent->worldVersion;
 }
 
 DirectX::XMFLOAT3 Transform::GetForwardVector()
@@ -92,24 +143,34 @@ DirectX::XMFLOAT3 Transform::GetForwardVector()
 	return realForward;
 }
 
+const DirectX::XMFLOAT4X4& Transform::GetWorldMatrix()
+{
+	if (store != nullptr) return store->GetWorldMatrix(storeIndex);
+	UpdateWorldMatrix();
+	return worldMatrix;
+}
+
+void Transform::UpdateWorldMatrix()
+{
+	//Bound transforms are updated all at once by the store
+	if (store != nullptr) return;
+	//Outside of the update pass the parent might not have been updated yet this frame
+	if (parrent != nullptr && parrent->GetIsDirty()) parrent->UpdateWorldMatrix();
+	if (GetIsDirty()) RecalculateWorldMatrix();
+}
+
 DirectX::XMFLOAT4X4 Transform::RecalculateWorldMatrix()
 {
-	if (!GetIsDirty()) return worldMatrix;//Dont know if I want to keep it.
-	DirectX::XMMATRIX allignedWorldMatrix = DirectX::XMLoadFloat4x4(&worldMatrix);
-	if (parrent == nullptr) {
-		DirectX::XMMATRIX  calculatedWorldMatrix =
-			DirectX::XMMatrixScalingFromVector(DirectX::XMLoadFloat3(&scale)) * DirectX::XMMatrixRotationRollPitchYawFromVector(DirectX::XMLoadFloat3(&rotation)) *
-			//DirectX::XMMatrixRotationX(rotation.x) * DirectX::XMMatrixRotationY(rotation.y) * DirectX::XMMatrixRotationZ(rotation.z) *
-			//DirectX::XMMatrixRotationQuaternion(DirectX::XMQuaternionRotationRollPitchYawFromVector(DirectX::XMLoadFloat3(&rotation))) * 
-			DirectX::XMMatrixTranslationFromVector(DirectX::XMLoadFloat3(&position));
-		DirectX::XMStoreFloat4x4(&worldMatrix, DirectX::XMMatrixTranspose(calculatedWorldMatrix));
-	} else {
-		DirectX::XMMATRIX  calculatedWorldMatrix =
-			DirectX::XMMatrixScalingFromVector(DirectX::XMLoadFloat3(&scale)) *
-			DirectX::XMMatrixRotationX(rotation.x) * DirectX::XMMatrixRotationY(rotation.y) * DirectX::XMMatrixRotationZ(rotation.z) *
-			DirectX::XMMatrixTranslationFromVector(DirectX::XMLoadFloat3(&position));
-		DirectX::XMStoreFloat4x4(&worldMatrix, DirectX::XMMatrixTranspose(
-			DirectX::XMMatrixMultiply(DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&parrent->GetWorldMatrix())), calculatedWorldMatrix)));
+	if (store != nullptr) return store->GetWorldMatrix(storeIndex);
+	DirectX::XMMATRIX  calculatedWorldMatrix =
+		DirectX::XMMatrixScalingFromVector(DirectX::XMLoadFloat3(&scale)) * DirectX::XMMatrixRotationRollPitchYawFromVector(DirectX::XMLoadFloat3(&rotation)) *
+		DirectX::XMMatrixTranslationFromVector(DirectX::XMLoadFloat3(&position));
+	if (parrent != nullptr) {
+		calculatedWorldMatrix = DirectX::XMMatrixMultiply(calculatedWorldMatrix, DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&parrent->GetWorldMatrix())));
+		cachedParrentWorldVersion = parrent->worldVersion;
 	}
+	DirectX::XMStoreFloat4x4(&worldMatrix, DirectX::XMMatrixTranspose(calculatedWorldMatrix));
+	cachedVersion = version;
+	worldVersion++;
 	return worldMatrix;
 }
@@ -1,6 +1,8 @@
 #pragma once
 #include <DirectXMath.h>
 
+class TransformStore;
+
 class Transform
 {
 public:
@@ -14,20 +16,41 @@ public:
 	void MoveRelative(float addX, float addY, float addZ);
 	void SetRotation(DirectX::XMFLOAT3 newRot);
 	void SetScale(DirectX::XMFLOAT3 newScale);
-	void SetParrent(Transform* newParrent);
-	bool GetIsDirty();
+	void SetParrent(Transform* newParrent);//nullptr unparents it
+	//True when the cached world matrix is older than this transform or its parent's world matrix
+	bool GetIsDirty() const;
+	//Goes up every time the position, rotation or scale changes
+	unsigned int GetVersion() const { return version; }
+	//Goes up every time anything is parented to something new, so the update order can be rebuilt
+	static unsigned int GetHierarchyVersion() { return hierarchyVersion; }
 	DirectX::XMFLOAT3 GetPosition() { return position; }
 	DirectX::XMFLOAT3 GetRotation() { return rotation; }
 	DirectX::XMFLOAT3 GetScale() { return scale; }
 	DirectX::XMFLOAT3 GetForwardVector();
-	DirectX::XMFLOAT4X4 GetWorldMatrix() { return RecalculateWorldMatrix(); isDirty = false; }
+	const DirectX::XMFLOAT4X4& GetWorldMatrix();
 	Transform* GetParrent() { return parrent; }
 
+	//Entity transforms live in the entity system's store and get their world matrix from its update pass.
+	//Anything else (camera, lights) keeps its own. A bound transform can only be parented to one in the same store.
+	void BindToStore(TransformStore* newStore, int newStoreIndex);
+	bool IsBoundToStore() const { return store != nullptr; }
+
+	//Only recalculates if dirty. Expects the parent to be up to date already, which the entity system's update pass makes sure of
+	void UpdateWorldMatrix();
 	DirectX::XMFLOAT4X4 RecalculateWorldMatrix();
 private:
-	//we save the world matrix and only recalculate it when this is true, this is set to true when we change information about the transform
+	static unsigned int hierarchyVersion;
+
+	TransformStore* store;
+	int storeIndex;
+	void WriteToStore();
+
+	//we save the world matrix and only recalculate it when the versions it was built from are out of date
 	Transform* parrent;
-	bool isDirty;
+	unsigned int version;
+	unsigned int worldVersion;//Goes up every time the world matrix is recalculated, children compare against this
+	unsigned int cachedVersion;
+	unsigned int cachedParrentWorldVersion;
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 rotation;
 	DirectX::XMFLOAT3 scale;
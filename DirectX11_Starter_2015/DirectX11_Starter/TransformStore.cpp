@@ -0,0 +1,377 @@
+#include "TransformStore.h"
+#include <malloc.h>
+#include <cstring>
+#include <xmmintrin.h>
+
+static float* AllocateAlignedFloats(int count, float value)
+{
+	float* floats = (float*)_aligned_malloc(sizeof(float) * count, 16);
+	for (int i = 0; i < count; i++) {
+		floats[i] = value;
+	}
+	return floats;
+}
+
+static __m128 LerpLanes(const float* from, const float* to, __m128 t)
+{
+	__m128 a = _mm_load_ps(from);
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(_mm_load_ps(to), a)));
+}
+
+TransformStore::TransformStore(int newCapacity)
+{
+	capacity = ((newCapacity + BATCH_SIZE - 1) / BATCH_SIZE) * BATCH_SIZE;
+	positionX = AllocateAlignedFloats(capacity, 0.0f);
+	positionY = AllocateAlignedFloats(capacity, 0.0f);
+	positionZ = AllocateAlignedFloats(capacity, 0.0f);
+	rotationX = AllocateAlignedFloats(capacity, 0.0f);
+	rotationY = AllocateAlignedFloats(capacity, 0.0f);
+	rotationZ = AllocateAlignedFloats(capacity, 0.0f);
+	rotationW = AllocateAlignedFloats(capacity, 1.0f);
+	scaleX = AllocateAlignedFloats(capacity, 1.0f);
+	scaleY = AllocateAlignedFloats(capacity, 1.0f);
+	scaleZ = AllocateAlignedFloats(capacity, 1.0f);
+	parrents = new int[capacity];
+	dirty = new unsigned char[capacity];
+	worldMatrices = (DirectX::XMFLOAT4X4A*)_aligned_malloc(sizeof(DirectX::XMFLOAT4X4A) * capacity, 16);
+	previousPositionX = AllocateAlignedFloats(capacity, 0.0f);
+	previousPositionY = AllocateAlignedFloats(capacity, 0.0f);
+	previousPositionZ = AllocateAlignedFloats(capacity, 0.0f);
+	previousRotationX = AllocateAlignedFloats(capacity, 0.0f);
+	previousRotationY = AllocateAlignedFloats(capacity, 0.0f);
+	previousRotationZ = AllocateAlignedFloats(capacity, 0.0f);
+	previousRotationW = AllocateAlignedFloats(capacity, 1.0f);
+	previousScaleX = AllocateAlignedFloats(capacity, 1.0f);
+	previousScaleY = AllocateAlignedFloats(capacity, 1.0f);
+	previousScaleZ = AllocateAlignedFloats(capacity, 1.0f);
+	changedSteps = new unsigned int[capacity];
+	currentStep = 1;//0 is never a step, so it's what changedSteps starts at
+	renderedStep = 0;
+	teleported = new unsigned char[capacity];
+	teleportedSlots = new int[capacity];
+	numTeleportedSlots = 0;
+	renderMatrices = (DirectX::XMFLOAT4X4A*)_aligned_malloc(sizeof(DirectX::XMFLOAT4X4A) * capacity, 16);
+	moving = new unsigned char[capacity];
+	renderIsLocal = new unsigned char[capacity];
+	renderIsBlended = new unsigned char[capacity];
+	for (int i = 0; i < capacity; i++) {
+		parrents[i] = -1;
+		dirty[i] = 1;
+		DirectX::XMStoreFloat4x4A(&worldMatrices[i], DirectX::XMMatrixIdentity());
+		DirectX::XMStoreFloat4x4A(&renderMatrices[i], DirectX::XMMatrixIdentity());
+		changedSteps[i] = 0;
+		teleported[i] = 0;
+		moving[i] = 0;
+		renderIsLocal[i] = 0;
+		renderIsBlended[i] = 1;//Nothing has been copied over yet
+	}
+}
+
+TransformStore::~TransformStore()
+{
+	_aligned_free(positionX);
+	_aligned_free(positionY);
+	_aligned_free(positionZ);
+	_aligned_free(rotationX);
+	_aligned_free(rotationY);
+	_aligned_free(rotationZ);
+	_aligned_free(rotationW);
+	_aligned_free(scaleX);
+	_aligned_free(scaleY);
+	_aligned_free(scaleZ);
+	_aligned_free(worldMatrices);
+	_aligned_free(previousPositionX);
+	_aligned_free(previousPositionY);
+	_aligned_free(previousPositionZ);
+	_aligned_free(previousRotationX);
+	_aligned_free(previousRotationY);
+	_aligned_free(previousRotationZ);
+	_aligned_free(previousRotationW);
+	_aligned_free(previousScaleX);
+	_aligned_free(previousScaleY);
+	_aligned_free(previousScaleZ);
+	_aligned_free(renderMatrices);
+	delete[] parrents;
+	delete[] dirty;
+	delete[] changedSteps;
+	delete[] teleported;
+	delete[] teleportedSlots;
+	delete[] moving;
+	delete[] renderIsLocal;
+	delete[] renderIsBlended;
+}
+
+void TransformStore::Teleport(int index)
+{
+	changedSteps[index] = currentStep;
+	if (teleported[index]) return;
+	teleported[index] = 1;
+	teleportedSlots[numTeleportedSlots++] = index;
+}
+
+void TransformStore::EndStep()
+{
+	//Where a teleported slot ended up is also where it came from
+	for (int t = 0; t < numTeleportedSlots; t++) {
+		int index = teleportedSlots[t];
+		changedSteps[index] = 0;
+		SavePrevious(index);
+		teleported[index] = 0;
+	}
+	numTeleportedSlots = 0;
+	currentStep++;
+}
+
+//Before the first change in a step, so what's saved is where the slot was when the step started
+void TransformStore::SavePrevious(int index)
+{
+	if (changedSteps[index] == currentStep) return;
+	changedSteps[index] = currentStep;
+	previousPositionX[index] = positionX[index];
+	previousPositionY[index] = positionY[index];
+	previousPositionZ[index] = positionZ[index];
+	previousRotationX[index] = rotationX[index];
+	previousRotationY[index] = rotationY[index];
+	previousRotationZ[index] = rotationZ[index];
+	previousRotationW[index] = rotationW[index];
+	previousScaleX[index] = scaleX[index];
+	previousScaleY[index] = scaleY[index];
+	previousScaleZ[index] = scaleZ[index];
+}
+
+void TransformStore::SetPosition(int index, const DirectX::XMFLOAT3& position)
+{
+	SavePrevious(index);
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	dirty[index] = 1;
+}
+
+void TransformStore::SetRotation(int index, const DirectX::XMFLOAT4& quaternion)
+{
+	SavePrevious(index);
+	rotationX[index] = quaternion.x;
+	rotationY[index] = quaternion.y;
+	rotationZ[index] = quaternion.z;
+	rotationW[index] = quaternion.w;
+	dirty[index] = 1;
+}
+
+void TransformStore::SetScale(int index, const DirectX::XMFLOAT3& scale)
+{
+	SavePrevious(index);
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+	dirty[index] = 1;
+}
+
+void TransformStore::SetParrent(int index, int parrentIndex)
+{
+	SavePrevious(index);
+	parrents[index] = parrentIndex;
+	dirty[index] = 1;
+}
+
+void TransformStore::UpdateWorldMatrices(const int* order, int orderCount, int slotCount)
+{
+	PropagateDirty(order, orderCount);
+	ComposeLocalMatrices(0, GetNumBatches(slotCount));
+	ApplyParrents(order, 0, orderCount);
+	ClearDirty(slotCount);
+}
+
+//A child has to be rebuilt whenever its parent is, parents come first so one pass is enough
+void TransformStore::PropagateDirty(const int* order, int orderCount)
+{
+	for (int o = 0; o < orderCount; o++) {
+		int index = order[o];
+		if (parrents[index] >= 0) dirty[index] |= dirty[parrents[index]];
+	}
+}
+
+//Local matrices, which are already the world matrices for anything without a parent.
+//A batch is rebuilt whole when any of it is dirty
+void TransformStore::ComposeLocalMatrices(int firstBatch, int endBatch)
+{
+	for (int batch = firstBatch; batch < endBatch; batch++) {
+		int first = batch * BATCH_SIZE;
+		if (dirty[first] | dirty[first + 1] | dirty[first + 2] | dirty[first + 3]) {
+			ComposeBatch(first);
+			//The whole batch is local matrices now, children in it need their parents applied again
+			//even if they hadn't changed. Their own children come out the same, so they don't need it
+			dirty[first] = dirty[first + 1] = dirty[first + 2] = dirty[first + 3] = 1;
+		}
+	}
+}
+
+//Stored transposed, so child world = (local * parent)^T = parent^T * local^T
+void TransformStore::ApplyParrents(const int* order, int start, int end)
+{
+	for (int o = start; o < end; o++) {
+		int index = order[o];
+		if (parrents[index] < 0 || !dirty[index]) continue;
+		DirectX::XMMATRIX world = DirectX::XMMatrixMultiply(
+			DirectX::XMLoadFloat4x4A(&worldMatrices[parrents[index]]),
+			DirectX::XMLoadFloat4x4A(&worldMatrices[index]));
+		DirectX::XMStoreFloat4x4A(&worldMatrices[index], world);
+	}
+}
+
+void TransformStore::ClearDirty(int slotCount)
+{
+	memset(dirty, 0, slotCount);
+}
+
+//Same passes as UpdateWorldMatrices, over what moved in the last step. A batch with anything moving in it is rebuilt
+//into the render matrices, everything else has its world matrix, which only needs copying once it stops moving
+void TransformStore::UpdateRenderMatrices(const int* order, int orderCount, int slotCount, float interpolation)
+{
+	//Before the first step ends nothing has anywhere to be blended from
+	unsigned int lastStep = currentStep - 1;
+	for (int i = 0; i < slotCount; i++) {
+		moving[i] = lastStep > 0 && changedSteps[i] == lastStep ? 1 : 0;
+		//Frames can run more than one step. Anything that changed in an earlier one is at rest now but was never
+		//copied over, that includes teleports and reused slots
+		if (changedSteps[i] > renderedStep) renderIsBlended[i] = 1;
+	}
+	for (int o = 0; o < orderCount; o++) {
+		int index = order[o];
+		if (parrents[index] < 0) continue;
+		moving[index] |= moving[parrents[index]];
+		renderIsBlended[index] |= renderIsBlended[parrents[index]];
+	}
+	renderedStep = lastStep;
+
+	for (int batch = 0; batch < GetNumBatches(slotCount); batch++) {
+		int first = batch * BATCH_SIZE;
+		if (moving[first] | moving[first + 1] | moving[first + 2] | moving[first + 3]) {
+			ComposeInterpolatedBatch(first, interpolation);
+			for (int t = first; t < first + BATCH_SIZE; t++) {
+				renderIsLocal[t] = 1;
+				renderIsBlended[t] = 1;
+			}
+			continue;
+		}
+		for (int t = first; t < first + BATCH_SIZE; t++) {
+			renderIsLocal[t] = 0;
+			if (!renderIsBlended[t]) continue;
+			renderMatrices[t] = worldMatrices[t];
+			renderIsBlended[t] = 0;
+		}
+	}
+
+	for (int o = 0; o < orderCount; o++) {
+		int index = order[o];
+		if (parrents[index] < 0 || !renderIsLocal[index]) continue;
+		DirectX::XMMATRIX render = DirectX::XMMatrixMultiply(
+			DirectX::XMLoadFloat4x4A(&renderMatrices[parrents[index]]),
+			DirectX::XMLoadFloat4x4A(&renderMatrices[index]));
+		DirectX::XMStoreFloat4x4A(&renderMatrices[index], render);
+	}
+}
+
+//Builds scale * rotation * translation for BATCH_SIZE transforms at once, each lane is one transform.
+//Every lane comes out as a local matrix, so parented lanes have to be marked dirty to get their parent back
+void TransformStore::ComposeBatch(int first)
+{
+	ComposeMatrices(
+		_mm_load_ps(positionX + first), _mm_load_ps(positionY + first), _mm_load_ps(positionZ + first),
+		_mm_load_ps(rotationX + first), _mm_load_ps(rotationY + first), _mm_load_ps(rotationZ + first), _mm_load_ps(rotationW + first),
+		_mm_load_ps(scaleX + first), _mm_load_ps(scaleY + first), _mm_load_ps(scaleZ + first),
+		worldMatrices + first);
+}
+
+//Lanes that changed in the last step are blended from their previous values, the rest use where they are now
+//since their previous values could be from any step. Rotations are a normalized lerp the short way around
+void TransformStore::ComposeInterpolatedBatch(int first, float interpolation)
+{
+	unsigned int lastStep = currentStep - 1;
+	__m128 t = _mm_set_ps(
+		changedSteps[first + 3] == lastStep ? interpolation : 1.0f,
+		changedSteps[first + 2] == lastStep ? interpolation : 1.0f,
+		changedSteps[first + 1] == lastStep ? interpolation : 1.0f,
+		changedSteps[first] == lastStep ? interpolation : 1.0f);
+
+	__m128 px = LerpLanes(previousPositionX + first, positionX + first, t);
+	__m128 py = LerpLanes(previousPositionY + first, positionY + first, t);
+	__m128 pz = LerpLanes(previousPositionZ + first, positionZ + first, t);
+	__m128 sx = LerpLanes(previousScaleX + first, scaleX + first, t);
+	__m128 sy = LerpLanes(previousScaleY + first, scaleY + first, t);
+	__m128 sz = LerpLanes(previousScaleZ + first, scaleZ + first, t);
+
+	__m128 ax = _mm_load_ps(previousRotationX + first);
+	__m128 ay = _mm_load_ps(previousRotationY + first);
+	__m128 az = _mm_load_ps(previousRotationZ + first);
+	__m128 aw = _mm_load_ps(previousRotationW + first);
+	__m128 bx = _mm_load_ps(rotationX + first);
+	__m128 by = _mm_load_ps(rotationY + first);
+	__m128 bz = _mm_load_ps(rotationZ + first);
+	__m128 bw = _mm_load_ps(rotationW + first);
+	//q and -q are the same rotation, flipping the previous one when they point apart takes the shorter way
+	__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+	__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+	ax = _mm_xor_ps(ax, flip);
+	ay = _mm_xor_ps(ay, flip);
+	az = _mm_xor_ps(az, flip);
+	aw = _mm_xor_ps(aw, flip);
+	__m128 qx = _mm_add_ps(ax, _mm_mul_ps(t, _mm_sub_ps(bx, ax)));
+	__m128 qy = _mm_add_ps(ay, _mm_mul_ps(t, _mm_sub_ps(by, ay)));
+	__m128 qz = _mm_add_ps(az, _mm_mul_ps(t, _mm_sub_ps(bz, az)));
+	__m128 qw = _mm_add_ps(aw, _mm_mul_ps(t, _mm_sub_ps(bw, aw)));
+	__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw))));
+	qx = _mm_div_ps(qx, length);
+	qy = _mm_div_ps(qy, length);
+	qz = _mm_div_ps(qz, length);
+	qw = _mm_div_ps(qw, length);
+
+	ComposeMatrices(px, py, pz, qx, qy, qz, qw, sx, sy, sz, renderMatrices + first);
+}
+
+void TransformStore::ComposeMatrices(__m128 px, __m128 py, __m128 pz, __m128 qx, __m128 qy, __m128 qz, __m128 qw,
+	__m128 sx, __m128 sy, __m128 sz, DirectX::XMFLOAT4X4A* matrices)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	__m128 xx = _mm_mul_ps(qx, qx);
+	__m128 yy = _mm_mul_ps(qy, qy);
+	__m128 zz = _mm_mul_ps(qz, qz);
+	__m128 xy = _mm_mul_ps(qx, qy);
+	__m128 xz = _mm_mul_ps(qx, qz);
+	__m128 yz = _mm_mul_ps(qy, qz);
+	__m128 xw = _mm_mul_ps(qx, qw);
+	__m128 yw = _mm_mul_ps(qy, qw);
+	__m128 zw = _mm_mul_ps(qz, qw);
+
+	//Rotation matrix from the quaternion, same layout as XMMatrixRotationQuaternion
+	__m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+	__m128 r01 = _mm_mul_ps(two, _mm_add_ps(xy, zw));
+	__m128 r02 = _mm_mul_ps(two, _mm_sub_ps(xz, yw));
+	__m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, zw));
+	__m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+	__m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, xw));
+	__m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, yw));
+	__m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, xw));
+	__m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+	//Row k of the transposed matrix is (sx * r0k, sy * r1k, sz * r2k, tk)
+	__m128 rows[3][4] = {
+		{ _mm_mul_ps(sx, r00), _mm_mul_ps(sy, r10), _mm_mul_ps(sz, r20), px },
+		{ _mm_mul_ps(sx, r01), _mm_mul_ps(sy, r11), _mm_mul_ps(sz, r21), py },
+		{ _mm_mul_ps(sx, r02), _mm_mul_ps(sy, r12), _mm_mul_ps(sz, r22), pz },
+	};
+	const __m128 lastRow = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+	for (int k = 0; k < 3; k++) {
+		//Turns the four lanes of each element into one row per transform
+		_MM_TRANSPOSE4_PS(rows[k][0], rows[k][1], rows[k][2], rows[k][3]);
+		for (int t = 0; t < BATCH_SIZE; t++) {
+			_mm_store_ps(&matrices[t].m[k][0], rows[k][t]);
+		}
+	}
+	for (int t = 0; t < BATCH_SIZE; t++) {
+		_mm_store_ps(&matrices[t].m[3][0], lastRow);
+	}
+}
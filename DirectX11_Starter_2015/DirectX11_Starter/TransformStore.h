@@ -0,0 +1,93 @@
+#pragma once
+#include <DirectXMath.h>
+#include <xmmintrin.h>
+
+//Keeps the transforms of every entity in separate, aligned arrays (structure of arrays)
+//so the world matrices can be built four at a time with SSE.
+//World matrices are stored transposed, ready for HLSL, like everywhere else.
+//The simulation steps at a fixed rate while frames can come faster or slower, so the store also keeps where
+//everything was before the last step and builds render matrices somewhere between the two for each frame.
+class TransformStore
+{
+public:
+	const static int BATCH_SIZE = 4;//Number of transforms the kernel builds at once, one per SSE lane
+
+	TransformStore(int newCapacity);
+	~TransformStore();
+
+	void SetPosition(int index, const DirectX::XMFLOAT3& position);
+	void SetRotation(int index, const DirectX::XMFLOAT4& quaternion);
+	void SetScale(int index, const DirectX::XMFLOAT3& scale);
+	void SetParrent(int index, int parrentIndex);//-1 for no parent
+
+	//Rebuilds the world matrix of everything in order that changed, or whose parent did.
+	//order has to list every parent before its children, and only slots below slotCount.
+	void UpdateWorldMatrices(const int* order, int orderCount, int slotCount);
+
+	//The steps of UpdateWorldMatrices, split up so they can be spread over threads.
+	//Batches of local matrices don't depend on each other, and neither do parents on the same depth.
+	void PropagateDirty(const int* order, int orderCount);
+	void ComposeLocalMatrices(int firstBatch, int endBatch);
+	void ApplyParrents(const int* order, int start, int end);
+	void ClearDirty(int slotCount);
+	static int GetNumBatches(int slotCount) { return (slotCount + BATCH_SIZE - 1) / BATCH_SIZE; }
+
+	//After every simulation step. Anything set after this is part of the next step,
+	//the first change to a slot in a step saves what it was before
+	void EndStep();
+	//Nothing set on the slot for the rest of this step is blended, for slots that were just reused or jumped somewhere
+	void Teleport(int index);
+	//Builds render matrices part of the way from where things were before the last step to where they are now,
+	//0 is before and 1 is now. Only what changed in the last step is blended, the rest are the world matrices.
+	//World matrices have to be up to date, order is the same as UpdateWorldMatrices'
+	void UpdateRenderMatrices(const int* order, int orderCount, int slotCount, float interpolation);
+
+	const DirectX::XMFLOAT4X4& GetWorldMatrix(int index) const { return worldMatrices[index]; }
+	const DirectX::XMFLOAT4X4& GetRenderMatrix(int index) const { return renderMatrices[index]; }
+	bool GetIsDirty(int index) const { return dirty[index] != 0; }
+	int GetCapacity() const { return capacity; }
+private:
+	int capacity;//Always a multiple of BATCH_SIZE so the kernel never needs a remainder loop
+
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+	float* rotationX;
+	float* rotationY;
+	float* rotationZ;
+	float* rotationW;
+	float* scaleX;
+	float* scaleY;
+	float* scaleZ;
+	int* parrents;
+	unsigned char* dirty;
+	DirectX::XMFLOAT4X4A* worldMatrices;
+
+	//Position, rotation and scale from before the step each slot last changed in
+	float* previousPositionX;
+	float* previousPositionY;
+	float* previousPositionZ;
+	float* previousRotationX;
+	float* previousRotationY;
+	float* previousRotationZ;
+	float* previousRotationW;
+	float* previousScaleX;
+	float* previousScaleY;
+	float* previousScaleZ;
+	unsigned int* changedSteps;//The step each slot last changed in
+	unsigned int currentStep;
+	unsigned int renderedStep;//The last step UpdateRenderMatrices saw, anything changed after it has to be caught up
+	unsigned char* teleported;
+	int* teleportedSlots;//Every slot Teleport was called on this step
+	int numTeleportedSlots;
+	DirectX::XMFLOAT4X4A* renderMatrices;
+	unsigned char* moving;//Changed in the last step, or its parent did. Only for UpdateRenderMatrices
+	unsigned char* renderIsLocal;//Render matrix still needs its parent's applied
+	unsigned char* renderIsBlended;//Render matrix isn't the world matrix, so it has to be put back once it stops moving
+	void SavePrevious(int index);
+
+	void ComposeBatch(int first);
+	void ComposeInterpolatedBatch(int first, float interpolation);
+	static void ComposeMatrices(__m128 px, __m128 py, __m128 pz, __m128 qx, __m128 qy, __m128 qz, __m128 qw,
+		__m128 sx, __m128 sy, __m128 sz, DirectX::XMFLOAT4X4A* matrices);
+};
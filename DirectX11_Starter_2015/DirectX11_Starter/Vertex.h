@@ -11,4 +11,21 @@ struct Vertex
 	DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT2 UV;
 	DirectX::XMFLOAT3 Tangent;
-};
\ No newline at end of file
+};
+
+const int VERTEX_FORMAT_FULL = 0;//Vertex
+const int VERTEX_FORMAT_COMPACT = 1;//CompactVertex
+
+// --------------------------------------------------------
+// The same vertex squeezed into 20 bytes, decoded in CompactVertexShader.hlsl
+// - Position is 16 bit unorm across the mesh's bounding box, w is padding
+// - Normal and tangent are octahedral encoded into two 16 bit snorms
+// - UV is two halfs
+// --------------------------------------------------------
+struct CompactVertex
+{
+	unsigned short Position[4];
+	short Normal[2];
+	short Tangent[2];
+	unsigned short UV[2];
+};